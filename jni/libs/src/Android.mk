@@ -56,9 +56,14 @@ LOCAL_SRC_FILES := \
   $(subst $(LOCAL_PATH)/,,$(DEPENDENCIES_SDL_DIR))/src/main/android/SDL_android_main.c \
   $(PIE_NOON_RELATIVE_DIR)/src/ai_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/analytics_tracking.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/asset_pack.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/builder_pool.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/cardboard_controller.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/cardboard_quads.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/character.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/character_state_machine.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/component_scheduler.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/config_cache.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/components/cardboard_player.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/components/drip_and_vanish.cpp \
@@ -72,15 +77,30 @@ LOCAL_SRC_FILES := \
   $(PIE_NOON_RELATIVE_DIR)/src/gpg_manager.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gpg_multiplayer.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gui_menu.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/job_system.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/ktx_texture.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/lockstep.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/mapped_file.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/menu_asset_cache.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/main.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/message_ring.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/multiplayer_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/multiplayer_director.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/multiplayer_telemetry.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/nearby_transport.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/player_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/particles.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/precompiled.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/pie_noon_game.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/shader_cache.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/spatial_grid.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/startup_tracer.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/status_predictor.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/status_replicator.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/texture_load_plan.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_button.cpp \
-  $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_controller.cpp
+  $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_controller.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/upload_scheduler.cpp
 
 PIE_NOON_SCHEMA_DIR := $(PIE_NOON_DIR)/src/flatbufferschemas
 
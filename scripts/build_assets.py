@@ -23,13 +23,22 @@ rules. If you just want to build the flatbuffer binaries you can pass
 'flatbuffer' as an argument, or if you want to just build the webp files you can
 pass 'cwebp' as an argument. Additionally, if you would like to clean all
 generated files, you can call this script with the argument 'clean'.
+
+The assets are built into obj/assets/built/, then packed into
+assets/assets.piepack, and each overlay's into its own pack, so the game can
+load them all from one file. Only the sound data that pindrop opens by name is
+copied to assets/ as separate files.
 """
 
 
 import distutils.dir_util
+import distutils.spawn
 import glob
 import json
 import os
+import shutil
+import struct
+import subprocess
 import sys
 # The project root directory, which is two levels up from this script's
 # directory.
@@ -70,6 +79,9 @@ INTERMEDIATE_ASSETS_PATH = os.path.join(PROJECT_ROOT, 'obj', 'assets')
 # Directory where png files are written to before they are converted to webp.
 INTERMEDIATE_TEXTURE_PATH = os.path.join(INTERMEDIATE_ASSETS_PATH, 'textures')
 
+# Directory the built assets are written to before they're packed.
+BUILT_ASSETS_PATH = os.path.join(INTERMEDIATE_ASSETS_PATH, 'built')
+
 # Potential root directories for source assets.
 ASSET_ROOTS = [RAW_ASSETS_PATH, INTERMEDIATE_TEXTURE_PATH]
 
@@ -115,6 +127,20 @@ FLATBUFFERS_CONVERSION_DATA = [
 ]
 
 
+# GPU-compressed textures to write next to the webp files. Each format has its
+# own directory, as named by CompressedTextureDirectory() in ktx_texture.cpp,
+# holding a KTX file for each texture. Each entry is the directory, the tool
+# that writes the format, and a function returning the tool's arguments for a
+# source and target file. Formats whose tool isn't installed are skipped, and
+# the game uses the webp files instead.
+COMPRESSED_TEXTURE_FORMATS = [
+    ('etc2', 'EtcTool',
+     lambda source, target: [source, '-format', 'RGBA8', '-output', target]),
+    ('astc', 'astcenc',
+     lambda source, target: ['-cl', source, target, '6x6', '-medium'])
+]
+
+
 def fbx_files_to_convert():
   """FBX files to convert to fplmesh."""
   return glob.glob(os.path.join(RAW_MESH_PATH, '*.fbx'))
@@ -148,27 +174,189 @@ def anim_files_to_convert():
   return glob.glob(os.path.join(RAW_ANIM_PATH, '*.fbx'))
 
 
+# Name of the pack files, and the format of their header and index entries.
+# Must match src/asset_pack.h.
+ASSET_PACK_NAME = 'assets.piepack'
+ASSET_PACK_MAGIC = 'PIEP'
+ASSET_PACK_VERSION = 1
+ASSET_PACK_ALIGNMENT = 16
+ASSET_PACK_HEADER = struct.Struct('<4sIII')
+ASSET_PACK_ENTRY = struct.Struct('<QQQII')
+
+# Built assets that pindrop opens by name, rather than through the game's
+# loader, so they're copied to assets/ instead of packed.
+UNPACKED_ASSET_EXTENSIONS = ['.pinbank', '.pinbus', '.pinsound']
+
+
+def texture_sources():
+  """Source textures, each with the assets directory its webp is written to."""
+  sources = [(f, BUILT_ASSETS_PATH) for f in png_files_to_convert()]
+  for overlay in OVERLAY_DIRS:
+    sources += [(f, os.path.join(BUILT_ASSETS_PATH, overlay))
+                for f in glob.glob(os.path.join(RAW_ASSETS_PATH, overlay,
+                                                'textures', '*.png'))]
+  return sources
+
+
+def compress_textures(clean):
+  """Writes, or with clean removes, the GPU-compressed copy of each texture.
+
+  Args:
+    clean: Remove the compressed textures rather than writing them.
+
+  Returns:
+    Returns 0 on success.
+  """
+  for directory, tool, arguments in COMPRESSED_TEXTURE_FORMATS:
+    tool_path = None if clean else distutils.spawn.find_executable(tool)
+    if not clean and not tool_path:
+      print('%s not found, so %s textures will not be built' %
+            (tool, directory))
+      continue
+    for source, assets in texture_sources():
+      name = os.path.splitext(os.path.basename(source))[0] + '.ktx'
+      target = os.path.join(assets, directory, 'textures', name)
+      if clean:
+        if os.path.exists(target):
+          os.remove(target)
+        continue
+      if (os.path.exists(target) and
+          os.path.getmtime(target) >= os.path.getmtime(source)):
+        continue
+      if not os.path.isdir(os.path.dirname(target)):
+        os.makedirs(os.path.dirname(target))
+      if subprocess.call([tool_path] + arguments(source, target)) != 0:
+        print('%s failed to convert %s' % (tool, source))
+        return 1
+  return 0
+
+
+def asset_pack_hash(name):
+  """64-bit FNV-1a hash of name, as AssetPack::HashName() computes it."""
+  value = 14695981039346656037
+  for byte in bytearray(name):
+    value = ((value ^ byte) * 1099511628211) & 0xffffffffffffffff
+  return value
+
+
+def align(offset):
+  """Rounds offset up to the pack's alignment."""
+  return (offset + ASSET_PACK_ALIGNMENT - 1) & ~(ASSET_PACK_ALIGNMENT - 1)
+
+
+def is_unpacked_asset(name):
+  """Whether name is copied to assets/ rather than packed."""
+  return os.path.splitext(name)[1] in UNPACKED_ASSET_EXTENSIONS
+
+
+def write_asset_pack(source, exclude_dirs, destination):
+  """Packs all built files under source into one pack file in destination.
+
+  Files that can't be loaded from a pack are copied to destination instead.
+
+  Args:
+    source: Directory to pack. Names in the pack are relative to it.
+    exclude_dirs: Subdirectories of source to leave out.
+    destination: Directory to write the pack to.
+  """
+  names = []
+  for root, dirs, files in os.walk(source):
+    dirs[:] = [d for d in dirs
+               if os.path.relpath(os.path.join(root, d), source)
+               not in exclude_dirs]
+    for f in files:
+      path = os.path.relpath(os.path.join(root, f), source)
+      if is_unpacked_asset(f):
+        target = os.path.join(destination, path)
+        if not os.path.isdir(os.path.dirname(target)):
+          os.makedirs(os.path.dirname(target))
+        shutil.copy2(os.path.join(root, f), target)
+        continue
+      names.append(path.replace(os.sep, '/').encode('utf-8'))
+  names.sort(key=lambda name: (asset_pack_hash(name), name))
+
+  name_offset = ASSET_PACK_HEADER.size + ASSET_PACK_ENTRY.size * len(names)
+  data_offset = align(name_offset + sum(len(name) for name in names))
+  index = []
+  contents = []
+  for name in names:
+    with open(os.path.join(source, name.decode('utf-8')), 'rb') as f:
+      data = f.read()
+    index.append(ASSET_PACK_ENTRY.pack(asset_pack_hash(name), data_offset,
+                                       len(data), name_offset, len(name)))
+    contents.append((data_offset, data))
+    name_offset += len(name)
+    data_offset = align(data_offset + len(data))
+
+  if not os.path.isdir(destination):
+    os.makedirs(destination)
+  with open(os.path.join(destination, ASSET_PACK_NAME), 'wb') as pack:
+    pack.write(ASSET_PACK_HEADER.pack(ASSET_PACK_MAGIC.encode('ascii'),
+                                      ASSET_PACK_VERSION, len(names), 0))
+    pack.write(b''.join(index))
+    pack.write(b''.join(names))
+    for offset, data in contents:
+      pack.write(b'\0' * (offset - pack.tell()))
+      pack.write(data)
+
+
+def clean_asset_pack(destination):
+  """Removes the pack, and the files copied beside it, from destination."""
+  pack = os.path.join(destination, ASSET_PACK_NAME)
+  if os.path.exists(pack):
+    os.remove(pack)
+  for root, _, files in os.walk(destination):
+    for f in files:
+      if is_unpacked_asset(f):
+        os.remove(os.path.join(root, f))
+
+
+def asset_pack_dirs():
+  """Directories to pack, relative to the assets, each with the subdirectories
+  to leave out."""
+  return [('', ['overlays'])] + [(d, []) for d in OVERLAY_DIRS]
+
+
 def main():
   """Builds or cleans the assets needed for the game.
 
   To build all assets, either call this script without any arguments. Or
   alternatively, call it with the argument 'all'. To just convert the
   flatbuffer json files, call it with 'flatbuffers'. Likewise to convert the
-  png files to webp files, call it with 'webp'. To clean all converted files,
+  png files to webp files, call it with 'webp'; this also writes GPU-compressed
+  KTX copies of the textures, with each tool in COMPRESSED_TEXTURE_FORMATS that
+  is installed. To clean all converted files,
   call it with 'clean'.
 
   Returns:
     Returns 0 on success.
   """
-  return builder.main(
+  result = builder.main(
       project_root=PROJECT_ROOT,
-      assets_path=ASSETS_PATH,
+      assets_path=BUILT_ASSETS_PATH,
       asset_roots=ASSET_ROOTS,
       intermediate_path=INTERMEDIATE_TEXTURE_PATH,
       overlay_dirs=OVERLAY_DIRS,
       tga_files_to_convert=tga_files_to_convert,
       png_files_to_convert=png_files_to_convert,
       flatbuffers_conversion_data=lambda: FLATBUFFERS_CONVERSION_DATA)
+  if result != 0:
+    return result
+
+  # Compressed textures go in the packs, so write them first.
+  if 'flatbuffers' not in sys.argv[1:]:
+    result = compress_textures('clean' in sys.argv[1:])
+    if result != 0:
+      return result
+
+  for directory, exclude_dirs in asset_pack_dirs():
+    source = os.path.join(BUILT_ASSETS_PATH, directory)
+    destination = os.path.join(ASSETS_PATH, directory)
+    if 'clean' in sys.argv[1:]:
+      clean_asset_pack(destination)
+    elif os.path.isdir(source):
+      write_asset_pack(source, exclude_dirs, destination)
+  return 0
 
 
 if __name__ == '__main__':
@@ -0,0 +1,131 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <algorithm>
+#include <cstring>
+#include "asset_pack.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static_assert(sizeof(AssetPackHeader) == 16, "Must match build_assets.py");
+static_assert(sizeof(AssetPackEntry) == 32, "Must match build_assets.py");
+
+AssetPack::AssetPack() : entries_(nullptr), num_entries_(0) {}
+
+uint64_t AssetPack::HashName(const char* name, size_t length) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<uint8_t>(name[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool AssetPack::Open(const char* filename) {
+  Close();
+  if (!file_.Open(filename)) return false;
+
+  const uint8_t* data = file_.data();
+  const uint64_t file_size = file_.size();
+  AssetPackHeader header;
+  if (file_size < sizeof(header)) {
+    fplbase::LogError(fplbase::kApplication, "%s is too short\n", filename);
+    file_.Close();
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, kAssetPackMagic, sizeof(header.magic)) != 0 ||
+      header.version != kAssetPackVersion) {
+    fplbase::LogError(fplbase::kApplication,
+                      "%s isn't an asset pack this build can read\n",
+                      filename);
+    file_.Close();
+    return false;
+  }
+
+  // Check the whole index once, so that Find() can trust it.
+  const uint64_t index_end =
+      sizeof(header) +
+      static_cast<uint64_t>(header.num_entries) * sizeof(AssetPackEntry);
+  bool valid = index_end <= file_size;
+  const AssetPackEntry* entries =
+      reinterpret_cast<const AssetPackEntry*>(data + sizeof(header));
+  for (uint32_t i = 0; valid && i < header.num_entries; ++i) {
+    const AssetPackEntry& entry = entries[i];
+    valid = entry.offset <= file_size &&
+            entry.size <= file_size - entry.offset &&
+            entry.name_offset <= file_size &&
+            entry.name_length <= file_size - entry.name_offset &&
+            (i == 0 || entries[i - 1].hash <= entry.hash);
+  }
+  if (!valid) {
+    fplbase::LogError(fplbase::kApplication, "%s is corrupt\n", filename);
+    file_.Close();
+    return false;
+  }
+
+  entries_ = entries;
+  num_entries_ = header.num_entries;
+  return true;
+}
+
+void AssetPack::Close() {
+  file_.Close();
+  entries_ = nullptr;
+  num_entries_ = 0;
+}
+
+bool AssetPack::Find(const char* name, const uint8_t** data,
+                     size_t* size) const {
+  if (!is_open()) return false;
+
+  // Names are relative to the pack's directory.
+  while (name[0] == '.' && name[1] == '/') name += 2;
+  const size_t length = strlen(name);
+  const uint64_t hash = HashName(name, length);
+
+  const AssetPackEntry* end = entries_ + num_entries_;
+  const AssetPackEntry* it = std::lower_bound(
+      entries_, end, hash, [](const AssetPackEntry& entry, uint64_t hash) {
+        return entry.hash < hash;
+      });
+  for (; it != end && it->hash == hash; ++it) {
+    if (it->name_length == length &&
+        memcmp(file_.data() + it->name_offset, name, length) == 0) {
+      *data = file_.data() + it->offset;
+      *size = static_cast<size_t>(it->size);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AssetPack::HasDirectory(const char* directory) const {
+  const size_t length = strlen(directory);
+  for (uint32_t i = 0; i < num_entries_; ++i) {
+    const AssetPackEntry& entry = entries_[i];
+    const char* name =
+        reinterpret_cast<const char*>(file_.data() + entry.name_offset);
+    if (entry.name_length > length && name[length] == '/' &&
+        memcmp(name, directory, length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,93 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_ASSET_PACK_H_
+#define PIE_NOON_ASSET_PACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "common.h"
+#include "mapped_file.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Many assets in one file, written by scripts/build_assets.py, so that
+// loading them costs one open and one mapping rather than one of each per
+// asset. The layout, all little-endian, is:
+//
+//   AssetPackHeader
+//   AssetPackEntry[num_entries], sorted by hash, then by name
+//   the entries' names, not null-terminated
+//   the entries' data, each aligned to kAssetPackAlignment
+//
+// Names are paths relative to the directory the pack was built from, with
+// '/' separators. Hashes are 64-bit FNV-1a hashes of the names.
+struct AssetPackHeader {
+  char magic[4];  // kAssetPackMagic
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t reserved;
+};
+
+struct AssetPackEntry {
+  uint64_t hash;
+  // Offsets are from the start of the file.
+  uint64_t offset;
+  uint64_t size;
+  uint32_t name_offset;
+  uint32_t name_length;
+};
+
+static const char kAssetPackMagic[4] = {'P', 'I', 'E', 'P'};
+static const uint32_t kAssetPackVersion = 1;
+static const size_t kAssetPackAlignment = 16;
+// What build_assets.py calls the packs it writes.
+static const char kAssetPackFileName[] = "assets.piepack";
+
+class AssetPack {
+ public:
+  AssetPack();
+
+  // Map the pack in 'filename', and check that its index makes sense.
+  // Returns false, leaving the pack closed, if it can't be read or is
+  // corrupt.
+  bool Open(const char* filename);
+  void Close();
+  bool is_open() const { return entries_ != nullptr; }
+
+  // Find the asset called 'name'. The data stays valid while the pack is
+  // open. Returns false if the pack doesn't hold it.
+  bool Find(const char* name, const uint8_t** data, size_t* size) const;
+
+  // True if the pack holds anything under 'directory'. Looks at every name,
+  // so it's for checking what a pack was built with, not for every load.
+  bool HasDirectory(const char* directory) const;
+
+  uint32_t num_entries() const { return num_entries_; }
+
+  static uint64_t HashName(const char* name, size_t length);
+
+ private:
+  MappedFile file_;
+  const AssetPackEntry* entries_;
+  uint32_t num_entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(AssetPack);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_ASSET_PACK_H_
@@ -0,0 +1,48 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "builder_pool.h"
+
+namespace fpl {
+namespace pie_noon {
+
+FlatBufferBuilderPool::FlatBufferBuilderPool(size_t initial_size)
+    : initial_size_(initial_size) {}
+
+flatbuffers::FlatBufferBuilder* FlatBufferBuilderPool::Acquire() {
+  if (free_.empty()) {
+    free_.push_back(std::unique_ptr<flatbuffers::FlatBufferBuilder>(
+        new flatbuffers::FlatBufferBuilder(initial_size_)));
+  }
+  in_use_.push_back(std::move(free_.back()));
+  free_.pop_back();
+  return in_use_.back().get();
+}
+
+void FlatBufferBuilderPool::Release(flatbuffers::FlatBufferBuilder* builder) {
+  for (auto it = in_use_.begin(); it != in_use_.end(); ++it) {
+    if (it->get() == builder) {
+      // Clear() empties the builder but keeps its buffer.
+      builder->Clear();
+      free_.push_back(std::move(*it));
+      in_use_.erase(it);
+      return;
+    }
+  }
+  assert(false);
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,71 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_BUILDER_POOL_H_
+#define PIE_NOON_BUILDER_POOL_H_
+
+#include <memory>
+#include <vector>
+#include "common.h"
+#include "flatbuffers/flatbuffers.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// FlatBufferBuilders that keep their memory from one message to the next, so
+// that building a message only allocates until the builders have grown to
+// fit the largest one. Not thread safe.
+class FlatBufferBuilderPool {
+ public:
+  // Multiplayer messages are small, so start each builder off small too.
+  static const size_t kDefaultInitialSize = 256;
+
+  explicit FlatBufferBuilderPool(size_t initial_size = kDefaultInitialSize);
+
+  // Returns an empty builder, making a new one if they're all in use.
+  flatbuffers::FlatBufferBuilder* Acquire();
+
+  // Give back a builder from Acquire(), once its buffer has been sent.
+  void Release(flatbuffers::FlatBufferBuilder* builder);
+
+ private:
+  size_t initial_size_;
+  std::vector<std::unique_ptr<flatbuffers::FlatBufferBuilder>> free_;
+  // Builders handed out by Acquire().
+  std::vector<std::unique_ptr<flatbuffers::FlatBufferBuilder>> in_use_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlatBufferBuilderPool);
+};
+
+// Holds a builder from a pool for the length of a scope.
+class PooledBuilder {
+ public:
+  explicit PooledBuilder(FlatBufferBuilderPool* pool)
+      : pool_(pool), builder_(pool->Acquire()) {}
+  ~PooledBuilder() { pool_->Release(builder_); }
+
+  flatbuffers::FlatBufferBuilder& operator*() const { return *builder_; }
+  flatbuffers::FlatBufferBuilder* operator->() const { return builder_; }
+
+ private:
+  FlatBufferBuilderPool* pool_;
+  flatbuffers::FlatBufferBuilder* builder_;
+
+  DISALLOW_COPY_AND_ASSIGN(PooledBuilder);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_BUILDER_POOL_H_
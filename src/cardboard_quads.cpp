@@ -0,0 +1,202 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include "cardboard_quads.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/material.h"
+#include "fplbase/mesh.h"
+#include "fplbase/renderer.h"
+
+using mathfu::vec2;
+using mathfu::vec3;
+
+namespace fpl {
+namespace pie_noon {
+
+static const int kQuadNumVertices = 4;
+static const int kQuadNumIndices = 6;
+static const unsigned short kQuadIndices[] = {0, 1, 2, 2, 1, 3};
+
+static_assert(sizeof(CardboardVertex) == 24, "Vertex format is packed");
+
+// The full-precision vertex that fplbase computes normals and tangents for.
+struct NormalMappedVertex {
+  mathfu::vec3_packed pos;
+  mathfu::vec2_packed tc;
+  mathfu::vec3_packed norm;
+  mathfu::vec4_packed tangent;
+};
+
+// Initializes 'vertices' at the specified position, aligned up-and-down.
+// 'vertices' must be an array of length kQuadNumVertices.
+static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
+                               const vec2& texture_coord_size,
+                               NormalMappedVertex* vertices) {
+  const float half_width = geo_size[0] * 0.5f;
+  const vec3 bottom_left = offset + vec3(-half_width, 0.0f, 0.0f);
+  const vec3 top_right = offset + vec3(half_width, geo_size[1], 0.0f);
+
+  vertices[0].pos = bottom_left;
+  vertices[1].pos = vec3(top_right[0], bottom_left[1], offset[2]);
+  vertices[2].pos = vec3(bottom_left[0], top_right[1], offset[2]);
+  vertices[3].pos = top_right;
+
+  const float coord_half_width = texture_coord_size[0] * 0.5f;
+  const vec2 coord_bottom_left(0.5f - coord_half_width, 1.0f);
+  const vec2 coord_top_right(0.5f + coord_half_width,
+                             1.0f - texture_coord_size[1]);
+
+  vertices[0].tc = coord_bottom_left;
+  vertices[1].tc = vec2(coord_top_right[0], coord_bottom_left[1]);
+  vertices[2].tc = vec2(coord_bottom_left[0], coord_top_right[1]);
+  vertices[3].tc = coord_top_right;
+
+  fplbase::Mesh::ComputeNormalsTangents(vertices, &kQuadIndices[0],
+      kQuadNumVertices, kQuadNumIndices);
+}
+
+static uint16_t PackUnitFloat(float f) {
+  return static_cast<uint16_t>(
+      std::floor(mathfu::Clamp(f, 0.0f, 1.0f) * 65535.0f + 0.5f));
+}
+
+static int8_t PackSignedUnitFloat(float f) {
+  return static_cast<int8_t>(
+      std::floor(mathfu::Clamp(f, -1.0f, 1.0f) * 127.0f + 0.5f));
+}
+
+const CardboardQuads::QuadId CardboardQuads::kInvalidQuad;
+
+CardboardQuads::CardboardQuads() : vbo_(0), ibo_(0) {}
+
+CardboardQuads::~CardboardQuads() {
+  if (vbo_ != 0) GL_CALL(glDeleteBuffers(1, &vbo_));
+  if (ibo_ != 0) GL_CALL(glDeleteBuffers(1, &ibo_));
+}
+
+CardboardQuads::QuadId CardboardQuads::Add(const vec3& offset,
+                                           const vec2& size,
+                                           const vec2& texture_coord_size,
+                                           fplbase::Material* material) {
+  assert(vbo_ == 0);
+  NormalMappedVertex quad[kQuadNumVertices];
+  CreateVerticalQuad(offset, size, texture_coord_size, quad);
+
+  for (int i = 0; i < kQuadNumVertices; ++i) {
+    const vec2 tc(quad[i].tc);
+    const vec3 norm(quad[i].norm);
+    const mathfu::vec4 tangent(quad[i].tangent);
+    CardboardVertex vertex;
+    vertex.pos = quad[i].pos;
+    vertex.tc[0] = PackUnitFloat(tc.x());
+    vertex.tc[1] = PackUnitFloat(tc.y());
+    for (int j = 0; j < 3; ++j) vertex.norm[j] = PackSignedUnitFloat(norm[j]);
+    vertex.norm[3] = 0;
+    for (int j = 0; j < 4; ++j) {
+      vertex.tangent[j] = PackSignedUnitFloat(tangent[j]);
+    }
+    vertices_.push_back(vertex);
+  }
+  materials_.push_back(material);
+  return num_quads() - 1;
+}
+
+bool CardboardQuads::Upload() {
+  assert(vbo_ == 0);
+  if (vertices_.empty()) return false;
+  if (vertices_.size() > std::numeric_limits<unsigned short>::max() + 1u) {
+    fplbase::LogError(fplbase::kApplication,
+                      "%d cardboard quads are too many to index\n",
+                      num_quads());
+    return false;
+  }
+
+  // Every quad has its own six indices, since GLES 2 can't offset them.
+  std::vector<unsigned short> indices;
+  indices.reserve(materials_.size() * kQuadNumIndices);
+  for (int quad = 0; quad < num_quads(); ++quad) {
+    const int base = quad * kQuadNumVertices;
+    for (int i = 0; i < kQuadNumIndices; ++i) {
+      indices.push_back(static_cast<unsigned short>(base + kQuadIndices[i]));
+    }
+  }
+
+  GL_CALL(glGenBuffers(1, &vbo_));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                       vertices_.size() * sizeof(CardboardVertex),
+                       &vertices_[0], GL_STATIC_DRAW));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+  GL_CALL(glGenBuffers(1, &ibo_));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_));
+  GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                       indices.size() * sizeof(unsigned short), &indices[0],
+                       GL_STATIC_DRAW));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+  std::vector<CardboardVertex>().swap(vertices_);
+  return true;
+}
+
+void CardboardQuads::Bind() const {
+  assert(vbo_ != 0);
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_));
+
+  const GLsizei stride = sizeof(CardboardVertex);
+  GL_CALL(glEnableVertexAttribArray(fplbase::kAttributePosition));
+  GL_CALL(glVertexAttribPointer(
+      fplbase::kAttributePosition, 3, GL_FLOAT, GL_FALSE, stride,
+      reinterpret_cast<const void*>(offsetof(CardboardVertex, pos))));
+  GL_CALL(glEnableVertexAttribArray(fplbase::kAttributeTexCoord));
+  GL_CALL(glVertexAttribPointer(
+      fplbase::kAttributeTexCoord, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+      reinterpret_cast<const void*>(offsetof(CardboardVertex, tc))));
+  GL_CALL(glEnableVertexAttribArray(fplbase::kAttributeNormal));
+  GL_CALL(glVertexAttribPointer(
+      fplbase::kAttributeNormal, 3, GL_BYTE, GL_TRUE, stride,
+      reinterpret_cast<const void*>(offsetof(CardboardVertex, norm))));
+  GL_CALL(glEnableVertexAttribArray(fplbase::kAttributeTangent));
+  GL_CALL(glVertexAttribPointer(
+      fplbase::kAttributeTangent, 4, GL_BYTE, GL_TRUE, stride,
+      reinterpret_cast<const void*>(offsetof(CardboardVertex, tangent))));
+}
+
+void CardboardQuads::Unbind() const {
+  GL_CALL(glDisableVertexAttribArray(fplbase::kAttributePosition));
+  GL_CALL(glDisableVertexAttribArray(fplbase::kAttributeTexCoord));
+  GL_CALL(glDisableVertexAttribArray(fplbase::kAttributeNormal));
+  GL_CALL(glDisableVertexAttribArray(fplbase::kAttributeTangent));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+}
+
+void CardboardQuads::Render(fplbase::Renderer& renderer, QuadId quad,
+                            bool ignore_material) const {
+  assert(0 <= quad && quad < num_quads());
+  if (!ignore_material) materials_[quad]->Set(renderer);
+  const size_t first_index = static_cast<size_t>(quad) * kQuadNumIndices;
+  GL_CALL(glDrawElements(
+      GL_TRIANGLES, kQuadNumIndices, GL_UNSIGNED_SHORT,
+      reinterpret_cast<const void*>(first_index * sizeof(unsigned short))));
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,89 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PIE_NOON_CARDBOARD_QUADS_H_
+#define PIE_NOON_CARDBOARD_QUADS_H_
+
+#include <cstdint>
+#include <vector>
+#include "common.h"
+
+namespace fplbase {
+class Material;
+class Renderer;
+}  // fplbase
+
+namespace fpl {
+namespace pie_noon {
+
+// Vertex layout of the quads in CardboardQuads: half the size of the float
+// position, texture coordinate, normal and tangent a fplbase::Mesh would use.
+// Texture coordinates are normalized unsigned shorts, and normals and tangents
+// normalized bytes, which are exact enough for upright quads.
+struct CardboardVertex {
+  mathfu::vec3_packed pos;
+  uint16_t tc[2];
+  int8_t norm[4];
+  int8_t tangent[4];
+};
+
+// The upright, textured quads that cardboard cutouts and their sticks are
+// drawn with, all in one vertex buffer and one index buffer. Drawing one quad
+// after another only has to set its material, rather than bind a buffer and
+// vertex format per quad, as a fplbase::Mesh per quad would.
+class CardboardQuads {
+ public:
+  typedef int QuadId;
+  static const QuadId kInvalidQuad = -1;
+
+  CardboardQuads();
+  ~CardboardQuads();
+
+  // Add a quad whose bottom edge is centered on 'offset', 'size' world units
+  // across and up, showing the top-center 'texture_coord_size' of
+  // 'material's texture. Returns the id to draw it with.
+  QuadId Add(const mathfu::vec3& offset, const mathfu::vec2& size,
+             const mathfu::vec2& texture_coord_size,
+             fplbase::Material* material);
+
+  // Upload every quad added so far into the buffers, and free the copy in
+  // memory. Call once, after the last Add(), with a GL context. Returns false
+  // if there are too many quads to index, or nothing to upload.
+  bool Upload();
+
+  // Bind the buffers and vertex format. Render() may then be called until
+  // Unbind(), as long as nothing else draws in between.
+  void Bind() const;
+  void Unbind() const;
+  // Draw 'quad', setting its material unless 'ignore_material'.
+  void Render(fplbase::Renderer& renderer, QuadId quad,
+              bool ignore_material = false) const;
+
+  fplbase::Material* material(QuadId quad) const { return materials_[quad]; }
+  int num_quads() const { return static_cast<int>(materials_.size()); }
+
+ private:
+  std::vector<CardboardVertex> vertices_;
+  std::vector<fplbase::Material*> materials_;
+  uint32_t vbo_;
+  uint32_t ibo_;
+
+  DISALLOW_COPY_AND_ASSIGN(CardboardQuads);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_CARDBOARD_QUADS_H_
@@ -146,7 +146,7 @@ class Character {
   bool just_joined_game() { return just_joined_game_; }
 
   void set_victory_state(VictoryState state) { victory_state_ = state; }
-  VictoryState victory_state() { return victory_state_; }
+  VictoryState victory_state() const { return victory_state_; }
 
   // Resets all stats we've accumulated.  Usually called when we have finished
   // sending them to the server.
@@ -0,0 +1,131 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "component_scheduler.h"
+#include "job_system.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Below this many entities, it's not worth handing a range to another thread.
+static const size_t kMinEntitiesPerTask = 32;
+
+void ComponentAccess::Add(corgi::ComponentId id, bool write, Scope scope) {
+  Entry entry = {id, write, scope};
+  entries_.push_back(entry);
+}
+
+bool ComponentAccess::ConflictsWith(const ComponentAccess& other) const {
+  for (auto a = entries_.begin(); a != entries_.end(); ++a) {
+    for (auto b = other.entries_.begin(); b != other.entries_.end(); ++b) {
+      if (a->id != b->id || !(a->write || b->write)) continue;
+
+      // Two components that only touch their own entities never touch the
+      // same data, since every entity is owned by at most one of them.
+      if (a->scope == kOwnEntities && b->scope == kOwnEntities) continue;
+      return true;
+    }
+  }
+  return false;
+}
+
+ComponentScheduler::ComponentScheduler() : job_system_(nullptr) {}
+
+void ComponentScheduler::Clear() {
+  entries_.clear();
+  phases_.clear();
+}
+
+void ComponentScheduler::RegisterComponent(
+    corgi::ComponentInterface* component, ScheduledComponent* scheduled,
+    corgi::ComponentId id) {
+  assert(id != corgi::kInvalidComponent);
+  Entry entry;
+  entry.component = component;
+  entry.scheduled = scheduled;
+  entry.access.Writes(id, ComponentAccess::kOwnEntities);
+  scheduled->DeclareAccess(&entry.access);
+
+  // Run after every earlier component that we conflict with.
+  entry.phase = 0;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->access.ConflictsWith(entry.access)) {
+      entry.phase = std::max(entry.phase, it->phase + 1);
+    }
+  }
+
+  if (entry.phase >= static_cast<int>(phases_.size())) {
+    phases_.resize(entry.phase + 1);
+  }
+  phases_[entry.phase].push_back(entries_.size());
+  entries_.push_back(entry);
+}
+
+void ComponentScheduler::UpdateComponents(corgi::WorldTime delta_time) {
+  for (auto it = phases_.begin(); it != phases_.end(); ++it) {
+    RunPhase(*it, delta_time);
+  }
+}
+
+void ComponentScheduler::RunPhase(const std::vector<size_t>& phase,
+                                  corgi::WorldTime delta_time) {
+  // Split the phase into tasks. Components that can't be split by entity
+  // are a single task.
+  tasks_.clear();
+  for (auto it = phase.begin(); it != phase.end(); ++it) {
+    const size_t num_entities = entries_[*it].scheduled->GatherEntities();
+    if (num_entities == 0) {
+      Task task = {*it, 0, 0};
+      tasks_.push_back(task);
+      continue;
+    }
+
+    const int num_threads =
+        job_system_ == nullptr ? 1 : job_system_->num_threads();
+    const size_t entities_per_task = std::max(
+        kMinEntitiesPerTask, (num_entities + num_threads - 1) / num_threads);
+    for (size_t begin = 0; begin < num_entities; begin += entities_per_task) {
+      Task task = {*it, begin,
+                   std::min(begin + entities_per_task, num_entities)};
+      tasks_.push_back(task);
+    }
+  }
+
+  auto run_task = [this, delta_time](int task_index) {
+    const Task& task = tasks_[task_index];
+    const Entry& entry = entries_[task.entry];
+    if (task.begin == task.end) {
+      entry.component->UpdateAllEntities(delta_time);
+    } else {
+      entry.scheduled->UpdateEntityRange(delta_time, task.begin, task.end);
+    }
+  };
+  const int num_tasks = static_cast<int>(tasks_.size());
+  if (job_system_ == nullptr) {
+    for (int i = 0; i < num_tasks; ++i) run_task(i);
+  } else {
+    job_system_->ParallelFor(num_tasks, 1,
+                             [&run_task](int begin, int end, int) {
+      for (int i = begin; i < end; ++i) run_task(i);
+    });
+  }
+
+  for (auto it = phase.begin(); it != phase.end(); ++it) {
+    entries_[*it].scheduled->FinishEntityRanges();
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,155 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_COMPONENT_SCHEDULER_H_
+#define PIE_NOON_COMPONENT_SCHEDULER_H_
+
+#include <vector>
+#include "common.h"
+#include "corgi/component_interface.h"
+#include "corgi/entity_manager.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class JobSystem;
+
+// The component data that a component touches during UpdateAllEntities().
+class ComponentAccess {
+ public:
+  enum Scope {
+    // Only data belonging to entities that this component owns: its own
+    // entities, and child entities that it created and nobody else updates.
+    kOwnEntities,
+    // Data belonging to any entity.
+    kAnyEntity
+  };
+
+  void Reads(corgi::ComponentId id, Scope scope) { Add(id, false, scope); }
+  void Writes(corgi::ComponentId id, Scope scope) { Add(id, true, scope); }
+
+  // Motivators, including the matrix behind every SceneObjectData's
+  // transform, keep their state in the MotiveEngine's processors, which all
+  // entities share. So a component that sets motivators conflicts with any
+  // other that reads or sets them, whichever entities each one owns.
+  void ReadsMotivators() { Add(kMotivators, false, kAnyEntity); }
+  void WritesMotivators() { Add(kMotivators, true, kAnyEntity); }
+
+  // True if the two components can't be updated at the same time.
+  bool ConflictsWith(const ComponentAccess& other) const;
+
+  void Clear() { entries_.clear(); }
+
+ private:
+  struct Entry {
+    corgi::ComponentId id;
+    bool write;
+    Scope scope;
+  };
+  void Add(corgi::ComponentId id, bool write, Scope scope);
+
+  // Stands in for the MotiveEngine, which isn't a component.
+  static const corgi::ComponentId kMotivators = corgi::kInvalidComponent;
+
+  std::vector<Entry> entries_;
+};
+
+// Implemented by components that can be updated by the ComponentScheduler.
+class ScheduledComponent {
+ public:
+  virtual ~ScheduledComponent() {}
+
+  // Record every piece of component data that UpdateAllEntities() reads or
+  // writes. The component's own data is recorded automatically.
+  virtual void DeclareAccess(ComponentAccess* access) const = 0;
+
+  // Components whose entities can be updated independently of one another
+  // return the number of entities to update, and then have
+  // UpdateEntityRange() called on disjoint ranges, possibly concurrently.
+  // Ranges may read motivators, but never set them, since the ranges share
+  // the MotiveEngine. Components that return 0 get UpdateAllEntities()
+  // instead.
+  virtual size_t GatherEntities() { return 0; }
+  virtual void UpdateEntityRange(corgi::WorldTime /*delta_time*/,
+                                 size_t /*begin*/, size_t /*end*/) {}
+
+  // Called on the scheduling thread after every task in the phase has
+  // finished, one component at a time. Apply the motivator writes that the
+  // ranges computed here.
+  virtual void FinishEntityRanges() {}
+};
+
+// Runs component updates on the job system. Components are grouped into
+// phases: a component runs in the first phase after every earlier-registered
+// component that it conflicts with. Components in the same phase, and entity
+// ranges within a component, run concurrently. Conflicting components always
+// run in registration order, so the results match a serial update.
+class ComponentScheduler {
+ public:
+  ComponentScheduler();
+
+  // Updates run on the calling thread if no job system is set.
+  void set_job_system(JobSystem* job_system) { job_system_ = job_system; }
+
+  // Forget all registered components.
+  void Clear();
+
+  // Add a component, after those already registered. It must already be
+  // registered with the entity manager, so that it has a component id.
+  template <typename T>
+  void RegisterComponent(T* component) {
+    RegisterComponent(component, component,
+                      corgi::ComponentIdLookup<T>::component_id);
+  }
+
+  // Update every registered component. Replaces
+  // EntityManager::UpdateComponents().
+  void UpdateComponents(corgi::WorldTime delta_time);
+
+  int num_phases() const { return static_cast<int>(phases_.size()); }
+
+ private:
+  struct Entry {
+    corgi::ComponentInterface* component;
+    ScheduledComponent* scheduled;
+    ComponentAccess access;
+    int phase;
+  };
+
+  // A piece of work within a phase: either a whole component (begin == end)
+  // or a range of its entities.
+  struct Task {
+    size_t entry;
+    size_t begin;
+    size_t end;
+  };
+
+  void RegisterComponent(corgi::ComponentInterface* component,
+                         ScheduledComponent* scheduled, corgi::ComponentId id);
+  void RunPhase(const std::vector<size_t>& phase, corgi::WorldTime delta_time);
+
+  std::vector<Entry> entries_;
+  // Indices into entries_, for each phase.
+  std::vector<std::vector<size_t>> phases_;
+  // Scratch space, reused every phase.
+  std::vector<Task> tasks_;
+  JobSystem* job_system_;
+
+  DISALLOW_COPY_AND_ASSIGN(ComponentScheduler);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_COMPONENT_SCHEDULER_H_
@@ -39,6 +39,17 @@ void CardboardPlayerComponent::UpdateAllEntities(
   }
 }
 
+// Cardboard players share their entity with a player character, and re-aim
+// the player character's base circle, so they must update after it.
+void CardboardPlayerComponent::DeclareAccess(ComponentAccess* access) const {
+  access->Reads(
+      corgi::ComponentIdLookup<PlayerCharacterComponent>::component_id,
+      ComponentAccess::kAnyEntity);
+  access->Writes(corgi::ComponentIdLookup<SceneObjectComponent>::component_id,
+                 ComponentAccess::kAnyEntity);
+  access->WritesMotivators();
+}
+
 void CardboardPlayerComponent::UpdateTargetReticle(corgi::EntityRef entity) {
   CardboardPlayerData* cp_data = GetComponentData(entity);
   std::vector<std::unique_ptr<Character>>& character_vector =
@@ -16,6 +16,7 @@
 #define COMPONENTS_CARDBOARD_PLAYER_H_
 
 #include "common.h"
+#include "component_scheduler.h"
 #include "components_generated.h"
 #include "config_generated.h"
 #include "corgi/component.h"
@@ -35,10 +36,12 @@ struct CardboardPlayerData {
   CharacterId character_id;
 };
 
-class CardboardPlayerComponent : public corgi::Component<CardboardPlayerData> {
+class CardboardPlayerComponent : public corgi::Component<CardboardPlayerData>,
+                                 public ScheduledComponent {
  public:
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+  virtual void DeclareAccess(ComponentAccess* access) const;
   virtual void InitEntity(corgi::EntityRef& entity);
 
   void set_gamestate_ptr(GameState* gamestate_ptr) {
@@ -28,10 +28,38 @@ using mathfu::vec3;
 // and then slowly sinks, while shrinking.  It's used to govern behavior
 // for splatters on the background.
 void DripAndVanishComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
+  UpdateEntityRange(delta_time, 0, GatherEntities());
+  FinishEntityRanges();
+}
+
+// Ranges of splatters work out where they slide to concurrently. Moving
+// them, and putting them on the free list, waits for FinishEntityRanges().
+void DripAndVanishComponent::DeclareAccess(ComponentAccess* access) const {
+  access->Writes(corgi::ComponentIdLookup<SceneObjectComponent>::component_id,
+                 ComponentAccess::kOwnEntities);
+  access->ReadsMotivators();
+}
+
+size_t DripAndVanishComponent::GatherEntities() {
+  update_entities_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    SceneObjectData* so_data = Data<SceneObjectData>(iter->entity);
-    DripAndVanishData* dv_data = GetComponentData(iter->entity);
+    if (!iter->data.in_free_list) {
+      update_entities_.push_back(iter->entity);
+    }
+  }
+  slides_.resize(update_entities_.size());
+  return update_entities_.size();
+}
+
+void DripAndVanishComponent::UpdateEntityRange(corgi::WorldTime delta_time,
+                                               size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    const corgi::EntityRef& entity = update_entities_[i];
+    const SceneObjectData* so_data = Data<SceneObjectData>(entity);
+    DripAndVanishData* dv_data = GetComponentData(entity);
+    Slide& slide = slides_[i];
+    slide.moved = false;
 
     dv_data->lifetime_remaining -= delta_time;
     if (dv_data->lifetime_remaining > 0) {
@@ -50,11 +78,29 @@ void DripAndVanishComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
 
         relative_scale = vec3(dv_data->start_scale) * (1.0f - slide_amount);
 
-        so_data->SetTranslation(relative_offset);
-        so_data->SetScale(relative_scale);
+        slide.translation = relative_offset;
+        slide.scale = relative_scale;
+        slide.moved = true;
       }
-    } else {
-      entity_manager_->DeleteEntity(iter->entity);
+    }
+  }
+}
+
+// Move the splatters, and park everything that vanished this frame on the
+// free list.
+void DripAndVanishComponent::FinishEntityRanges() {
+  for (size_t i = 0; i < update_entities_.size(); ++i) {
+    const corgi::EntityRef& entity = update_entities_[i];
+    SceneObjectData* so_data = Data<SceneObjectData>(entity);
+    DripAndVanishData* dv_data = GetComponentData(entity);
+    if (slides_[i].moved) {
+      so_data->SetTranslation(vec3(slides_[i].translation));
+      so_data->SetScale(vec3(slides_[i].scale));
+    }
+    if (dv_data->lifetime_remaining <= 0) {
+      so_data->set_visible(false);
+      dv_data->in_free_list = true;
+      free_entities_.push_back(entity);
     }
   }
 }
@@ -69,8 +115,10 @@ void DripAndVanishComponent::AddFromRawData(corgi::EntityRef& entity,
       static_cast<const DripAndVanishDef*>(component_data->data());
 
   entity_data->drip_distance = dripandvanish_data->distance_dripped();
-  entity_data->lifetime_remaining =
+  entity_data->total_lifetime =
       dripandvanish_data->total_lifetime() * kMillisecondsPerSecond;
+  entity_data->lifetime_remaining = entity_data->total_lifetime;
+  entity_data->in_free_list = false;
   entity_data->slide_time =
       dripandvanish_data->time_spent_dripping() * kMillisecondsPerSecond;
 }
@@ -93,5 +141,18 @@ void DripAndVanishComponent::SetStartingValues(corgi::EntityRef& entity) {
   entity_data->start_scale = so_data->Scale();
 }
 
+corgi::EntityRef DripAndVanishComponent::ReuseFreeEntity() {
+  if (free_entities_.empty()) return corgi::EntityRef();
+
+  corgi::EntityRef entity = free_entities_.back();
+  free_entities_.pop_back();
+
+  DripAndVanishData* entity_data = GetComponentData(entity);
+  entity_data->lifetime_remaining = entity_data->total_lifetime;
+  entity_data->in_free_list = false;
+  Data<SceneObjectData>(entity)->set_visible(true);
+  return entity;
+}
+
 }  // pie noon
 }  // fpl
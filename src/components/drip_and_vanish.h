@@ -15,7 +15,9 @@
 #ifndef COMPONENTS_DRIPANDVANISH_H_
 #define COMPONENTS_DRIPANDVANISH_H_
 
+#include <vector>
 #include "common.h"
+#include "component_scheduler.h"
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "mathfu/constants.h"
@@ -26,21 +28,53 @@ namespace pie_noon {
 
 // Data for accessory components.
 struct DripAndVanishData {
+  float total_lifetime;
   float lifetime_remaining;
   float slide_time;
   float drip_distance;
   mathfu::vec3_packed start_position;
   mathfu::vec3_packed start_scale;
+  // True when the entity has vanished and is waiting to be reused.
+  bool in_free_list;
 };
 
 // Basic behavior for pie splatters:  They stay there for a while,
 // and then they slowly drip down and vanish.
-class DripAndVanishComponent : public corgi::Component<DripAndVanishData> {
+class DripAndVanishComponent : public corgi::Component<DripAndVanishData>,
+                               public ScheduledComponent {
  public:
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
-  virtual void UpdateAllEntities(corgi::WorldTime /*delta_time*/);
+  virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+  virtual void DeclareAccess(ComponentAccess* access) const;
+  virtual size_t GatherEntities();
+  virtual void UpdateEntityRange(corgi::WorldTime delta_time, size_t begin,
+                                 size_t end);
+  virtual void FinishEntityRanges();
   virtual void InitEntity(corgi::EntityRef& entity);
   void SetStartingValues(corgi::EntityRef& entity);
+
+  // Entities that have finished vanishing are hidden and kept here instead
+  // of being deleted. Returns one of them, visible and with its lifetime
+  // restarted, or an invalid EntityRef if there are none.
+  corgi::EntityRef ReuseFreeEntity();
+
+  // Forget the free entities. Call when the entity manager is cleared.
+  void ClearFreeEntities() { free_entities_.clear(); }
+
+ private:
+  std::vector<corgi::EntityRef> free_entities_;
+  // Where each entity is sliding to, computed by the ranges and applied to
+  // its scene object by FinishEntityRanges().
+  struct Slide {
+    mathfu::vec3_packed translation;
+    mathfu::vec3_packed scale;
+    bool moved;
+  };
+
+  // Entities to update this frame, split into ranges by the scheduler.
+  std::vector<corgi::EntityRef> update_entities_;
+  // One per entry in update_entities_.
+  std::vector<Slide> slides_;
 };
 
 }  // pie_noon
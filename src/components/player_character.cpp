@@ -45,6 +45,15 @@ void PlayerCharacterComponent::UpdateAllEntities(
   }
 }
 
+// The character, its base circle, and its accessories are all created by,
+// and only updated by, this component. Moving them sets their transform
+// motivators, though, so it can't run alongside the other components.
+void PlayerCharacterComponent::DeclareAccess(ComponentAccess* access) const {
+  access->Writes(corgi::ComponentIdLookup<SceneObjectComponent>::component_id,
+                 ComponentAccess::kOwnEntities);
+  access->WritesMotivators();
+}
+
 // Make sure the character is correctly positioned and facing the correct way:
 void PlayerCharacterComponent::UpdateCharacterFacing(corgi::EntityRef entity) {
   SceneObjectData* so_data = Data<SceneObjectData>(entity);
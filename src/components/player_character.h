@@ -17,6 +17,7 @@
 
 #include "character.h"
 #include "common.h"
+#include "component_scheduler.h"
 #include "components_generated.h"
 #include "config_generated.h"
 #include "corgi/component.h"
@@ -40,10 +41,12 @@ struct PlayerCharacterData {
 
 // Child Objects are basically anything that hangs off of a scene-object as a
 // child.  They inherit transformations from their parent.
-class PlayerCharacterComponent : public corgi::Component<PlayerCharacterData> {
+class PlayerCharacterComponent : public corgi::Component<PlayerCharacterData>,
+                                 public ScheduledComponent {
  public:
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+  virtual void DeclareAccess(ComponentAccess* access) const;
   virtual void InitEntity(corgi::EntityRef& entity);
   void set_gamestate_ptr(GameState* gamestate_ptr) {
     gamestate_ptr_ = gamestate_ptr;
@@ -93,6 +93,7 @@ void SceneObjectComponent::AddFromRawData(corgi::EntityRef& entity,
 void SceneObjectComponent::InitEntity(corgi::EntityRef& entity) {
   SceneObjectData* data = GetComponentData(entity);
   data->Initialize(engine_);
+  global_matrices_current_ = false;
 }
 
 void SceneObjectComponent::UpdateGlobalMatrix(
@@ -146,8 +147,16 @@ bool SceneObjectComponent::VisibleInHierarchy(
   }
 }
 
-void SceneObjectComponent::PopulateScene(SceneDescription* scene) {
+void SceneObjectComponent::AdvanceFrame() {
   UpdateGlobalMatrices();
+  global_matrices_current_ = true;
+}
+
+void SceneObjectComponent::PopulateScene(SceneDescription* scene) {
+  if (!global_matrices_current_) UpdateGlobalMatrices();
+  // The engine may advance again before the next scene without a call to
+  // AdvanceFrame(), as it does when paused.
+  global_matrices_current_ = false;
 
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
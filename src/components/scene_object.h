@@ -189,9 +189,14 @@ class SceneObjectData {
 class SceneObjectComponent : public corgi::Component<SceneObjectData> {
  public:
   explicit SceneObjectComponent(motive::MotiveEngine* engine)
-      : engine_(engine) {}
+      : engine_(engine), global_matrices_current_(false) {}
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
   virtual void InitEntity(corgi::EntityRef& entity);
+  // Bring every visible entity's global matrix up to date with its
+  // motivators. Call once a frame, after the MotiveEngine advances.
+  void AdvanceFrame();
+  // Reuses the matrices from AdvanceFrame(), or computes them if it hasn't
+  // been called since the last scene.
   void PopulateScene(SceneDescription* scene);
 
  private:
@@ -201,6 +206,9 @@ class SceneObjectComponent : public corgi::Component<SceneObjectData> {
   bool VisibleInHierarchy(const corgi::EntityRef& entity) const;
 
   motive::MotiveEngine* engine_;
+  // True if no motivator has advanced, and no entity has been added, since
+  // the global matrices were computed.
+  bool global_matrices_current_;
 };
 
 }  // pie_noon
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include <cmath>
+#include <limits>
 #include "scene_object.h"
 #include "shakeable_prop.h"
 
@@ -26,19 +28,52 @@ CORGI_DEFINE_COMPONENT(fpl::pie_noon::ShakeablePropComponent,
 namespace fpl {
 namespace pie_noon {
 
-void ShakeablePropComponent::UpdateAllEntities(
-    corgi::WorldTime /*delta_time*/) {
+// Props farther away than the distance at which the closeness factor drops
+// to this value are not shaken at all.
+static const float kMinShakeCloseness = 0.01f;
+
+void ShakeablePropComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
+  UpdateEntityRange(delta_time, 0, GatherEntities());
+  FinishEntityRanges();
+}
+
+// Ranges of props read their shake motivators concurrently. Each prop then
+// tilts its own scene object, in FinishEntityRanges().
+void ShakeablePropComponent::DeclareAccess(ComponentAccess* access) const {
+  access->Writes(corgi::ComponentIdLookup<SceneObjectComponent>::component_id,
+                 ComponentAccess::kOwnEntities);
+  access->ReadsMotivators();
+}
+
+size_t ShakeablePropComponent::GatherEntities() {
+  update_entities_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    corgi::EntityRef entity = iter->entity;
-    ShakeablePropData* sp_data = GetComponentData(iter->entity);
-    SceneObjectData* so_data = Data<SceneObjectData>(entity);
-    assert(so_data != nullptr && sp_data != nullptr);
+    update_entities_.push_back(iter->entity);
+  }
+  shake_angles_.resize(update_entities_.size());
+  return update_entities_.size();
+}
 
-    if (sp_data->motivator.Valid()) {
-      so_data->SetPreRotationAboutAxis(sp_data->motivator.Value(),
-                                       sp_data->axis);
-    }
+void ShakeablePropComponent::UpdateEntityRange(
+    corgi::WorldTime /*delta_time*/, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    const ShakeablePropData* sp_data = GetComponentData(update_entities_[i]);
+    assert(sp_data != nullptr);
+    shake_angles_[i] = sp_data->motivator.Valid()
+                           ? sp_data->motivator.Value()
+                           : std::numeric_limits<float>::quiet_NaN();
+  }
+}
+
+void ShakeablePropComponent::FinishEntityRanges() {
+  for (size_t i = 0; i < update_entities_.size(); ++i) {
+    if (std::isnan(shake_angles_[i])) continue;
+    const corgi::EntityRef& entity = update_entities_[i];
+    SceneObjectData* so_data = Data<SceneObjectData>(entity);
+    assert(so_data != nullptr);
+    so_data->SetPreRotationAboutAxis(shake_angles_[i],
+                                     GetComponentData(entity)->axis);
   }
 }
 
@@ -70,6 +105,12 @@ void ShakeablePropComponent::AddFromRawData(corgi::EntityRef& entity,
 
     entity_data->motivator.Initialize(scaled_shake_init, engine_);
   }
+
+  // The global matrix isn't calculated yet, so this is usually the origin.
+  // UpdateSpatialGrid() moves the prop to its real cell.
+  const vec3 position = Data<SceneObjectData>(entity)->GlobalPosition();
+  entity_data->grid_position = position;
+  grid_.Insert(entity, position);
 }
 
 // Preload specifications for motivators from the config file.
@@ -88,20 +129,59 @@ void ShakeablePropComponent::LoadMotivatorSpecs() {
 void ShakeablePropComponent::CleanupEntity(corgi::EntityRef& entity) {
   ShakeablePropData* sp_data = GetComponentData(entity);
   sp_data->motivator.Invalidate();
+  grid_.Remove(entity, vec3(sp_data->grid_position));
+}
+
+void ShakeablePropComponent::ResetSpatialGrid() {
+  grid_.Clear(config_->prop_grid_cell_size());
+}
+
+void ShakeablePropComponent::UpdateSpatialGrid() {
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    ShakeablePropData* data = &iter->data;
+    const vec3 old_position(data->grid_position);
+    const vec3 new_position =
+        Data<SceneObjectData>(iter->entity)->GlobalPosition();
+    grid_.Move(iter->entity, old_position, new_position);
+    data->grid_position = new_position;
+  }
+}
+
+void ShakeablePropComponent::FindPropsNear(
+    const vec3& position, float radius,
+    std::vector<corgi::EntityRef>* props) const {
+  const size_t first_candidate = props->size();
+  grid_.Query(position, radius, props);
+
+  // The grid returns everything in the overlapping cells. Keep only the
+  // props that are actually within range.
+  const float radius_squared = radius * radius;
+  auto end = std::remove_if(
+      props->begin() + first_candidate, props->end(),
+      [this, &position, radius_squared](const corgi::EntityRef& prop) {
+        const SceneObjectData* so_data = Data<SceneObjectData>(prop);
+        return (so_data->GlobalPosition() - position).LengthSquared() >
+               radius_squared;
+      });
+  props->erase(end, props->end());
 }
 
 // General function to shake props when something hits near them.
 // Usually called by gamestate, in response to a pie landing.
 void ShakeablePropComponent::ShakeProps(float damage_percent,
                                         const vec3& damage_position) {
-  (void)damage_percent;
-  (void)damage_position;
+  // Only props close enough to get more than the minimum shake are affected.
+  const float shake_radius = sqrt(config_->prop_shake_identity_distance_sq() /
+                                  kMinShakeCloseness);
+  nearby_props_.clear();
+  FindPropsNear(damage_position, shake_radius, &nearby_props_);
 
-  for (auto iter = component_data_.begin(); iter != component_data_.end();
+  for (auto iter = nearby_props_.begin(); iter != nearby_props_.end();
        ++iter) {
-    ShakeablePropData* data = &iter->data;
+    ShakeablePropData* data = GetComponentData(*iter);
 
-    SceneObjectData* so_data = Data<SceneObjectData>(iter->entity);
+    SceneObjectData* so_data = Data<SceneObjectData>(*iter);
 
     float shake_scale = data->shake_scale;
     if (shake_scale == 0.0f) {
@@ -119,7 +199,7 @@ void ShakeablePropComponent::ShakeProps(float damage_percent,
     const float closeness =
         mathfu::Clamp(config_->prop_shake_identity_distance_sq() /
                           (damage_position - prop_position).LengthSquared(),
-                      0.01f, 1.0f);
+                      kMinShakeCloseness, 1.0f);
 
     // Velocity added is the product of all the factors.
     const float delta_velocity = current_direction * damage_percent *
@@ -18,12 +18,14 @@
 #include <memory>
 #include <vector>
 #include "common.h"
+#include "component_scheduler.h"
 #include "components_generated.h"
 #include "config_generated.h"
 #include "corgi/component.h"
 #include "motive/init.h"
 #include "motive/io/flatbuffers.h"
 #include "motive/util.h"
+#include "spatial_grid.h"
 
 namespace fpl {
 namespace pie_noon {
@@ -33,11 +35,19 @@ struct ShakeablePropData {
   float shake_scale;
   fplbase::Axis axis;
   motive::Motivator1f motivator;
+  // Position the prop was last filed under in the spatial grid.
+  mathfu::vec3_packed grid_position;
 };
 
-class ShakeablePropComponent : public corgi::Component<ShakeablePropData> {
+class ShakeablePropComponent : public corgi::Component<ShakeablePropData>,
+                               public ScheduledComponent {
  public:
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+  virtual void DeclareAccess(ComponentAccess* access) const;
+  virtual size_t GatherEntities();
+  virtual void UpdateEntityRange(corgi::WorldTime delta_time, size_t begin,
+                                 size_t end);
+  virtual void FinishEntityRanges();
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
   virtual void InitEntity(corgi::EntityRef& entity);
   virtual void CleanupEntity(corgi::EntityRef& entity);
@@ -47,9 +57,28 @@ class ShakeablePropComponent : public corgi::Component<ShakeablePropData> {
   void LoadMotivatorSpecs();
   void ShakeProps(float damage_percent, const mathfu::vec3& damage_position);
 
+  // Empty the spatial grid. Call before loading a new set of props.
+  void ResetSpatialGrid();
+
+  // Re-file every prop under its current global position. Call after the
+  // scene object global matrices have been recalculated.
+  void UpdateSpatialGrid();
+
+  // Append to 'props' every prop within 'radius' of 'position'.
+  void FindPropsNear(const mathfu::vec3& position, float radius,
+                     std::vector<corgi::EntityRef>* props) const;
+
  private:
   const Config* config_;
   motive::MotiveEngine* engine_;
+  SpatialGrid grid_;
+  // Entities to update this frame, split into ranges by the scheduler.
+  std::vector<corgi::EntityRef> update_entities_;
+  // Each entity's shake angle, read by the ranges and applied to its scene
+  // object by FinishEntityRanges(). NaN if the prop isn't shaking.
+  std::vector<float> shake_angles_;
+  // Scratch space for grid queries, to avoid allocating every shake.
+  std::vector<corgi::EntityRef> nearby_props_;
   motive::OvershootInit motivator_inits[MotivatorSpecification_Count];
 };
 
@@ -0,0 +1,114 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include <algorithm>
+#include <cstring>
+#include "config_cache.h"
+#include "config_generated.h"
+#include "particles_generated.h"
+
+using mathfu::vec3;
+
+namespace fpl {
+namespace pie_noon {
+
+ParticleRanges::ParticleRanges() { Load(nullptr); }
+
+void ParticleRanges::Load(const ParticleDef* def) {
+  renderables.clear();
+  tints.clear();
+  if (def == nullptr) {
+    min_scale = max_scale = mathfu::kOnes3f;
+    min_velocity = max_velocity = mathfu::kZeros3f;
+    min_position_offset = max_position_offset = mathfu::kZeros3f;
+    min_orientation_offset = max_orientation_offset = mathfu::kZeros3f;
+    min_angular_velocity = max_angular_velocity = mathfu::kZeros3f;
+    acceleration = mathfu::kZeros3f;
+    min_duration = max_duration = 0;
+    shrink_duration = fade_duration = 0;
+    preserve_aspect = false;
+    return;
+  }
+
+  min_scale = LoadVec3(def->min_scale());
+  max_scale = LoadVec3(def->max_scale());
+  min_velocity = LoadVec3(def->min_velocity());
+  max_velocity = LoadVec3(def->max_velocity());
+  min_position_offset = LoadVec3(def->min_position_offset());
+  max_position_offset = LoadVec3(def->max_position_offset());
+  min_orientation_offset = LoadVec3(def->min_orientation_offset());
+  max_orientation_offset = LoadVec3(def->max_orientation_offset());
+  min_angular_velocity = LoadVec3(def->min_angular_velocity());
+  max_angular_velocity = LoadVec3(def->max_angular_velocity());
+  acceleration = LoadVec3(def->acceleration());
+  min_duration = def->min_duration();
+  max_duration = def->max_duration();
+  shrink_duration = def->shrink_duration();
+  fade_duration = def->fade_duration();
+  preserve_aspect = def->preserve_aspect();
+
+  const auto renderable = def->renderable();
+  for (size_t i = 0; renderable != nullptr && i < renderable->size(); ++i) {
+    renderables.push_back(static_cast<uint16_t>(renderable->Get(i)));
+  }
+  const auto tint = def->tint();
+  for (size_t i = 0; tint != nullptr && i < tint->size(); ++i) {
+    tints.push_back(mathfu::vec4_packed(LoadVec4(tint->Get(i))));
+  }
+}
+
+ConfigCache::ConfigCache()
+    : cardboard_ambient_material_(mathfu::kZeros3f),
+      cardboard_diffuse_material_(mathfu::kZeros3f),
+      cardboard_specular_material_(mathfu::kZeros3f),
+      cardboard_shininess_(0.0f),
+      cardboard_normalmap_scale_(0.0f),
+      source_(nullptr) {
+  memset(renderable_flags_, 0, sizeof(renderable_flags_));
+}
+
+void ConfigCache::Build(const Config& config) {
+  source_ = &config;
+
+  memset(renderable_flags_, 0, sizeof(renderable_flags_));
+  const auto renderables = config.renderables();
+  const size_t num_renderables =
+      renderables == nullptr
+          ? 0
+          : std::min<size_t>(renderables->size(), RenderableId_Count);
+  for (size_t id = 0; id < num_renderables; ++id) {
+    const CardboardFigure* figure = renderables->Get(id);
+    uint8_t flags = 0;
+    if (figure->shadow()) flags |= kShadow;
+    if (figure->stick()) flags |= kStick;
+    if (figure->cardboard()) flags |= kCardboard;
+    renderable_flags_[id] = flags;
+  }
+
+  cardboard_ambient_material_ = LoadVec3(config.cardboard_ambient_material());
+  cardboard_diffuse_material_ = LoadVec3(config.cardboard_diffuse_material());
+  cardboard_specular_material_ =
+      LoadVec3(config.cardboard_specular_material());
+  cardboard_shininess_ = config.cardboard_shininess();
+  cardboard_normalmap_scale_ = config.cardboard_normalmap_scale();
+
+  pie_splatter_.Load(config.pie_splatter_def());
+  confetti_.Load(config.confetti_def());
+  joining_confetti_.Load(config.joining_confetti_def());
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,135 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PIE_NOON_CONFIG_CACHE_H_
+#define PIE_NOON_CONFIG_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+#include "common.h"
+#include "mathfu/glsl_mappings.h"
+#include "pie_noon_common_generated.h"
+
+namespace fpl {
+
+struct ParticleDef;
+
+namespace pie_noon {
+
+struct Config;
+
+// A ParticleDef with its vectors already loaded, so that spawning a burst of
+// particles doesn't have to walk the FlatBuffer for every particle.
+struct ParticleRanges {
+  ParticleRanges();
+  // Loads 'def', or resets to an empty definition if 'def' is null.
+  void Load(const ParticleDef* def);
+
+  mathfu::vec3 min_scale;
+  mathfu::vec3 max_scale;
+  mathfu::vec3 min_velocity;
+  mathfu::vec3 max_velocity;
+  mathfu::vec3 min_position_offset;
+  mathfu::vec3 max_position_offset;
+  mathfu::vec3 min_orientation_offset;
+  mathfu::vec3 max_orientation_offset;
+  mathfu::vec3 min_angular_velocity;
+  mathfu::vec3 max_angular_velocity;
+  mathfu::vec3 acceleration;
+  int min_duration;
+  int max_duration;
+  int shrink_duration;
+  int fade_duration;
+  bool preserve_aspect;
+  // Particles pick a random renderable and tint from these.
+  std::vector<uint16_t> renderables;
+  std::vector<mathfu::vec4_packed> tints;
+};
+
+// The parts of the Config that are read every frame, decoded once when the
+// Config is set. Reading a FlatBuffer field means following offsets through
+// the vtable and byte-swapping vectors on the way out, which adds up when
+// it's done for every renderable, every frame.
+//
+// Build() must be called again whenever the Config changes.
+class ConfigCache {
+ public:
+  ConfigCache();
+
+  void Build(const Config& config);
+
+  // The Config the cache was last built from, or null.
+  const Config* source() const { return source_; }
+
+  // Per-renderable flags from the Config's CardboardFigure table. Ids with
+  // no entry have no flags set.
+  bool shadow(int id) const { return HasFlag(id, kShadow); }
+  bool stick(int id) const { return HasFlag(id, kStick); }
+  bool cardboard(int id) const { return HasFlag(id, kCardboard); }
+
+  // Uniforms for the cardboard shader.
+  const mathfu::vec3& cardboard_ambient_material() const {
+    return cardboard_ambient_material_;
+  }
+  const mathfu::vec3& cardboard_diffuse_material() const {
+    return cardboard_diffuse_material_;
+  }
+  const mathfu::vec3& cardboard_specular_material() const {
+    return cardboard_specular_material_;
+  }
+  float cardboard_shininess() const { return cardboard_shininess_; }
+  float cardboard_normalmap_scale() const { return cardboard_normalmap_scale_; }
+
+  const ParticleRanges& pie_splatter() const { return pie_splatter_; }
+  const ParticleRanges& confetti() const { return confetti_; }
+  const ParticleRanges& joining_confetti() const { return joining_confetti_; }
+
+ private:
+  enum RenderableFlag {
+    kShadow = 1 << 0,
+    kStick = 1 << 1,
+    kCardboard = 1 << 2,
+  };
+
+  bool HasFlag(int id, RenderableFlag flag) const {
+    return id >= 0 && id < RenderableId_Count &&
+           (renderable_flags_[id] & flag) != 0;
+  }
+
+  // Read by the render loops for every renderable. One byte per id keeps
+  // the whole table within a cache line or two. It isn't alignas() a cache
+  // line because GameState is allocated by std::vector in the headless
+  // host, and allocators before C++17 ignore over-alignment.
+  uint8_t renderable_flags_[RenderableId_Count];
+
+  mathfu::vec3 cardboard_ambient_material_;
+  mathfu::vec3 cardboard_diffuse_material_;
+  mathfu::vec3 cardboard_specular_material_;
+  float cardboard_shininess_;
+  float cardboard_normalmap_scale_;
+
+  ParticleRanges pie_splatter_;
+  ParticleRanges confetti_;
+  ParticleRanges joining_confetti_;
+
+  const Config* source_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConfigCache);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_CONFIG_CACHE_H_
@@ -21,6 +21,7 @@
 #include "config_generated.h"
 #include "controller.h"
 #include "game_state.h"
+#include "job_system.h"
 #include "motive/init.h"
 #include "motive/io/flatbuffers.h"
 #include "motive/util.h"
@@ -91,6 +92,16 @@ static T EnumerationValueForPieDamage(
   return static_cast<T>(lookup_vector.Get(clamped_damage));
 }
 
+// The headless host is built without pindrop, and never has an audio engine.
+static void PlaySound(pindrop::AudioEngine* audio_engine, const char* name) {
+#ifdef PIE_NOON_HEADLESS
+  (void)audio_engine;
+  (void)name;
+#else
+  if (audio_engine != nullptr) audio_engine->PlaySound(name);
+#endif  // PIE_NOON_HEADLESS
+}
+
 static corgi::ComponentId ConvertEnumToComponentId(
     ComponentDataUnion component) {
   // We handle this via a switch rather than a static array to make it more
@@ -114,19 +125,38 @@ static corgi::ComponentId ConvertEnumToComponentId(
   }
 }
 
+// Look up the components for 'def', resolving them on first use.
+const PieNoonEntityFactory::ResolvedDefinition&
+PieNoonEntityFactory::FindOrResolveDefinition(
+    const EntityDefinition* def, corgi::EntityManager* entity_manager) {
+  auto it = resolved_definitions_.find(def);
+  if (it != resolved_definitions_.end()) return it->second;
+
+  ResolvedDefinition& resolved = resolved_definitions_[def];
+  resolved.reserve(def->component_list()->size());
+  for (uoffset_t i = 0; i < def->component_list()->size(); i++) {
+    const ComponentDefInstance* currentInstance = def->component_list()->Get(i);
+    ResolvedComponent resolved_component;
+    resolved_component.component = entity_manager->GetComponent(
+        ConvertEnumToComponentId(currentInstance->data_type()));
+    resolved_component.raw_data = currentInstance;
+    assert(resolved_component.component != nullptr);
+    resolved.push_back(resolved_component);
+  }
+  return resolved;
+}
+
 // Factory method for the entity manager, for converting data (in our case.
 // flatbuffer definitions) into entities and sticking them into the system.
 corgi::EntityRef PieNoonEntityFactory::CreateEntityFromData(
     const void* data, corgi::EntityManager* entity_manager) {
   const EntityDefinition* def = static_cast<const EntityDefinition*>(data);
   assert(def != nullptr);
+  const ResolvedDefinition& resolved =
+      FindOrResolveDefinition(def, entity_manager);
   corgi::EntityRef entity = entity_manager->AllocateNewEntity();
-  for (uoffset_t i = 0; i < def->component_list()->size(); i++) {
-    const ComponentDefInstance* currentInstance = def->component_list()->Get(i);
-    corgi::ComponentInterface* component = entity_manager->GetComponent(
-        ConvertEnumToComponentId(currentInstance->data_type()));
-    assert(component != nullptr);
-    component->AddFromRawData(entity, currentInstance);
+  for (auto it = resolved.begin(); it != resolved.end(); ++it) {
+    it->component->AddFromRawData(entity, it->raw_data);
   }
   return entity;
 }
@@ -136,8 +166,10 @@ GameState::GameState()
       config_(nullptr),
       arrangement_(nullptr),
       sceneobject_component_(&engine_),
+      job_system_(nullptr),
       multiplayer_director_(nullptr),
       is_multiscreen_(false),
+      is_displayed_(true),
       is_in_cardboard_(false),
       use_undistort_rendering_(true) {}
 
@@ -177,18 +209,16 @@ static const CharacterArrangement* GetBestArrangement(const Config* config,
 
 // All shakeable props are tracked and handled by the shakeable prop component.
 void GameState::ShakeProps(float damage_percent, const vec3& damage_position) {
+  if (!is_displayed_) return;
   shakeable_prop_component_.ShakeProps(damage_percent, damage_position);
 
-  for (auto iter = shakeable_prop_component_.begin();
-       iter != shakeable_prop_component_.end(); ++iter) {
-    const SceneObjectData* so_data =
-        entity_manager_.GetComponentData<SceneObjectData>(iter->entity);
-    assert(so_data != nullptr);
-    float dist_squared =
-        (so_data->GlobalPosition() - damage_position).LengthSquared();
-    if (dist_squared < config_->splatter_radius_squared()) {
-      AddSplatterToProp(iter->entity);
-    }
+  splattered_props_.clear();
+  shakeable_prop_component_.FindPropsNear(
+      damage_position, sqrt(config_->splatter_radius_squared()),
+      &splattered_props_);
+  for (auto iter = splattered_props_.begin(); iter != splattered_props_.end();
+       ++iter) {
+    AddSplatterToProp(*iter);
   }
 }
 
@@ -233,6 +263,8 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
   analytics_mode_ = analytics_mode;
 
   entity_manager_.Clear();
+  pie_noon_entity_factory_.ClearResolvedDefinitions();
+  drip_and_vanish_component_.ClearFreeEntities();
   entity_manager_.RegisterComponent<SceneObjectComponent>(
       &sceneobject_component_);
   entity_manager_.RegisterComponent<ShakeablePropComponent>(
@@ -244,10 +276,18 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
   entity_manager_.RegisterComponent<CardboardPlayerComponent>(
       &cardboard_player_component_);
 
+  // Order matters: components that conflict are updated in this order.
+  component_scheduler_.Clear();
+  component_scheduler_.RegisterComponent(&shakeable_prop_component_);
+  component_scheduler_.RegisterComponent(&drip_and_vanish_component_);
+  component_scheduler_.RegisterComponent(&player_character_component_);
+  component_scheduler_.RegisterComponent(&cardboard_player_component_);
+
   // Shakable Prop Component needs to know about some of our structures:
   shakeable_prop_component_.set_engine(&engine_);
   shakeable_prop_component_.set_config(config_);
   shakeable_prop_component_.LoadMotivatorSpecs();
+  shakeable_prop_component_.ResetSpatialGrid();
   player_character_component_.set_config(config_);
   cardboard_player_component_.set_config(config_);
 
@@ -310,9 +350,35 @@ WorldTime GameState::GetAnimationTime(const Character& character) const {
   return time_ - character.state_machine()->current_state_start_time();
 }
 
-void GameState::ProcessSounds(pindrop::AudioEngine* audio_engine,
-                              const Character& character,
-                              WorldTime delta_time) const {
+uint32_t GameState::Checksum() const {
+  StateHash hash;
+  hash.Add(time_);
+  for (auto it = characters_.begin(); it != characters_.end(); ++it) {
+    const Character& character = **it;
+    hash.Add(character.health());
+    hash.Add(character.pie_damage());
+    hash.Add(character.target());
+    hash.Add(static_cast<uint32_t>(character.State()));
+    hash.Add(static_cast<int>(character.victory_state()));
+  }
+  for (auto it = pies_.begin(); it != pies_.end(); ++it) {
+    const AirbornePie& pie = **it;
+    hash.Add(pie.source());
+    hash.Add(pie.target());
+    hash.Add(pie.damage());
+    hash.Add(pie.start_time());
+    hash.Add(pie.flight_time());
+  }
+  return hash.value();
+}
+
+void GameState::ProcessSounds(const Character& character,
+                              WorldTime delta_time) {
+#ifdef PIE_NOON_HEADLESS
+  // Headless hosts run without sound.
+  (void)character;
+  (void)delta_time;
+#else
   // Process sounds in timeline.
   const Timeline* const timeline = character.CurrentTimeline();
   if (!timeline) return;
@@ -324,23 +390,25 @@ void GameState::ProcessSounds(pindrop::AudioEngine* audio_engine,
       TimelineIndexAfterTime(sounds, start_index, anim_time + delta_time);
   for (int i = start_index; i < end_index; ++i) {
     const TimelineSound& timeline_sound = *sounds->Get(i);
-    audio_engine->PlaySound(timeline_sound.sound()->c_str());
+    QueueSound(timeline_sound.sound()->c_str());
   }
 
   // If the character is trying to turn, play the turn sound.
   if (RequestedTurn(character.id())) {
-    audio_engine->PlaySound("Turning");
+    QueueSound("Turning");
   }
+#endif  // PIE_NOON_HEADLESS
 }
 
-static float CalculatePieHeight(const Config& config) {
+static float CalculatePieHeight(const Config& config, LockstepRandom* random) {
   return config.pie_arc_height() +
-         config.pie_arc_height_variance() * (mathfu::Random<float>() * 2 - 1);
+         config.pie_arc_height_variance() * (random->NextFloat() * 2 - 1);
 }
 
-static float CalculatePieRotations(const Config& config) {
+static float CalculatePieRotations(const Config& config,
+                                   LockstepRandom* random) {
   const int variance = config.pie_rotation_variance();
-  const int bonus = variance == 0 ? 0 : (rand() % (variance * 2)) - variance;
+  const int bonus = variance == 0 ? 0 : random->InRange(-variance, variance);
   return config.pie_rotations() + bonus;
 }
 
@@ -367,8 +435,9 @@ void GameState::CreatePie(CharacterId original_source_id, CharacterId source_id,
                           CharacterHealth original_damage,
                           CharacterHealth damage) {
   const float peak_height =
-      CalculatePieHeight(is_in_cardboard_ ? *cardboard_config_ : *config_);
-  const int rotations = CalculatePieRotations(*config_);
+      CalculatePieHeight(is_in_cardboard_ ? *cardboard_config_ : *config_,
+                         &random_);
+  const int rotations = CalculatePieRotations(*config_, &random_);
   const float y_rotation = CalculatePieYRotation(source_id, target_id);
   pies_.push_back(std::unique_ptr<AirbornePie>(new AirbornePie(
       original_source_id, *characters_[source_id], *characters_[target_id],
@@ -377,7 +446,7 @@ void GameState::CreatePie(CharacterId original_source_id, CharacterId source_id,
       &engine_)));
 }
 
-CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) const {
+CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) {
   switch (config_->pie_deflection_mode()) {
     case PieDeflectionMode_ToTargetOfTarget: {
       return characters_[pie.target_id]->target();
@@ -386,7 +455,7 @@ CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) const {
       return pie.source_id;
     }
     case PieDeflectionMode_ToRandom: {
-      return rand() % characters_.size();
+      return random_.InRange(0, static_cast<int>(characters_.size()));
     }
     default: {
       assert(0);
@@ -412,8 +481,7 @@ static GameCameraMovement CalculateCameraMovement(
   return movement;
 }
 
-void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
-                             Character* character, unsigned int event,
+void GameState::ProcessEvent(Character* character, unsigned int event,
                              const EventData& event_data) {
   bool is_ai_player =
       character->controller()->controller_type() == Controller::kTypeAI;
@@ -435,19 +503,15 @@ void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
           bool hit_self = pie.original_source_id == pie.target_id;
           bool direct = pie.original_damage == pie.damage;
           const char* action = is_ai_player ? kActionHitAi : kActionHitPlayer;
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, hit_self ? kLabelHitSelf : kLabelHitOther,
-                           pie.damage);
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, direct ? kLabelDirectHit : kLabelIndirectHit,
-                           pie.damage);
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, kLabelSizeDelta,
-                           pie.original_damage - pie.damage);
+          QueueTrackerEvent(action, hit_self ? kLabelHitSelf : kLabelHitOther,
+                            pie.damage);
+          QueueTrackerEvent(action,
+                            direct ? kLabelDirectHit : kLabelIndirectHit,
+                            pie.damage);
+          QueueTrackerEvent(action, kLabelSizeDelta,
+                            pie.original_damage - pie.damage);
           if (character->health() <= 0) {
-            SendTrackerEvent(
-                is_multiscreen() ? kCategoryGameMSX : kCategoryGame, action,
-                kLabelKnockOut, time_);
+            QueueTrackerEvent(action, kLabelKnockOut, time_);
           }
         }
         ApplyScoringRule(config_->scoring_rules(), ScoreEvent_HitByPie,
@@ -484,8 +548,7 @@ void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
       if (analytics_mode_ == kTrackAnalytics) {
         const char* action =
             is_ai_player ? kActionAiThrewPie : kActionHumanThrewPie;
-        SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                         action, kLabelSize, character->pie_damage());
+        QueueTrackerEvent(action, kLabelSize, character->pie_damage());
       }
       ApplyScoringRule(config_->scoring_rules(), ScoreEvent_ThrewPie,
                        character->pie_damage(), character);
@@ -501,7 +564,7 @@ void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
             config_->blocked_sound_id_for_pie_damage()->Length() - 1);
         const auto& sound_name =
             config_->blocked_sound_id_for_pie_damage()->Get(index);
-        audio_engine->PlaySound(sound_name->c_str());
+        QueueSound(sound_name->c_str());
 
         const CharacterHealth deflected_pie_damage =
             pie.damage + config_->pie_damage_change_when_deflected();
@@ -510,14 +573,13 @@ void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
                     DetermineDeflectionTarget(pie), pie.original_damage,
                     deflected_pie_damage);
         }
-        CreatePieSplatter(audio_engine, *character, 1);
+        CreatePieSplatter(*character, 1);
         character->IncrementStat(kBlocks);
         characters_[pie.source_id]->IncrementStat(kMisses);
         if (analytics_mode_ == kTrackAnalytics) {
           const char* action =
               is_ai_player ? kActionAiDeflected : kActionPlayerDeflected;
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, kLabelSize, pie.damage);
+          QueueTrackerEvent(action, kLabelSize, pie.damage);
         }
         ApplyScoringRule(config_->scoring_rules(), ScoreEvent_DeflectedPie,
                          character->pie_damage(), character);
@@ -548,8 +610,11 @@ void GameState::AddSplatterToProp(corgi::EntityRef prop) {
       RenderableId_Splatter1, RenderableId_Splatter2, RenderableId_Splatter3};
   if (entity_manager_.GetComponent<SceneObjectComponent>()->HasDataForEntity(
           prop)) {
-    corgi::EntityRef splatter =
-        entity_manager_.CreateEntityFromData(config_->splatter_def());
+    // Reuse a splatter that has finished dripping, if there is one.
+    corgi::EntityRef splatter = drip_and_vanish_component_.ReuseFreeEntity();
+    if (!splatter.IsValid()) {
+      splatter = entity_manager_.CreateEntityFromData(config_->splatter_def());
+    }
     auto so_data = entity_manager_.GetComponentData<SceneObjectData>(splatter);
 
     so_data->set_renderable_id(id_list[mathfu::RandomInRange(0, 3)]);
@@ -573,8 +638,7 @@ void GameState::AddSplatterToProp(corgi::EntityRef prop) {
   }
 }
 
-void GameState::ProcessEvents(pindrop::AudioEngine* audio_engine,
-                              Character* character, EventData* event_data,
+void GameState::ProcessEvents(Character* character, EventData* event_data,
                               WorldTime delta_time) {
   // Process events in timeline.
   const Timeline* const timeline = character->CurrentTimeline();
@@ -589,7 +653,7 @@ void GameState::ProcessEvents(pindrop::AudioEngine* audio_engine,
   for (int i = start_index; i < end_index; ++i) {
     const TimelineEvent* event = events->Get(i);
     event_data->pie_damage = event->modifier();
-    ProcessEvent(audio_engine, character, event->event(), *event_data);
+    ProcessEvent(character, event->event(), *event_data);
   }
 }
 
@@ -603,8 +667,7 @@ void GameState::PopulateConditionInputs(ConditionInputs* condition_inputs,
   condition_inputs->is_multiscreen = is_multiscreen();
 }
 
-void GameState::ProcessConditionalEvents(pindrop::AudioEngine* audio_engine,
-                                         Character* character,
+void GameState::ProcessConditionalEvents(Character* character,
                                          EventData* event_data) {
   auto current_state = character->state_machine()->current_state();
   if (current_state && current_state->conditional_events()) {
@@ -617,7 +680,7 @@ void GameState::ProcessConditionalEvents(pindrop::AudioEngine* audio_engine,
       if (EvaluateCondition(conditional_event->condition(), condition_inputs)) {
         unsigned int event = conditional_event->event();
         event_data->pie_damage = conditional_event->modifier();
-        ProcessEvent(audio_engine, character, event, *event_data);
+        ProcessEvent(character, event, *event_data);
       }
     }
   }
@@ -888,45 +951,35 @@ uint32_t GameState::AllLogicalInputs() const {
 }
 
 // Creates a bunch of particles when a character gets hit by a pie.
-void GameState::CreatePieSplatter(pindrop::AudioEngine* audio_engine,
-                                  const Character& character,
+void GameState::CreatePieSplatter(const Character& character,
                                   CharacterHealth damage) {
-  const ParticleDef* def = config_->pie_splatter_def();
   SpawnParticles(
-      character.position(), def,
+      character.position(), config_cache_.pie_splatter(),
       static_cast<int>(damage) * config_->pie_noon_particles_per_damage());
   // Play a pie hit sound based upon the amount of damage applied (size of the
   // pie).
   const CharacterHealth index = mathfu::Clamp<CharacterHealth>(
       damage, 0, config_->hit_sound_id_for_pie_damage()->Length() - 1);
   const auto& sound_name = config_->hit_sound_id_for_pie_damage()->Get(index);
-  audio_engine->PlaySound(sound_name->c_str());
+  QueueSound(sound_name->c_str());
 }
 
 // Creates confetti when a character presses buttons on the join screen.
 void GameState::CreateJoinConfettiBurst(const Character& character) {
-  const ParticleDef* def = config_->joining_confetti_def();
   vec3 character_color =
       LoadVec3(config_->character_colors()->Get(character.id()));
   SpawnParticles(
-      character.position(), def, config_->joining_confetti_count(),
+      character.position(), config_cache_.joining_confetti(),
+      config_->joining_confetti_count(),
       vec4(character_color.x(), character_color.y(), character_color.z(), 1));
 }
 
 // Spawns a particle at the given position, using a particle definition.
 void GameState::SpawnParticles(const mathfu::vec3& position,
-                               const ParticleDef* def, const int particle_count,
+                               const ParticleRanges& def,
+                               const int particle_count,
                                const mathfu::vec4& base_tint) {
-  const vec3 min_scale = LoadVec3(def->min_scale());
-  const vec3 max_scale = LoadVec3(def->max_scale());
-  const vec3 min_velocity = LoadVec3(def->min_velocity());
-  const vec3 max_velocity = LoadVec3(def->max_velocity());
-  const vec3 min_angular_velocity = LoadVec3(def->min_angular_velocity());
-  const vec3 max_angular_velocity = LoadVec3(def->max_angular_velocity());
-  const vec3 min_position_offset = LoadVec3(def->min_position_offset());
-  const vec3 max_position_offset = LoadVec3(def->max_position_offset());
-  const vec3 min_orientation_offset = LoadVec3(def->min_orientation_offset());
-  const vec3 max_orientation_offset = LoadVec3(def->max_orientation_offset());
+  if (!is_displayed_ || def.renderables.empty() || def.tints.empty()) return;
 
   const Angle to_position = Angle::FromXZVector(position - camera().Position());
   const vec3 additional_rotation =
@@ -940,36 +993,36 @@ void GameState::SpawnParticles(const mathfu::vec3& position,
       break;
     }
     p->set_base_scale(
-        def->preserve_aspect()
-            ? vec3(mathfu::RandomInRange(min_scale.x(), max_scale.x()))
-            : vec3::RandomInRange(min_scale, max_scale));
-
-    p->set_base_velocity(vec3::RandomInRange(min_velocity, max_velocity));
-    p->set_acceleration(LoadVec3(def->acceleration()));
-    p->set_renderable_id(def->renderable()->Get(
-        mathfu::RandomInRange<int>(0, def->renderable()->size())));
-    mathfu::vec4 tint = LoadVec4(
-        def->tint()->Get(mathfu::RandomInRange<int>(0, def->tint()->size())));
+        def.preserve_aspect
+            ? vec3(mathfu::RandomInRange(def.min_scale.x(), def.max_scale.x()))
+            : vec3::RandomInRange(def.min_scale, def.max_scale));
+
+    p->set_base_velocity(
+        vec3::RandomInRange(def.min_velocity, def.max_velocity));
+    p->set_acceleration(def.acceleration);
+    p->set_renderable_id(def.renderables[mathfu::RandomInRange<int>(
+        0, static_cast<int>(def.renderables.size()))]);
+    const vec4 tint(def.tints[mathfu::RandomInRange<int>(
+        0, static_cast<int>(def.tints.size()))]);
     p->set_base_tint(
         mathfu::vec4(tint.x() * base_tint.x(), tint.y() * base_tint.y(),
                      tint.z() * base_tint.z(), tint.w() * base_tint.w()));
-    p->set_duration(static_cast<float>(mathfu::RandomInRange<int32_t>(
-        def->min_duration(), def->max_duration())));
-    p->set_base_position(position + vec3::RandomInRange(min_position_offset,
-                                                        max_position_offset));
+    p->set_duration(static_cast<float>(
+        mathfu::RandomInRange<int32_t>(def.min_duration, def.max_duration)));
+    p->set_base_position(position +
+                         vec3::RandomInRange(def.min_position_offset,
+                                             def.max_position_offset));
     p->set_base_orientation(
-        additional_rotation +
-        vec3::RandomInRange(min_orientation_offset, max_orientation_offset));
-    p->set_rotational_velocity(
-        vec3::RandomInRange(min_angular_velocity, max_angular_velocity));
-    p->set_duration_of_shrink_out(
-        static_cast<TimeStep>(def->shrink_duration()));
-    p->set_duration_of_fade_out(static_cast<TimeStep>(def->fade_duration()));
+        additional_rotation + vec3::RandomInRange(def.min_orientation_offset,
+                                                  def.max_orientation_offset));
+    p->set_rotational_velocity(vec3::RandomInRange(def.min_angular_velocity,
+                                                   def.max_angular_velocity));
+    p->set_duration_of_shrink_out(static_cast<TimeStep>(def.shrink_duration));
+    p->set_duration_of_fade_out(static_cast<TimeStep>(def.fade_duration));
   }
 }
 
-void GameState::AdvanceFrame(WorldTime delta_time,
-                             pindrop::AudioEngine* audio_engine) {
+void GameState::AdvanceFrame(WorldTime delta_time) {
   // Increment the world time counter. This happens at the start of the
   // function so that functions that reference the current world time will
   // include the delta_time. For example, GetAnimationTime needs to compare
@@ -983,7 +1036,7 @@ void GameState::AdvanceFrame(WorldTime delta_time,
                        countdown_timer_);
     }
   }
-  SpawnParticles(mathfu::vec3(0, 10, 0), config_->confetti_def(), 1);
+  SpawnParticles(mathfu::vec3(0, 10, 0), config_cache_.confetti(), 1);
 
   // Damage is queued up per character then applied during event processing.
   std::vector<EventData> event_data(characters_.size());
@@ -1016,7 +1069,9 @@ void GameState::AdvanceFrame(WorldTime delta_time,
   }
 
   // Update all the particles.
-  particle_manager_.AdvanceFrame(static_cast<TimeStep>(delta_time));
+  if (is_displayed_) {
+    particle_manager_.AdvanceFrame(static_cast<TimeStep>(delta_time));
+  }
 
   // Update pies. Modify state machine input when character hit by pie.
   for (auto it = pies_.begin(); it != pies_.end();) {
@@ -1032,7 +1087,7 @@ void GameState::AdvanceFrame(WorldTime delta_time,
       event_data[pie->target()].received_pies.push_back(received_pie);
       character->controller()->SetLogicalInputs(LogicalInputs_JustHit, true);
       if (character->State() != StateId_Blocking)
-        CreatePieSplatter(audio_engine, *character, pie->damage());
+        CreatePieSplatter(*character, pie->damage());
       it = pies_.erase(it);
     } else {
       ++it;
@@ -1066,31 +1121,66 @@ void GameState::AdvanceFrame(WorldTime delta_time,
 
   // Look to timeline to see what's happening. Make it happen.
   for (unsigned int i = 0; i < characters_.size(); ++i) {
-    ProcessEvents(audio_engine, characters_[i].get(), &event_data[i],
-                  delta_time);
+    ProcessEvents(characters_[i].get(), &event_data[i], delta_time);
   }
 
   for (unsigned int i = 0; i < characters_.size(); ++i) {
-    ProcessConditionalEvents(audio_engine, characters_[i].get(),
-                             &event_data[i]);
+    ProcessConditionalEvents(characters_[i].get(), &event_data[i]);
   }
 
   // Play the sounds that need to be played at this point in time.
   for (unsigned int i = 0; i < characters_.size(); ++i) {
-    ProcessSounds(audio_engine, *characters_[i].get(), delta_time);
+    ProcessSounds(*characters_[i].get(), delta_time);
   }
 
-  // Update entities.
-  entity_manager_.UpdateComponents(delta_time);
+  // Update entities. The scheduler replaces EntityManager::UpdateComponents(),
+  // so we also have to flush the entities deleted during the update.
+  component_scheduler_.UpdateComponents(delta_time);
+  entity_manager_.DeleteMarkedEntities();
 
   // Update all Motivators. Motivator updates are done in bulk for scalability.
   // Must come after entity_manager_'s update because matrix Motivators are
   // modified by Components.
   engine_.AdvanceFrame(delta_time);
 
+  // Keep the prop grid in sync with where the props now are, for next frame's
+  // shake and splatter queries. Headless rooms never populate a scene, so this
+  // can't wait for PopulateScene(), which reuses these matrices instead.
+  if (is_displayed_) {
+    sceneobject_component_.AdvanceFrame();
+    shakeable_prop_component_.UpdateSpatialGrid();
+  }
+
   camera_.AdvanceFrame(delta_time);
 }
 
+void GameState::QueueSound(const char* name) {
+  pending_sounds_.push_back(name);
+}
+
+void GameState::QueueTrackerEvent(const char* action, const char* label,
+                                  int value) {
+  const TrackerEvent event = {
+      is_multiscreen() ? kCategoryGameMSX : kCategoryGame, action, label,
+      value};
+  pending_tracker_events_.push_back(event);
+}
+
+void GameState::FlushSideEffects(pindrop::AudioEngine* audio_engine) {
+  for (auto it = pending_sounds_.begin(); it != pending_sounds_.end(); ++it) {
+    PlaySound(audio_engine, *it);
+  }
+  pending_sounds_.clear();
+  for (auto it = pending_tracker_events_.begin();
+       it != pending_tracker_events_.end(); ++it) {
+    SendTrackerEvent(it->category, it->action, it->label, it->value);
+  }
+  pending_tracker_events_.clear();
+  if (multiplayer_director_ != nullptr) {
+    multiplayer_director_->FlushPendingSends();
+  }
+}
+
 void GameState::PreGameLogging() const {
   SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
                    kActionStartedGame, EnumNameGameMode(config_->game_mode()),
@@ -1133,12 +1223,35 @@ class CharacterDepthComparer {
 };
 
 // Add anything in the list of particles into the scene description:
-void GameState::AddParticlesToScene(SceneDescription* scene) const {
-  auto plist = particle_manager_.get_particle_list();
-  for (auto it = plist.begin(); it != plist.end(); ++it) {
-    scene->renderables().push_back(std::unique_ptr<Renderable>(
-        new Renderable((*it)->renderable_id(), 0, (*it)->CalculateMatrix(),
-                       (*it)->CurrentTint())));
+void GameState::AddParticlesToScene(SceneDescription* scene) {
+  // Below this many particles, it's not worth handing a batch to another
+  // thread.
+  static const int kMinParticlesPerBatch = 64;
+
+  const auto& plist = particle_manager_.get_particle_list();
+  scene_particles_.clear();
+  scene_particles_.insert(scene_particles_.end(), plist.begin(), plist.end());
+  const std::vector<const Particle*>& particles = scene_particles_;
+  const int num_particles = static_cast<int>(particles.size());
+
+  // Each batch fills in its own slots, so no locking is needed.
+  auto& renderables = scene->renderables();
+  const size_t first = renderables.size();
+  renderables.resize(first + num_particles);
+  auto add_particles = [&particles, &renderables, first](int begin, int end,
+                                                         int) {
+    for (int i = begin; i < end; ++i) {
+      const Particle* particle = particles[i];
+      renderables[first + i].reset(new Renderable(
+          particle->renderable_id(), 0, particle->CalculateMatrix(),
+          particle->CurrentTint()));
+    }
+  };
+  if (job_system_ == nullptr) {
+    add_particles(0, num_particles, 0);
+  } else {
+    job_system_->ParallelFor(num_particles, kMinParticlesPerBatch,
+                             add_particles);
   }
 }
 
@@ -1146,6 +1259,7 @@ void GameState::PopulateScene(SceneDescription* scene) {
   scene->Clear();
   // Camera.
   scene->set_camera(CameraMatrix());
+  scene->set_camera_position(camera().Position());
   AddParticlesToScene(scene);
   sceneobject_component_.PopulateScene(scene);
 
@@ -16,16 +16,20 @@
 #define GAME_STATE_H_
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include "character.h"
+#include "component_scheduler.h"
 #include "components/cardboard_player.h"
 #include "components/drip_and_vanish.h"
 #include "components/player_character.h"
 #include "components/scene_object.h"
 #include "components/shakeable_prop.h"
+#include "config_cache.h"
 #include "corgi/entity.h"
 #include "corgi/entity_manager.h"
 #include "game_camera.h"
+#include "lockstep.h"
 #include "motive/engine.h"
 #include "motive/processor.h"
 #include "motive/util.h"
@@ -45,12 +49,35 @@ struct Config;
 struct CharacterArrangement;
 struct EventData;
 struct ReceivedPie;
+class JobSystem;
 class MultiplayerDirector;
 
+// Converts EntityDefinitions into entities. Each definition's component list is
+// resolved once--the component to add each entry to, and the raw data to hand
+// it--so that spawning the same definition again doesn't map union types to
+// component ids. Each component still reads its defaults from the FlatBuffer
+// in AddFromRawData().
 class PieNoonEntityFactory : public corgi::EntityFactoryInterface {
  public:
   virtual corgi::EntityRef CreateEntityFromData(
       const void* data, corgi::EntityManager* entity_manager);
+
+  // Forget all resolved definitions. Must be called whenever the components
+  // are re-registered or the definitions they point into are unloaded.
+  void ClearResolvedDefinitions() { resolved_definitions_.clear(); }
+
+ private:
+  struct ResolvedComponent {
+    corgi::ComponentInterface* component;
+    const void* raw_data;
+  };
+  typedef std::vector<ResolvedComponent> ResolvedDefinition;
+
+  const ResolvedDefinition& FindOrResolveDefinition(
+      const EntityDefinition* def, corgi::EntityManager* entity_manager);
+
+  std::unordered_map<const EntityDefinition*, ResolvedDefinition>
+      resolved_definitions_;
 };
 
 class GameState {
@@ -68,8 +95,15 @@ class GameState {
   void Reset(AnalyticsMode analytics_mode);
   void Reset();
 
-  // Update controller and state machine for each character.
-  void AdvanceFrame(WorldTime delta_time, pindrop::AudioEngine* audio_engine);
+  // Update controller and state machine for each character. Touches nothing
+  // outside the game state, so may run on a job system thread: the sounds,
+  // analytics events and multiscreen messages it causes are queued until
+  // FlushSideEffects().
+  void AdvanceFrame(WorldTime delta_time);
+
+  // Play and send what AdvanceFrame() queued. Call on the main thread, after
+  // every AdvanceFrame(). 'audio_engine' may be null, to run without sound.
+  void FlushSideEffects(pindrop::AudioEngine* audio_engine);
 
   // To be run before starting a game and after ending one to log data about
   // gameplay.
@@ -124,7 +158,13 @@ class GameState {
 
   WorldTime time() const { return time_; }
 
-  void set_config(const Config* config) { config_ = config; }
+  // Also decodes the parts of 'config' that are read every frame. Call this
+  // again if the Config changes.
+  void set_config(const Config* config) {
+    config_ = config;
+    if (config != nullptr) config_cache_.Build(*config);
+  }
+  const ConfigCache& config_cache() const { return config_cache_; }
 
   void set_cardboard_config(const Config* config) {
     cardboard_config_ = config;
@@ -133,6 +173,13 @@ class GameState {
   motive::MotiveEngine& engine() { return engine_; }
   ParticleManager& particle_manager() { return particle_manager_; }
 
+  // Component updates and scene building are spread over the threads in
+  // 'job_system'. You must ensure it stays in memory as long as GameState does.
+  void set_job_system(JobSystem* job_system) {
+    job_system_ = job_system;
+    component_scheduler_.set_job_system(job_system);
+  }
+
   // Sets up the players in joining mode, where all they can do is jump up
   // and down.
   void EnterJoiningMode();
@@ -152,20 +199,35 @@ class GameState {
   void set_is_in_cardboard(bool b) { is_in_cardboard_ = b; }
   bool is_in_cardboard() const { return is_in_cardboard_; }
 
+  // Set to false to skip the effects that only show in the scene--particles,
+  // shaking props and their matrices--when nobody will see it.
+  void set_is_displayed(bool b) { is_displayed_ = b; }
+  bool is_displayed() const { return is_displayed_; }
+
   void set_use_undistort_rendering(bool b) { use_undistort_rendering_ = b; }
   bool use_undistort_rendering() { return use_undistort_rendering_; }
 
+  // Everything random that affects the game comes from here, so that games
+  // given the same seed and inputs play out the same. Purely cosmetic
+  // randomness, like particles, doesn't need to.
+  LockstepRandom& random() { return random_; }
+
+  // Hash of everything that decides the game's outcome, for checking that
+  // games running in lockstep haven't drifted apart.
+  uint32_t Checksum() const;
+
  private:
-  void ProcessSounds(pindrop::AudioEngine* audio_engine,
-                     const Character& character, WorldTime delta_time) const;
+  void ProcessSounds(const Character& character, WorldTime delta_time);
+  void QueueSound(const char* name);
+  void QueueTrackerEvent(const char* action, const char* label, int value);
   void CreatePie(CharacterId original_source_id, CharacterId source_id,
                  CharacterId target_id, CharacterHealth original_damage,
                  CharacterHealth damage);
   float CalculatePieYRotation(CharacterId source_id,
                               CharacterId target_id) const;
-  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie) const;
-  void ProcessEvent(pindrop::AudioEngine* audio_engine, Character* character,
-                    unsigned int event, const EventData& event_data);
+  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie);
+  void ProcessEvent(Character* character, unsigned int event,
+                    const EventData& event_data);
   void PopulateConditionInputs(ConditionInputs* condition_inputs,
                                const Character& character) const;
   void PopulateCharacterAccessories(SceneDescription* scene,
@@ -173,10 +235,9 @@ class GameState {
                                     const mathfu::mat4& character_matrix,
                                     int num_accessories, int damage,
                                     int health) const;
-  void ProcessConditionalEvents(pindrop::AudioEngine* audio_engine,
-                                Character* character, EventData* event_data);
-  void ProcessEvents(pindrop::AudioEngine* audio_engine, Character* character,
-                     EventData* data, WorldTime delta_time);
+  void ProcessConditionalEvents(Character* character, EventData* event_data);
+  void ProcessEvents(Character* character, EventData* data,
+                     WorldTime delta_time);
   void UpdatePiePosition(AirbornePie* pie) const;
   CharacterId CalculateCharacterTarget(CharacterId id) const;
   float CalculateCharacterFacingAngleVelocity(const Character* character,
@@ -186,11 +247,11 @@ class GameState {
   motive::Angle TiltCharacterAwayFromCamera(CharacterId id,
                                             const motive::Angle angle) const;
   motive::TwitchDirection FakeResponseToTurn(CharacterId id) const;
-  void AddParticlesToScene(SceneDescription* scene) const;
-  void CreatePieSplatter(pindrop::AudioEngine* audio_engine,
-                         const Character& character, int damage);
+  void AddParticlesToScene(SceneDescription* scene);
+  void CreatePieSplatter(const Character& character, int damage);
   void CreateJoinConfettiBurst(const Character& character);
-  void SpawnParticles(const mathfu::vec3& position, const ParticleDef* def,
+  void SpawnParticles(const mathfu::vec3& position,
+                      const ParticleRanges& def,
                       const int particle_count,
                       const mathfu::vec4& base_tint = mathfu::vec4(1, 1, 1, 1));
   void ShakeProps(float percent, const mathfu::vec3& damage_position);
@@ -205,12 +266,29 @@ class GameState {
   GameCameraState camera_base_;
   std::vector<std::unique_ptr<Character>> characters_;
   std::vector<std::unique_ptr<AirbornePie>> pies_;
+  LockstepRandom random_;
   motive::MotiveEngine engine_;
   const Config* config_;
+  // The hot parts of config_, decoded.
+  ConfigCache config_cache_;
   const CharacterArrangement* arrangement_;
   ParticleManager particle_manager_;
+  // Scratch space for the particles being added to the scene, so that they
+  // can be split into batches. Reused every frame.
+  std::vector<const Particle*> scene_particles_;
   AnalyticsMode analytics_mode_;
 
+  // What this frame wants played and sent, for FlushSideEffects(). Sound
+  // names point into the config, which outlives them.
+  struct TrackerEvent {
+    const char* category;
+    const char* action;
+    const char* label;
+    int value;
+  };
+  std::vector<const char*> pending_sounds_;
+  std::vector<TrackerEvent> pending_tracker_events_;
+
   // Entity manager that tracks all of our entities.
   corgi::EntityManager entity_manager_;
   // Entity factory for creating entities from flatbuffers:
@@ -220,6 +298,8 @@ class GameState {
   SceneObjectComponent sceneobject_component_;
   // Component for handling static, swaying props in the background.
   ShakeablePropComponent shakeable_prop_component_;
+  // Scratch space for the props that get splattered when a pie lands.
+  std::vector<corgi::EntityRef> splattered_props_;
   // Component for scenery-splatter behavior.
   DripAndVanishComponent drip_and_vanish_component_;
   // Component for drawing player characters:
@@ -227,11 +307,18 @@ class GameState {
   // Component for drawing Cardboard mode information.
   CardboardPlayerComponent cardboard_player_component_;
 
+  // Runs the component updates, in parallel where they don't conflict.
+  ComponentScheduler component_scheduler_;
+  // Threads for the frame's parallel work. Null to do it all on this thread.
+  JobSystem* job_system_;
+
   // For multi-screen mode.
   MultiplayerDirector* multiplayer_director_;
 
   // Whether you are playing in multiscreen mode.
   bool is_multiscreen_;
+  // Whether the scene is ever rendered.
+  bool is_displayed_;
 
   const Config* cardboard_config_;
   // Whether you are playing in Cardboard mode.
@@ -19,30 +19,33 @@
 
 namespace fpl {
 
+// Room for a few turns' worth of messages from every player.
+static const size_t kIncomingMessageCapacity = 256;
+// Enough for any message we send, so the ring never has to grow its slots.
+static const size_t kReservedMessageSize = 512;
+
 GPGMultiplayer::GPGMultiplayer()
-    : message_mutex_(PTHREAD_MUTEX_INITIALIZER),
+    : transport_listener_(this),
+      instance_snapshot_(nullptr),
+      snapshot_readers_(0),
+      current_snapshot_(new InstanceMap()),
+      incoming_messages_(kIncomingMessageCapacity, kReservedMessageSize),
       instance_mutex_(PTHREAD_MUTEX_INITIALIZER),
-      state_mutex_(PTHREAD_MUTEX_INITIALIZER) {}
+      state_mutex_(PTHREAD_MUTEX_INITIALIZER) {
+  instance_snapshot_ = current_snapshot_.get();
+}
 
-bool GPGMultiplayer::Initialize(const std::string& service_id) {
+bool GPGMultiplayer::Initialize(const std::string& service_id,
+                                MultiplayerTransport* transport) {
   state_ = kIdle;
   is_hosting_ = false;
   allow_reconnecting_ = true;
 
-  service_id_ = service_id;
-  gpg::AndroidPlatformConfiguration platform_configuration;
-  platform_configuration.SetActivity((jobject)fplbase::AndroidGetActivity());
-
-  gpg::NearbyConnections::Builder nearby_builder;
-  nearby_connections_ = nearby_builder.SetDefaultOnLog(gpg::LogLevel::VERBOSE)
-                            .SetServiceId(service_id_)
-                            .Create(platform_configuration);
-  discovery_listener_.reset(nullptr);
-  message_listener_.reset(nullptr);
-
-  if (nearby_connections_ == nullptr) {
+  transport_.reset(transport);
+  if (transport_ == nullptr ||
+      !transport_->Initialize(service_id, &transport_listener_)) {
     fplbase::LogError(fplbase::kApplication,
-             "GPGMultiplayer: Unable to build a NearbyConnections instance.");
+                      "GPGMultiplayer: Unable to initialize the transport.");
     return false;
   }
 
@@ -50,9 +53,7 @@ bool GPGMultiplayer::Initialize(const std::string& service_id) {
 }
 
 void GPGMultiplayer::AddAppIdentifier(const std::string& identifier) {
-  gpg::AppIdentifier id;
-  id.identifier = identifier;
-  app_identifiers_.push_back(id);
+  transport_->AddAppIdentifier(identifier);
 }
 
 void GPGMultiplayer::StartAdvertising() { QueueNextState(kAdvertising); }
@@ -88,22 +89,20 @@ void GPGMultiplayer::ResetToIdle() {
 
   pthread_mutex_lock(&instance_mutex_);
   connected_instances_.clear();
-  connected_instances_reverse_.clear();
+  UpdateConnectedInstances();
   instance_names_.clear();
   pending_instances_.clear();
   discovered_instances_.clear();
   pthread_mutex_unlock(&instance_mutex_);
 
-  pthread_mutex_lock(&message_mutex_);
-  while (!incoming_messages_.empty()) incoming_messages_.pop();
-  pthread_mutex_unlock(&message_mutex_);
+  incoming_messages_.Clear();
 }
 
 void GPGMultiplayer::DisconnectInstance(const std::string& instance_id) {
   fplbase::LogInfo(fplbase::kApplication,
           "GPGMultiplayer: Disconnect player (instance_id='%s')",
           instance_id.c_str());
-  nearby_connections_->Disconnect(instance_id);
+  transport_->Disconnect(instance_id);
 
   pthread_mutex_lock(&instance_mutex_);
   auto i = std::find(connected_instances_.begin(), connected_instances_.end(),
@@ -129,7 +128,7 @@ void GPGMultiplayer::DisconnectAll() {
   // Disconnect anyone we are connected to.
   pthread_mutex_lock(&instance_mutex_);
   for (const auto& instance : connected_instances_) {
-    nearby_connections_->Disconnect(instance);
+    transport_->Disconnect(instance);
   }
   connected_instances_.clear();
   UpdateConnectedInstances();
@@ -142,60 +141,20 @@ void GPGMultiplayer::DisconnectAll() {
 
 void GPGMultiplayer::SendConnectionRequest(
     const std::string& host_instance_id) {
-  if (message_listener_ == nullptr) {
-    message_listener_.reset(new MessageListener(
-        [this](const std::string& instance_id,
-               std::vector<uint8_t> const& payload, bool is_reliable) {
-          fplbase::LogInfo(fplbase::kApplication,
-                  "GPGMultiplayer: OnMessageReceived(%s) callback",
-                  instance_id.c_str());
-          this->MessageReceivedCallback(instance_id, payload, is_reliable);
-        },
-        [this](const std::string& instance_id) {
-          fplbase::LogInfo(fplbase::kApplication,
-                  "GPGMultiplayer: OnDisconnect(%s) callback",
-                  instance_id.c_str());
-          this->DisconnectedCallback(instance_id);
-        }));
-  }
   LogInfo(fplbase::kApplication,
           "GPGMultiplayer: Sending connection request to %s",
           host_instance_id.c_str());
 
   // Immediately stop discovery once we start connecting.
-  nearby_connections_->SendConnectionRequest(
-      my_instance_name_, host_instance_id, std::vector<uint8_t>{},
-      [this](int64_t client_id, gpg::ConnectionResponse const& response) {
-        LogInfo(fplbase::kApplication,
-                "GPGMultiplayer: OnConnectionResponse() callback");
-        this->ConnectionResponseCallback(response);
-      },
-      message_listener_.get());
+  transport_->SendConnectionRequest(my_instance_name_, host_instance_id);
 }
 
 void GPGMultiplayer::AcceptConnectionRequest(
     const std::string& client_instance_id) {
-  if (message_listener_ == nullptr) {
-    message_listener_.reset(new MessageListener(
-        [this](const std::string& instance_id,
-               std::vector<uint8_t> const& payload, bool is_reliable) {
-          fplbase::LogInfo(fplbase::kApplication,
-                  "GPGMultiplayer: OnMessageReceived(%s) callback",
-                  instance_id.c_str());
-          this->MessageReceivedCallback(instance_id, payload, is_reliable);
-        },
-        [this](const std::string& instance_id) {
-          fplbase::LogInfo(fplbase::kApplication,
-                  "GPGMultiplayer: OnDisconnect(%s) callback",
-                  instance_id.c_str());
-          this->DisconnectedCallback(instance_id);
-        }));
-  }
   fplbase::LogInfo(fplbase::kApplication,
                    "GPGMultiplayer: Accepting connection from %s",
           client_instance_id.c_str());
-  nearby_connections_->AcceptConnectionRequest(
-      client_instance_id, std::vector<uint8_t>{}, message_listener_.get());
+  transport_->AcceptConnectionRequest(client_instance_id);
 
   pthread_mutex_lock(&instance_mutex_);
   AddNewConnectedInstance(client_instance_id);
@@ -212,7 +171,7 @@ void GPGMultiplayer::RejectConnectionRequest(
     const std::string& client_instance_id) {
   LogInfo(fplbase::kApplication, "GPGMultiplayer: Rejecting connection from %s",
           client_instance_id.c_str());
-  nearby_connections_->RejectConnectionRequest(client_instance_id);
+  transport_->RejectConnectionRequest(client_instance_id);
 
   pthread_mutex_lock(&instance_mutex_);
   auto i = std::find(pending_instances_.begin(), pending_instances_.end(),
@@ -226,7 +185,7 @@ void GPGMultiplayer::RejectConnectionRequest(
 void GPGMultiplayer::RejectAllConnectionRequests() {
   pthread_mutex_lock(&instance_mutex_);
   for (const auto& instance_id : pending_instances_) {
-    nearby_connections_->RejectConnectionRequest(instance_id);
+    transport_->RejectConnectionRequest(instance_id);
   }
   pending_instances_.clear();
   pthread_mutex_unlock(&instance_mutex_);
@@ -362,6 +321,8 @@ void GPGMultiplayer::Update() {
       break;
     }
   }
+
+  UpdateTelemetry();
 }
 
 void GPGMultiplayer::TransitionState(MultiplayerState old_state,
@@ -378,7 +339,7 @@ void GPGMultiplayer::TransitionState(MultiplayerState old_state,
       if (new_state != kDiscoveringPromptedUser &&
           new_state != kDiscoveringWaitingForHost &&
           new_state != kDiscovering) {
-        nearby_connections_->StopDiscovery(service_id_);
+        transport_->StopDiscovery();
         fplbase::LogInfo(fplbase::kApplication,
                          "GPGMultiplayer: Stopped discovery.");
       }
@@ -390,7 +351,7 @@ void GPGMultiplayer::TransitionState(MultiplayerState old_state,
       // Make sure we are totally leaving the "advertising" world.
       if (new_state != kAdvertising && new_state != kAdvertisingPromptedUser &&
           new_state != kConnectedWithDisconnections) {
-        nearby_connections_->StopAdvertising();
+        transport_->StopAdvertising();
         fplbase::LogInfo(fplbase::kApplication,
                          "GPGMultiplayer: Stopped advertising");
       }
@@ -421,18 +382,7 @@ void GPGMultiplayer::TransitionState(MultiplayerState old_state,
 
       if (old_state != kAdvertising && old_state != kAdvertisingPromptedUser &&
           old_state != kConnectedWithDisconnections) {
-        nearby_connections_->StartAdvertising(
-            my_instance_name_, app_identifiers_, gpg::Duration::zero(),
-            [this](int64_t client_id,
-                   gpg::StartAdvertisingResult const& result) {
-              fplbase::LogInfo(fplbase::kApplication,
-                      "GPGMultiplayer: StartAdvertising callback");
-              this->StartAdvertisingCallback(result);
-            },
-            [this](int64_t client_id,
-                   gpg::ConnectionRequest const& connection_request) {
-              this->ConnectionRequestCallback(connection_request);
-            });
+        transport_->StartAdvertising(my_instance_name_);
         fplbase::LogInfo(fplbase::kApplication,
                          "GPGMultiplayer: Starting advertising");
       }
@@ -444,17 +394,7 @@ void GPGMultiplayer::TransitionState(MultiplayerState old_state,
 
       if (old_state != kDiscoveringWaitingForHost &&
           old_state != kDiscoveringPromptedUser) {
-        if (discovery_listener_ == nullptr) {
-          discovery_listener_.reset(new DiscoveryListener(
-              [this](gpg::EndpointDetails const& endpoint_details) {
-                this->DiscoveryEndpointFoundCallback(endpoint_details);
-              },
-              [this](const std::string& instance_id) {
-                this->DiscoveryEndpointLostCallback(instance_id);
-              }));
-        }
-        nearby_connections_->StartDiscovery(service_id_, gpg::Duration::zero(),
-                                            discovery_listener_.get());
+        transport_->StartDiscovery();
         fplbase::LogInfo(fplbase::kApplication,
                          "GPGMultiplayer: Starting discovery");
       }
@@ -509,53 +449,71 @@ void GPGMultiplayer::QueueNextState(MultiplayerState next_state) {
 }
 
 bool GPGMultiplayer::SendMessage(const std::string& instance_id,
-                                 const std::vector<uint8_t>& payload,
+                                 const uint8_t* data, size_t size,
                                  bool reliable) {
-  if (GetPlayerNumberByInstanceId(instance_id) == -1) {
+  const int player = GetPlayerNumberByInstanceId(instance_id);
+  if (player == -1) {
     // Ensure we are actually connected to the specified instance.
     return false;
-  } else {
   }
+  telemetry_.RecordSent(player, size);
 
   if (reliable) {
-    nearby_connections_->SendReliableMessage(instance_id, payload);
+    transport_->SendReliableMessage(instance_id, data, size);
   } else {
-    nearby_connections_->SendUnreliableMessage(instance_id, payload);
+    transport_->SendUnreliableMessage(instance_id, data, size);
   }
   return true;
 }
 
-void GPGMultiplayer::BroadcastMessage(const std::vector<uint8_t>& payload,
-                                      bool reliable) {
+bool GPGMultiplayer::SendMessageToPlayer(unsigned int player,
+                                         const uint8_t* data, size_t size,
+                                         bool reliable) {
+  // Assigning into an existing string reuses its buffer.
+  send_instances_.resize(1);
   pthread_mutex_lock(&instance_mutex_);
-  std::vector<std::string> all_instances{connected_instances_.begin(),
-                                         connected_instances_.end()};
+  // A disconnected player's slot holds an empty instance ID.
+  const bool connected = player < connected_instances_.size() &&
+                         !connected_instances_[player].empty();
+  if (connected) send_instances_[0] = connected_instances_[player];
   pthread_mutex_unlock(&instance_mutex_);
+  if (!connected) return false;
+  telemetry_.RecordSent(static_cast<int>(player), size);
+
   if (reliable) {
-    nearby_connections_->SendReliableMessage(all_instances, payload);
+    transport_->SendReliableMessage(send_instances_[0], data, size);
   } else {
-    nearby_connections_->SendUnreliableMessage(all_instances, payload);
+    transport_->SendUnreliableMessage(send_instances_[0], data, size);
   }
+  return true;
 }
 
-bool GPGMultiplayer::HasMessage() {
-  pthread_mutex_lock(&message_mutex_);
-  bool empty = incoming_messages_.empty();
-  pthread_mutex_unlock(&message_mutex_);
-  return !empty;
+void GPGMultiplayer::BroadcastMessage(const uint8_t* data, size_t size,
+                                      bool reliable) {
+  pthread_mutex_lock(&instance_mutex_);
+  // Assigning into existing strings reuses their buffers.
+  send_instances_.resize(connected_instances_.size());
+  std::copy(connected_instances_.begin(), connected_instances_.end(),
+            send_instances_.begin());
+  pthread_mutex_unlock(&instance_mutex_);
+  for (size_t i = 0; i < send_instances_.size(); ++i) {
+    const std::string& instance_id = send_instances_[i];
+    // Skip the slots of players waiting to reconnect.
+    if (instance_id.empty()) continue;
+    telemetry_.RecordSent(static_cast<int>(i), size);
+    if (reliable) {
+      transport_->SendReliableMessage(instance_id, data, size);
+    } else {
+      transport_->SendUnreliableMessage(instance_id, data, size);
+    }
+  }
 }
 
-GPGMultiplayer::SenderAndMessage GPGMultiplayer::GetNextMessage() {
-  if (HasMessage()) {
-    pthread_mutex_lock(&message_mutex_);
-    auto message = incoming_messages_.front();
-    incoming_messages_.pop();
-    pthread_mutex_unlock(&message_mutex_);
-    return message;
-  } else {
-    SenderAndMessage blank{"", {}};
-    return blank;
-  }
+bool GPGMultiplayer::GetNextMessage(IncomingMessage* message) {
+  if (!incoming_messages_.Pop(message)) return false;
+  telemetry_.RecordDeliveryDelay(MultiplayerTelemetry::Clock::now() -
+                                 message->received_time);
+  return true;
 }
 
 bool GPGMultiplayer::HasReconnectedPlayer() {
@@ -581,17 +539,14 @@ int GPGMultiplayer::GetReconnectedPlayer() {
 // Callbacks are below.
 
 // Callback on the host when it starts advertising.
-void GPGMultiplayer::StartAdvertisingCallback(
-    gpg::StartAdvertisingResult const& result) {
+void GPGMultiplayer::StartAdvertisingCallback(bool success) {
   // We've started hosting
-  if (result.status == gpg::StartAdvertisingResult::StatusCode::SUCCESS) {
+  if (success) {
     fplbase::LogInfo(fplbase::kApplication,
-            "GPGMultiplayer: Started advertising (name='%s')",
-            result.local_endpoint_name.c_str());
+                     "GPGMultiplayer: Started advertising");
   } else {
     fplbase::LogError(fplbase::kApplication,
-             "GPGMultiplayer: FAILED to start advertising, error code %d",
-             result.status);
+                      "GPGMultiplayer: FAILED to start advertising");
     if (state() == kConnectedWithDisconnections) {
       // We couldn't allow reconnections, sorry!
       ClearDisconnectedInstances();
@@ -603,27 +558,25 @@ void GPGMultiplayer::StartAdvertisingCallback(
 }
 
 // Callback on the host when a client tries to connect.
-void GPGMultiplayer::ConnectionRequestCallback(
-    gpg::ConnectionRequest const& connection_request) {
+void GPGMultiplayer::ConnectionRequestCallback(const std::string& instance_id,
+                                               const std::string& name) {
   fplbase::LogInfo(fplbase::kApplication,
           "GPGMultiplayer: Incoming connection (instance_id=%s,name=%s)",
-          connection_request.remote_endpoint_id.c_str(),
-          connection_request.remote_endpoint_name.c_str());
+          instance_id.c_str(), name.c_str());
   // process the incoming connection
   pthread_mutex_lock(&instance_mutex_);
-  pending_instances_.push_back(connection_request.remote_endpoint_id);
-  instance_names_[connection_request.remote_endpoint_id] =
-      connection_request.remote_endpoint_name;
+  pending_instances_.push_back(instance_id);
+  instance_names_[instance_id] = name;
   pthread_mutex_unlock(&instance_mutex_);
 }
 
 // Callback on the client when it discovers a host.
 void GPGMultiplayer::DiscoveryEndpointFoundCallback(
-    gpg::EndpointDetails const& endpoint_details) {
+    const std::string& instance_id, const std::string& name) {
   fplbase::LogInfo(fplbase::kApplication, "GPGMultiplayer: Found endpoint");
   pthread_mutex_lock(&instance_mutex_);
-  instance_names_[endpoint_details.endpoint_id] = endpoint_details.name;
-  discovered_instances_.push_back(endpoint_details.endpoint_id);
+  instance_names_[instance_id] = name;
+  discovered_instances_.push_back(instance_id);
   pthread_mutex_unlock(&instance_mutex_);
 }
 
@@ -642,20 +595,20 @@ void GPGMultiplayer::DiscoveryEndpointLostCallback(
 
 // Callback on the client when it is either accepted or rejected by the host.
 void GPGMultiplayer::ConnectionResponseCallback(
-    gpg::ConnectionResponse const& response) {
-  if (response.status == gpg::ConnectionResponse::StatusCode::ACCEPTED) {
+    const std::string& instance_id, bool accepted) {
+  if (accepted) {
     fplbase::LogInfo(fplbase::kApplication, "GPGMultiplayer: Connected!");
 
     pthread_mutex_lock(&instance_mutex_);
-    connected_instances_.push_back(response.remote_endpoint_id);
+    connected_instances_.push_back(instance_id);
     UpdateConnectedInstances();
     pthread_mutex_unlock(&instance_mutex_);
 
     QueueNextState(kConnected);
   } else {
     fplbase::LogInfo(fplbase::kApplication,
-            "GPGMultiplayer: Didn't connect, response status = %d",
-            response.status);
+                     "GPGMultiplayer: Didn't connect to %s",
+                     instance_id.c_str());
     QueueNextState(kDiscovering);
   }
 }
@@ -663,10 +616,17 @@ void GPGMultiplayer::ConnectionResponseCallback(
 // Callback on host or client when an incoming message is received.
 void GPGMultiplayer::MessageReceivedCallback(
     const std::string& instance_id, std::vector<uint8_t> const& payload,
-    bool is_reliable) {
-  pthread_mutex_lock(&message_mutex_);
-  incoming_messages_.push({instance_id, payload});
-  pthread_mutex_unlock(&message_mutex_);
+    bool /*is_reliable*/) {
+  const int player = GetPlayerNumberByInstanceId(instance_id);
+  telemetry_.RecordReceived(player, payload.size());
+  const int overflowed = incoming_messages_.overflowed();
+  incoming_messages_.Push(player, payload.data(), payload.size());
+  if (incoming_messages_.overflowed() != overflowed) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "GPGMultiplayer: Queue is full, holding a message from "
+                     "%s until it drains (%d held so far)",
+                     instance_id.c_str(), overflowed + 1);
+  }
 }
 
 // Callback on host or client when a connected instance disconnects.
@@ -714,6 +674,13 @@ void GPGMultiplayer::UpdateConnectedInstances() {
   for (unsigned int i = 0; i < connected_instances_.size(); i++) {
     connected_instances_reverse_[connected_instances_[i]] = i;
   }
+
+  // Swap in a new snapshot. Once nobody is reading, nobody can be holding
+  // a replaced one: later readers only see the new pointer.
+  retired_snapshots_.push_back(std::move(current_snapshot_));
+  current_snapshot_.reset(new InstanceMap(connected_instances_reverse_));
+  instance_snapshot_ = current_snapshot_.get();
+  if (snapshot_readers_ == 0) retired_snapshots_.clear();
 }
 
 // Important: make sure you lock instance_mutex_ before calling this.
@@ -761,6 +728,24 @@ int GPGMultiplayer::AddNewConnectedInstance(const std::string& instance_id) {
   return new_index;
 }
 
+void GPGMultiplayer::UpdateTelemetry() {
+  telemetry_.RecordQueue(static_cast<int>(incoming_messages_.Size()),
+                         incoming_messages_.overflowed());
+  if (!telemetry_.Update()) return;
+
+  // Only once a second, as the transport may need to lock to answer.
+  pthread_mutex_lock(&instance_mutex_);
+  send_instances_.resize(connected_instances_.size());
+  std::copy(connected_instances_.begin(), connected_instances_.end(),
+            send_instances_.begin());
+  pthread_mutex_unlock(&instance_mutex_);
+  for (size_t i = 0; i < send_instances_.size(); ++i) {
+    if (send_instances_[i].empty()) continue;
+    telemetry_.RecordResends(static_cast<int>(i),
+                             transport_->GetResendCount(send_instances_[i]));
+  }
+}
+
 void GPGMultiplayer::ClearDisconnectedInstances() {
   disconnected_instances_.clear();
   while (!reconnected_players_.empty()) reconnected_players_.pop();
@@ -780,10 +765,11 @@ int GPGMultiplayer::GetNumConnectedPlayers() {
 
 int GPGMultiplayer::GetPlayerNumberByInstanceId(
     const std::string& instance_id) {
-  pthread_mutex_lock(&instance_mutex_);
-  auto i = connected_instances_reverse_.find(instance_id);
-  int player_num = ((i != connected_instances_reverse_.end()) ? i->second : -1);
-  pthread_mutex_unlock(&instance_mutex_);
+  ++snapshot_readers_;
+  const InstanceMap* instances = instance_snapshot_;
+  auto i = instances->find(instance_id);
+  int player_num = ((i != instances->end()) ? i->second : -1);
+  --snapshot_readers_;
   return player_num;
 }
 
@@ -804,10 +790,10 @@ bool GPGMultiplayer::DisplayConnectionDialog(const char* title,
                                              const char* question_text,
                                              const char* yes_text,
                                              const char* no_text) {
-#ifdef __ANDROID__
   if (auto_connect_) {
     return true;
   }
+#ifdef __ANDROID__
   bool question_shown = false;
 
   JNIEnv* env = fplbase::AndroidGetJNIEnv();
@@ -845,7 +831,8 @@ bool GPGMultiplayer::DisplayConnectionDialog(const char* title,
   (void)question_text;
   (void)yes_text;
   (void)no_text;
-  return false;
+  // There's no dialog to show, so GetConnectionDialogResponse() says yes.
+  return true;
 #endif
 }
 
@@ -853,11 +840,11 @@ bool GPGMultiplayer::DisplayConnectionDialog(const char* title,
 // for Yes), or kDialogWaiting if there is no result yet. Calling this consumes
 // the result.
 GPGMultiplayer::DialogResponse GPGMultiplayer::GetConnectionDialogResponse() {
-#ifdef __ANDROID__
   // If we are set to automatically connect, pretend this is true.
   if (auto_connect_) {
     return kDialogYes;
   }
+#ifdef __ANDROID__
   JNIEnv* env = fplbase::AndroidGetJNIEnv();
   jobject activity = fplbase::AndroidGetActivity();
   jclass fpl_class = env->GetObjectClass(activity);
@@ -881,7 +868,7 @@ GPGMultiplayer::DialogResponse GPGMultiplayer::GetConnectionDialogResponse() {
       return kDialogWaiting;
   }
 #else
-  return kDialogWaiting;
+  return kDialogYes;
 #endif
 }
 
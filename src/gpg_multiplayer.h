@@ -14,11 +14,11 @@
 
 // gpg_multiplayer.h
 //
-// Multiplayer library using the Nearby Connections API in the Google Play
-// Games SDK.
+// Multiplayer library on top of a MultiplayerTransport: the Nearby Connections
+// API in the Google Play Games SDK on Android, or UDP sockets elsewhere.
 //
-// This library wraps the new NearbyConnections library so that game code
-// doesn't have to worry about:
+// This library wraps the transport so that game code doesn't have to worry
+// about:
 //  - callbacks
 //  - synchronization/thread safety
 //  - prompting the user to connect
@@ -28,7 +28,8 @@
 // frame, and then retreive incoming messages from a queue whenever is
 // convenient.
 //
-// To start, call Initialize() and pass in a unique service ID for your game.
+// To start, call Initialize() and pass in a unique service ID for your game,
+// along with the transport to use.
 // After this point you should start calling Update() each frame. You can also
 // call set_my_instance_name() to set a human-readable name for your instance
 // (maybe your Play Games full name, or your device's name).
@@ -44,27 +45,34 @@
 //
 // To send a message to a specific user (as the host), call SendMessage(). To
 // send a message to all other users (as either host or client), call
-// BroadcastMessage. Only the host can see all the players.
+// BroadcastMessage. Only the host can see all the players. Both take a span
+// over the caller's buffer, such as a FlatBufferBuilder's, and reuse their own
+// scratch storage, so call them from one thread only.
 //
-// To receive, call HasMessage() to check if there are any messages available,
-// then GetNextMessage() to get the next incoming message from the queue.
+// To receive, call GetNextMessage() until it returns false. Messages are
+// handed from the transport's thread to yours through a lock-free ring, so
+// call it from one thread only. If you fall behind and the ring fills up,
+// messages wait in a locked overflow list instead, so none are lost.
 
 #ifndef GPG_MULTIPLAYER_H
 #define GPG_MULTIPLAYER_H
 
+#include <pthread.h>
+#include <atomic>
 #include <list>
 #include <map>
+#include <memory>
 #include <queue>
 #include <string>
 #include <vector>
+#include "message_ring.h"
+#include "multiplayer_telemetry.h"
+#include "multiplayer_transport.h"
 
 namespace fpl {
 
 class GPGMultiplayer {
  public:
-  // In the pair, first = the sender's instance_id, second = the message.
-  typedef std::pair<std::string, std::vector<uint8_t>> SenderAndMessage;
-
   enum MultiplayerState {
     // Starting state, you aren't connected, broadcasting, or scanning.
     kIdle = 0,
@@ -96,13 +104,15 @@ class GPGMultiplayer {
     kDialogWaiting,
   };
 
-  // Initializes mutexes only.
+  // Initializes mutexes and the message ring only.
   GPGMultiplayer();
 
   // Initialize the connection manager, set up callbacks, etc.
   // Call this before doing anything else but after initializing
-  // GameServices. service_id should be unique for your game.
-  bool Initialize(const std::string& service_id);
+  // GameServices. service_id should be unique for your game. Takes ownership
+  // of 'transport'.
+  bool Initialize(const std::string& service_id,
+                  MultiplayerTransport* transport);
 
   // Add an app identifier that is used for linking to your device's app store,
   // if a user scanning for games doesn't have this one installed.
@@ -173,25 +183,37 @@ class GPGMultiplayer {
 
   // Get the player number of a connected instance by instance ID (the reverse
   // of GetInstanceIdByPlayerNumber), or -1 if there is no such connected
-  // instance. This locks a mutex so you're best off caching this value for
-  // performance.
+  // instance. Doesn't lock, so the transport can call it for every message.
   int GetPlayerNumberByInstanceId(const std::string& instance_id);
 
   // Send a message to a specific instance. Returns false if you are not
   // connected to that instance (in which case nothing is sent).
+  bool SendMessage(const std::string& instance_id, const uint8_t* data,
+                   size_t size, bool reliable);
   bool SendMessage(const std::string& instance_id,
-                   const std::vector<uint8_t>& payload, bool reliable);
+                   const std::vector<uint8_t>& payload, bool reliable) {
+    return SendMessage(instance_id, payload.data(), payload.size(), reliable);
+  }
+
+  // Send a message to a connected player, by player number. Returns false if
+  // there is no such player. Unlike GetInstanceIdByPlayerNumber(), this
+  // doesn't allocate.
+  bool SendMessageToPlayer(unsigned int player, const uint8_t* data,
+                           size_t size, bool reliable);
 
   // For the host: broadcast to all clients. For the client, sends just to host.
-  void BroadcastMessage(const std::vector<uint8_t>& payload, bool reliable);
+  void BroadcastMessage(const uint8_t* data, size_t size, bool reliable);
+  void BroadcastMessage(const std::vector<uint8_t>& payload, bool reliable) {
+    BroadcastMessage(payload.data(), payload.size(), reliable);
+  }
 
   // Returns true if there are one or more messages available in the queue.
-  // You would then call GetNextMessage() to retrieve the next message.
-  bool HasMessage();
+  bool HasMessage() const { return !incoming_messages_.Empty(); }
 
-  // Get the latest incoming message, or a blank sender and message if there are
-  // none.
-  SenderAndMessage GetNextMessage();
+  // Get the oldest incoming message, or return false if there are none. The
+  // sender is identified by player number, as in GetPlayerNumberByInstanceId().
+  // Reuse the same 'message' each time to avoid allocating.
+  bool GetNextMessage(IncomingMessage* message);
 
   // Returns true if a player has just reconnected.
   bool HasReconnectedPlayer();
@@ -226,58 +248,45 @@ class GPGMultiplayer {
   // If true, we allow disconnected users to reconnect.
   bool allow_reconnecting() const { return allow_reconnecting_; }
 
- private:
-  typedef std::queue<SenderAndMessage> MessageQueue;
+  // Counters for traffic with each player, and for the incoming queue. Round
+  // trip times are up to the caller to measure and record.
+  MultiplayerTelemetry& telemetry() { return telemetry_; }
 
-  // Listens for hosts that are advertising.
-  class DiscoveryListener : public gpg::IEndpointDiscoveryListener {
+ private:
+  // Forwards events from the transport.
+  class TransportListener : public MultiplayerTransportListener {
    public:
-    explicit DiscoveryListener(
-        std::function<void(gpg::EndpointDetails const&)> endpointfound_callback,
-        std::function<void(const std::string&)> endpointremoved_callback)
-        : endpointfound_callback_(endpointfound_callback),
-          endpointremoved_callback_(endpointremoved_callback) {}
-    void OnEndpointFound(int64_t /*client_id*/,
-                         gpg::EndpointDetails const& endpoint_details) {
-      // Ignore client_id because we only have one NearbyConnections client.
-      endpointfound_callback_(endpoint_details);
+    explicit TransportListener(GPGMultiplayer* multiplayer)
+        : multiplayer_(multiplayer) {}
+    virtual void OnAdvertisingResult(bool success) {
+      multiplayer_->StartAdvertisingCallback(success);
     }
-    void OnEndpointLost(int64_t /*client_id*/, const std::string& instance_id) {
-      // Ignore client_id because we only have one NearbyConnections client.
-      endpointremoved_callback_(instance_id);
+    virtual void OnConnectionRequest(const std::string& instance_id,
+                                     const std::string& name) {
+      multiplayer_->ConnectionRequestCallback(instance_id, name);
     }
-
-   private:
-    std::function<void(gpg::EndpointDetails const&)> endpointfound_callback_;
-    std::function<void(const std::string&)> endpointremoved_callback_;
-  };
-
-  // Listens for messages or disconnects from connected instances.
-  class MessageListener : public gpg::IMessageListener {
-   public:
-    explicit MessageListener(
-        std::function<void(const std::string&, std::vector<uint8_t>, bool)>
-            message_received_callback,
-        std::function<void(const std::string&)> disconnected_callback)
-        : message_received_callback_(message_received_callback),
-          disconnected_callback_(disconnected_callback) {}
-    void OnMessageReceived(int64_t /* client_id */,
-                           const std::string& instance_id,
-                           std::vector<uint8_t> const& payload,
-                           bool is_reliable) {
-      // Ignore client_id because we only have one NearbyConnections client.
-      message_received_callback_(instance_id, payload, is_reliable);
+    virtual void OnEndpointFound(const std::string& instance_id,
+                                 const std::string& name) {
+      multiplayer_->DiscoveryEndpointFoundCallback(instance_id, name);
+    }
+    virtual void OnEndpointLost(const std::string& instance_id) {
+      multiplayer_->DiscoveryEndpointLostCallback(instance_id);
+    }
+    virtual void OnConnectionResponse(const std::string& instance_id,
+                                      bool accepted) {
+      multiplayer_->ConnectionResponseCallback(instance_id, accepted);
     }
-    void OnDisconnected(int64_t /* client_id */,
-                        const std::string& instance_id) {
-      // Ignore client_id because we only have one NearbyConnections client.
-      disconnected_callback_(instance_id);
+    virtual void OnMessageReceived(const std::string& instance_id,
+                                   const std::vector<uint8_t>& payload,
+                                   bool reliable) {
+      multiplayer_->MessageReceivedCallback(instance_id, payload, reliable);
+    }
+    virtual void OnDisconnected(const std::string& instance_id) {
+      multiplayer_->DisconnectedCallback(instance_id);
     }
 
    private:
-    std::function<void(const std::string&, std::vector<uint8_t>, bool)>
-        message_received_callback_;
-    std::function<void(const std::string&)> disconnected_callback_;
+    GPGMultiplayer* multiplayer_;
   };
 
   // Enter a new state, exiting the previous one first.
@@ -295,14 +304,15 @@ class GPGMultiplayer {
   // On the host, reject all pending connection requests.
   void RejectAllConnectionRequests();
 
-  // Callbacks used by NearbyConnections library.
-  void StartAdvertisingCallback(gpg::StartAdvertisingResult const& info);
-  void ConnectionRequestCallback(
-      gpg::ConnectionRequest const& connection_request);
-  void DiscoveryEndpointFoundCallback(
-      gpg::EndpointDetails const& endpoint_details);
+  // Callbacks from the transport.
+  void StartAdvertisingCallback(bool success);
+  void ConnectionRequestCallback(const std::string& instance_id,
+                                 const std::string& name);
+  void DiscoveryEndpointFoundCallback(const std::string& instance_id,
+                                      const std::string& name);
   void DiscoveryEndpointLostCallback(const std::string& instance_id);
-  void ConnectionResponseCallback(gpg::ConnectionResponse const& response);
+  void ConnectionResponseCallback(const std::string& instance_id,
+                                  bool accepted);
   void MessageReceivedCallback(const std::string& instance_id,
                                std::vector<uint8_t> const& payload,
                                bool is_reliable);
@@ -313,7 +323,8 @@ class GPGMultiplayer {
   bool DisplayConnectionDialog(const char* title, const char* question_text,
                                const char* yes_text, const char* no_text);
 
-  // Update connected_instances_reverse_ to match to connected_instances_.
+  // Update connected_instances_reverse_ to match to connected_instances_,
+  // and publish a new instance_snapshot_ from it.
   // Make sure instance_mutex_ is locked when calling.
   void UpdateConnectedInstances();
 
@@ -326,22 +337,31 @@ class GPGMultiplayer {
   // connected_instances_ to remove holes from disconnected instances.
   void ClearDisconnectedInstances();
 
-  // The NearbyConnections library.
-  std::unique_ptr<gpg::NearbyConnections> nearby_connections_;
-  // The DiscoveryListener we've instantiated.
-  std::unique_ptr<DiscoveryListener> discovery_listener_;
-  // The MessageListener we've instantiated.
-  std::unique_ptr<MessageListener> message_listener_;
+  // Sample the incoming queue, and once the telemetry's rates are updated,
+  // ask the transport how many resends it's made.
+  void UpdateTelemetry();
 
-  std::string service_id_;
-  std::vector<gpg::AppIdentifier> app_identifiers_;
+  // Finds other instances and carries our messages.
+  std::unique_ptr<MultiplayerTransport> transport_;
+  TransportListener transport_listener_;
 
   // Keep track of fully-connected instances here. Lock instance_mutex_ before
   // using.
   std::vector<std::string> connected_instances_;
   // Keep a reverse map of instance IDs to vector indices. Lock instance_mutex_
   // before using.
-  std::map<std::string, int> connected_instances_reverse_;
+  typedef std::map<std::string, int> InstanceMap;
+  InstanceMap connected_instances_reverse_;
+  // A copy of connected_instances_reverse_ that is never modified, only
+  // replaced when instances connect or disconnect, so that it can be read
+  // without locking. Readers count themselves in snapshot_readers_ while
+  // they hold the pointer.
+  std::atomic<const InstanceMap*> instance_snapshot_;
+  std::atomic<int> snapshot_readers_;
+  // Owns the current snapshot, and replaced ones that a reader may still
+  // hold. Lock instance_mutex_ before using.
+  std::unique_ptr<const InstanceMap> current_snapshot_;
+  std::vector<std::unique_ptr<const InstanceMap>> retired_snapshots_;
   // The host keeps track of instances that are trying to connect. Lock
   // instance_mutex_ before using.
   std::list<std::string> pending_instances_;
@@ -359,8 +379,14 @@ class GPGMultiplayer {
   // so the user code can send them a game state update.
   std::queue<int> reconnected_players_;
 
-  // List of incoming messages. Lock message_mutex_ before using.
-  MessageQueue incoming_messages_;
+  // Incoming messages. The transport's thread pushes, the game thread pops.
+  MessageRing incoming_messages_;
+
+  MultiplayerTelemetry telemetry_;
+
+  // Instance IDs copied out from under instance_mutex_ for sending. Only
+  // touched by the sending thread, and reused so sends don't allocate.
+  std::vector<std::string> send_instances_;
 
   // Our current state.
   MultiplayerState state_;
@@ -370,9 +396,6 @@ class GPGMultiplayer {
   std::string my_instance_name_;
   int max_connected_players_allowed_;  // 0 to allow any number
 
-  // Mutex for the incoming_messages_ queue.
-  pthread_mutex_t message_mutex_;
-
   // Mutex for instance management: connected_instances_, pending_instances_,
   // discovered_instances, and instance_names_.
   pthread_mutex_t instance_mutex_;
@@ -16,6 +16,8 @@
 #include "character_state_machine_def_generated.h"
 #include "config_generated.h"
 #include "gui_menu.h"
+#include "menu_asset_cache.h"
+#include "shader_cache.h"
 
 using flatbuffers::uoffset_t;
 namespace fpl {
@@ -24,7 +26,11 @@ namespace pie_noon {
 //#define USE_IMGUI (1)
 
 GuiMenu::GuiMenu()
-    : debug_shader(nullptr), draw_debug_bounds(false), time_elapsed_(0) {
+    : asset_cache_(nullptr),
+      shaders_(nullptr),
+      debug_shader(nullptr),
+      draw_debug_bounds(false),
+      time_elapsed_(0) {
 #ifdef USE_IMGUI
   // Initialize font manager.
   fontman_ = new FontManager();
@@ -57,6 +63,7 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     return;  // Nothing to set up.  Just clearing things out.
   }
   assert(menu_def->cannonical_window_height() > 0);
+  if (asset_cache_ != nullptr) asset_cache_->Use(menu_def);
   const size_t length_button_list = ArrayLength(menu_def->button_list());
   const size_t length_image_list = ArrayLength(menu_def->static_image_list());
   menu_def_ = menu_def;
@@ -81,13 +88,14 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     const char* shader_name = (button->shader() == nullptr)
                                   ? menu_def->default_shader()->c_str()
                                   : button->shader()->c_str();
-    fplbase::Shader* shader = matman->FindShader(shader_name);
+    fplbase::Shader* shader = shaders_->FindShader(shader_name);
 
     const char* inactive_shader_name =
         (button->inactive_shader() == nullptr)
             ? menu_def->default_inactive_shader()->c_str()
             : button->inactive_shader()->c_str();
-    fplbase::Shader* inactive_shader = matman->FindShader(inactive_shader_name);
+    fplbase::Shader* inactive_shader =
+        shaders_->FindShader(inactive_shader_name);
 
     if (shader == nullptr) {
       fplbase::LogInfo(fplbase::kApplication,
@@ -100,7 +108,7 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     button_list_[i].set_is_highlighted(true);
 
     if (debug_shader) {
-      button_list_[i].set_debug_shader(matman->FindShader(debug_shader));
+      button_list_[i].set_debug_shader(shaders_->FindShader(debug_shader));
     }
     button_list_[i].set_draw_bounds(draw_debug_bounds);
     button_list_[i].SetCannonicalWindowHeight(
@@ -124,7 +132,7 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     const char* shader_name = (image_def.shader() == nullptr)
                                   ? menu_def->default_shader()->c_str()
                                   : image_def.shader()->c_str();
-    fplbase::Shader* shader = matman->FindShader(shader_name);
+    fplbase::Shader* shader = shaders_->FindShader(shader_name);
     if (shader == nullptr) {
       fplbase::LogError(fplbase::kApplication,
                         "Static image missing shader '%s'", shader_name);
@@ -138,53 +146,73 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
 // Loads the debug shader if available
 // Sets option to draw render bounds for button
 void GuiMenu::LoadDebugShaderAndOptions(const Config* config,
-                                        fplbase::AssetManager* matman) {
+                                        ShaderCache* shaders) {
   if (config->menu_button_debug_shader() != nullptr &&
       config->menu_button_debug_shader()->size() > 0) {
     debug_shader = config->menu_button_debug_shader()->c_str();
-    matman->LoadShader(debug_shader);
+    shaders->LoadShader(debug_shader);
   }
   draw_debug_bounds = config->draw_touch_button_bounds() != 0;
 }
 
-// Force the material manager to load all the textures and shaders
-// used in the UI group.
-void GuiMenu::LoadAssets(const UiGroup* menu_def,
-                         fplbase::AssetManager* matman) {
+void GuiMenu::ForEachMaterialName(
+    const UiGroup* menu_def,
+    const std::function<void(const char* material_name)>& function) {
   if (menu_def == nullptr) return;
   const size_t length_button_list = ArrayLength(menu_def->button_list());
-  matman->LoadShader(menu_def->default_shader()->c_str());
-  matman->LoadShader(menu_def->default_inactive_shader()->c_str());
   for (uoffset_t i = 0; i < length_button_list; i++) {
     const ButtonDef* button = menu_def->button_list()->Get(i);
     const size_t length_texture_normal = ArrayLength(button->texture_normal());
     for (uoffset_t j = 0; j < length_texture_normal; j++) {
-      const char* texture_name = TextureName(*button->texture_normal()->Get(j));
-      matman->LoadMaterial(texture_name);
+      function(TextureName(*button->texture_normal()->Get(j)));
     }
     if (button->texture_pressed()) {
-      matman->LoadMaterial(TextureName(*button->texture_pressed()));
+      function(TextureName(*button->texture_pressed()));
+    }
+  }
+
+  const size_t length_image_list = ArrayLength(menu_def->static_image_list());
+  for (uoffset_t i = 0; i < length_image_list; i++) {
+    const StaticImageDef& image_def = *menu_def->static_image_list()->Get(i);
+    const size_t length_texture = ArrayLength(image_def.texture());
+    for (uoffset_t j = 0; j < length_texture; ++j) {
+      function(TextureName(*image_def.texture()->Get(j)));
     }
+  }
+}
 
+// Force the material manager to load all the textures and shaders
+// used in the UI group.
+void GuiMenu::LoadAssets(const UiGroup* menu_def,
+                         fplbase::AssetManager* matman, ShaderCache* shaders,
+                         std::vector<fplbase::Material*>* materials) {
+  if (menu_def == nullptr) return;
+  shaders->LoadShader(menu_def->default_shader()->c_str());
+  shaders->LoadShader(menu_def->default_inactive_shader()->c_str());
+  const size_t length_button_list = ArrayLength(menu_def->button_list());
+  for (uoffset_t i = 0; i < length_button_list; i++) {
+    const ButtonDef* button = menu_def->button_list()->Get(i);
     if (button->shader() != nullptr) {
-      matman->LoadShader(button->shader()->c_str());
+      shaders->LoadShader(button->shader()->c_str());
     }
     if (button->inactive_shader() != nullptr) {
-      matman->LoadShader(button->inactive_shader()->c_str());
+      shaders->LoadShader(button->inactive_shader()->c_str());
     }
   }
-
   const size_t length_image_list = ArrayLength(menu_def->static_image_list());
   for (uoffset_t i = 0; i < length_image_list; i++) {
     const StaticImageDef& image_def = *menu_def->static_image_list()->Get(i);
-    const size_t length_texture = ArrayLength(image_def.texture());
-    for (uoffset_t j = 0; j < length_texture; ++j) {
-      matman->LoadMaterial(TextureName(*image_def.texture()->Get(j)));
-    }
     if (image_def.shader() != nullptr) {
-      matman->LoadShader(image_def.shader()->c_str());
+      shaders->LoadShader(image_def.shader()->c_str());
     }
   }
+
+  ForEachMaterialName(menu_def, [matman, materials](const char* name) {
+    fplbase::Material* material = matman->LoadMaterial(name);
+    if (materials != nullptr && material != nullptr) {
+      materials->push_back(material);
+    }
+  });
 }
 
 void GuiMenu::AdvanceFrame(WorldTime delta_time, fplbase::InputSystem* input,
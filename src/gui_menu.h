@@ -15,6 +15,7 @@
 #ifndef GUI_MENU_H
 #define GUI_MENU_H
 
+#include <functional>
 #include <queue>
 #include "common.h"
 #include "config_generated.h"
@@ -25,6 +26,8 @@
 namespace fpl {
 namespace pie_noon {
 
+class MenuAssetCache;
+class ShaderCache;
 class StaticImage;
 
 // Simple struct for transporting a menu selection, and the controller that
@@ -44,7 +47,11 @@ class GuiMenu {
   void AdvanceFrame(WorldTime delta_time, fplbase::InputSystem* input,
                     const vec2& window_size);
   void Setup(const UiGroup* menudef, fplbase::AssetManager* matman);
-  void LoadAssets(const UiGroup* menu_def, fplbase::AssetManager* matman);
+  // Request the menu's textures and shaders. If 'materials' isn't null, the
+  // materials requested are appended to it.
+  static void LoadAssets(const UiGroup* menu_def,
+                         fplbase::AssetManager* matman, ShaderCache* shaders,
+                         std::vector<fplbase::Material*>* materials = nullptr);
   void Render(fplbase::Renderer* renderer);
   void AdvanceFrame(WorldTime delta_time);
   MenuSelection GetRecentSelection();
@@ -55,8 +62,17 @@ class GuiMenu {
   TouchscreenButton* FindButtonById(ButtonId id);
   StaticImage* FindImageById(ButtonId id);
   const UiGroup* menu_def() const { return menu_def_; }
-  void LoadDebugShaderAndOptions(const Config* config,
-                                 fplbase::AssetManager* matman);
+  void LoadDebugShaderAndOptions(const Config* config, ShaderCache* shaders);
+  // If set, Setup() asks 'cache' to load each menu's assets, so they needn't
+  // all be loaded up front.
+  void set_asset_cache(MenuAssetCache* cache) { asset_cache_ = cache; }
+  // Where Setup() finds the menus' shaders, which LoadAssets() loads.
+  void set_shader_cache(ShaderCache* shaders) { shaders_ = shaders; }
+
+  // Call 'function' with the name of each material the menu uses.
+  static void ForEachMaterialName(
+      const UiGroup* menu_def,
+      const std::function<void(const char* material_name)>& function);
 
  private:
   void ClearRecentSelections();
@@ -71,6 +87,8 @@ class GuiMenu {
   fplbase::InputSystem* input_;
   fplbase::AssetManager* matman_;
   flatui::FontManager* fontman_;
+  MenuAssetCache* asset_cache_;
+  ShaderCache* shaders_;
 
   const char* debug_shader;
   bool draw_debug_bounds;
@@ -0,0 +1,185 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hosts many multi-screen tables from one machine, with no screen and no
+// phone tied up as the host. Usage:
+//
+//   pie_noon_headless_host [rooms] [seconds]
+//
+// Room N listens on the configured UDP port plus N. Runs for 'seconds', or
+// until killed if not given. Every so often, logs how long each room's
+// updates have been taking.
+
+#include "precompiled.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "character_state_machine.h"
+#include "character_state_machine_def_generated.h"
+#include "config_generated.h"
+#include "headless_room.h"
+#include "job_system.h"
+#include "mapped_file.h"
+#include "motive/init.h"
+
+using fpl::pie_noon::Config;
+using fpl::pie_noon::HeadlessRoom;
+using fpl::pie_noon::JobCounter;
+using fpl::pie_noon::JobSystem;
+using fpl::pie_noon::MappedFile;
+using fpl::pie_noon::RoomTickStats;
+using fpl::pie_noon::WorldTime;
+
+static const char kAssetsDir[] = "assets";
+static const char kConfigFileName[] = "config.pieconfig";
+static const char kStateMachineFileName[] =
+    "character_state_machine_def.piestate";
+static const int kDefaultNumRooms = 4;
+
+typedef std::chrono::steady_clock Clock;
+
+static float ToMilliseconds(Clock::duration duration) {
+  return std::chrono::duration<float, std::milli>(duration).count();
+}
+
+static void ReportTickCosts(std::vector<HeadlessRoom>& rooms,
+                            Clock::duration frame_total, int frames) {
+  for (auto it = rooms.begin(); it != rooms.end(); ++it) {
+    const RoomTickStats& stats = it->tick_stats();
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Room %d: %s, %d players, %d games; tick avg %.3f ms, "
+                     "max %.3f ms\n",
+                     it->room(), it->playing() ? "playing" : "waiting",
+                     it->num_players(), it->games_played(),
+                     stats.ticks > 0 ? ToMilliseconds(stats.total) / stats.ticks
+                                     : 0.0f,
+                     ToMilliseconds(stats.max));
+    it->ResetTickStats();
+  }
+  fplbase::LogInfo(fplbase::kApplication,
+                   "All %d rooms: frame avg %.3f ms over %d frames\n",
+                   static_cast<int>(rooms.size()),
+                   frames > 0 ? ToMilliseconds(frame_total) / frames : 0.0f,
+                   frames);
+}
+
+extern "C" int FPL_main(int argc, char* argv[]) {
+  const char* binary_directory = argc > 0 ? argv[0] : "";
+  const int num_rooms = argc > 1 ? atoi(argv[1]) : kDefaultNumRooms;
+  const int run_seconds = argc > 2 ? atoi(argv[2]) : 0;
+  if (num_rooms <= 0) {
+    fplbase::LogError(fplbase::kError, "Need at least one room.\n");
+    return 1;
+  }
+
+  if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir)) return 1;
+
+  // Both files are used in place for as long as the host runs.
+  MappedFile config_file;
+  if (!config_file.Open(kConfigFileName)) {
+    fplbase::LogError(fplbase::kError, "Can't load config file.\n");
+    return 1;
+  }
+  flatbuffers::Verifier config_verifier(config_file.data(),
+                                        config_file.size());
+  if (!fpl::pie_noon::VerifyConfigBuffer(config_verifier)) {
+    fplbase::LogError(fplbase::kError, "Config file is corrupt.\n");
+    return 1;
+  }
+  const Config& config = *fpl::pie_noon::GetConfig(config_file.data());
+
+  MappedFile state_machine_file;
+  if (!state_machine_file.Open(kStateMachineFileName)) {
+    fplbase::LogError(fplbase::kError,
+                      "Error loading character state machine.\n");
+    return 1;
+  }
+  flatbuffers::Verifier state_machine_verifier(state_machine_file.data(),
+                                               state_machine_file.size());
+  auto state_machine_def = fpl::pie_noon::GetCharacterStateMachineDef(
+      state_machine_file.data());
+  if (!fpl::pie_noon::VerifyCharacterStateMachineDefBuffer(
+          state_machine_verifier) ||
+      !fpl::pie_noon::CharacterStateMachineDef_Validate(state_machine_def)) {
+    fplbase::LogError(fplbase::kError, "State machine is invalid.\n");
+    return 1;
+  }
+
+  // Register the motivator types with the MotiveEngine.
+  motive::OvershootInit::Register();
+  motive::SplineInit::Register();
+  motive::MatrixInit::Register();
+
+  // Each room is a job, so the rooms are spread over all the cores.
+  JobSystem job_system;
+  job_system.Initialize(JobSystem::DefaultNumWorkers());
+
+  std::vector<HeadlessRoom> rooms(num_rooms);
+  for (int i = 0; i < num_rooms; ++i) {
+    if (!rooms[i].Initialize(i, &config, state_machine_def)) return 1;
+  }
+
+  const WorldTime min_update_time = config.min_update_time();
+  const WorldTime max_update_time = config.max_update_time();
+  const Clock::duration report_interval = std::chrono::milliseconds(
+      config.multiscreen_options()->headless_report_interval_milliseconds());
+  const Clock::time_point start_time = Clock::now();
+  Clock::time_point prev_time = start_time - std::chrono::milliseconds(
+                                                 min_update_time);
+  Clock::time_point next_report = start_time + report_interval;
+  Clock::duration frame_total(0);
+  int frames = 0;
+
+  while (run_seconds <= 0 ||
+         Clock::now() - start_time < std::chrono::seconds(run_seconds)) {
+    // As in PieNoonGame::Run(), don't update more often than
+    // min_update_time, and don't let one update cover more than
+    // max_update_time.
+    const Clock::time_point now = Clock::now();
+    const WorldTime elapsed = static_cast<WorldTime>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - prev_time)
+            .count());
+    if (elapsed < min_update_time) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(min_update_time - elapsed));
+      continue;
+    }
+    const WorldTime delta_time = std::min(elapsed, max_update_time);
+    prev_time = now;
+
+    JobCounter rooms_done;
+    for (auto it = rooms.begin(); it != rooms.end(); ++it) {
+      HeadlessRoom* room = &*it;
+      job_system.Submit(
+          [room, delta_time](int) { room->AdvanceFrame(delta_time); },
+          &rooms_done);
+    }
+    job_system.Wait(rooms_done);
+    frame_total += Clock::now() - now;
+    frames++;
+
+    if (Clock::now() >= next_report) {
+      ReportTickCosts(rooms, frame_total, frames);
+      frame_total = Clock::duration(0);
+      frames = 0;
+      next_report += report_interval;
+    }
+  }
+
+  ReportTickCosts(rooms, frame_total, frames);
+  job_system.Shutdown();
+  return 0;
+}
@@ -0,0 +1,273 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <algorithm>
+#include "ai_controller.h"
+#include "character.h"
+#include "config_generated.h"
+#include "flatbuffers/util.h"
+#include "headless_room.h"
+#include "multiplayer_controller.h"
+#include "multiplayer_generated.h"
+#include "udp_transport.h"
+
+namespace fpl {
+namespace pie_noon {
+
+HeadlessRoom::HeadlessRoom()
+    : room_(-1),
+      config_(nullptr),
+      state_(kWaitingForPlayers),
+      waiting_time_(0),
+      games_played_(0) {}
+
+bool HeadlessRoom::Initialize(
+    int room, const Config* config,
+    const CharacterStateMachineDef* state_machine_def) {
+  room_ = room;
+  config_ = config;
+  const MultiscreenOptions* options = config->multiscreen_options();
+
+  game_state_.set_config(config);
+  game_state_.set_is_multiscreen(true);
+
+  // Characters start out with AI controllers, which are swapped for
+  // multiplayer controllers when a game starts.
+  for (unsigned int i = 0; i < config->character_count(); ++i) {
+    AiController* controller = new AiController();
+    controller->Initialize(&game_state_, config, i);
+    game_state_.characters().push_back(std::unique_ptr<Character>(
+        new Character(i, controller, *config, state_machine_def)));
+    controllers_.push_back(std::unique_ptr<Controller>(controller));
+  }
+
+  multiplayer_director_.reset(new MultiplayerDirector());
+  multiplayer_director_->Initialize(&game_state_, config);
+  multiplayer_director_->RegisterGPGMultiplayer(&gpg_multiplayer_);
+  for (unsigned int i = 0; i < config->character_count(); ++i) {
+    MultiplayerController* controller = new MultiplayerController();
+    controller->Initialize(&game_state_, config);
+    controllers_.push_back(std::unique_ptr<Controller>(controller));
+    multiplayer_director_->RegisterController(controller);
+  }
+  game_state_.RegisterMultiplayerDirector(multiplayer_director_.get());
+  game_state_.Reset(GameState::kNoAnalytics);
+
+  const uint16_t port = static_cast<uint16_t>(options->udp_port() + room);
+  if (!gpg_multiplayer_.Initialize(
+          options->nearby_connections_service_id()->c_str(),
+          new UdpTransport(port, options->udp_discovery_address()->str()))) {
+    fplbase::LogError(fplbase::kApplication,
+                      "Room %d: GPGMultiplayer::Initialize failed\n", room);
+    return false;
+  }
+  for (unsigned int i = 0;
+       i < options->nearby_connections_app_identifiers()->Length(); i++) {
+    gpg_multiplayer_.AddAppIdentifier(
+        options->nearby_connections_app_identifiers()->Get(i)->c_str());
+  }
+  gpg_multiplayer_.set_my_instance_name("Room " +
+                                        flatbuffers::NumToString(room));
+  gpg_multiplayer_.set_max_connected_players_allowed(options->max_players());
+  // Nobody is around to accept players by hand.
+  gpg_multiplayer_.set_auto_connect(true);
+  gpg_multiplayer_.StartAdvertising();
+
+  fplbase::LogInfo(fplbase::kApplication, "Room %d: hosting on port %d\n",
+                   room, static_cast<int>(port));
+  return true;
+}
+
+void HeadlessRoom::AdvanceFrame(WorldTime delta_time) {
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  gpg_multiplayer_.Update();
+  ProcessMultiplayerMessages();
+  switch (state_) {
+    case kWaitingForPlayers:
+      WaitForPlayers(delta_time);
+      break;
+    case kPlaying:
+      Play(delta_time);
+      break;
+  }
+
+  const std::chrono::steady_clock::duration cost =
+      std::chrono::steady_clock::now() - start;
+  tick_stats_.ticks++;
+  tick_stats_.total += cost;
+  tick_stats_.max = std::max(tick_stats_.max, cost);
+}
+
+// The host's half of PieNoonGame::ProcessMultiplayerMessages(). Clients
+// never send us the other messages.
+void HeadlessRoom::ProcessMultiplayerMessages() {
+  while (gpg_multiplayer_.GetNextMessage(&incoming_message_)) {
+    const std::vector<uint8_t>& payload = incoming_message_.payload;
+    const int sender = incoming_message_.sender;
+    if (payload.empty() || sender < 0) continue;
+
+    flatbuffers::Verifier verifier(payload.data(), payload.size());
+    if (!multiplayer::VerifyMessageRootBuffer(verifier)) {
+      fplbase::LogError(fplbase::kApplication,
+                        "Room %d: got a malformed multiplayer message!",
+                        room_);
+      continue;
+    }
+    const multiplayer::MessageRoot* message =
+        multiplayer::GetMessageRoot(payload.data());
+    if (message->data_type() == multiplayer::Data_PlayerCommand) {
+      if (state_ == kPlaying) {
+        multiplayer_director_->InputPlayerCommand(
+            sender, *static_cast<const multiplayer::PlayerCommand*>(
+                        message->data()));
+      }
+    } else if (message->data_type() == multiplayer::Data_PlayerStatusAck) {
+      if (state_ == kPlaying) {
+        multiplayer_director_->ReceivePlayerStatusAck(
+            sender,
+            *static_cast<const multiplayer::PlayerStatusAck*>(message->data()),
+            payload.size());
+      }
+    } else if (message->data_type() == multiplayer::Data_Ping) {
+      SendPong(sender,
+               static_cast<const multiplayer::Ping*>(message->data())->time());
+    }
+  }
+
+  // If any players were disconnected and have reconnected, re-send them
+  // their player number.
+  while (gpg_multiplayer_.HasReconnectedPlayer()) {
+    const int player = gpg_multiplayer_.GetReconnectedPlayer();
+    const std::string instance_id =
+        gpg_multiplayer_.GetInstanceIdByPlayerNumber(player);
+    if (state_ == kPlaying && instance_id != "") {
+      fplbase::LogInfo(fplbase::kApplication,
+                       "Room %d: player %d (instance %s) reconnected", room_,
+                       player, instance_id.c_str());
+      multiplayer_director_->SendPlayerAssignmentMsg(instance_id, player,
+                                                     true);
+      multiplayer_director_->SendFullSyncMsg(instance_id, player);
+    }
+  }
+}
+
+void HeadlessRoom::WaitForPlayers(WorldTime delta_time) {
+  const int connected_players = gpg_multiplayer_.GetNumConnectedPlayers();
+  if (connected_players == 0) {
+    waiting_time_ = 0;
+    return;
+  }
+  waiting_time_ += delta_time;
+  const MultiscreenOptions* options = config_->multiscreen_options();
+  if (connected_players >= options->max_players() ||
+      waiting_time_ >= options->headless_start_delay_milliseconds()) {
+    StartGame();
+  }
+}
+
+// As PieNoonGame::StartMultiscreenGameAsHost(), followed by the transitions
+// to kJoining and kPlaying.
+void HeadlessRoom::StartGame() {
+  gpg_multiplayer_.StopAdvertising();
+  gpg_multiplayer_.telemetry().Reset();
+  const int connected_players = gpg_multiplayer_.GetNumConnectedPlayers();
+  fplbase::LogInfo(fplbase::kApplication,
+                   "Room %d: starting a game with %d players", room_,
+                   connected_players);
+
+  // Lockstep needs the host to check the clients' checksums frame by frame,
+  // which rooms don't do yet.
+  multiplayer_director_->DisableLockstep();
+  for (int i = 0; i < connected_players; i++) {
+    multiplayer_director_->SendPlayerAssignmentMsg(
+        gpg_multiplayer_.GetInstanceIdByPlayerNumber(i), i, false);
+  }
+  multiplayer_director_->set_num_ai_players(
+      config_->multiscreen_options()->max_players() - connected_players);
+  game_state_.Reset(GameState::kNoAnalytics);
+  multiplayer_director_->StartGame();
+  game_state_.EnterJoiningMode();
+
+  // Every character is played through a multiplayer controller, whether a
+  // phone or the director's AI is choosing its commands.
+  for (auto it = controllers_.begin(); it != controllers_.end(); ++it) {
+    Controller* controller = it->get();
+    if (controller->controller_type() != Controller::kTypeMultiplayer ||
+        controller->character_id() != kNoCharacter) {
+      continue;
+    }
+    const auto& characters = game_state_.characters();
+    for (CharacterId id = 0; id < static_cast<CharacterId>(characters.size());
+         ++id) {
+      Character* character = characters[id].get();
+      if (character->controller()->controller_type() == Controller::kTypeAI) {
+        character->controller()->set_character_id(kNoCharacter);
+        character->set_controller(controller);
+        controller->set_character_id(id);
+        character->set_just_joined_game(true);
+        break;
+      }
+    }
+  }
+
+  game_state_.Reset(GameState::kNoAnalytics);
+  state_ = kPlaying;
+}
+
+void HeadlessRoom::Play(WorldTime delta_time) {
+  if (!gpg_multiplayer_.IsConnected()) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Room %d: all players disconnected", room_);
+    gpg_multiplayer_.ResetToIdle();
+    FinishGame();
+    return;
+  }
+
+  for (auto it = controllers_.begin(); it != controllers_.end(); ++it) {
+    (*it)->AdvanceFrame(delta_time);
+  }
+  multiplayer_director_->AdvanceFrame(delta_time);
+  game_state_.AdvanceFrame(delta_time);
+  game_state_.FlushSideEffects(nullptr);
+
+  if (game_state_.IsGameOver()) {
+    multiplayer_director_->SendEndGameMsg();
+    FinishGame();
+  }
+}
+
+void HeadlessRoom::FinishGame() {
+  multiplayer_director_->EndGame();
+  games_played_++;
+  waiting_time_ = 0;
+  gpg_multiplayer_.StartAdvertising();
+  state_ = kWaitingForPlayers;
+}
+
+void HeadlessRoom::SendPong(CharacterId player, uint32_t time) {
+  PooledBuilder builder(&message_builders_);
+  auto message_root = multiplayer::CreateMessageRoot(
+      *builder, multiplayer::Data_Pong,
+      multiplayer::CreatePong(*builder, time).Union());
+  builder->Finish(message_root);
+
+  gpg_multiplayer_.SendMessageToPlayer(player, builder->GetBufferPointer(),
+                                       builder->GetSize(), false);
+}
+
+}  // pie_noon
+}  // fpl
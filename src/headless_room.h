@@ -0,0 +1,105 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_HEADLESS_ROOM_H_
+#define PIE_NOON_HEADLESS_ROOM_H_
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "builder_pool.h"
+#include "common.h"
+#include "controller.h"
+#include "game_state.h"
+#include "gpg_multiplayer.h"
+#include "multiplayer_director.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// How long a room's updates have been taking.
+struct RoomTickStats {
+  RoomTickStats() : ticks(0), total(0), max(0) {}
+
+  int ticks;
+  std::chrono::steady_clock::duration total;
+  std::chrono::steady_clock::duration max;
+};
+
+// One multi-screen table, hosted without a screen: the same game the host
+// phone runs, with its own transport, game state and multiplayer director,
+// but no rendering, sound or menus. Players' phones find the room and join
+// it as clients, just as they would a phone that's hosting. A room starts a
+// game once it is full, or a while after its first player joins, and after
+// each game waits for players again.
+//
+// Rooms share nothing, so several can be updated at once on different
+// threads. Each room must only be updated by one thread at a time.
+class HeadlessRoom {
+ public:
+  HeadlessRoom();
+
+  // Host room number 'room', listening on the configured UDP port plus
+  // 'room'. 'config' and 'state_machine_def' must outlive the room.
+  bool Initialize(int room, const Config* config,
+                  const CharacterStateMachineDef* state_machine_def);
+
+  // Run the room for 'delta_time', like one frame of the game.
+  void AdvanceFrame(WorldTime delta_time);
+
+  int room() const { return room_; }
+  bool playing() const { return state_ == kPlaying; }
+  int games_played() const { return games_played_; }
+  int num_players() { return gpg_multiplayer_.GetNumConnectedPlayers(); }
+  GPGMultiplayer& gpg_multiplayer() { return gpg_multiplayer_; }
+
+  const RoomTickStats& tick_stats() const { return tick_stats_; }
+  void ResetTickStats() { tick_stats_ = RoomTickStats(); }
+
+ private:
+  enum RoomState { kWaitingForPlayers, kPlaying };
+
+  void ProcessMultiplayerMessages();
+  void WaitForPlayers(WorldTime delta_time);
+  void StartGame();
+  void Play(WorldTime delta_time);
+  // Go back to waiting for players. The players still connected get to play
+  // the next game too.
+  void FinishGame();
+  void SendPong(CharacterId player, uint32_t time);
+
+  int room_;
+  const Config* config_;
+  RoomState state_;
+  // How long we've had players while waiting for more.
+  WorldTime waiting_time_;
+  int games_played_;
+
+  GameState game_state_;
+  std::unique_ptr<MultiplayerDirector> multiplayer_director_;
+  // The AI controllers the characters start with, and the multiplayer
+  // controllers that take them over when a game starts.
+  std::vector<std::unique_ptr<Controller>> controllers_;
+
+  GPGMultiplayer gpg_multiplayer_;
+  IncomingMessage incoming_message_;
+  FlatBufferBuilderPool message_builders_;
+
+  RoomTickStats tick_stats_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_HEADLESS_ROOM_H_
@@ -0,0 +1,300 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "job_system.h"
+
+namespace fpl {
+namespace pie_noon {
+
+typedef std::chrono::steady_clock Clock;
+
+// ParallelFor splits work into at most this many batches per thread, so that
+// threads that finish early can steal the remainder.
+static const int kBatchesPerThread = 4;
+
+void* ScratchAllocator::Allocate(size_t size, size_t alignment) {
+  const size_t aligned = (used_ + alignment - 1) & ~(alignment - 1);
+  if (aligned + size > buffer_.size()) return nullptr;
+  used_ = aligned + size;
+  return &buffer_[aligned];
+}
+
+JobSystem::JobSystem() : queued_jobs_(0), shutting_down_(false) {
+  // Until Initialize() is called, everything runs on the calling thread.
+  workers_.push_back(std::unique_ptr<Worker>(new Worker(kDefaultScratchBytes)));
+  workers_[0]->thread_id = std::this_thread::get_id();
+  stats_start_ = Clock::now();
+}
+
+JobSystem::~JobSystem() { Shutdown(); }
+
+int JobSystem::DefaultNumWorkers() {
+  const int num_cores = static_cast<int>(std::thread::hardware_concurrency());
+  return num_cores > 1 ? num_cores - 1 : 0;
+}
+
+void JobSystem::Initialize(int num_workers, size_t scratch_bytes_per_worker) {
+  Shutdown();
+  shutting_down_ = false;
+
+  workers_.clear();
+  for (int i = 0; i <= num_workers; ++i) {
+    workers_.push_back(
+        std::unique_ptr<Worker>(new Worker(scratch_bytes_per_worker)));
+  }
+  workers_[0]->thread_id = std::this_thread::get_id();
+
+  // Workers wait for this lock before they start, so every thread id is
+  // filled in before anyone calls CurrentWorkerIndex().
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    for (int i = 1; i <= num_workers; ++i) {
+      Worker* worker = workers_[i].get();
+      worker->thread = std::thread(&JobSystem::WorkerMain, this, i);
+      worker->thread_id = worker->thread.get_id();
+    }
+  }
+  ResetStats();
+}
+
+void JobSystem::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    shutting_down_ = true;
+  }
+  wake_.notify_all();
+  for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+    if ((*it)->thread.joinable()) {
+      (*it)->thread.join();
+    }
+  }
+  for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+    (*it)->jobs.clear();
+  }
+  external_jobs_.clear();
+  queued_jobs_ = 0;
+}
+
+int JobSystem::CurrentWorkerIndex() const {
+  const std::thread::id id = std::this_thread::get_id();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i]->thread_id == id) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+void JobSystem::Submit(const JobFunction& function, JobCounter* counter,
+                       JobCounter* dependency) {
+  Job job = {function, counter};
+  if (counter != nullptr) {
+    counter->count_++;
+  }
+
+  // Park the job on the dependency. FinishJob() will queue it when the
+  // dependency's last job finishes.
+  if (dependency != nullptr) {
+    std::lock_guard<std::mutex> lock(dependency->mutex_);
+    if (!dependency->Done()) {
+      dependency->continuations_.push_back(job);
+      return;
+    }
+  }
+  Push(job);
+}
+
+void JobSystem::Push(const Job& job) {
+  const int worker_index = CurrentWorkerIndex();
+  if (worker_index >= 0) {
+    Worker* worker = workers_[worker_index].get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->jobs.push_back(job);
+  } else {
+    std::lock_guard<std::mutex> lock(external_mutex_);
+    external_jobs_.push_back(job);
+  }
+  queued_jobs_++;
+
+  // Taking the lock means a worker that's about to sleep either sees the new
+  // job, or is already waiting and gets the notification.
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+  wake_.notify_one();
+}
+
+// Find a job: first our own newest, then anything submitted from outside,
+// then the oldest job of another worker.
+bool JobSystem::PopJob(int worker_index, Job* job) {
+  {
+    Worker* worker = workers_[worker_index].get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (!worker->jobs.empty()) {
+      *job = worker->jobs.back();
+      worker->jobs.pop_back();
+      return true;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(external_mutex_);
+    if (!external_jobs_.empty()) {
+      *job = external_jobs_.front();
+      external_jobs_.pop_front();
+      return true;
+    }
+  }
+
+  const int num_workers = static_cast<int>(workers_.size());
+  for (int i = 1; i < num_workers; ++i) {
+    Worker* victim = workers_[(worker_index + i) % num_workers].get();
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    if (!victim->jobs.empty()) {
+      *job = victim->jobs.front();
+      victim->jobs.pop_front();
+      workers_[worker_index]->jobs_stolen++;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool JobSystem::TryRunJob(int worker_index) {
+  if (queued_jobs_.load() == 0) return false;
+
+  Job job;
+  if (!PopJob(worker_index, &job)) return false;
+  queued_jobs_--;
+
+  Worker* worker = workers_[worker_index].get();
+  const size_t scratch_mark = worker->scratch.used();
+  const Clock::time_point start = Clock::now();
+
+  worker->depth++;
+  job.function(worker_index);
+  worker->depth--;
+
+  // Nested jobs are already counted in the time of the job that ran them.
+  if (worker->depth == 0) {
+    worker->busy_nanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count();
+  }
+  worker->scratch.ReleaseTo(scratch_mark);
+  worker->jobs_executed++;
+
+  FinishJob(job.counter);
+  return true;
+}
+
+void JobSystem::FinishJob(JobCounter* counter) {
+  if (counter == nullptr) return;
+
+  // Decrement under the lock: once a waiter sees zero it may destroy the
+  // counter, and Wait() takes the lock to be sure we're done with it.
+  std::vector<Job> continuations;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex_);
+    if (counter->count_.fetch_sub(1) != 1) return;
+
+    // That was the last job, so release everything that depends on it.
+    continuations.swap(counter->continuations_);
+  }
+  for (auto it = continuations.begin(); it != continuations.end(); ++it) {
+    Push(*it);
+  }
+}
+
+void JobSystem::Wait(const JobCounter& counter) {
+  const int worker_index = CurrentWorkerIndex();
+  while (!counter.Done()) {
+    // Threads that aren't workers have no scratch memory to run jobs with,
+    // so they just wait.
+    if (worker_index < 0 || !TryRunJob(worker_index)) {
+      // The remaining jobs are running elsewhere.
+      std::this_thread::yield();
+    }
+  }
+
+  // The thread that finished the last job may still hold the lock.
+  std::lock_guard<std::mutex> lock(counter.mutex_);
+}
+
+void JobSystem::ParallelFor(int count, int min_batch_size,
+                            const RangeFunction& function) {
+  if (count <= 0) return;
+
+  const int max_batches = num_threads() * kBatchesPerThread;
+  const int min_size = std::max(1, min_batch_size);
+  const int batch_size =
+      std::max(min_size, (count + max_batches - 1) / max_batches);
+
+  // Not worth handing out. Run it here.
+  const int worker_index = CurrentWorkerIndex();
+  assert(worker_index >= 0);
+  if (batch_size >= count || num_threads() == 1) {
+    function(0, count, worker_index);
+    return;
+  }
+
+  JobCounter counter;
+  for (int begin = 0; begin < count; begin += batch_size) {
+    const int end = std::min(begin + batch_size, count);
+    Submit([&function, begin, end](int worker_index) {
+      function(begin, end, worker_index);
+    }, &counter);
+  }
+  Wait(counter);
+}
+
+void JobSystem::WorkerMain(int worker_index) {
+  // Wait for Initialize() to finish filling in the workers.
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+
+  for (;;) {
+    if (TryRunJob(worker_index)) continue;
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    while (!shutting_down_ && queued_jobs_.load() == 0) {
+      wake_.wait(lock);
+    }
+    if (shutting_down_) return;
+  }
+}
+
+void JobSystem::GetStats(std::vector<WorkerStats>* stats) const {
+  const double elapsed_seconds =
+      std::chrono::duration<double>(Clock::now() - stats_start_).count();
+  stats->resize(workers_.size());
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    const Worker& worker = *workers_[i];
+    WorkerStats& s = (*stats)[i];
+    s.jobs_executed = worker.jobs_executed.load();
+    s.jobs_stolen = worker.jobs_stolen.load();
+    s.busy_seconds = worker.busy_nanoseconds.load() * 1e-9;
+    s.utilization =
+        elapsed_seconds > 0.0 ? s.busy_seconds / elapsed_seconds : 0.0;
+  }
+}
+
+void JobSystem::ResetStats() {
+  for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+    (*it)->jobs_executed = 0;
+    (*it)->jobs_stolen = 0;
+    (*it)->busy_nanoseconds = 0;
+  }
+  stats_start_ = Clock::now();
+}
+
+}  // pie_noon
+}  // fpl
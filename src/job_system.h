@@ -0,0 +1,215 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_JOB_SYSTEM_H_
+#define PIE_NOON_JOB_SYSTEM_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class JobCounter;
+
+// Work to be done. 'worker_index' identifies the thread running the job, and
+// can be used to get at that thread's scratch memory.
+typedef std::function<void(int worker_index)> JobFunction;
+
+// Work on the items in [begin, end).
+typedef std::function<void(int begin, int end, int worker_index)>
+    RangeFunction;
+
+struct Job {
+  JobFunction function;
+  JobCounter* counter;
+};
+
+// Counts the jobs that have been submitted against it but not yet finished.
+// Jobs can wait on a counter, or be held back until it reaches zero.
+// A counter must outlive every job that references it; JobSystem::Wait()
+// returning is what guarantees that.
+class JobCounter {
+ public:
+  JobCounter() : count_(0) {}
+
+  // True when every job submitted against this counter has finished.
+  bool Done() const { return count_.load() == 0; }
+
+ private:
+  friend class JobSystem;
+
+  std::atomic<int> count_;
+
+  // Guards the transition to zero, and the jobs waiting for it.
+  mutable std::mutex mutex_;
+  std::vector<Job> continuations_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobCounter);
+};
+
+// Linear allocator for short-lived memory. Each worker has one. Memory
+// allocated while a job runs is released when the job returns, so it must
+// not be referenced afterwards.
+class ScratchAllocator {
+ public:
+  explicit ScratchAllocator(size_t capacity)
+      : buffer_(capacity), used_(0) {}
+
+  // Returns nullptr if there isn't enough space left.
+  void* Allocate(size_t size, size_t alignment);
+
+  template <typename T>
+  T* AllocateArray(size_t count) {
+    return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  size_t used() const { return used_; }
+  size_t capacity() const { return buffer_.size(); }
+
+  // Release everything allocated since 'used()' returned 'mark'.
+  void ReleaseTo(size_t mark) { used_ = mark; }
+
+ private:
+  std::vector<uint8_t> buffer_;
+  size_t used_;
+};
+
+struct WorkerStats {
+  uint64_t jobs_executed;
+  // Of the jobs executed, how many were taken from another worker's queue.
+  uint64_t jobs_stolen;
+  // Time spent running jobs since the stats were reset.
+  double busy_seconds;
+  // busy_seconds as a fraction of the time since the stats were reset.
+  double utilization;
+};
+
+// Runs jobs on a fixed set of threads. Each thread has its own queue: it
+// pushes and pops at the back, and when it runs out of work it steals from
+// the front of the other queues.
+//
+// The thread that calls Initialize() is worker 0. It never sleeps in the
+// job system, but runs jobs whenever it waits on a counter. Jobs can be
+// submitted, and counters waited on, from any thread, but only workers run
+// jobs and call ParallelFor().
+class JobSystem {
+ public:
+  static const size_t kDefaultScratchBytes = 64 * 1024;
+
+  JobSystem();
+  ~JobSystem();
+
+  // Start 'num_workers' threads in addition to the calling thread.
+  void Initialize(int num_workers,
+                  size_t scratch_bytes_per_worker = kDefaultScratchBytes);
+
+  // Stop all worker threads. Jobs that haven't started are dropped, so wait
+  // on their counters first.
+  void Shutdown();
+
+  // Queue 'function' to run. 'counter', if not null, is incremented now and
+  // decremented when the job finishes. If 'dependency' is not null, the job
+  // won't start until it reaches zero.
+  void Submit(const JobFunction& function, JobCounter* counter,
+              JobCounter* dependency = nullptr);
+
+  // Run jobs on the calling thread until 'counter' reaches zero.
+  void Wait(const JobCounter& counter);
+
+  // Call 'function' on batches that cover [0, count), and wait for them all.
+  // Batches hold at least 'min_batch_size' items, except perhaps the last.
+  void ParallelFor(int count, int min_batch_size,
+                   const RangeFunction& function);
+
+  // Scratch memory belonging to the worker running the current job.
+  ScratchAllocator& scratch(int worker_index) {
+    return workers_[worker_index]->scratch;
+  }
+
+  // Total number of threads that run jobs, including the calling thread.
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+  // One entry per thread, indexed by worker index.
+  void GetStats(std::vector<WorkerStats>* stats) const;
+  void ResetStats();
+
+  // Number of extra threads to use so that every core is busy.
+  static int DefaultNumWorkers();
+
+ private:
+  struct Worker {
+    explicit Worker(size_t scratch_bytes)
+        : scratch(scratch_bytes),
+          depth(0),
+          jobs_executed(0),
+          jobs_stolen(0),
+          busy_nanoseconds(0) {}
+
+    // Guards 'jobs'.
+    std::mutex mutex;
+    std::deque<Job> jobs;
+
+    std::thread thread;
+    std::thread::id thread_id;
+    ScratchAllocator scratch;
+
+    // How many jobs are running on this thread. Jobs that wait can run other
+    // jobs inside them.
+    int depth;
+
+    std::atomic<uint64_t> jobs_executed;
+    std::atomic<uint64_t> jobs_stolen;
+    std::atomic<uint64_t> busy_nanoseconds;
+  };
+
+  void WorkerMain(int worker_index);
+  int CurrentWorkerIndex() const;
+  void Push(const Job& job);
+  bool PopJob(int worker_index, Job* job);
+  bool TryRunJob(int worker_index);
+  void FinishJob(JobCounter* counter);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Jobs submitted from threads that aren't workers.
+  std::mutex external_mutex_;
+  std::deque<Job> external_jobs_;
+
+  // Number of jobs sitting in queues, ready to run.
+  std::atomic<int> queued_jobs_;
+
+  // Sleeping workers wait on this for 'queued_jobs_' to become non-zero.
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::atomic<bool> shutting_down_;
+
+  std::chrono::steady_clock::time_point stats_start_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobSystem);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_JOB_SYSTEM_H_
@@ -0,0 +1,107 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <cstring>
+#include "ktx_texture.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const uint8_t kKtxIdentifier[12] = {0xAB, 'K',  'T',  'X',
+                                           ' ',  '1',  '1',  0xBB,
+                                           '\r', '\n', 0x1A, '\n'};
+static const uint32_t kKtxEndianness = 0x04030201;
+// The identifier, then 13 32-bit fields.
+static const size_t kKtxHeaderSize = 64;
+
+const char* CompressedTextureDirectory(CompressedTextureFormat format) {
+  switch (format) {
+    case kCompressedTextureEtc2:
+      return "etc2";
+    case kCompressedTextureAstc:
+      return "astc";
+    default:
+      return nullptr;
+  }
+}
+
+static uint32_t ReadUint32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+bool ParseKtxHeader(const uint8_t* file, size_t file_size, KtxImage* image) {
+  if (file_size < kKtxHeaderSize ||
+      memcmp(file, kKtxIdentifier, sizeof(kKtxIdentifier)) != 0 ||
+      ReadUint32(file + 12) != kKtxEndianness) {
+    return false;
+  }
+  const uint32_t gl_internal_format = ReadUint32(file + 28);
+  const uint32_t width = ReadUint32(file + 36);
+  const uint32_t height = ReadUint32(file + 40);
+  const uint32_t depth = ReadUint32(file + 44);
+  const uint32_t faces = ReadUint32(file + 52);
+  if (width == 0 || height == 0 || depth > 1 || faces != 1 ||
+      width > 0x10000 || height > 0x10000) {
+    return false;
+  }
+
+  image->gl_internal_format = gl_internal_format;
+  image->width = static_cast<int>(width);
+  image->height = static_cast<int>(height);
+  image->data = nullptr;
+  image->size = 0;
+  return true;
+}
+
+bool ParseKtx(const uint8_t* file, size_t file_size, KtxImage* image) {
+  KtxImage header;
+  if (!ParseKtxHeader(file, file_size, &header)) return false;
+
+  // The first mip level follows the key/value data, prefixed by its size.
+  const uint32_t key_value_bytes = ReadUint32(file + 60);
+  if (key_value_bytes > file_size - kKtxHeaderSize ||
+      file_size - kKtxHeaderSize - key_value_bytes < sizeof(uint32_t)) {
+    return false;
+  }
+  const size_t image_offset = kKtxHeaderSize + key_value_bytes;
+  const uint32_t image_size = ReadUint32(file + image_offset);
+  if (image_size > file_size - image_offset - sizeof(uint32_t)) return false;
+
+  *image = header;
+  image->data = file + image_offset + sizeof(uint32_t);
+  image->size = image_size;
+  return true;
+}
+
+CompressedTextureFormat KtxFormat(const KtxImage& image) {
+  const uint32_t format = image.gl_internal_format;
+  if (format == kGlCompressedRgb8Etc2 || format == kGlCompressedRgba8Etc2Eac) {
+    return kCompressedTextureEtc2;
+  }
+  if (format >= kGlCompressedRgbaAstc4x4 &&
+      format <= kGlCompressedRgbaAstc12x12) {
+    return kCompressedTextureAstc;
+  }
+  return kCompressedTextureNone;
+}
+
+size_t UncompressedBytes(const KtxImage& image) {
+  return static_cast<size_t>(image.width) * image.height * 4;
+}
+
+}  // pie_noon
+}  // fpl
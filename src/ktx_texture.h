@@ -0,0 +1,71 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_KTX_TEXTURE_H_
+#define PIE_NOON_KTX_TEXTURE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// GPU-compressed texture formats that build_assets.py can write. Each has
+// its own directory under assets/, holding a KTX file for each texture
+// under the same path as the texture's .webp, e.g. etc2/textures/x.ktx for
+// textures/x.webp.
+enum CompressedTextureFormat {
+  kCompressedTextureNone,
+  kCompressedTextureEtc2,
+  kCompressedTextureAstc,
+};
+
+// Directory under assets/ for 'format''s textures, or nullptr for none.
+const char* CompressedTextureDirectory(CompressedTextureFormat format);
+
+// OpenGL's internal formats for the textures build_assets.py writes.
+static const uint32_t kGlCompressedRgb8Etc2 = 0x9274;
+static const uint32_t kGlCompressedRgba8Etc2Eac = 0x9278;
+static const uint32_t kGlCompressedRgbaAstc4x4 = 0x93B0;
+static const uint32_t kGlCompressedRgbaAstc12x12 = 0x93BD;
+
+// The largest mip level of a KTX 1.1 file. Points into the file's data.
+struct KtxImage {
+  uint32_t gl_internal_format;
+  int width;
+  int height;
+  const uint8_t* data;
+  size_t size;
+};
+
+// Check the header of the KTX file in 'file', and find its largest image.
+// Only 2D textures, in the native byte order, are supported. Returns false
+// if the file is anything else, or is truncated.
+bool ParseKtx(const uint8_t* file, size_t file_size, KtxImage* image);
+
+// As ParseKtx(), but only reads the 64-byte header, so only fills in the
+// format, width and height. 'image''s data is left null and its size 0.
+bool ParseKtxHeader(const uint8_t* file, size_t file_size, KtxImage* image);
+
+// Which of our formats the image is in, if any.
+CompressedTextureFormat KtxFormat(const KtxImage& image);
+
+// GPU memory the image would take if it were uncompressed RGBA.
+size_t UncompressedBytes(const KtxImage& image);
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_KTX_TEXTURE_H_
@@ -0,0 +1,120 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "lockstep.h"
+
+namespace fpl {
+namespace pie_noon {
+
+void LockstepRandom::Seed(uint32_t seed) {
+  state_ = seed != 0 ? seed : 0x9E3779B9u;
+}
+
+uint32_t LockstepRandom::Next() {
+  // xorshift32.
+  state_ ^= state_ << 13;
+  state_ ^= state_ >> 17;
+  state_ ^= state_ << 5;
+  return state_;
+}
+
+float LockstepRandom::NextFloat() {
+  // The top 24 bits fit exactly in a float.
+  return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f);
+}
+
+int LockstepRandom::InRange(int min, int max) {
+  if (max <= min) return min;
+  const uint32_t range = static_cast<uint32_t>(max - min);
+  return min + static_cast<int>(Next() % range);
+}
+
+void StateHash::Add(uint32_t data) {
+  for (int i = 0; i < 4; ++i) {
+    value_ ^= (data >> (i * 8)) & 0xFF;
+    value_ *= 16777619u;
+  }
+}
+
+const int LockstepSession::kHistorySize;
+const WorldTime LockstepSession::kMaxBacklog;
+
+LockstepSession::LockstepSession()
+    : step_(0),
+      checksum_interval_(1),
+      max_catch_up_frames_(1),
+      is_host_(false),
+      frame_(0),
+      run_until_frame_(0),
+      backlog_(0),
+      history_count_(0) {}
+
+void LockstepSession::Start(WorldTime step, int checksum_interval,
+                            int max_catch_up_frames, bool is_host,
+                            uint32_t run_until_frame) {
+  step_ = step > 0 ? step : 1;
+  checksum_interval_ = checksum_interval > 0 ? checksum_interval : 1;
+  max_catch_up_frames_ = max_catch_up_frames > 0 ? max_catch_up_frames : 1;
+  is_host_ = is_host;
+  frame_ = 0;
+  run_until_frame_ = run_until_frame;
+  backlog_ = 0;
+  history_count_ = 0;
+}
+
+void LockstepSession::Stop() { step_ = 0; }
+
+void LockstepSession::ExtendRunUntil(uint32_t run_until_frame) {
+  if (run_until_frame > run_until_frame_) run_until_frame_ = run_until_frame;
+}
+
+int LockstepSession::FramesToRun(WorldTime delta_time) {
+  if (!active()) return 0;
+  backlog_ = std::min(backlog_ + delta_time, kMaxBacklog);
+
+  int frames = std::min(backlog_ / step_, max_catch_up_frames_);
+  if (!is_host_) {
+    const int allowed = frame_ < run_until_frame_
+                            ? static_cast<int>(run_until_frame_ - frame_)
+                            : 0;
+    frames = std::min(frames, allowed);
+  }
+  backlog_ -= frames * step_;
+  return frames;
+}
+
+bool LockstepSession::EndFrame(uint32_t checksum) {
+  const uint32_t frame = frame_++;
+  if (frame % checksum_interval_ != 0) return false;
+
+  FrameChecksum& entry = history_[history_count_++ % kHistorySize];
+  entry.frame = frame;
+  entry.checksum = checksum;
+  return true;
+}
+
+bool LockstepSession::FindChecksum(uint32_t frame, uint32_t* checksum) const {
+  const int count = std::min(history_count_, kHistorySize);
+  for (int i = 0; i < count; ++i) {
+    if (history_[i].frame == frame) {
+      *checksum = history_[i].checksum;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // pie_noon
+}  // fpl
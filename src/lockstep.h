@@ -0,0 +1,115 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_LOCKSTEP_H_
+#define PIE_NOON_LOCKSTEP_H_
+
+#include <cstdint>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Random numbers that come out the same on every device, given the same
+// seed. Anything that can change the game's outcome has to use one of these
+// for the game to stay in lockstep.
+class LockstepRandom {
+ public:
+  explicit LockstepRandom(uint32_t seed = 1) { Seed(seed); }
+
+  // Zero is replaced by a fixed non-zero seed.
+  void Seed(uint32_t seed);
+
+  uint32_t Next();
+  // In the range [0, 1).
+  float NextFloat();
+  // In the range [min, max). Returns min if the range is empty.
+  int InRange(int min, int max);
+
+ private:
+  uint32_t state_;
+};
+
+// FNV-1a hash, for checking that two games are still the same.
+class StateHash {
+ public:
+  StateHash() : value_(2166136261u) {}
+
+  void Add(uint32_t data);
+  void Add(int data) { Add(static_cast<uint32_t>(data)); }
+
+  uint32_t value() const { return value_; }
+
+ private:
+  uint32_t value_;
+};
+
+// Keeps time for a game running in lockstep. The game runs in fixed steps,
+// or frames, so that every device runs exactly the same ones. Clients may
+// only run up to a frame the host has said is safe, since the host may apply
+// commands on any frame after that.
+class LockstepSession {
+ public:
+  LockstepSession();
+
+  // Start over at frame 0. Hosts are never held back; clients start off
+  // able to run up to 'run_until_frame'.
+  void Start(WorldTime step, int checksum_interval, int max_catch_up_frames,
+             bool is_host, uint32_t run_until_frame);
+  void Stop();
+
+  bool active() const { return step_ > 0; }
+  bool is_host() const { return is_host_; }
+  WorldTime step() const { return step_; }
+  // The next frame to run.
+  uint32_t frame() const { return frame_; }
+
+  // Let a client run further. Never moves back.
+  void ExtendRunUntil(uint32_t run_until_frame);
+
+  // Add 'delta_time' of real time, and return how many frames to run now.
+  int FramesToRun(WorldTime delta_time);
+
+  // Call after running a frame, with a checksum of the game state. Returns
+  // true if the checksum should be compared.
+  bool EndFrame(uint32_t checksum);
+
+  // Returns false if 'frame' had no checksum, or it's been forgotten.
+  bool FindChecksum(uint32_t frame, uint32_t* checksum) const;
+
+ private:
+  static const int kHistorySize = 64;
+  // Limit on real time owed, so a long stall doesn't turn into a long burst.
+  static const WorldTime kMaxBacklog = 1000;
+
+  struct FrameChecksum {
+    uint32_t frame;
+    uint32_t checksum;
+  };
+
+  WorldTime step_;
+  int checksum_interval_;
+  int max_catch_up_frames_;
+  bool is_host_;
+  uint32_t frame_;
+  uint32_t run_until_frame_;
+  WorldTime backlog_;
+  FrameChecksum history_[kHistorySize];
+  int history_count_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_LOCKSTEP_H_
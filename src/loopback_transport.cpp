@@ -0,0 +1,474 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <algorithm>
+#include "fplbase/utilities.h"
+#include "loopback_transport.h"
+
+namespace fpl {
+
+// Same as UdpTransport.
+static const int kConnectTimeout = 5000;
+static const int kResendInterval = 100;
+static const int kPeerTimeout = 5000;
+// Limit on resends of one reliable message, so a link that loses everything
+// can't stall the clock forever.
+static const int kMaxResends = 50;
+// Limit on exponential jitter, as a multiple of its average.
+static const int kMaxJitterMultiple = 10;
+
+LoopbackNetwork::LoopbackNetwork(uint32_t seed)
+    : next_event_order_(0),
+      now_(0),
+      peer_timeout_(kPeerTimeout),
+      random_(seed) {}
+
+MultiplayerTransport* LoopbackNetwork::CreateTransport(
+    const std::string& instance_id) {
+  return new LoopbackTransport(this, instance_id);
+}
+
+void LoopbackNetwork::SetConditions(const std::string& from,
+                                    const std::string& to,
+                                    const LinkConditions& conditions) {
+  Link& link = GetLink(from, to);
+  link.conditions = conditions;
+  link.has_conditions = true;
+}
+
+void LoopbackNetwork::SetLinkCut(const std::string& a, const std::string& b,
+                                 bool cut) {
+  const std::string* ends[2][2] = {{&a, &b}, {&b, &a}};
+  for (int i = 0; i < 2; ++i) {
+    const std::string& from = *ends[i][0];
+    const std::string& to = *ends[i][1];
+    Link& link = GetLink(from, to);
+    if (link.cut == cut) continue;
+    link.cut = cut;
+    if (cut) {
+      link.cut_since = now_;
+      continue;
+    }
+
+    // Resend what was held back, in the order it was sent.
+    std::vector<std::vector<uint8_t>> held;
+    held.swap(link.held);
+    for (auto it = held.begin(); it != held.end(); ++it) {
+      Deliver(from, to, ReliableArrivalTime(&link, it->size()), *it, true);
+    }
+    Endpoint* sender = FindEndpoint(from);
+    if (sender != nullptr && sender->advertising) Announce(from, to);
+  }
+}
+
+void LoopbackNetwork::Advance(int milliseconds) {
+  const int end = now_ + milliseconds;
+  for (;;) {
+    int next = events_.empty() ? -1 : events_.front().time;
+    const int timeout = NextTimeout();
+    if (timeout >= 0 && (next < 0 || timeout < next)) next = timeout;
+    if (next < 0 || next > end) break;
+
+    now_ = std::max(now_, next);
+    ExpireCutLinks();
+    if (!events_.empty() && events_.front().time <= now_) {
+      std::pop_heap(events_.begin(), events_.end(), LaterEvent());
+      const Event event = events_.back();
+      events_.pop_back();
+      event.action();
+    }
+  }
+  now_ = end;
+}
+
+void LoopbackNetwork::Register(const std::string& instance_id,
+                               const std::string& service_id,
+                               MultiplayerTransportListener* listener) {
+  Endpoint& endpoint = endpoints_[instance_id];
+  endpoint = Endpoint();
+  endpoint.listener = listener;
+  endpoint.service_id = service_id;
+}
+
+void LoopbackNetwork::Unregister(const std::string& instance_id) {
+  StopAdvertising(instance_id);
+  endpoints_.erase(instance_id);
+
+  // Everyone connected will notice it's gone once it's been silent long
+  // enough, as if it had crashed.
+  for (auto it = endpoints_.begin(); it != endpoints_.end(); ++it) {
+    if (it->second.connected.count(instance_id) == 0) continue;
+    const std::string other_id = it->first;
+    Schedule(now_ + peer_timeout_, [this, instance_id, other_id]() {
+      Endpoint* other = FindEndpoint(other_id);
+      if (other == nullptr || FindEndpoint(instance_id) != nullptr ||
+          other->connected.erase(instance_id) == 0) {
+        return;
+      }
+      other->listener->OnDisconnected(instance_id);
+    });
+  }
+}
+
+void LoopbackNetwork::StartAdvertising(const std::string& instance_id,
+                                       const std::string& name) {
+  Endpoint* host = FindEndpoint(instance_id);
+  if (host == nullptr) return;
+  host->advertising = true;
+  host->discovering = false;
+  host->advertised_name = name;
+  for (auto it = endpoints_.begin(); it != endpoints_.end(); ++it) {
+    if (it->second.discovering) Announce(instance_id, it->first);
+  }
+  host->listener->OnAdvertisingResult(true);
+}
+
+void LoopbackNetwork::StopAdvertising(const std::string& instance_id) {
+  Endpoint* host = FindEndpoint(instance_id);
+  if (host == nullptr || !host->advertising) return;
+  host->advertising = false;
+  for (auto it = endpoints_.begin(); it != endpoints_.end(); ++it) {
+    if (it->second.found.count(instance_id) != 0) {
+      Withdraw(instance_id, it->first);
+    }
+  }
+}
+
+void LoopbackNetwork::StartDiscovery(const std::string& instance_id) {
+  Endpoint* client = FindEndpoint(instance_id);
+  if (client == nullptr) return;
+  StopAdvertising(instance_id);
+  client->discovering = true;
+  client->found.clear();
+  for (auto it = endpoints_.begin(); it != endpoints_.end(); ++it) {
+    if (it->second.advertising) Announce(it->first, instance_id);
+  }
+}
+
+void LoopbackNetwork::StopDiscovery(const std::string& instance_id) {
+  Endpoint* client = FindEndpoint(instance_id);
+  if (client == nullptr) return;
+  client->discovering = false;
+}
+
+void LoopbackNetwork::SendConnectionRequest(const std::string& client_id,
+                                            const std::string& name,
+                                            const std::string& host_id) {
+  Endpoint* client = FindEndpoint(client_id);
+  if (client == nullptr) return;
+  const std::string service_id = client->service_id;
+  Link& link = GetLink(client_id, host_id);
+  if (link.cut || client->found.count(host_id) == 0) {
+    const int give_up = link.cut ? now_ + kConnectTimeout : now_;
+    Schedule(give_up, [this, client_id, host_id]() {
+      Endpoint* client = FindEndpoint(client_id);
+      if (client == nullptr) return;
+      client->listener->OnConnectionResponse(host_id, false);
+    });
+    return;
+  }
+
+  Schedule(ReliableArrivalTime(&link, name.size()),
+           [this, client_id, name, host_id, service_id]() {
+    Endpoint* host = FindEndpoint(host_id);
+    if (host != nullptr && host->advertising &&
+        host->service_id == service_id) {
+      host->requested.insert(client_id);
+      host->listener->OnConnectionRequest(client_id, name);
+    } else {
+      RespondToConnectionRequest(host_id, client_id, false);
+    }
+  });
+}
+
+void LoopbackNetwork::RespondToConnectionRequest(const std::string& host_id,
+                                                 const std::string& client_id,
+                                                 bool accept) {
+  Endpoint* host = FindEndpoint(host_id);
+  if (host != nullptr) {
+    if (host->requested.erase(client_id) == 0 && accept) return;
+    if (accept) host->connected.insert(client_id);
+  }
+
+  // If the answer can't get through, the client gives up waiting. The host
+  // finds out it's gone when the link times out.
+  Link& link = GetLink(host_id, client_id);
+  const int arrival =
+      link.cut ? now_ + kConnectTimeout : ReliableArrivalTime(&link, 0);
+  const bool accepted = accept && !link.cut;
+  Schedule(arrival, [this, host_id, client_id, accepted]() {
+    Endpoint* client = FindEndpoint(client_id);
+    if (client == nullptr) return;
+    if (accepted) client->connected.insert(host_id);
+    client->listener->OnConnectionResponse(host_id, accepted);
+  });
+}
+
+void LoopbackNetwork::Disconnect(const std::string& instance_id,
+                                 const std::string& other_id) {
+  Endpoint* endpoint = FindEndpoint(instance_id);
+  if (endpoint == nullptr || endpoint->connected.erase(other_id) == 0) return;
+
+  Link& link = GetLink(instance_id, other_id);
+  link.held.clear();
+  // Over a cut link the other end has to wait for the timeout instead.
+  if (link.cut) return;
+  Schedule(ReliableArrivalTime(&link, 0), [this, instance_id, other_id]() {
+    Endpoint* other = FindEndpoint(other_id);
+    if (other == nullptr || other->connected.erase(instance_id) == 0) return;
+    other->listener->OnDisconnected(instance_id);
+  });
+}
+
+void LoopbackNetwork::Send(const std::string& from, const std::string& to,
+                           const uint8_t* data, size_t size, bool reliable) {
+  Endpoint* sender = FindEndpoint(from);
+  if (sender == nullptr || sender->connected.count(to) == 0) return;
+  stats_.messages_sent++;
+
+  Link& link = GetLink(from, to);
+  const std::vector<uint8_t> payload(data, data + size);
+  if (reliable) {
+    if (link.cut) {
+      link.held.push_back(payload);
+    } else {
+      Deliver(from, to, ReliableArrivalTime(&link, size), payload, true);
+    }
+    return;
+  }
+
+  const LinkConditions& conditions = ConditionsFor(link);
+  if (link.cut || Chance(conditions.drop_rate)) {
+    stats_.packets_dropped++;
+    return;
+  }
+  Deliver(from, to, ArrivalTime(&link, size), payload, false);
+  if (Chance(conditions.duplicate_rate)) {
+    Deliver(from, to, ArrivalTime(&link, size), payload, false);
+  }
+}
+
+LoopbackNetwork::Endpoint* LoopbackNetwork::FindEndpoint(
+    const std::string& instance_id) {
+  auto it = endpoints_.find(instance_id);
+  return it == endpoints_.end() ? nullptr : &it->second;
+}
+
+LoopbackNetwork::Link& LoopbackNetwork::GetLink(const std::string& from,
+                                                const std::string& to) {
+  return links_[LinkId(from, to)];
+}
+
+const LinkConditions& LoopbackNetwork::ConditionsFor(const Link& link) const {
+  return link.has_conditions ? link.conditions : default_conditions_;
+}
+
+void LoopbackNetwork::Schedule(int time, const std::function<void()>& action) {
+  Event event;
+  event.time = time;
+  event.order = next_event_order_++;
+  event.action = action;
+  events_.push_back(event);
+  std::push_heap(events_.begin(), events_.end(), LaterEvent());
+}
+
+void LoopbackNetwork::Announce(const std::string& host_id,
+                               const std::string& client_id) {
+  Link& link = GetLink(host_id, client_id);
+  if (host_id == client_id || link.cut) return;
+  Schedule(now_ + ConditionsFor(link).latency_milliseconds,
+           [this, host_id, client_id]() {
+    Endpoint* host = FindEndpoint(host_id);
+    Endpoint* client = FindEndpoint(client_id);
+    if (host == nullptr || client == nullptr || !host->advertising ||
+        !client->discovering || host->service_id != client->service_id ||
+        !client->found.insert(host_id).second) {
+      return;
+    }
+    client->listener->OnEndpointFound(host_id, host->advertised_name);
+  });
+}
+
+void LoopbackNetwork::Withdraw(const std::string& host_id,
+                               const std::string& client_id) {
+  Schedule(now_, [this, host_id, client_id]() {
+    Endpoint* client = FindEndpoint(client_id);
+    if (client == nullptr || client->found.erase(host_id) == 0) return;
+    client->listener->OnEndpointLost(host_id);
+  });
+}
+
+int LoopbackNetwork::ArrivalTime(Link* link, size_t size) {
+  const LinkConditions& conditions = ConditionsFor(*link);
+  int sent = now_;
+  if (conditions.bytes_per_second > 0) {
+    const int start = std::max(now_, link->busy_until);
+    const int duration = static_cast<int>(
+        size * 1000 / static_cast<size_t>(conditions.bytes_per_second));
+    link->busy_until = start + duration;
+    sent = link->busy_until;
+  }
+
+  int jitter = 0;
+  const int max_jitter = conditions.jitter_milliseconds;
+  if (max_jitter > 0) {
+    if (conditions.jitter_distribution == LinkConditions::kJitterExponential) {
+      std::exponential_distribution<float> distribution(1.0f / max_jitter);
+      jitter = static_cast<int>(std::min(
+          distribution(random_),
+          static_cast<float>(max_jitter * kMaxJitterMultiple)));
+    } else {
+      std::uniform_int_distribution<int> distribution(0, max_jitter);
+      jitter = distribution(random_);
+    }
+  }
+  return sent + conditions.latency_milliseconds + jitter;
+}
+
+int LoopbackNetwork::ReliableArrivalTime(Link* link, size_t size) {
+  // Each lost copy costs a resend interval.
+  const float drop_rate = ConditionsFor(*link).drop_rate;
+  int resend_delay = 0;
+  for (int i = 0; i < kMaxResends && Chance(drop_rate); ++i) {
+    stats_.packets_dropped++;
+    link->resends++;
+    resend_delay += kResendInterval;
+  }
+  const int arrival = std::max(ArrivalTime(link, size) + resend_delay,
+                               link->last_reliable_arrival);
+  link->last_reliable_arrival = arrival;
+  return arrival;
+}
+
+void LoopbackNetwork::Deliver(const std::string& from, const std::string& to,
+                              int time, const std::vector<uint8_t>& payload,
+                              bool reliable) {
+  Schedule(time, [this, from, to, payload, reliable]() {
+    Endpoint* receiver = FindEndpoint(to);
+    if (receiver == nullptr || receiver->connected.count(from) == 0) return;
+    stats_.messages_delivered++;
+    stats_.bytes_delivered += payload.size();
+    receiver->listener->OnMessageReceived(from, payload, reliable);
+  });
+}
+
+bool LoopbackNetwork::Chance(float probability) {
+  if (probability <= 0.0f) return false;
+  std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+  return distribution(random_) < probability;
+}
+
+int LoopbackNetwork::NextTimeout() {
+  int next = -1;
+  for (auto it = links_.begin(); it != links_.end(); ++it) {
+    if (!it->second.cut) continue;
+    const Endpoint* receiver = FindEndpoint(it->first.second);
+    if (receiver == nullptr ||
+        receiver->connected.count(it->first.first) == 0) {
+      continue;
+    }
+    const int timeout = it->second.cut_since + peer_timeout_;
+    if (next < 0 || timeout < next) next = timeout;
+  }
+  return next;
+}
+
+void LoopbackNetwork::ExpireCutLinks() {
+  for (auto it = links_.begin(); it != links_.end(); ++it) {
+    Link& link = it->second;
+    if (!link.cut || link.cut_since + peer_timeout_ > now_) continue;
+    const std::string from = it->first.first;
+    const std::string to = it->first.second;
+    Endpoint* receiver = FindEndpoint(to);
+    if (receiver == nullptr || receiver->connected.erase(from) == 0) continue;
+
+    fplbase::LogInfo(fplbase::kApplication,
+                     "LoopbackNetwork: %s timed out on %s", from.c_str(),
+                     to.c_str());
+    // Nothing more gets through from this connection, even if the link comes
+    // back.
+    stats_.packets_dropped += static_cast<int>(link.held.size());
+    link.held.clear();
+    Schedule(now_, [this, from, to]() {
+      Endpoint* receiver = FindEndpoint(to);
+      if (receiver != nullptr) receiver->listener->OnDisconnected(from);
+    });
+  }
+}
+
+LoopbackTransport::LoopbackTransport(LoopbackNetwork* network,
+                                     const std::string& instance_id)
+    : network_(network), instance_id_(instance_id) {}
+
+LoopbackTransport::~LoopbackTransport() { network_->Unregister(instance_id_); }
+
+bool LoopbackTransport::Initialize(const std::string& service_id,
+                                   MultiplayerTransportListener* listener) {
+  network_->Register(instance_id_, service_id, listener);
+  return true;
+}
+
+void LoopbackTransport::StartAdvertising(const std::string& name) {
+  network_->StartAdvertising(instance_id_, name);
+}
+
+void LoopbackTransport::StopAdvertising() {
+  network_->StopAdvertising(instance_id_);
+}
+
+void LoopbackTransport::AcceptConnectionRequest(
+    const std::string& client_instance_id) {
+  network_->RespondToConnectionRequest(instance_id_, client_instance_id, true);
+}
+
+void LoopbackTransport::RejectConnectionRequest(
+    const std::string& client_instance_id) {
+  network_->RespondToConnectionRequest(instance_id_, client_instance_id,
+                                       false);
+}
+
+void LoopbackTransport::StartDiscovery() {
+  network_->StartDiscovery(instance_id_);
+}
+
+void LoopbackTransport::StopDiscovery() {
+  network_->StopDiscovery(instance_id_);
+}
+
+void LoopbackTransport::SendConnectionRequest(
+    const std::string& name, const std::string& host_instance_id) {
+  network_->SendConnectionRequest(instance_id_, name, host_instance_id);
+}
+
+void LoopbackTransport::Disconnect(const std::string& instance_id) {
+  network_->Disconnect(instance_id_, instance_id);
+}
+
+void LoopbackTransport::SendReliableMessage(const std::string& instance_id,
+                                            const uint8_t* data, size_t size) {
+  network_->Send(instance_id_, instance_id, data, size, true);
+}
+
+void LoopbackTransport::SendUnreliableMessage(const std::string& instance_id,
+                                              const uint8_t* data,
+                                              size_t size) {
+  network_->Send(instance_id_, instance_id, data, size, false);
+}
+
+int LoopbackTransport::GetResendCount(const std::string& instance_id) {
+  return network_->GetLink(instance_id_, instance_id).resends;
+}
+
+}  // namespace fpl
@@ -0,0 +1,272 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// loopback_transport.h
+//
+// An emulated network inside one process, for testing GPGMultiplayer and the
+// multiscreen game without devices. Every transport created by a
+// LoopbackNetwork can find and connect to the others.
+//
+// Nothing arrives until the network's clock is moved on with Advance(), so
+// tests control time exactly and run as fast as the CPU allows. Each link
+// can be given latency, jitter, loss, duplication and a bandwidth cap, and
+// can be cut to force disconnections.
+//
+// Not thread safe: create, send, and advance from one thread. Callbacks are
+// made from Advance(), never from inside a transport function, so it's safe
+// to call transport functions while holding a lock.
+
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "multiplayer_transport.h"
+
+namespace fpl {
+
+// How packets going one way down a link misbehave. The defaults make a
+// perfect link.
+struct LinkConditions {
+  enum JitterDistribution {
+    // Anywhere from 0 to jitter_milliseconds.
+    kJitterUniform,
+    // Averages jitter_milliseconds, with a long tail, like a busy wireless
+    // network.
+    kJitterExponential,
+  };
+
+  LinkConditions()
+      : latency_milliseconds(0),
+        jitter_milliseconds(0),
+        jitter_distribution(kJitterUniform),
+        drop_rate(0.0f),
+        duplicate_rate(0.0f),
+        bytes_per_second(0) {}
+
+  // Delay every packet has.
+  int latency_milliseconds;
+  // Extra delay, different for each packet. Unreliable messages can overtake
+  // each other because of it; reliable ones wait for the ones before them.
+  int jitter_milliseconds;
+  JitterDistribution jitter_distribution;
+  // Chance of a packet being lost, from 0 to 1. Lost reliable messages are
+  // resent, as UdpTransport does, so they arrive late instead.
+  float drop_rate;
+  // Chance of an unreliable message arriving twice, from 0 to 1.
+  float duplicate_rate;
+  // 0 for no limit. Otherwise packets queue up behind each other.
+  int bytes_per_second;
+};
+
+// Message traffic over the whole network.
+struct LoopbackStats {
+  LoopbackStats()
+      : messages_sent(0),
+        messages_delivered(0),
+        packets_dropped(0),
+        bytes_delivered(0) {}
+
+  int messages_sent;
+  // Includes duplicates.
+  int messages_delivered;
+  // Unreliable messages lost, and reliable messages that had to be resent.
+  int packets_dropped;
+  size_t bytes_delivered;
+};
+
+class LoopbackNetwork {
+ public:
+  // 'seed' decides which packets are lost and how late they are, so a test
+  // plays out the same every time.
+  explicit LoopbackNetwork(uint32_t seed);
+
+  // A transport for a new instance, to hand to GPGMultiplayer, which takes
+  // ownership. An instance must keep the same id to reconnect into its
+  // old slot. The network must outlive its
+  // transports.
+  MultiplayerTransport* CreateTransport(const std::string& instance_id);
+
+  // For links that haven't been given their own conditions.
+  void set_default_conditions(const LinkConditions& conditions) {
+    default_conditions_ = conditions;
+  }
+  // For packets sent from 'from' to 'to'.
+  void SetConditions(const std::string& from, const std::string& to,
+                     const LinkConditions& conditions);
+
+  // Cut the link between two instances both ways, or restore it. Unreliable
+  // messages sent while it's cut are lost; reliable ones get through once
+  // it's back. Instances cut off from each other for longer than the peer
+  // timeout are told they've been disconnected.
+  void SetLinkCut(const std::string& a, const std::string& b, bool cut);
+
+  // How long a connected instance can go without hearing from another
+  // before giving up on it. Same as UdpTransport by default.
+  void set_peer_timeout_milliseconds(int timeout) { peer_timeout_ = timeout; }
+
+  // Move the clock on, delivering everything that arrives meanwhile in order.
+  void Advance(int milliseconds);
+  // Milliseconds since the network was created.
+  int now() const { return now_; }
+
+  const LoopbackStats& stats() const { return stats_; }
+
+ private:
+  friend class LoopbackTransport;
+
+  typedef std::pair<std::string, std::string> LinkId;
+
+  struct Endpoint {
+    Endpoint()
+        : listener(nullptr), advertising(false), discovering(false) {}
+
+    MultiplayerTransportListener* listener;
+    std::string service_id;
+    bool advertising;
+    std::string advertised_name;
+    bool discovering;
+    // Hosts this client has been told about.
+    std::set<std::string> found;
+    // On the host, clients asking to connect.
+    std::set<std::string> requested;
+    std::set<std::string> connected;
+  };
+
+  // One direction of a link.
+  struct Link {
+    Link()
+        : has_conditions(false),
+          cut(false),
+          cut_since(0),
+          busy_until(0),
+          last_reliable_arrival(0),
+          resends(0) {}
+
+    LinkConditions conditions;
+    bool has_conditions;
+    bool cut;
+    int cut_since;
+    // With a bandwidth cap, when the last packet has finished being sent.
+    int busy_until;
+    // Reliable messages arrive in order, so never before this.
+    int last_reliable_arrival;
+    // Reliable messages waiting for the link to be restored.
+    std::vector<std::vector<uint8_t>> held;
+    // Lost copies of reliable messages, each of which was resent.
+    int resends;
+  };
+
+  struct Event {
+    int time;
+    // Breaks ties, so events due at the same time happen in the order they
+    // were scheduled.
+    uint64_t order;
+    std::function<void()> action;
+  };
+  struct LaterEvent {
+    bool operator()(const Event& a, const Event& b) const {
+      return a.time != b.time ? a.time > b.time : a.order > b.order;
+    }
+  };
+
+  // Called by LoopbackTransport.
+  void Register(const std::string& instance_id, const std::string& service_id,
+                MultiplayerTransportListener* listener);
+  void Unregister(const std::string& instance_id);
+  void StartAdvertising(const std::string& instance_id,
+                        const std::string& name);
+  void StopAdvertising(const std::string& instance_id);
+  void StartDiscovery(const std::string& instance_id);
+  void StopDiscovery(const std::string& instance_id);
+  void SendConnectionRequest(const std::string& client_id,
+                             const std::string& name,
+                             const std::string& host_id);
+  void RespondToConnectionRequest(const std::string& host_id,
+                                  const std::string& client_id, bool accept);
+  void Disconnect(const std::string& instance_id,
+                  const std::string& other_id);
+  void Send(const std::string& from, const std::string& to,
+            const uint8_t* data, size_t size, bool reliable);
+
+  Endpoint* FindEndpoint(const std::string& instance_id);
+  Link& GetLink(const std::string& from, const std::string& to);
+  const LinkConditions& ConditionsFor(const Link& link) const;
+
+  void Schedule(int time, const std::function<void()>& action);
+  // Let a discovering client know about an advertising host.
+  void Announce(const std::string& host_id, const std::string& client_id);
+  // Tell a discovering client that a host has gone.
+  void Withdraw(const std::string& host_id, const std::string& client_id);
+  // When a packet of 'size' bytes sent now arrives.
+  int ArrivalTime(Link* link, size_t size);
+  int ReliableArrivalTime(Link* link, size_t size);
+  void Deliver(const std::string& from, const std::string& to, int time,
+               const std::vector<uint8_t>& payload, bool reliable);
+  bool Chance(float probability);
+
+  // Earliest time a cut link times out, or -1 if none will.
+  int NextTimeout();
+  void ExpireCutLinks();
+
+  std::map<std::string, Endpoint> endpoints_;
+  std::map<LinkId, Link> links_;
+  LinkConditions default_conditions_;
+  std::vector<Event> events_;
+  uint64_t next_event_order_;
+  int now_;
+  int peer_timeout_;
+  std::mt19937 random_;
+  LoopbackStats stats_;
+};
+
+class LoopbackTransport : public MultiplayerTransport {
+ public:
+  LoopbackTransport(LoopbackNetwork* network, const std::string& instance_id);
+  virtual ~LoopbackTransport();
+
+  virtual bool Initialize(const std::string& service_id,
+                          MultiplayerTransportListener* listener);
+
+  virtual void StartAdvertising(const std::string& name);
+  virtual void StopAdvertising();
+  virtual void AcceptConnectionRequest(const std::string& client_instance_id);
+  virtual void RejectConnectionRequest(const std::string& client_instance_id);
+
+  virtual void StartDiscovery();
+  virtual void StopDiscovery();
+  virtual void SendConnectionRequest(const std::string& name,
+                                     const std::string& host_instance_id);
+
+  virtual void Disconnect(const std::string& instance_id);
+  virtual void SendReliableMessage(const std::string& instance_id,
+                                   const uint8_t* data, size_t size);
+  virtual void SendUnreliableMessage(const std::string& instance_id,
+                                     const uint8_t* data, size_t size);
+  virtual int GetResendCount(const std::string& instance_id);
+
+ private:
+  LoopbackNetwork* network_;
+  std::string instance_id_;
+};
+
+}  // namespace fpl
+
+#endif  // LOOPBACK_TRANSPORT_H
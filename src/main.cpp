@@ -16,6 +16,11 @@
 
 #include "pie_noon_game.h"
 
+// --startup-benchmark[=trace.json] writes a trace of startup and exits at the
+// first interactive frame.
+static const char kStartupBenchmarkFlag[] = "--startup-benchmark";
+static const char kDefaultStartupTraceFile[] = "startup_trace.json";
+
 extern "C" int FPL_main(int argc, char* argv[]) {
   fpl::pie_noon::PieNoonGame game;
   const char* binary_directory = argc > 0 ? argv[0] : "";
@@ -27,7 +32,18 @@ extern "C" int FPL_main(int argc, char* argv[]) {
   fpl::pie_noon::PieNoonGame::ParseViewIntentData(
       fplbase::AndroidGetViewIntentData(), &launch_mode, &overlay);
 #else
-  overlay = argc > 1 ? argv[1] : "";
+  const size_t flag_length = sizeof(kStartupBenchmarkFlag) - 1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (argument.compare(0, flag_length, kStartupBenchmarkFlag) != 0) {
+      overlay = argument;
+    } else if (argument.size() > flag_length + 1 &&
+               argument[flag_length] == '=') {
+      game.SetStartupBenchmark(argument.c_str() + flag_length + 1);
+    } else {
+      game.SetStartupBenchmark(kDefaultStartupTraceFile);
+    }
+  }
 #endif  // defined(__ANDROID__)
   fpl::pie_noon::PieNoonGame::SetOverlayName(overlay.c_str());
   if (!game.Initialize(binary_directory)) {
@@ -0,0 +1,109 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "mapped_file.h"
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#define PIE_NOON_USES_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#endif
+
+namespace fpl {
+namespace pie_noon {
+
+MappedFile::MappedFile()
+    : data_(nullptr), size_(0), mapping_(nullptr), asset_(nullptr) {}
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+
+#ifdef PIE_NOON_USES_MMAP
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(file_stat.st_size);
+  if (size > 0) {
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      mapping_ = mapping;
+      data_ = static_cast<const uint8_t*>(mapping);
+      size_ = size;
+    }
+  }
+  // The mapping holds its own reference to the file.
+  close(fd);
+  if (mapping_ != nullptr) return true;
+  // Empty files can't be mapped, and some file systems don't allow it, so
+  // fall back to reading the file.
+#endif  // PIE_NOON_USES_MMAP
+
+#ifdef __ANDROID__
+  // The asset manager maps uncompressed assets straight from the APK, and
+  // only has to inflate compressed ones.
+  AAsset* asset = AAssetManager_open(fplbase::GetAAssetManager(), filename,
+                                     AASSET_MODE_BUFFER);
+  if (asset != nullptr) {
+    const void* buffer = AAsset_getBuffer(asset);
+    if (buffer != nullptr) {
+      asset_ = asset;
+      data_ = static_cast<const uint8_t*>(buffer);
+      size_ = static_cast<size_t>(AAsset_getLength(asset));
+      return true;
+    }
+    AAsset_close(asset);
+  }
+#endif  // __ANDROID__
+
+  if (!fplbase::LoadFileRaw(filename, &contents_)) return false;
+  data_ = reinterpret_cast<const uint8_t*>(contents_.data());
+  size_ = contents_.size();
+  return true;
+}
+
+void MappedFile::OpenView(const uint8_t* data, size_t size) {
+  Close();
+  data_ = data;
+  size_ = size;
+}
+
+void MappedFile::Close() {
+#ifdef PIE_NOON_USES_MMAP
+  if (mapping_ != nullptr) munmap(mapping_, size_);
+#endif
+#ifdef __ANDROID__
+  if (asset_ != nullptr) AAsset_close(static_cast<AAsset*>(asset_));
+#endif
+  mapping_ = nullptr;
+  asset_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+  std::string().swap(contents_);
+}
+
+}  // pie_noon
+}  // fpl
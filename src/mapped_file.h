@@ -0,0 +1,70 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_MAPPED_FILE_H_
+#define PIE_NOON_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// A read-only view of a whole file, for FlatBuffers that are used in place.
+// Where the platform allows, the file is mapped into memory rather than
+// read, so nothing is copied and pages are only loaded as they're touched.
+// On Android the file is an asset in the APK, and the asset manager's buffer
+// is used instead. That is mapped too, as long as the asset is stored
+// uncompressed. On Windows the file is read into memory owned by the
+// MappedFile.
+//
+// The data stays valid, and doesn't move, until the MappedFile is closed or
+// destroyed.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  // Map 'filename', closing any file already open. Returns false, leaving
+  // the MappedFile empty, if it can't be opened or read.
+  bool Open(const char* filename);
+  // Refer to memory owned by something else, such as an asset pack, which
+  // must outlive this view. Closes any file already open.
+  void OpenView(const uint8_t* data, size_t size);
+  void Close();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  // True if the data isn't a copy held by the MappedFile.
+  bool mapped() const { return mapping_ != nullptr || asset_ != nullptr; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  // Start of the mapping, if the file is mapped.
+  void* mapping_;
+  // The open AAsset on Android, which owns the data.
+  void* asset_;
+  // Holds the file's contents, if it isn't mapped.
+  std::string contents_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_MAPPED_FILE_H_
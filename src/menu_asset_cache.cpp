@@ -0,0 +1,180 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "gui_menu.h"
+#include "menu_asset_cache.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// True if all the material's textures are on the GPU, in which case 'bytes'
+// is set to the memory they use there.
+static bool Resident(const fplbase::Material& material, size_t* bytes) {
+  *bytes = 0;
+  const std::vector<fplbase::Texture*>& textures = material.textures();
+  for (auto it = textures.begin(); it != textures.end(); ++it) {
+    if (!(*it)->id()) return false;
+    const mathfu::vec2i size = (*it)->size();
+    *bytes += static_cast<size_t>(size.x()) * size.y() * 4;
+  }
+  return true;
+}
+
+MenuAssetCache::MenuAssetCache()
+    : matman_(nullptr),
+      shaders_(nullptr),
+      budget_bytes_(0),
+      current_menu_(nullptr),
+      frame_(0),
+      resident_bytes_(0),
+      loading_(false) {}
+
+void MenuAssetCache::Initialize(fplbase::AssetManager* matman,
+                                ShaderCache* shaders, size_t budget_bytes) {
+  matman_ = matman;
+  shaders_ = shaders;
+  budget_bytes_ = budget_bytes;
+}
+
+MenuAssetCache::Entry* MenuAssetCache::Load(const char* material_name) {
+  auto it = entries_.find(material_name);
+  if (it == entries_.end()) {
+    fplbase::Material* material = matman_->LoadMaterial(material_name);
+    if (material == nullptr) return nullptr;
+    Entry entry;
+    entry.material = material;
+    entry.last_used = frame_;
+    entry.pinned = false;
+    entry.external = false;
+    it = entries_.insert(std::make_pair(material_name, entry)).first;
+    loading_ = true;
+  }
+  return &it->second;
+}
+
+void MenuAssetCache::Pin(const UiGroup* menu_def) {
+  GuiMenu::ForEachMaterialName(
+      menu_def, [this](const char* name) { PinMaterial(name); });
+}
+
+fplbase::Material* MenuAssetCache::PinMaterial(const char* material_name) {
+  Entry* entry = Load(material_name);
+  if (entry == nullptr) return nullptr;
+  entry->pinned = true;
+  return entry->material;
+}
+
+void MenuAssetCache::AddTransition(const UiGroup* from, const UiGroup* to) {
+  if (from != nullptr && to != nullptr && from != to) {
+    transitions_[from][to]++;
+  }
+}
+
+void MenuAssetCache::Touch(const UiGroup* menu_def) {
+  GuiMenu::ForEachMaterialName(menu_def, [this](const char* name) {
+    Entry* entry = Load(name);
+    if (entry != nullptr) entry->last_used = frame_;
+  });
+}
+
+void MenuAssetCache::Use(const UiGroup* menu_def) {
+  GuiMenu::LoadAssets(menu_def, matman_, shaders_);
+  Touch(menu_def);
+  AddTransition(current_menu_, menu_def);
+  current_menu_ = menu_def;
+
+  // Prefetch the menu that has most often followed this one.
+  auto found = transitions_.find(menu_def);
+  if (found == transitions_.end()) return;
+  auto next = std::max_element(
+      found->second.begin(), found->second.end(),
+      [](const std::pair<const UiGroup* const, int>& a,
+         const std::pair<const UiGroup* const, int>& b) {
+        return a.second < b.second;
+      });
+  if (next != found->second.end()) Prefetch(next->first);
+}
+
+void MenuAssetCache::Prefetch(const UiGroup* menu_def) {
+  GuiMenu::LoadAssets(menu_def, matman_, shaders_);
+  GuiMenu::ForEachMaterialName(menu_def, [this](const char* name) {
+    Load(name);
+  });
+}
+
+void MenuAssetCache::UseMaterial(const char* material_name) {
+  auto it = entries_.find(material_name);
+  if (it == entries_.end()) {
+    Entry entry;
+    entry.material = nullptr;
+    entry.pinned = false;
+    entry.external = true;
+    it = entries_.insert(std::make_pair(material_name, entry)).first;
+  }
+  it->second.last_used = frame_;
+}
+
+void MenuAssetCache::AdvanceFrame() {
+  // The menu on screen stays in use until another replaces it.
+  if (current_menu_ != nullptr) Touch(current_menu_);
+
+  resident_bytes_ = 0;
+  loading_ = false;
+  // Materials that could be unloaded, with when they were last used and
+  // their size.
+  struct Evictable {
+    uint64_t last_used;
+    size_t bytes;
+    EntryMap::iterator entry;
+  };
+  std::vector<Evictable> evictable;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    Entry& entry = it->second;
+    if (entry.material == nullptr) {
+      entry.material = matman_->FindMaterial(it->first.c_str());
+      if (entry.material == nullptr) continue;
+    }
+    size_t bytes;
+    if (!Resident(*entry.material, &bytes)) {
+      // The caller finalizes its own materials, when it chooses to.
+      if (!entry.external) loading_ = true;
+    } else if (!entry.pinned) {
+      resident_bytes_ += bytes;
+      if (entry.last_used != frame_) {
+        const Evictable candidate = {entry.last_used, bytes, it};
+        evictable.push_back(candidate);
+      }
+    }
+  }
+
+  // Unload the least recently used first.
+  std::sort(evictable.begin(), evictable.end(),
+            [](const Evictable& a, const Evictable& b) {
+    return a.last_used < b.last_used;
+  });
+  for (auto it = evictable.begin();
+       it != evictable.end() && resident_bytes_ > budget_bytes_; ++it) {
+    resident_bytes_ -= it->bytes;
+    matman_->UnloadMaterial(it->entry->first.c_str());
+    entries_.erase(it->entry);
+  }
+  frame_++;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,111 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_MENU_ASSET_CACHE_H_
+#define PIE_NOON_MENU_ASSET_CACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include "common.h"
+#include "config_generated.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class ShaderCache;
+
+// Loads menus' textures when the menus are first shown, rather than all at
+// startup, and unloads the least recently used ones once they take up more
+// than a budget. The menu that usually follows the one on screen is loaded
+// ahead of time.
+//
+// Only materials that went through the cache are ever unloaded, and then
+// only once they're on the GPU and not in use.
+class MenuAssetCache {
+ public:
+  MenuAssetCache();
+
+  void Initialize(fplbase::AssetManager* matman, ShaderCache* shaders,
+                  size_t budget_bytes);
+
+  // Never unload these. For materials that are used outside of menus, or are
+  // needed in every game.
+  void Pin(const UiGroup* menu_def);
+  // Returns the material, or nullptr if it can't be loaded.
+  fplbase::Material* PinMaterial(const char* material_name);
+
+  // 'to' is often shown after 'from', so load it when 'from' is shown.
+  // Transitions seen while the game runs are learnt as well.
+  void AddTransition(const UiGroup* from, const UiGroup* to);
+
+  // 'menu_def' is being shown. Load its assets if they aren't loaded, and
+  // start loading the menu most likely to follow it.
+  void Use(const UiGroup* menu_def);
+
+  // Start loading 'menu_def''s assets before they're needed.
+  void Prefetch(const UiGroup* menu_def);
+
+  // 'material_name' is used outside of menus, and loaded by the caller (the
+  // tutorial's slides go through the UploadScheduler, for example). Count it
+  // against the budget once it's loaded, and unload it when it's the least
+  // recently used. Call each frame it's shown.
+  void UseMaterial(const char* material_name);
+
+  // Call once a frame, after the frame's Use() calls. Unloads materials while
+  // the unpinned ones take up more than the budget.
+  void AdvanceFrame();
+
+  // True while any material loaded through the cache isn't on the GPU yet,
+  // so fplbase::AssetManager::TryFinalize() still needs calling.
+  bool loading() const { return loading_; }
+
+  // GPU memory used by the unpinned textures the cache has loaded, as of the
+  // last AdvanceFrame(). Counts four bytes a texel, whatever the format.
+  size_t resident_bytes() const { return resident_bytes_; }
+
+ private:
+  struct Entry {
+    // nullptr until a material loaded by the caller is found.
+    fplbase::Material* material;
+    // Frame the material was last in use.
+    uint64_t last_used;
+    bool pinned;
+    // Loaded by the caller, who also gets it onto the GPU.
+    bool external;
+  };
+
+  typedef std::map<std::string, Entry> EntryMap;
+
+  Entry* Load(const char* material_name);
+  void Touch(const UiGroup* menu_def);
+
+  fplbase::AssetManager* matman_;
+  ShaderCache* shaders_;
+  size_t budget_bytes_;
+  EntryMap entries_;
+  // How often each menu has followed each other menu.
+  std::map<const UiGroup*, std::map<const UiGroup*, int>> transitions_;
+  const UiGroup* current_menu_;
+  uint64_t frame_;
+  size_t resident_bytes_;
+  bool loading_;
+
+  DISALLOW_COPY_AND_ASSIGN(MenuAssetCache);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_MENU_ASSET_CACHE_H_
@@ -0,0 +1,112 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "message_ring.h"
+
+namespace fpl {
+
+MessageRing::MessageRing(size_t capacity, size_t reserved_payload_size)
+    : head_(0),
+      tail_(0),
+      overflowed_(0),
+      overflowing_(false),
+      overflow_size_(0) {
+  size_t size = 1;
+  while (size < capacity) size <<= 1;
+  slots_.resize(size);
+  mask_ = size - 1;
+  for (auto it = slots_.begin(); it != slots_.end(); ++it) {
+    it->payload.reserve(reserved_payload_size);
+  }
+}
+
+void MessageRing::Push(int sender, const uint8_t* data, size_t size) {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  const bool full = tail - head_.load(std::memory_order_acquire) ==
+                    slots_.size();
+  if (!full && !overflowing_.load(std::memory_order_acquire)) {
+    PushToRing(sender, data, size);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(overflow_mutex_);
+  // The consumer may have emptied the overflow since we looked.
+  if (!full && !overflowing_.load(std::memory_order_relaxed)) {
+    PushToRing(sender, data, size);
+    return;
+  }
+  overflowed_++;
+  overflow_.push_back(IncomingMessage());
+  IncomingMessage& message = overflow_.back();
+  message.sender = sender;
+  message.payload.assign(data, data + size);
+  message.received_time = std::chrono::steady_clock::now();
+  overflow_size_.store(overflow_.size());
+  overflowing_.store(true, std::memory_order_release);
+}
+
+void MessageRing::PushToRing(int sender, const uint8_t* data, size_t size) {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  IncomingMessage& slot = slots_[tail & mask_];
+  slot.sender = sender;
+  slot.payload.assign(data, data + size);
+  slot.received_time = std::chrono::steady_clock::now();
+  // Publish the slot only once it's filled in.
+  tail_.store(tail + 1, std::memory_order_release);
+}
+
+bool MessageRing::Pop(IncomingMessage* message) {
+  if (PopFromRing(message)) return true;
+  if (!overflowing_.load(std::memory_order_acquire)) return false;
+
+  std::lock_guard<std::mutex> lock(overflow_mutex_);
+  // The producer may have filled the ring just before it started
+  // overflowing. Those messages are older, and it can't add more to the ring
+  // until the overflow is empty.
+  if (PopFromRing(message)) return true;
+  IncomingMessage& front = overflow_.front();
+  message->sender = front.sender;
+  message->payload.swap(front.payload);
+  message->received_time = front.received_time;
+  overflow_.pop_front();
+  overflow_size_.store(overflow_.size());
+  if (overflow_.empty()) {
+    overflowing_.store(false, std::memory_order_release);
+  }
+  return true;
+}
+
+bool MessageRing::PopFromRing(IncomingMessage* message) {
+  const size_t head = head_.load(std::memory_order_relaxed);
+  if (head == tail_.load(std::memory_order_acquire)) return false;
+  IncomingMessage& slot = slots_[head & mask_];
+  message->sender = slot.sender;
+  message->payload.swap(slot.payload);
+  message->received_time = slot.received_time;
+  // Hand the slot back only once we're done with it.
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+void MessageRing::Clear() {
+  std::lock_guard<std::mutex> lock(overflow_mutex_);
+  head_.store(tail_.load(std::memory_order_acquire),
+              std::memory_order_release);
+  overflow_.clear();
+  overflow_size_.store(0);
+  overflowing_.store(false, std::memory_order_release);
+}
+
+}  // namespace fpl
@@ -0,0 +1,103 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MESSAGE_RING_H
+#define MESSAGE_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace fpl {
+
+// A message received from another instance.
+struct IncomingMessage {
+  IncomingMessage() : sender(-1) {}
+
+  // Player number of the sender, or -1 if it wasn't connected.
+  int sender;
+  std::vector<uint8_t> payload;
+  // When the transport handed it over.
+  std::chrono::steady_clock::time_point received_time;
+};
+
+// Queue of messages, for handing them from one producer thread to one
+// consumer thread. Slots are allocated up front and keep their payload
+// buffers, so once those have grown to fit the largest message, neither side
+// allocates or locks. Reliable messages have already been acknowledged by the
+// time they get here, so none can be dropped: when the ring is full, messages
+// go to an overflow list behind a mutex until the consumer catches up.
+class MessageRing {
+ public:
+  // 'capacity' is rounded up to a power of two. Each slot starts with room
+  // for 'reserved_payload_size' bytes.
+  MessageRing(size_t capacity, size_t reserved_payload_size);
+
+  // Producer only.
+  void Push(int sender, const uint8_t* data, size_t size);
+
+  // Consumer only. Returns false if there are no messages. The payload is
+  // swapped into 'message', so pass the same one each time to keep reusing
+  // its buffer.
+  bool Pop(IncomingMessage* message);
+
+  // Consumer only. Drops every waiting message.
+  void Clear();
+
+  bool Empty() const {
+    return head_.load() == tail_.load() && !overflowing_.load();
+  }
+  // Messages waiting. Only a snapshot, as either side may be busy.
+  size_t Size() const {
+    // Head first, so it can't pass the tail we read.
+    const size_t head = head_.load();
+    return tail_.load() - head + overflow_size_.load();
+  }
+
+  // Messages that found the ring full, and went to the overflow list.
+  int overflowed() const { return overflowed_.load(); }
+
+ private:
+  static const size_t kCacheLineSize = 64;
+
+  void PushToRing(int sender, const uint8_t* data, size_t size);
+  // Returns false if the ring is empty.
+  bool PopFromRing(IncomingMessage* message);
+
+  std::vector<IncomingMessage> slots_;
+  size_t mask_;
+
+  // Next slot to read. Only the consumer writes it.
+  alignas(kCacheLineSize) std::atomic<size_t> head_;
+  // Next slot to write. Only the producer writes it.
+  alignas(kCacheLineSize) std::atomic<size_t> tail_;
+  std::atomic<int> overflowed_;
+
+  // Messages newer than any in the ring. While there are any, the producer
+  // adds to them rather than to the ring, so that order is kept. Only the
+  // producer sets 'overflowing_', and only the consumer clears it, with
+  // 'overflow_mutex_' held.
+  std::mutex overflow_mutex_;
+  std::deque<IncomingMessage> overflow_;
+  std::atomic<bool> overflowing_;
+  std::atomic<size_t> overflow_size_;
+};
+
+}  // namespace fpl
+
+#endif  // MESSAGE_RING_H
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include <algorithm>
+#include <limits>
 #include "common.h"
 #include "controller.h"
 #include "multiplayer_director.h"
@@ -22,7 +24,13 @@ namespace fpl {
 namespace pie_noon {
 
 MultiplayerDirector::MultiplayerDirector()
-    : turn_timer_(0), debug_input_system_(nullptr) {}
+    : turn_timer_(0),
+      debug_input_system_(nullptr),
+      lockstep_step_(0),
+      lockstep_seed_(0),
+      lockstep_frame_(0),
+      following_(false),
+      player_status_pending_(false) {}
 
 void MultiplayerDirector::Initialize(GameState* gamestate,
                                      const Config* config) {
@@ -35,6 +43,8 @@ void MultiplayerDirector::Initialize(GameState* gamestate,
   turn_number_ = 0;
   num_ai_players_ = 0;
   game_running_ = false;
+  lockstep_step_ = 0;
+  lockstep_seed_ = 0;
 }
 
 void MultiplayerDirector::RegisterController(
@@ -61,11 +71,141 @@ void MultiplayerDirector::StartGame() {
   for (unsigned int i = 0; i < character_splats_.size(); i++) {
     character_splats_[i] = 0;
   }
+  status_replication_.Reset(static_cast<int>(controllers_.size()));
+  lockstep_frame_ = 0;
+  following_ = false;
+  pending_turns_.clear();
+  desynced_.assign(controllers_.size(), false);
+  player_status_pending_ = false;
+}
+
+void MultiplayerDirector::EnableLockstep(uint32_t seed, WorldTime step) {
+  lockstep_seed_ = seed;
+  lockstep_step_ = step > 0 ? step : 1;
+}
+
+void MultiplayerDirector::DisableLockstep() {
+  lockstep_step_ = 0;
+  lockstep_seed_ = 0;
+}
+
+void MultiplayerDirector::StartFollowing(WorldTime step) {
+  EnableLockstep(0, step);
+  StartGame();
+  following_ = true;
+  // The host times the turns.
+  start_turn_timer_ = 0;
+}
+
+void MultiplayerDirector::AdvanceLockstepFrame(uint32_t frame,
+                                               WorldTime step) {
+  lockstep_frame_ = frame;
+  if (!following_) {
+    AdvanceFrame(step);
+    return;
+  }
+  while (!pending_turns_.empty() && pending_turns_.front().frame <= frame) {
+    PendingTurn& turn = pending_turns_.front();
+    if (turn.frame < frame) {
+      // The host promised not to do this, so we're out of step now.
+      fplbase::LogError(fplbase::kApplication,
+                        "MultiplayerDirector: turn for frame %d applied late "
+                        "on frame %d",
+                        static_cast<int>(turn.frame), static_cast<int>(frame));
+    }
+    commands_.swap(turn.commands);
+    ApplyTurn(turn.seed);
+    pending_turns_.pop_front();
+  }
+}
+
+void MultiplayerDirector::AdvanceControllers(WorldTime step) {
+  for (auto it = controllers_.begin(); it != controllers_.end(); ++it) {
+    (*it)->AdvanceFrame(step);
+  }
+}
+
+void MultiplayerDirector::QueueTurnCommands(
+    const multiplayer::TurnCommands& turn_commands) {
+  if (!following_) return;
+  PendingTurn turn;
+  turn.frame = turn_commands.frame();
+  turn.seed = turn_commands.seed();
+  turn.commands = commands_;
+  auto commands = turn_commands.commands();
+  if (commands != nullptr) {
+    for (unsigned int i = 0;
+         i < commands->size() && i < turn.commands.size(); i++) {
+      turn.commands[i] = CommandFromMessage(*commands->Get(i));
+    }
+  }
+  pending_turns_.push_back(turn);
+}
+
+void MultiplayerDirector::MarkDesynced(CharacterId id) {
+  if (id < 0 || id >= static_cast<int>(desynced_.size()) || desynced_[id]) {
+    return;
+  }
+  fplbase::LogInfo(fplbase::kApplication,
+                   "MultiplayerDirector: player %d out of step, sending it "
+                   "player statuses",
+                   id);
+  desynced_[id] = true;
+  status_replication_.ResetClient(id);
+}
+
+void MultiplayerDirector::CaptureStatus(PlayerStatusSnapshot* status) {
+  status->health = ReadPlayerHealth();
+  status->splats = character_splats_;
+}
+
+uint32_t MultiplayerDirector::LockstepFrames(WorldTime time) const {
+  return time > 0 ? static_cast<uint32_t>((time + lockstep_step_ - 1) /
+                                          lockstep_step_)
+                  : 0;
+}
+
+uint32_t MultiplayerDirector::FirstTurnEndFrame() const {
+  // Timers count down once on every frame, starting with frame 0, and a
+  // turn's timer starts counting on the frame it's set.
+  const auto* options = config_->multiscreen_options();
+  const WorldTime turn_time =
+      CalculateSecondsPerTurn(1) * kMillisecondsPerSecond +
+      options->network_grace_milliseconds();
+  return LockstepFrames(options->first_turn_delay_milliseconds()) - 1 +
+         LockstepFrames(turn_time) - 1;
+}
+
+uint32_t MultiplayerDirector::NextTurnEndFrame() const {
+  if (start_turn_timer_ <= 0) {
+    // Next turn starts when we're told to, so we can't see past this frame.
+    return lockstep_frame_ + 1;
+  }
+  const WorldTime turn_time =
+      CalculateSecondsPerTurn(turn_number_ + 1) * kMillisecondsPerSecond +
+      config_->multiscreen_options()->network_grace_milliseconds();
+  return lockstep_frame_ + LockstepFrames(start_turn_timer_) +
+         LockstepFrames(turn_time) - 1;
 }
 
 void MultiplayerDirector::EndGame() {
   game_running_ = false;
   turn_timer_ = 0;
+
+  const ReplicationStats& stats = status_replication_.stats();
+  fplbase::LogInfo(fplbase::kApplication,
+                   "MP: Status replication sent %d full, %d delta, %d bytes; "
+                   "received %d acks, %d bytes\n",
+                   stats.full_statuses, stats.delta_statuses,
+                   static_cast<int>(stats.bytes_sent), stats.acks,
+                   static_cast<int>(stats.bytes_received));
+}
+
+void MultiplayerDirector::ReceivePlayerStatusAck(
+    CharacterId id, const multiplayer::PlayerStatusAck& ack,
+    size_t message_size) {
+  status_replication_.RecordReceived(message_size);
+  status_replication_.ReceiveAck(id, ack);
 }
 
 void MultiplayerDirector::AdvanceFrame(WorldTime delta_time) {
@@ -101,6 +241,29 @@ void MultiplayerDirector::TriggerEndOfTurn() {
     }
   }
 
+  turn_timer_ = 0;
+  if (debug_input_system_ == nullptr) {
+    // Schedule the next turn to start soon
+    start_turn_timer_ =
+        config_->multiscreen_options()->start_turn_delay_milliseconds();
+  }
+
+  uint32_t seed = 0;
+  if (lockstep()) {
+    seed = static_cast<uint32_t>(mathfu::RandomInRange<int>(
+        1, std::numeric_limits<int>::max()));
+#ifdef PIE_NOON_USES_MULTISCREEN
+    SendTurnCommandsMsg(seed);
+#endif
+  }
+  ApplyTurn(seed);
+}
+
+void MultiplayerDirector::ApplyTurn(uint32_t seed) {
+  if (seed != 0) {
+    gamestate_->random().Seed(seed);
+  }
+
   for (int i = 0; i < static_cast<int>(controllers_.size()); i++) {
     int character_delay =
         i * config_->multiscreen_options()->char_delay_milliseconds();
@@ -129,17 +292,10 @@ void MultiplayerDirector::TriggerEndOfTurn() {
   for (unsigned int i = 0; i < character_splats_.size(); i++) {
     character_splats_[i] = 0;  // splats only last one turn
   }
-
-  turn_timer_ = 0;
-  if (debug_input_system_ == nullptr) {
-    // Schedule the next turn to start soon
-    start_turn_timer_ =
-        config_->multiscreen_options()->start_turn_delay_milliseconds();
-  }
 }
 
 unsigned int MultiplayerDirector::CalculateSecondsPerTurn(
-    unsigned int turn_number) {
+    unsigned int turn_number) const {
   auto turn_spec_list = config_->multiscreen_options()->turn_length();
   for (auto iter = turn_spec_list->begin(); iter != turn_spec_list->end();
        ++iter) {
@@ -159,7 +315,7 @@ void MultiplayerDirector::TriggerStartOfTurn() {
   set_seconds_per_turn(CalculateSecondsPerTurn(turn_number_));
   turn_timer_ = seconds_per_turn() * kMillisecondsPerSecond +
                 config_->multiscreen_options()->network_grace_milliseconds();
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
   SendStartTurnMsg(seconds_per_turn());
 #endif
 }
@@ -190,7 +346,9 @@ void MultiplayerDirector::TriggerPlayerHitByPie(CharacterId player,
     }
   }
   while (num_splats > 0 && splats_available.size() > 0) {
-    unsigned int idx = mathfu::RandomInRange<int>(
+    // Splats are part of the game, so in lockstep they have to be the same
+    // everywhere.
+    unsigned int idx = gamestate_->random().InRange(
         0, static_cast<int>(splats_available.size()));
     unsigned int splat_used = splats_available[idx];
     unsigned int splat_mask = (1 << splat_used);
@@ -198,8 +356,17 @@ void MultiplayerDirector::TriggerPlayerHitByPie(CharacterId player,
     num_splats--;
     splats_available.erase(splats_available.begin() + idx);
   }
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-  SendPlayerStatusMsg();  // sent unreliably since we may send a bunch in a row
+  if (!following_) player_status_pending_ = true;
+}
+
+void MultiplayerDirector::FlushPendingSends() {
+  if (!player_status_pending_) return;
+  player_status_pending_ = false;
+#ifdef PIE_NOON_USES_MULTISCREEN
+  // Sent unreliably, since there may be a bunch in a row. The statuses are
+  // deltas against what each client has acknowledged, so one send covers
+  // every hit in the frame.
+  SendPlayerStatusMsg();
 #endif
 }
 
@@ -208,8 +375,8 @@ bool MultiplayerDirector::IsAIPlayer(CharacterId player) {
           controllers_.size() - num_ai_players());
 }
 
-void MultiplayerDirector::InputPlayerCommand(
-    CharacterId id, const multiplayer::PlayerCommand& player_command) {
+MultiplayerDirector::Command MultiplayerDirector::CommandFromMessage(
+    const multiplayer::PlayerCommand& player_command) {
   Command command;
   if (player_command.aim_at() >= 0) {
     command.aim_at = (CharacterId)player_command.aim_at();
@@ -218,7 +385,12 @@ void MultiplayerDirector::InputPlayerCommand(
   }
   command.is_firing = player_command.is_firing() != 0;
   command.is_blocking = player_command.is_blocking() != 0;
-  commands_[id] = command;
+  return command;
+}
+
+void MultiplayerDirector::InputPlayerCommand(
+    CharacterId id, const multiplayer::PlayerCommand& player_command) {
+  commands_[id] = CommandFromMessage(player_command);
 }
 
 void MultiplayerDirector::ChooseAICommand(CharacterId id) {
@@ -479,96 +651,164 @@ void MultiplayerDirector::DebugInput(fplbase::InputSystem* input) {
   }
 
   // Enter triggers end of turn manually.
-  if (input->GetButton(fplbase::FPLK_RETURN).went_down()) {
+  // Not in lockstep though, since the clients have been told when the turn
+  // ends.
+  if (input->GetButton(fplbase::FPLK_RETURN).went_down() && !lockstep()) {
     fplbase::LogInfo(fplbase::kApplication, "MP: Enter: Trigger EndOfTurn");
     turn_timer_ = 1;
   }
 }
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
 void MultiplayerDirector::SendPlayerAssignmentMsg(const std::string& instance,
-                                                  CharacterId id) {
-  flatbuffers::FlatBufferBuilder builder;
+                                                  CharacterId id,
+                                                  bool rejoining) {
+  const bool lockstep_client = lockstep() && !rejoining;
+  PooledBuilder builder(&builders_);
   auto message_root = multiplayer::CreateMessageRoot(
-      builder, multiplayer::Data_PlayerAssignment,
-      multiplayer::CreatePlayerAssignment(builder, id).Union());
-  builder.Finish(message_root);
+      *builder, multiplayer::Data_PlayerAssignment,
+      multiplayer::CreatePlayerAssignment(
+          *builder, id, lockstep_client ? lockstep_seed_ : 0,
+          lockstep_client ? FirstTurnEndFrame() : 0)
+          .Union());
+  builder->Finish(message_root);
+
+  gpg_multiplayer_->SendMessage(instance, builder->GetBufferPointer(),
+                                builder->GetSize(), true);
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->SendMessage(instance, message, true);
+  // The client starts over when it gets its assignment.
+  status_replication_.ResetClient(id);
+  if (lockstep() && rejoining) {
+    MarkDesynced(id);
+  }
 }
 
 void MultiplayerDirector::SendStartTurnMsg(unsigned int seconds) {
   // read the player healths
-  std::vector<uint8_t> health_vec = ReadPlayerHealth();
-  std::vector<uint8_t> splats_vec = ReadPlayerSplats();
+  status_replication_.Capture(ReadPlayerHealth(), ReadPlayerSplats());
 
-  flatbuffers::FlatBufferBuilder builder;
-  auto health = builder.CreateVector(health_vec);
-  auto splats = builder.CreateVector(splats_vec);
-  auto player_status = multiplayer::CreatePlayerStatus(builder, health, splats);
+  PooledBuilder builder(&builders_);
+  auto player_status = status_replication_.CreateFullStatus(*builder);
   auto message_root = multiplayer::CreateMessageRoot(
-      builder, multiplayer::Data_StartTurn,
-      multiplayer::CreateStartTurn(builder, (unsigned short)seconds,
-                                   player_status)
+      *builder, multiplayer::Data_StartTurn,
+      multiplayer::CreateStartTurn(
+          *builder, (unsigned short)seconds, player_status,
+          lockstep() ? lockstep_frame_ + LockstepFrames(turn_timer_) - 1 : 0)
           .Union());
-  builder.Finish(message_root);
+  builder->Finish(message_root);
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->BroadcastMessage(message, true);
+  status_replication_.RecordSent(builder->GetSize() *
+                                 gpg_multiplayer_->GetNumConnectedPlayers());
+  gpg_multiplayer_->BroadcastMessage(builder->GetBufferPointer(),
+                                     builder->GetSize(), true);
 }
 
 void MultiplayerDirector::SendEndGameMsg() {
-  std::vector<uint8_t> health_vec = ReadPlayerHealth();
-  std::vector<uint8_t> splats_vec = ReadPlayerSplats();
+  status_replication_.Capture(ReadPlayerHealth(), ReadPlayerSplats());
 
-  flatbuffers::FlatBufferBuilder builder;
-  auto health = builder.CreateVector(health_vec);
-  auto splats = builder.CreateVector(splats_vec);
-  auto player_status = multiplayer::CreatePlayerStatus(builder, health, splats);
+  PooledBuilder builder(&builders_);
+  auto player_status = status_replication_.CreateFullStatus(*builder);
   auto message_root = multiplayer::CreateMessageRoot(
-      builder, multiplayer::Data_EndGame,
-      multiplayer::CreateEndGame(builder, player_status).Union());
-  builder.Finish(message_root);
-
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->BroadcastMessage(message, true);
+      *builder, multiplayer::Data_EndGame,
+      multiplayer::CreateEndGame(*builder, player_status).Union());
+  builder->Finish(message_root);
+
+  status_replication_.RecordSent(builder->GetSize() *
+                                 gpg_multiplayer_->GetNumConnectedPlayers());
+  gpg_multiplayer_->BroadcastMessage(builder->GetBufferPointer(),
+                                     builder->GetSize(), true);
 }
 
 void MultiplayerDirector::SendPlayerStatusMsg() {
-  std::vector<uint8_t> health_vec = ReadPlayerHealth();
-  std::vector<uint8_t> splats_vec = ReadPlayerSplats();
+  status_replication_.Capture(ReadPlayerHealth(), ReadPlayerSplats());
 
-  flatbuffers::FlatBufferBuilder builder;
-  auto health = builder.CreateVector(health_vec);
-  auto splats = builder.CreateVector(splats_vec);
+  // Each client has acknowledged a different status, so each gets its own
+  // delta. A disconnected player leaves an empty slot, which
+  // SendMessageToPlayer() skips, but the players after it still need theirs.
+  for (unsigned int i = 0; i < controllers_.size(); i++) {
+    if (IsAIPlayer(static_cast<CharacterId>(i))) continue;
+    if (lockstep() && !desynced_[i]) continue;
+
+    PooledBuilder builder(&builders_);
+    builder->Finish(status_replication_.CreateDeltaMessage(i, *builder));
+
+    // Unreliably.
+    if (gpg_multiplayer_->SendMessageToPlayer(i, builder->GetBufferPointer(),
+                                              builder->GetSize(), false)) {
+      status_replication_.RecordSent(builder->GetSize());
+    }
+  }
+}
+
+void MultiplayerDirector::SendTurnCommandsMsg(uint32_t seed) {
+  PooledBuilder builder(&builders_);
+  command_offsets_.clear();
+  for (auto it = commands_.begin(); it != commands_.end(); ++it) {
+    command_offsets_.push_back(multiplayer::CreatePlayerCommand(
+        *builder, static_cast<int8_t>(it->aim_at), it->is_firing,
+        it->is_blocking));
+  }
+  auto commands = builder->CreateVector(command_offsets_);
+  auto message_root = multiplayer::CreateMessageRoot(
+      *builder, multiplayer::Data_TurnCommands,
+      multiplayer::CreateTurnCommands(
+          *builder, static_cast<uint16_t>(turn_number_), lockstep_frame_, seed,
+          commands, NextTurnEndFrame())
+          .Union());
+  builder->Finish(message_root);
+
+  gpg_multiplayer_->BroadcastMessage(builder->GetBufferPointer(),
+                                     builder->GetSize(), true);
+}
+
+void MultiplayerDirector::SendFullSyncMsg(const std::string& instance,
+                                          CharacterId id) {
+  status_replication_.Capture(ReadPlayerHealth(), ReadPlayerSplats());
+
+  const auto& characters = gamestate_->characters();
+  pie_damage_.resize(characters.size());
+  for (size_t i = 0; i < characters.size(); i++) {
+    pie_damage_[i] = static_cast<uint8_t>(characters[i]->pie_damage());
+  }
+  const Command command = id >= 0 && id < static_cast<int>(commands_.size())
+                              ? commands_[id]
+                              : Command();
+  // The client's turn ends when ours would, less the grace we give its
+  // command to arrive.
+  const WorldTime client_turn_timer = std::max<WorldTime>(
+      turn_timer_ -
+          config_->multiscreen_options()->network_grace_milliseconds(),
+      0);
+
+  PooledBuilder builder(&builders_);
+  auto player_status = status_replication_.CreateFullStatus(*builder);
+  auto pie_damage = builder->CreateVector(pie_damage_);
+  auto player_command = multiplayer::CreatePlayerCommand(
+      *builder, command.aim_at, command.is_firing, command.is_blocking);
   auto message_root = multiplayer::CreateMessageRoot(
-      builder, multiplayer::Data_PlayerStatus,
-      multiplayer::CreatePlayerStatus(builder, health, splats).Union());
-  builder.Finish(message_root);
+      *builder, multiplayer::Data_FullSync,
+      multiplayer::CreateFullSync(
+          *builder, static_cast<uint16_t>(turn_number_),
+          static_cast<uint32_t>(client_turn_timer),
+          player_status, pie_damage, player_command)
+          .Union());
+  builder->Finish(message_root);
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->BroadcastMessage(message, false);  // Send unreliably.
+  status_replication_.RecordSent(builder->GetSize());
+  gpg_multiplayer_->SendMessage(instance, builder->GetBufferPointer(),
+                                builder->GetSize(), true);
 }
 
-#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#endif  // PIE_NOON_USES_MULTISCREEN
 
-std::vector<uint8_t> MultiplayerDirector::ReadPlayerHealth() {
-  std::vector<uint8_t> vec;
+const std::vector<uint8_t> &MultiplayerDirector::ReadPlayerHealth() {
+  player_health_.clear();
   for (auto iter = controllers_.begin(); iter != controllers_.end(); ++iter) {
     auto controller = *iter;
     int health = controller->GetCharacter().health();
-    vec.push_back((health < 0) ? 0 : static_cast<uint8_t>(health));
+    player_health_.push_back((health < 0) ? 0 : static_cast<uint8_t>(health));
   }
-  return vec;
-}
-
-std::vector<uint8_t> MultiplayerDirector::ReadPlayerSplats() {
-  return character_splats_;
+  return player_health_;
 }
 
 }  // namespace pie_noon
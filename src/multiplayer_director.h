@@ -15,15 +15,18 @@
 #ifndef MULTIPLAYER_DIRECTOR_H_
 #define MULTIPLAYER_DIRECTOR_H_
 
+#include <deque>
 #include <vector>
+#include "builder_pool.h"
 #include "common.h"
 #include "controller.h"
 #include "game_state.h"
 #include "multiplayer_controller.h"
 #include "multiplayer_generated.h"
 #include "pie_noon_game.h"
+#include "status_replicator.h"
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
 #include "gpg_multiplayer.h"
 #endif
 
@@ -45,7 +48,7 @@ class MultiplayerDirector {
 
   // Give the multiplayer director everything it will need.
   void Initialize(GameState *gamestate_ptr, const Config *config);
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
   // Register a pointer to GPGMultiplayer, so we can send multiplayer messages.
   void RegisterGPGMultiplayer(GPGMultiplayer *gpg_multiplayer) {
     gpg_multiplayer_ = gpg_multiplayer;
@@ -60,6 +63,38 @@ class MultiplayerDirector {
   // Start a new multi-screen game.
   void StartGame();
 
+  // Run the game in lockstep with the clients, starting from 'seed', in
+  // fixed steps of 'step'. Call before StartGame() and before sending the
+  // player assignments, which tell the clients to do the same.
+  void EnableLockstep(uint32_t seed, WorldTime step);
+  void DisableLockstep();
+  bool lockstep() const { return lockstep_step_ > 0; }
+  uint32_t lockstep_seed() const { return lockstep_seed_; }
+
+  // On a client, start a lockstep game that follows the host's: turns are
+  // timed by the host, and their commands arrive in QueueTurnCommands().
+  void StartFollowing(WorldTime step);
+
+  // In lockstep, call this before running each frame, instead of
+  // AdvanceFrame(). The host runs its turn timers; a client applies the
+  // host's commands if they're due on this frame.
+  void AdvanceLockstepFrame(uint32_t frame, WorldTime step);
+
+  // In lockstep, the multiplayer controllers have to run in the same steps
+  // as the game, so call this instead of advancing them with everything
+  // else.
+  void AdvanceControllers(WorldTime step);
+
+  // On a client, hold on to a turn's commands until the frame they're due.
+  void QueueTurnCommands(const multiplayer::TurnCommands &turn_commands);
+
+  // In lockstep, this client's game no longer matches ours, so it gets
+  // player statuses from now on.
+  void MarkDesynced(CharacterId id);
+
+  // Fill in the player statuses from our own game.
+  void CaptureStatus(PlayerStatusSnapshot *status);
+
   // End the multi-screen game.
   void EndGame();
 
@@ -69,17 +104,37 @@ class MultiplayerDirector {
     debug_input_system_ = input;
   }
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-  // Tell one of your connected players what his player number is.
-  void SendPlayerAssignmentMsg(const std::string &instance, CharacterId id);
+#ifdef PIE_NOON_USES_MULTISCREEN
+  // Tell one of your connected players what his player number is. In
+  // lockstep, players joining at the start of the game also get the seed;
+  // players 'rejoining' a game in progress can't catch up, so get player
+  // statuses instead.
+  void SendPlayerAssignmentMsg(const std::string &instance, CharacterId id,
+                               bool rejoining);
   // Broadcast start-of-turn to the players.
   void SendStartTurnMsg(unsigned int turn_seconds);
   // Broadcast end-of-game message to the players.
   void SendEndGameMsg();
-  // Broadcast player health to the players.
+  // Send each player the changes to player health since the last status
+  // it acknowledged. In lockstep, only players that have fallen out of step
+  // need them.
   void SendPlayerStatusMsg();
+  // In lockstep, broadcast this turn's commands, to be applied on this frame.
+  void SendTurnCommandsMsg(uint32_t seed);
+  // Bring a reconnected player up to date with the game in progress. Send
+  // right after its player assignment.
+  void SendFullSyncMsg(const std::string &instance, CharacterId id);
 #endif
 
+  // A client has acknowledged a player status.
+  void ReceivePlayerStatusAck(CharacterId id,
+                              const multiplayer::PlayerStatusAck &ack,
+                              size_t message_size);
+
+  const ReplicationStats &status_stats() const {
+    return status_replication_.stats();
+  }
+
   // Takes effect when the next turn starts.
   void set_seconds_per_turn(unsigned int seconds) {
     seconds_per_turn_ = seconds;
@@ -97,9 +152,15 @@ class MultiplayerDirector {
 
   // Internally, call this when a player has been hit by a pie. The multiplayer
   // director will decide whether that player should be "stunned" by the hit
-  // and have one or more of his buttons locked for a turn.
+  // and have one or more of his buttons locked for a turn. The game state
+  // calls this from its frame, which may be on a job system thread, so the
+  // resulting status is only sent by FlushPendingSends().
   void TriggerPlayerHitByPie(CharacterId player, int damage);
 
+  // Send the messages that the game state's frame asked for. Call on the
+  // main thread, after the frame.
+  void FlushPendingSends();
+
   // Is this an AI player or a human player?
   bool IsAIPlayer(CharacterId player);
 
@@ -120,12 +181,32 @@ class MultiplayerDirector {
     Command() : aim_at(-1), is_firing(false), is_blocking(false) {}
   };
 
+  // A turn's commands, waiting on a client for the frame they're due.
+  struct PendingTurn {
+    uint32_t frame;
+    uint32_t seed;
+    std::vector<Command> commands;
+  };
+
+  static Command CommandFromMessage(const multiplayer::PlayerCommand &message);
+
   void TriggerStartOfTurn();
   void TriggerEndOfTurn();
-  unsigned int CalculateSecondsPerTurn(unsigned int turn_number);
-
-  // Get all the players' healths so we can send them in an update
-  std::vector<uint8_t> ReadPlayerHealth();
+  // Have the characters carry out this turn's commands. In lockstep, 'seed'
+  // restarts the game's random numbers, the same on every device.
+  void ApplyTurn(uint32_t seed);
+  unsigned int CalculateSecondsPerTurn(unsigned int turn_number) const;
+
+  // In lockstep, the number of frames until 'time' runs out.
+  uint32_t LockstepFrames(WorldTime time) const;
+  // In lockstep, the frame on which the first turn ends.
+  uint32_t FirstTurnEndFrame() const;
+  // In lockstep, the frame on which the next turn ends, once this one has.
+  uint32_t NextTurnEndFrame() const;
+
+  // Get all the players' healths so we can send them in an update. Returns
+  // a reference to player_health_, which is refilled on each call.
+  const std::vector<uint8_t> &ReadPlayerHealth();
 
   // Tell the multiplayer director to choose AI commands for this player.
   void ChooseAICommand(CharacterId id);
@@ -133,13 +214,17 @@ class MultiplayerDirector {
   void DebugInput(fplbase::InputSystem *input);
 
   // Get all the players' onscreen splats to send in an update
-  std::vector<uint8_t> ReadPlayerSplats();
+  const std::vector<uint8_t> &ReadPlayerSplats() const {
+    return character_splats_;
+  }
 
   GameState *gamestate_;  // Pointer to the gamestate object
   const Config *config_;  // Pointer to the config structure
 
   std::vector<MultiplayerController *> controllers_;
   std::vector<uint8_t> character_splats_;
+  // Filled in by ReadPlayerHealth().
+  std::vector<uint8_t> player_health_;
   // How long the current turn lasts.
   WorldTime turn_timer_;
   // In how long to start the next turn.
@@ -153,11 +238,35 @@ class MultiplayerDirector {
 
   std::vector<Command> commands_;
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  // True if TriggerPlayerHitByPie() changed a player's splats since they
+  // were last sent.
+  bool player_status_pending_;
+
+  // Tracks which player statuses each client has, for sending deltas.
+  StatusReplicationHost status_replication_;
+
+#ifdef PIE_NOON_USES_MULTISCREEN
   GPGMultiplayer *gpg_multiplayer_ = nullptr;
+  // Builders for outgoing messages, reused so that sending doesn't allocate.
+  FlatBufferBuilderPool builders_;
+  // Scratch space for SendTurnCommandsMsg().
+  std::vector<flatbuffers::Offset<multiplayer::PlayerCommand>> command_offsets_;
+  // Scratch space for SendFullSyncMsg().
+  std::vector<uint8_t> pie_damage_;
 #endif
 
   bool game_running_;
+
+  // Fixed step the game runs in, in lockstep. 0 if not in lockstep.
+  WorldTime lockstep_step_;
+  uint32_t lockstep_seed_;
+  // Frame being run, in lockstep.
+  uint32_t lockstep_frame_;
+  // True on clients, whose turns are run by the host.
+  bool following_;
+  std::deque<PendingTurn> pending_turns_;
+  // Clients whose games no longer match ours.
+  std::vector<bool> desynced_;
 };
 
 }  // pie_noon
@@ -0,0 +1,245 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <algorithm>
+#include <cstdio>
+#include "multiplayer_telemetry.h"
+
+namespace fpl {
+
+// Weight of each new sample in smoothed values.
+static const float kSmoothing = 0.125f;
+static const std::chrono::seconds kRateWindow(1);
+
+static float Smooth(float smoothed, float sample, int samples_before) {
+  return samples_before == 0 ? sample
+                             : smoothed + (sample - smoothed) * kSmoothing;
+}
+
+static float ToMilliseconds(MultiplayerTelemetry::Clock::duration duration) {
+  return std::chrono::duration<float, std::milli>(duration).count();
+}
+
+PeerTelemetry::PeerTelemetry()
+    : round_trip_milliseconds(-1),
+      smoothed_round_trip_milliseconds(0.0f),
+      min_round_trip_milliseconds(0),
+      max_round_trip_milliseconds(0),
+      pings_answered(0),
+      messages_sent(0),
+      bytes_sent(0),
+      messages_received(0),
+      bytes_received(0),
+      messages_sent_per_second(0.0f),
+      bytes_sent_per_second(0.0f),
+      messages_received_per_second(0.0f),
+      bytes_received_per_second(0.0f),
+      reliable_resends(0) {}
+
+QueueTelemetry::QueueTelemetry()
+    : depth(0),
+      max_depth(0),
+      overflowed(0),
+      last_delay_milliseconds(0.0f),
+      smoothed_delay_milliseconds(0.0f),
+      max_delay_milliseconds(0.0f),
+      delays_recorded(0) {}
+
+const int MultiplayerTelemetry::kMaxPeers;
+
+MultiplayerTelemetry::Peer::Peer()
+    : messages_sent(0),
+      bytes_sent(0),
+      messages_received(0),
+      bytes_received(0),
+      window_messages_sent(0),
+      window_bytes_sent(0),
+      window_messages_received(0),
+      window_bytes_received(0) {}
+
+MultiplayerTelemetry::MultiplayerTelemetry() : num_peers_(0) { Reset(); }
+
+void MultiplayerTelemetry::Reset() {
+  for (int i = 0; i < kMaxPeers; ++i) {
+    Peer& peer = peers_[i];
+    peer.messages_sent = 0;
+    peer.bytes_sent = 0;
+    peer.messages_received = 0;
+    peer.bytes_received = 0;
+    peer.telemetry = PeerTelemetry();
+    peer.window_messages_sent = 0;
+    peer.window_bytes_sent = 0;
+    peer.window_messages_received = 0;
+    peer.window_bytes_received = 0;
+  }
+  num_peers_ = 0;
+  queue_ = QueueTelemetry();
+  window_start_ = Clock::now();
+}
+
+void MultiplayerTelemetry::RecordSent(int player, size_t size) {
+  Peer* peer = GetPeer(player);
+  if (peer == nullptr) return;
+  peer->messages_sent.fetch_add(1, std::memory_order_relaxed);
+  peer->bytes_sent.fetch_add(size, std::memory_order_relaxed);
+}
+
+void MultiplayerTelemetry::RecordReceived(int player, size_t size) {
+  Peer* peer = GetPeer(player);
+  if (peer == nullptr) return;
+  peer->messages_received.fetch_add(1, std::memory_order_relaxed);
+  peer->bytes_received.fetch_add(size, std::memory_order_relaxed);
+}
+
+void MultiplayerTelemetry::RecordRoundTrip(int player, int milliseconds) {
+  Peer* peer = GetPeer(player);
+  if (peer == nullptr || milliseconds < 0) return;
+  PeerTelemetry& telemetry = peer->telemetry;
+  telemetry.round_trip_milliseconds = milliseconds;
+  telemetry.smoothed_round_trip_milliseconds =
+      Smooth(telemetry.smoothed_round_trip_milliseconds,
+             static_cast<float>(milliseconds), telemetry.pings_answered);
+  if (telemetry.pings_answered == 0 ||
+      milliseconds < telemetry.min_round_trip_milliseconds) {
+    telemetry.min_round_trip_milliseconds = milliseconds;
+  }
+  telemetry.max_round_trip_milliseconds =
+      std::max(telemetry.max_round_trip_milliseconds, milliseconds);
+  telemetry.pings_answered++;
+}
+
+void MultiplayerTelemetry::RecordResends(int player, int total) {
+  Peer* peer = GetPeer(player);
+  if (peer == nullptr) return;
+  peer->telemetry.reliable_resends = total;
+}
+
+void MultiplayerTelemetry::RecordQueue(int depth, int overflowed) {
+  queue_.depth = depth;
+  queue_.max_depth = std::max(queue_.max_depth, depth);
+  queue_.overflowed = overflowed;
+}
+
+void MultiplayerTelemetry::RecordDeliveryDelay(Clock::duration delay) {
+  const float milliseconds = ToMilliseconds(delay);
+  queue_.last_delay_milliseconds = milliseconds;
+  queue_.smoothed_delay_milliseconds =
+      Smooth(queue_.smoothed_delay_milliseconds, milliseconds,
+             queue_.delays_recorded);
+  queue_.max_delay_milliseconds =
+      std::max(queue_.max_delay_milliseconds, milliseconds);
+  queue_.delays_recorded++;
+}
+
+bool MultiplayerTelemetry::Update() {
+  const Clock::time_point now = Clock::now();
+  if (now - window_start_ < kRateWindow) return false;
+
+  const float seconds = ToMilliseconds(now - window_start_) / 1000.0f;
+  const int num_peers = num_peers_.load(std::memory_order_acquire);
+  for (int i = 0; i < num_peers; ++i) {
+    Peer& peer = peers_[i];
+    PeerTelemetry& telemetry = peer.telemetry;
+    const uint64_t messages_sent =
+        peer.messages_sent.load(std::memory_order_relaxed);
+    const uint64_t bytes_sent =
+        peer.bytes_sent.load(std::memory_order_relaxed);
+    const uint64_t messages_received =
+        peer.messages_received.load(std::memory_order_relaxed);
+    const uint64_t bytes_received =
+        peer.bytes_received.load(std::memory_order_relaxed);
+    telemetry.messages_sent_per_second =
+        (messages_sent - peer.window_messages_sent) / seconds;
+    telemetry.bytes_sent_per_second =
+        (bytes_sent - peer.window_bytes_sent) / seconds;
+    telemetry.messages_received_per_second =
+        (messages_received - peer.window_messages_received) / seconds;
+    telemetry.bytes_received_per_second =
+        (bytes_received - peer.window_bytes_received) / seconds;
+    peer.window_messages_sent = messages_sent;
+    peer.window_bytes_sent = bytes_sent;
+    peer.window_messages_received = messages_received;
+    peer.window_bytes_received = bytes_received;
+  }
+  window_start_ = now;
+  return true;
+}
+
+int MultiplayerTelemetry::num_peers() const {
+  return num_peers_.load(std::memory_order_acquire);
+}
+
+PeerTelemetry MultiplayerTelemetry::peer(int player) const {
+  if (player < 0 || player >= num_peers()) return PeerTelemetry();
+  const Peer& peer = peers_[player];
+  PeerTelemetry telemetry = peer.telemetry;
+  telemetry.messages_sent = peer.messages_sent.load(std::memory_order_relaxed);
+  telemetry.bytes_sent = peer.bytes_sent.load(std::memory_order_relaxed);
+  telemetry.messages_received =
+      peer.messages_received.load(std::memory_order_relaxed);
+  telemetry.bytes_received =
+      peer.bytes_received.load(std::memory_order_relaxed);
+  return telemetry;
+}
+
+bool MultiplayerTelemetry::DumpToFile(const std::string& filename) const {
+  FILE* file = fopen(filename.c_str(), "w");
+  if (file == nullptr) return false;
+
+  fprintf(file,
+          "player,round_trip_ms,smoothed_round_trip_ms,min_round_trip_ms,"
+          "max_round_trip_ms,pings_answered,messages_sent,bytes_sent,"
+          "messages_received,bytes_received,messages_sent_per_second,"
+          "bytes_sent_per_second,messages_received_per_second,"
+          "bytes_received_per_second,reliable_resends\n");
+  const int num_peers = this->num_peers();
+  for (int i = 0; i < num_peers; ++i) {
+    const PeerTelemetry peer = this->peer(i);
+    fprintf(file, "%d,%d,%.1f,%d,%d,%d,%llu,%llu,%llu,%llu,%.1f,%.1f,%.1f,"
+                  "%.1f,%d\n",
+            i, peer.round_trip_milliseconds,
+            peer.smoothed_round_trip_milliseconds,
+            peer.min_round_trip_milliseconds,
+            peer.max_round_trip_milliseconds, peer.pings_answered,
+            static_cast<unsigned long long>(peer.messages_sent),
+            static_cast<unsigned long long>(peer.bytes_sent),
+            static_cast<unsigned long long>(peer.messages_received),
+            static_cast<unsigned long long>(peer.bytes_received),
+            peer.messages_sent_per_second, peer.bytes_sent_per_second,
+            peer.messages_received_per_second,
+            peer.bytes_received_per_second, peer.reliable_resends);
+  }
+  fprintf(file,
+          "\nqueue_depth,max_queue_depth,overflowed,last_delay_ms,"
+          "smoothed_delay_ms,max_delay_ms,delays_recorded\n");
+  fprintf(file, "%d,%d,%d,%.2f,%.2f,%.2f,%d\n", queue_.depth,
+          queue_.max_depth, queue_.overflowed, queue_.last_delay_milliseconds,
+          queue_.smoothed_delay_milliseconds, queue_.max_delay_milliseconds,
+          queue_.delays_recorded);
+  return fclose(file) == 0;
+}
+
+MultiplayerTelemetry::Peer* MultiplayerTelemetry::GetPeer(int player) {
+  if (player < 0 || player >= kMaxPeers) return nullptr;
+  int num_peers = num_peers_.load(std::memory_order_relaxed);
+  while (num_peers <= player &&
+         !num_peers_.compare_exchange_weak(num_peers, player + 1,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+  }
+  return &peers_[player];
+}
+
+}  // namespace fpl
@@ -0,0 +1,150 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// multiplayer_telemetry.h
+//
+// Counters for the connection to each other player, so that when a message
+// turns up late we can tell whether the network was slow or the game thread
+// was busy: round trip times, traffic in each direction, reliable resends,
+// and how long messages wait in the queue between the transport's thread and
+// the game's.
+//
+// Round trip times come from the game, which pings and times the replies.
+// Everything else is recorded by GPGMultiplayer.
+
+#ifndef MULTIPLAYER_TELEMETRY_H
+#define MULTIPLAYER_TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace fpl {
+
+// Traffic with one other player.
+struct PeerTelemetry {
+  PeerTelemetry();
+
+  // From the latest ping, or -1 if none has been answered yet.
+  int round_trip_milliseconds;
+  // Averaged over recent pings, the way TCP does.
+  float smoothed_round_trip_milliseconds;
+  int min_round_trip_milliseconds;
+  int max_round_trip_milliseconds;
+  int pings_answered;
+
+  uint64_t messages_sent;
+  uint64_t bytes_sent;
+  uint64_t messages_received;
+  uint64_t bytes_received;
+  // Over the last whole second.
+  float messages_sent_per_second;
+  float bytes_sent_per_second;
+  float messages_received_per_second;
+  float bytes_received_per_second;
+
+  // Reliable messages the transport has had to send again.
+  int reliable_resends;
+};
+
+// Messages waiting to be handed to the game.
+struct QueueTelemetry {
+  QueueTelemetry();
+
+  // Messages waiting at the last update, and the most ever seen.
+  int depth;
+  int max_depth;
+  // Messages that found the queue full, and had to wait in its overflow.
+  int overflowed;
+  // From the transport handing a message over to the game taking it.
+  float last_delay_milliseconds;
+  float smoothed_delay_milliseconds;
+  float max_delay_milliseconds;
+  int delays_recorded;
+};
+
+// RecordSent and RecordReceived are called on the transport's threads as
+// well as the game's, so they only add to atomic counters and never block.
+// Everything else, including reading the numbers back, is for the game
+// thread.
+class MultiplayerTelemetry {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Players beyond this are assumed to be bogus.
+  static const int kMaxPeers = 64;
+
+  MultiplayerTelemetry();
+
+  // Forget everything, for a new game.
+  void Reset();
+
+  // 'player' is the player number in GPGMultiplayer. Messages from players
+  // that aren't connected (-1) aren't counted.
+  void RecordSent(int player, size_t size);
+  void RecordReceived(int player, size_t size);
+  void RecordRoundTrip(int player, int milliseconds);
+  // 'total' is the transport's running count for the player.
+  void RecordResends(int player, int total);
+  void RecordQueue(int depth, int overflowed);
+  void RecordDeliveryDelay(Clock::duration delay);
+
+  // Work out the per-second rates. Returns true when they've been updated,
+  // about once a second.
+  bool Update();
+
+  // Snapshots of the numbers so far.
+  int num_peers() const;
+  PeerTelemetry peer(int player) const;
+  QueueTelemetry queue() const { return queue_; }
+
+  // Write every counter to 'filename' as comma-separated text. Returns false
+  // if the file couldn't be written.
+  bool DumpToFile(const std::string& filename) const;
+
+ private:
+  struct Peer {
+    Peer();
+
+    // Added to from any thread.
+    std::atomic<uint64_t> messages_sent;
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> messages_received;
+    std::atomic<uint64_t> bytes_received;
+
+    // Game thread only. The traffic totals in here are filled in when a
+    // snapshot is taken.
+    PeerTelemetry telemetry;
+    // Counters when the current rate window started.
+    uint64_t window_messages_sent;
+    uint64_t window_bytes_sent;
+    uint64_t window_messages_received;
+    uint64_t window_bytes_received;
+  };
+
+  // Counts 'player' in num_peers(). Returns nullptr if 'player' is out of
+  // range.
+  Peer* GetPeer(int player);
+
+  Peer peers_[kMaxPeers];
+  // One more than the highest player recorded.
+  std::atomic<int> num_peers_;
+  QueueTelemetry queue_;
+  Clock::time_point window_start_;
+};
+
+}  // namespace fpl
+
+#endif  // MULTIPLAYER_TELEMETRY_H
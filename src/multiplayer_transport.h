@@ -0,0 +1,118 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// multiplayer_transport.h
+//
+// The network underneath GPGMultiplayer. GPGMultiplayer owns the connection
+// state machine, player slots and message queue; a transport just finds
+// other instances, connects to them, and moves bytes.
+//
+// NearbyTransport uses the Nearby Connections API on Android. UdpTransport
+// uses plain UDP sockets, so that hosts and clients can run as separate
+// processes on one machine, or on a local network.
+
+#ifndef MULTIPLAYER_TRANSPORT_H
+#define MULTIPLAYER_TRANSPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Multi-screen games need either Nearby Connections (Android) or BSD sockets,
+// which leaves out Windows.
+#if !defined(_WIN32)
+#define PIE_NOON_USES_MULTISCREEN
+#endif
+
+namespace fpl {
+
+// Receives events from a transport. Transports may call these from any
+// thread, but never while holding a lock that the transport's own functions
+// take, so it's safe to call back into the transport.
+class MultiplayerTransportListener {
+ public:
+  virtual ~MultiplayerTransportListener() {}
+
+  // On the host, when advertising has started, or failed to.
+  virtual void OnAdvertisingResult(bool success) = 0;
+  // On the host, when a client asks to connect.
+  virtual void OnConnectionRequest(const std::string& instance_id,
+                                   const std::string& name) = 0;
+
+  // On the client, when a host is found or goes away.
+  virtual void OnEndpointFound(const std::string& instance_id,
+                               const std::string& name) = 0;
+  virtual void OnEndpointLost(const std::string& instance_id) = 0;
+  // On the client, when the host accepts or rejects our request.
+  virtual void OnConnectionResponse(const std::string& instance_id,
+                                    bool accepted) = 0;
+
+  // On either side, for connected instances only. Messages are delivered
+  // from one thread at a time, so GPGMultiplayer can queue them without
+  // locking.
+  virtual void OnMessageReceived(const std::string& instance_id,
+                                 const std::vector<uint8_t>& payload,
+                                 bool reliable) = 0;
+  virtual void OnDisconnected(const std::string& instance_id) = 0;
+};
+
+class MultiplayerTransport {
+ public:
+  virtual ~MultiplayerTransport() {}
+
+  // Only instances initialized with the same service_id can see each other.
+  // 'listener' must outlive the transport.
+  virtual bool Initialize(const std::string& service_id,
+                          MultiplayerTransportListener* listener) = 0;
+
+  // Used for linking to the app store, for transports that support it.
+  virtual void AddAppIdentifier(const std::string& identifier) {
+    (void)identifier;
+  }
+
+  // Host side.
+  virtual void StartAdvertising(const std::string& name) = 0;
+  virtual void StopAdvertising() = 0;
+  virtual void AcceptConnectionRequest(
+      const std::string& client_instance_id) = 0;
+  virtual void RejectConnectionRequest(
+      const std::string& client_instance_id) = 0;
+
+  // Client side.
+  virtual void StartDiscovery() = 0;
+  virtual void StopDiscovery() = 0;
+  virtual void SendConnectionRequest(const std::string& name,
+                                     const std::string& host_instance_id) = 0;
+
+  // Either side.
+  virtual void Disconnect(const std::string& instance_id) = 0;
+  // Reliable messages arrive once each, in the order they were sent. The
+  // payload is copied if it needs to outlive the call.
+  virtual void SendReliableMessage(const std::string& instance_id,
+                                   const uint8_t* data, size_t size) = 0;
+  // Unreliable messages may be dropped, duplicated or reordered.
+  virtual void SendUnreliableMessage(const std::string& instance_id,
+                                     const uint8_t* data, size_t size) = 0;
+
+  // Reliable messages resent to 'instance_id' so far, for transports that
+  // resend them.
+  virtual int GetResendCount(const std::string& instance_id) {
+    (void)instance_id;
+    return 0;
+  }
+};
+
+}  // namespace fpl
+
+#endif  // MULTIPLAYER_TRANSPORT_H
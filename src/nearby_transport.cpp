@@ -0,0 +1,132 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "fplbase/utilities.h"
+#include "nearby_transport.h"
+
+namespace fpl {
+
+NearbyTransport::NearbyTransport() : listener_(nullptr) {}
+
+bool NearbyTransport::Initialize(const std::string& service_id,
+                                 MultiplayerTransportListener* listener) {
+  service_id_ = service_id;
+  listener_ = listener;
+  discovery_listener_.reset(new DiscoveryListener(listener));
+  message_listener_.reset(new MessageListener(listener));
+
+  gpg::AndroidPlatformConfiguration platform_configuration;
+  platform_configuration.SetActivity((jobject)fplbase::AndroidGetActivity());
+
+  gpg::NearbyConnections::Builder nearby_builder;
+  nearby_connections_ = nearby_builder.SetDefaultOnLog(gpg::LogLevel::VERBOSE)
+                            .SetServiceId(service_id_)
+                            .Create(platform_configuration);
+  if (nearby_connections_ == nullptr) {
+    fplbase::LogError(
+        fplbase::kApplication,
+        "NearbyTransport: Unable to build a NearbyConnections instance.");
+    return false;
+  }
+  return true;
+}
+
+void NearbyTransport::AddAppIdentifier(const std::string& identifier) {
+  gpg::AppIdentifier id;
+  id.identifier = identifier;
+  app_identifiers_.push_back(id);
+}
+
+void NearbyTransport::StartAdvertising(const std::string& name) {
+  nearby_connections_->StartAdvertising(
+      name, app_identifiers_, gpg::Duration::zero(),
+      [this](int64_t /*client_id*/, gpg::StartAdvertisingResult const& result) {
+        if (result.status == gpg::StartAdvertisingResult::StatusCode::SUCCESS) {
+          fplbase::LogInfo(fplbase::kApplication,
+                           "NearbyTransport: Started advertising (name='%s')",
+                           result.local_endpoint_name.c_str());
+        } else {
+          fplbase::LogError(
+              fplbase::kApplication,
+              "NearbyTransport: FAILED to start advertising, error code %d",
+              result.status);
+        }
+        listener_->OnAdvertisingResult(
+            result.status == gpg::StartAdvertisingResult::StatusCode::SUCCESS);
+      },
+      [this](int64_t /*client_id*/, gpg::ConnectionRequest const& request) {
+        listener_->OnConnectionRequest(request.remote_endpoint_id,
+                                       request.remote_endpoint_name);
+      });
+}
+
+void NearbyTransport::StopAdvertising() {
+  nearby_connections_->StopAdvertising();
+}
+
+void NearbyTransport::AcceptConnectionRequest(
+    const std::string& client_instance_id) {
+  nearby_connections_->AcceptConnectionRequest(
+      client_instance_id, std::vector<uint8_t>{}, message_listener_.get());
+}
+
+void NearbyTransport::RejectConnectionRequest(
+    const std::string& client_instance_id) {
+  nearby_connections_->RejectConnectionRequest(client_instance_id);
+}
+
+void NearbyTransport::StartDiscovery() {
+  nearby_connections_->StartDiscovery(service_id_, gpg::Duration::zero(),
+                                      discovery_listener_.get());
+}
+
+void NearbyTransport::StopDiscovery() {
+  nearby_connections_->StopDiscovery(service_id_);
+}
+
+void NearbyTransport::SendConnectionRequest(
+    const std::string& name, const std::string& host_instance_id) {
+  nearby_connections_->SendConnectionRequest(
+      name, host_instance_id, std::vector<uint8_t>{},
+      [this](int64_t /*client_id*/, gpg::ConnectionResponse const& response) {
+        if (response.status != gpg::ConnectionResponse::StatusCode::ACCEPTED) {
+          fplbase::LogInfo(fplbase::kApplication,
+                           "NearbyTransport: Connection response status = %d",
+                           response.status);
+        }
+        listener_->OnConnectionResponse(
+            response.remote_endpoint_id,
+            response.status == gpg::ConnectionResponse::StatusCode::ACCEPTED);
+      },
+      message_listener_.get());
+}
+
+void NearbyTransport::Disconnect(const std::string& instance_id) {
+  nearby_connections_->Disconnect(instance_id);
+}
+
+void NearbyTransport::SendReliableMessage(const std::string& instance_id,
+                                          const uint8_t* data, size_t size) {
+  payload_.assign(data, data + size);
+  nearby_connections_->SendReliableMessage(instance_id, payload_);
+}
+
+void NearbyTransport::SendUnreliableMessage(const std::string& instance_id,
+                                            const uint8_t* data, size_t size) {
+  payload_.assign(data, data + size);
+  nearby_connections_->SendUnreliableMessage(instance_id, payload_);
+}
+
+}  // namespace fpl
@@ -0,0 +1,113 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// nearby_transport.h
+//
+// MultiplayerTransport using the Nearby Connections API in the Google Play
+// Games SDK. Android only.
+
+#ifndef NEARBY_TRANSPORT_H
+#define NEARBY_TRANSPORT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "multiplayer_transport.h"
+
+namespace fpl {
+
+class NearbyTransport : public MultiplayerTransport {
+ public:
+  NearbyTransport();
+
+  virtual bool Initialize(const std::string& service_id,
+                          MultiplayerTransportListener* listener);
+  virtual void AddAppIdentifier(const std::string& identifier);
+
+  virtual void StartAdvertising(const std::string& name);
+  virtual void StopAdvertising();
+  virtual void AcceptConnectionRequest(const std::string& client_instance_id);
+  virtual void RejectConnectionRequest(const std::string& client_instance_id);
+
+  virtual void StartDiscovery();
+  virtual void StopDiscovery();
+  virtual void SendConnectionRequest(const std::string& name,
+                                     const std::string& host_instance_id);
+
+  virtual void Disconnect(const std::string& instance_id);
+  virtual void SendReliableMessage(const std::string& instance_id,
+                                   const uint8_t* data, size_t size);
+  virtual void SendUnreliableMessage(const std::string& instance_id,
+                                     const uint8_t* data, size_t size);
+
+ private:
+  // Listens for hosts that are advertising.
+  class DiscoveryListener : public gpg::IEndpointDiscoveryListener {
+   public:
+    explicit DiscoveryListener(MultiplayerTransportListener* listener)
+        : listener_(listener) {}
+    void OnEndpointFound(int64_t /*client_id*/,
+                         gpg::EndpointDetails const& endpoint_details) {
+      // Ignore client_id because we only have one NearbyConnections client.
+      listener_->OnEndpointFound(endpoint_details.endpoint_id,
+                                 endpoint_details.name);
+    }
+    void OnEndpointLost(int64_t /*client_id*/, const std::string& instance_id) {
+      // Ignore client_id because we only have one NearbyConnections client.
+      listener_->OnEndpointLost(instance_id);
+    }
+
+   private:
+    MultiplayerTransportListener* listener_;
+  };
+
+  // Listens for messages or disconnects from connected instances.
+  class MessageListener : public gpg::IMessageListener {
+   public:
+    explicit MessageListener(MultiplayerTransportListener* listener)
+        : listener_(listener) {}
+    void OnMessageReceived(int64_t /* client_id */,
+                           const std::string& instance_id,
+                           std::vector<uint8_t> const& payload,
+                           bool is_reliable) {
+      // Ignore client_id because we only have one NearbyConnections client.
+      listener_->OnMessageReceived(instance_id, payload, is_reliable);
+    }
+    void OnDisconnected(int64_t /* client_id */,
+                        const std::string& instance_id) {
+      // Ignore client_id because we only have one NearbyConnections client.
+      listener_->OnDisconnected(instance_id);
+    }
+
+   private:
+    MultiplayerTransportListener* listener_;
+  };
+
+  // The NearbyConnections library.
+  std::unique_ptr<gpg::NearbyConnections> nearby_connections_;
+  std::unique_ptr<DiscoveryListener> discovery_listener_;
+  std::unique_ptr<MessageListener> message_listener_;
+  MultiplayerTransportListener* listener_;
+
+  std::string service_id_;
+  std::vector<gpg::AppIdentifier> app_identifiers_;
+
+  // Nearby Connections wants payloads in a vector. This one is reused, so it
+  // stops allocating once it fits the largest message.
+  std::vector<uint8_t> payload_;
+};
+
+}  // namespace fpl
+
+#endif  // NEARBY_TRANSPORT_H
@@ -13,12 +13,16 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include <limits>
 #include "SDL_events.h"
 #include "analytics_tracking.h"
+#include "asset_pack.h"
 #include "audio_config_generated.h"
 #include "character_state_machine.h"
 #include "character_state_machine_def_generated.h"
 #include "config_generated.h"
+#include "fplbase/glplatform.h"
+#include "materials_generated.h"
 #include "motive/init.h"
 #include "motive/io/flatbuffers.h"
 #include "motive/math/angle.h"
@@ -29,10 +33,15 @@
 #include "timeline_generated.h"
 #include "touchscreen_controller.h"
 
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#include "nearby_transport.h"
+#elif defined(PIE_NOON_USES_MULTISCREEN)
+#include "udp_transport.h"
+#endif
+
 #include "SDL.h"
 
 #ifdef ANDROID_HMD
-#include "fplbase/glplatform.h"
 #include "fplbase/renderer_hmd.h"
 #endif  // ANDROID_HMD
 
@@ -47,8 +56,8 @@ using mathfu::mat3;
 namespace fpl {
 namespace pie_noon {
 
-static const int kQuadNumVertices = 4;
-static const int kQuadNumIndices = 6;
+// On multiscreen clients, how bright a player's face is with no health left.
+static const float kNoHealthButtonBrightness = 0.4f;
 
 static const char* kCategoryUi = "Ui";
 static const char* kActionClickedButton = "Clicked button";
@@ -71,7 +80,7 @@ static const char* kLabelMultiscreenButton = "Multiscreen";
 static const char* kLabelCardboardButton = "Cardboard";
 static const char* kLabelGameModesButton = "Game Modes";
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
 static const char* kCategoryMultiscreen = "Multiscreen";
 static const char* kActionStart = "Start";
 static const char* kActionFinish = "Finish";
@@ -84,14 +93,7 @@ static const char* kLabelReconnection = "Reconnection";
 static const char* kLabelHostDisconnected = "HostDisconnect";
 static const char* kLabelClientsDisconnected = "ClientDisconnect";
 static const char* kLabelConnectionLost = "ConnectionLost";
-#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
-
-static const unsigned short kQuadIndices[] = {0, 1, 2, 2, 1, 3};
-
-static const fplbase::Attribute kQuadMeshFormat[] = {
-  fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
-  fplbase::kTangent4f, fplbase::kEND
-};
+#endif  // PIE_NOON_USES_MULTISCREEN
 
 static const char kAssetsDir[] = "assets";
 
@@ -99,6 +101,9 @@ static const char kConfigFileName[] = "config.pieconfig";
 
 static const char kDefaultOverlayFile[] = "default_overlay.txt";
 
+static const char kStateMachineFileName[] =
+    "character_state_machine_def.piestate";
+
 #ifdef ANDROID_HMD
 static const char kCardboardConfigFileName[] = "cardboard_config.pieconfig";
 #endif
@@ -114,6 +119,12 @@ static std::vector<std::string> achievement_ids;
 #endif
 
 std::string PieNoonGame::overlay_name_;
+AssetPack PieNoonGame::asset_pack_;
+AssetPack PieNoonGame::overlay_pack_;
+StartupTracer PieNoonGame::startup_tracer_;
+TextureLoadPlan PieNoonGame::texture_load_plan_;
+CompressedTextureFormat PieNoonGame::compressed_texture_format_ =
+    kCompressedTextureNone;
 
 // Return the elapsed milliseconds since the start of the program. This number
 // will loop back to 0 after about 49 days; always take the difference to
@@ -147,15 +158,20 @@ PieNoonGame::PieNoonGame()
     : state_(kUninitialized),
       state_entry_time_(0),
       matman_(renderer_),
-      stick_front_(nullptr),
-      stick_back_(nullptr),
+      stick_front_(CardboardQuads::kInvalidQuad),
+      stick_back_(CardboardQuads::kInvalidQuad),
       shader_lit_textured_normal_(nullptr),
       shader_simple_shadow_(nullptr),
       shader_textured_(nullptr),
       shader_grayscale_(nullptr),
       shadow_mat_(nullptr),
+      current_scene_(0),
+      scene_ready_(false),
       prev_world_time_(0),
+      job_stats_time_(0),
+      upload_stats_time_(0),
       debug_previous_states_(),
+      textures_loaded_(false),
       full_screen_fader_(&renderer_),
       fade_exit_state_(kUninitialized),
       ambience_channel_(),
@@ -165,44 +181,35 @@ PieNoonGame::PieNoonGame()
   fplbase::SetLoadFileFunction(PieNoonGame::LoadFile);
   version_ = kVersion;
   for (size_t i = 0; i < RenderableId_Count; ++i) {
-    cardboard_backs_[i] = nullptr;
+    cardboard_backs_[i] = CardboardQuads::kInvalidQuad;
   }
 }
 
 PieNoonGame::~PieNoonGame() {
-  for (int i = 0; i < RenderableId_Count; ++i) {
-    std::vector<fplbase::Mesh*>& fronts = cardboard_fronts_[i];
-    for (size_t j = 0; j < fronts.size(); ++j) {
-      delete fronts[j];
-      fronts[j] = nullptr;
-    }
-
-    delete cardboard_backs_[i];
-    cardboard_backs_[i] = nullptr;
-  }
-
-  delete stick_front_;
-  stick_front_ = nullptr;
-
-  delete stick_back_;
-  stick_back_ = nullptr;
+  // The plan outlives the job system.
+  texture_load_plan_.WaitForDecoding();
 }
 
-bool PieNoonGame::InitializeConfig() {
-  if (!LoadFile(kConfigFileName, &config_source_)) {
-    fplbase::LogError(fplbase::kError, "can't load %s\n", kConfigFileName);
+bool PieNoonGame::MapConfig(const char* filename, MappedFile* dest) {
+  if (!MapFile(filename, dest)) {
+    fplbase::LogError(fplbase::kError, "can't load %s\n", filename);
+    return false;
+  }
+  flatbuffers::Verifier verifier(dest->data(), dest->size());
+  if (!VerifyConfigBuffer(verifier)) {
+    fplbase::LogError(fplbase::kError, "%s is corrupt\n", filename);
     return false;
   }
   return true;
 }
 
+bool PieNoonGame::InitializeConfig() {
+  return MapConfig(kConfigFileName, &config_file_);
+}
+
 #ifdef ANDROID_HMD
 bool PieNoonGame::InitializeCardboardConfig() {
-  if (!LoadFile(kCardboardConfigFileName, &cardboard_config_source_)) {
-    fplbase::LogError(fplbase::kError, "can't load %s\n", kCardboardConfigFileName);
-    return false;
-  }
-  return true;
+  return MapConfig(kCardboardConfigFileName, &cardboard_config_file_);
 }
 #endif  // ANDROID_HMD
 
@@ -260,57 +267,23 @@ bool PieNoonGame::InitializeRenderer() {
   return true;
 }
 
-struct NormalMappedVertex {
-  mathfu::vec3_packed pos;
-  mathfu::vec2_packed tc;
-  mathfu::vec3_packed norm;
-  mathfu::vec4_packed tangent;
-};
-
-// Initializes 'vertices' at the specified position, aligned up-and-down.
-// 'vertices' must be an array of length kQuadNumVertices.
-static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
-                               const vec2& texture_coord_size,
-                               NormalMappedVertex* vertices) {
-  const float half_width = geo_size[0] * 0.5f;
-  const vec3 bottom_left = offset + vec3(-half_width, 0.0f, 0.0f);
-  const vec3 top_right = offset + vec3(half_width, geo_size[1], 0.0f);
-
-  vertices[0].pos = bottom_left;
-  vertices[1].pos = vec3(top_right[0], bottom_left[1], offset[2]);
-  vertices[2].pos = vec3(bottom_left[0], top_right[1], offset[2]);
-  vertices[3].pos = top_right;
-
-  const float coord_half_width = texture_coord_size[0] * 0.5f;
-  const vec2 coord_bottom_left(0.5f - coord_half_width, 1.0f);
-  const vec2 coord_top_right(0.5f + coord_half_width,
-                             1.0f - texture_coord_size[1]);
-
-  vertices[0].tc = coord_bottom_left;
-  vertices[1].tc = vec2(coord_top_right[0], coord_bottom_left[1]);
-  vertices[2].tc = vec2(coord_bottom_left[0], coord_top_right[1]);
-  vertices[3].tc = coord_top_right;
-
-  fplbase::Mesh::ComputeNormalsTangents(vertices, &kQuadIndices[0],
-      kQuadNumVertices, kQuadNumIndices);
-}
-
-// Creates a mesh of a single quad (two triangles) vertically upright.
+// Adds a single quad (two triangles) vertically upright to cardboard_quads_.
 // The quad's has x and y size determined by the size of the texture.
 // The quad is offset in (x,y,z) space by the 'offset' variable.
-// Returns a mesh with the quad and texture, or nullptr if anything went wrong.
-fplbase::Mesh* PieNoonGame::CreateVerticalQuadMesh(
+// Returns the quad, or kInvalidQuad if anything went wrong.
+CardboardQuads::QuadId PieNoonGame::AddVerticalQuad(
     const flatbuffers::String* material_name, const vec3& offset,
     const vec2& pixel_bounds, float pixel_to_world_scale) {
   // Don't try to load obviously invalid materials. Suppresses error logs from
   // the material manager.
   if (material_name == nullptr || material_name->c_str()[0] == '\0')
-    return nullptr;
+    return CardboardQuads::kInvalidQuad;
 
   // Load the material from file, and check validity.
-  auto material = matman_.LoadMaterial(material_name->c_str());
+  auto material = LoadStartupMaterial(material_name->c_str(),
+                                      kLoadPriorityCardboards);
   bool material_valid = material != nullptr && material->textures().size() > 0;
-  if (!material_valid) return nullptr;
+  if (!material_valid) return CardboardQuads::kInvalidQuad;
 
   // Create vertex geometry in proportion to the texture size.
   // This is nice for the artist since everything is at the scale of the
@@ -321,15 +294,26 @@ fplbase::Mesh* PieNoonGame::CreateVerticalQuadMesh(
   const vec2 texture_coord_size = pixel_bounds / texture_size;
   const vec2 geo_size = pixel_bounds * vec2(pixel_to_world_scale);
 
-  // Initialize a vertex array in the requested position.
-  NormalMappedVertex vertices[kQuadNumVertices];
-  CreateVerticalQuad(offset, geo_size, texture_coord_size, vertices);
+  return cardboard_quads_.Add(offset, geo_size, texture_coord_size, material);
+}
 
-  // Create mesh and add in quad indices.
-  auto mesh = new fplbase::Mesh(vertices, kQuadNumVertices,
-                                sizeof(NormalMappedVertex), kQuadMeshFormat);
-  mesh->AddIndices(kQuadIndices, kQuadNumIndices, material);
-  return mesh;
+// Request the textures and shaders for 'menu_def', as part of 'priority'.
+void PieNoonGame::LoadMenuAssets(const UiGroup* menu_def,
+                                 LoadPriority priority) {
+  std::vector<fplbase::Material*> materials;
+  gui_menu_.LoadAssets(menu_def, &matman_, &shader_cache_, &materials);
+  for (auto it = materials.begin(); it != materials.end(); ++it) {
+    texture_load_plan_.Add(priority, *it);
+  }
+  menu_assets_.Pin(menu_def);
+}
+
+// Request a material that stays loaded all session, as part of 'priority'.
+fplbase::Material* PieNoonGame::LoadStartupMaterial(const char* material_name,
+                                                    LoadPriority priority) {
+  fplbase::Material* material = menu_assets_.PinMaterial(material_name);
+  texture_load_plan_.Add(priority, material);
+  return material;
 }
 
 // Load textures for cardboard into 'materials_'. The 'renderer_' and 'matman_'
@@ -346,13 +330,33 @@ bool PieNoonGame::InitializeRenderingAssets() {
     return false;
   }
 
-  // Force these textures to be queued up first, since we want to use them for
-  // the loading screen.
-  matman_.LoadMaterial(config.loading_material()->c_str());
-  matman_.LoadMaterial(config.loading_logo()->c_str());
-  matman_.LoadMaterial(config.fade_material()->c_str());
-
-  // Create a mesh for the front and back of each cardboard cutout.
+  // Menus load their own assets when they're first shown.
+  menu_assets_.Initialize(
+      &matman_, &shader_cache_,
+      static_cast<size_t>(config.menu_texture_budget_kilobytes()) * 1024);
+  gui_menu_.set_asset_cache(&menu_assets_);
+  gui_menu_.set_shader_cache(&shader_cache_);
+
+  // Textures are decoded in the order they're requested, so request them in
+  // the order they're needed. First, the loading screen.
+  LoadStartupMaterial(config.loading_material()->c_str(),
+                      kLoadPriorityLoadingScreen);
+  LoadStartupMaterial(config.loading_logo()->c_str(),
+                      kLoadPriorityLoadingScreen);
+  LoadStartupMaterial(config.fade_material()->c_str(),
+                      kLoadPriorityLoadingScreen);
+
+  // Then the title menu, which is shown once loading is done.
+  gui_menu_.LoadDebugShaderAndOptions(&config, &shader_cache_);
+  LoadMenuAssets(TitleScreenButtons(config), kLoadPriorityTitleMenu);
+
+  // Then everything seen in a game.
+  LoadMenuAssets(config.touchscreen_zones(), kLoadPriorityCardboards);
+  LoadMenuAssets(config.pause_screen_buttons(), kLoadPriorityCardboards);
+
+  // Create a quad for the front and back of each cardboard cutout.
+  const StartupTracer::Clock::time_point meshes_start =
+      StartupTracer::Clock::now();
   const vec3 front_z_offset(0.0f, 0.0f, config.cardboard_front_z_offset());
   const vec3 back_z_offset(0.0f, 0.0f, config.cardboard_back_z_offset());
   for (int id = 0; id < RenderableId_Count; ++id) {
@@ -370,81 +374,84 @@ bool PieNoonGame::InitializeRenderingAssets() {
         renderable->geometry_scale() * config.pixel_to_world_scale();
 
     const auto front = renderable->cardboard_fronts();
-    cardboard_fronts_[id].resize(front->size(), nullptr);
+    cardboard_fronts_[id].resize(front->size(), CardboardQuads::kInvalidQuad);
     for (size_t i = 0; i < front->size(); ++i) {
-      cardboard_fronts_[id][i] = CreateVerticalQuadMesh(
+      cardboard_fronts_[id][i] = AddVerticalQuad(
           front->Get(i), front_offset, pixel_bounds, pixel_to_world_scale);
     }
 
     cardboard_backs_[id] =
-        CreateVerticalQuadMesh(renderable->cardboard_back(), back_offset,
-                               pixel_bounds, pixel_to_world_scale);
+        AddVerticalQuad(renderable->cardboard_back(), back_offset,
+                        pixel_bounds, pixel_to_world_scale);
   }
 
   // We default to the invalid texture, so it has to exist.
-  if (!cardboard_fronts_[RenderableId_Invalid][0]) {
+  if (cardboard_fronts_[RenderableId_Invalid][0] ==
+      CardboardQuads::kInvalidQuad) {
     fplbase::LogError(fplbase::kError, "Can't load backup texture.\n");
     return false;
   }
 
-  // Create stick front and back meshes.
+  // Create stick front and back quads.
   const vec3 stick_front_offset(0.0f, config.stick_y_offset(),
                                 config.stick_front_z_offset());
   const vec3 stick_back_offset(0.0f, config.stick_y_offset(),
                                config.stick_back_z_offset());
-  stick_front_ = CreateVerticalQuadMesh(
+  stick_front_ = AddVerticalQuad(
       config.stick_front(), stick_front_offset, LoadVec2(config.stick_bounds()),
       config.pixel_to_world_scale());
-  stick_back_ = CreateVerticalQuadMesh(config.stick_back(), stick_back_offset,
-                                       LoadVec2(config.stick_bounds()),
-                                       config.pixel_to_world_scale());
+  stick_back_ = AddVerticalQuad(config.stick_back(), stick_back_offset,
+                                LoadVec2(config.stick_bounds()),
+                                config.pixel_to_world_scale());
+
+  // Then upload them all at once.
+  if (!cardboard_quads_.Upload()) return false;
+
+  startup_tracer_.AddSpan("CreateMeshes", meshes_start);
 
   // Load all shaders we use:
+  const StartupTracer::Clock::time_point shaders_start =
+      StartupTracer::Clock::now();
   shader_lit_textured_normal_ =
-      matman_.LoadShader("shaders/lit_textured_normal");
-  shader_cardboard = matman_.LoadShader("shaders/cardboard");
-  shader_simple_shadow_ = matman_.LoadShader("shaders/simple_shadow");
-  shader_textured_ = matman_.LoadShader("shaders/textured");
-  shader_grayscale_ = matman_.LoadShader("shaders/grayscale");
+      shader_cache_.LoadShader("shaders/lit_textured_normal");
+  shader_cardboard = shader_cache_.LoadShader("shaders/cardboard");
+  shader_simple_shadow_ = shader_cache_.LoadShader("shaders/simple_shadow");
+  shader_textured_ = shader_cache_.LoadShader("shaders/textured");
+  shader_grayscale_ = shader_cache_.LoadShader("shaders/grayscale");
   if (!(shader_lit_textured_normal_ && shader_cardboard &&
         shader_simple_shadow_ && shader_textured_ && shader_grayscale_))
     return false;
+  startup_tracer_.AddSpan("LoadShaders", shaders_start);
+  startup_tracer_.AddCounter("Shader cache", "hits", shader_cache_.hits());
+  startup_tracer_.AddCounter("Shader cache", "misses", shader_cache_.misses());
+  fplbase::LogInfo(fplbase::kApplication,
+                   "Shaders: %d loaded from saved programs, %d compiled\n",
+                   shader_cache_.hits(), shader_cache_.misses());
 
   // Load shadow material:
-  shadow_mat_ = matman_.LoadMaterial("materials/floor_shadows.fplmat");
+  shadow_mat_ = LoadStartupMaterial("materials/floor_shadows.fplmat",
+                                    kLoadPriorityCardboards);
   if (!shadow_mat_) return false;
 
-  // Load debug shader if available
-  gui_menu_.LoadDebugShaderAndOptions(&config, &matman_);
-
-  // Load all the menu textures.
-  gui_menu_.LoadAssets(TitleScreenButtons(config), &matman_);
-  gui_menu_.LoadAssets(config.touchscreen_zones(), &matman_);
-  gui_menu_.LoadAssets(config.pause_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.multiplayer_host(), &matman_);
-  gui_menu_.LoadAssets(config.multiplayer_client(), &matman_);
-  gui_menu_.LoadAssets(config.join_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.extras_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_pleasewait_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_waitingforplayers_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_waitingforgame_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_searching_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_connecting_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_cant_host_game_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_connection_lost_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_host_disconnected_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_all_players_disconnected_screen_buttons(),
-                       &matman_);
-  gui_menu_.LoadAssets(config.game_modes_screen_buttons(), &matman_);
+  // The rest of the menus are loaded when they're first shown, along with
+  // the menu most likely to follow. Most players go from the title menu
+  // straight to a game; the cache learns the rest as menus are used.
+  menu_assets_.AddTransition(TitleScreenButtons(config),
+                             config.game_modes_screen_buttons());
+
   // Configure the full screen fader.
   full_screen_fader_.set_material(
       matman_.FindMaterial(config.fade_material()->c_str()));
   full_screen_fader_.set_shader(shader_textured_);
 
-  // Start the thread that actually loads all assets we requested above.
+  // Decode the webp textures requested above on the workers, and start the
+  // thread that loads the rest.
+  texture_load_plan_.StartDecoding(&job_system_, ReadAssetFile);
   matman_.StartLoadingTextures();
 
+  upload_scheduler_.set_budget_milliseconds(
+      config.texture_upload_budget_milliseconds());
+
   return true;
 }
 
@@ -456,18 +463,26 @@ bool PieNoonGame::InitializeGameState() {
   game_state_.set_config(&config);
   game_state_.set_cardboard_config(&GetCardboardConfig());
 
+  game_state_.set_job_system(&job_system_);
+
   // Register the motivator types with the MotiveEngine.
   motive::OvershootInit::Register();
   motive::SplineInit::Register();
   motive::MatrixInit::Register();
 
-  // Load flatbuffer into buffer.
-  if (!LoadFile("character_state_machine_def.piestate",
-                &state_machine_source_)) {
+  // Map the flatbuffer, and check it once.
+  if (!MapFile(kStateMachineFileName, &state_machine_file_)) {
     fplbase::LogError(fplbase::kError,
                       "Error loading character state machine.\n");
     return false;
   }
+  flatbuffers::Verifier verifier(state_machine_file_.data(),
+                                 state_machine_file_.size());
+  if (!VerifyCharacterStateMachineDefBuffer(verifier)) {
+    fplbase::LogError(fplbase::kError, "%s is corrupt\n",
+                      kStateMachineFileName);
+    return false;
+  }
 
   // Grab the state machine from the buffer.
   auto state_machine_def = GetStateMachine();
@@ -512,9 +527,10 @@ bool PieNoonGame::InitializeGameState() {
 
   multiplayer_director_.reset(new MultiplayerDirector());
   multiplayer_director_->Initialize(&game_state_, &config);
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
   multiplayer_director_->RegisterGPGMultiplayer(&gpg_multiplayer_);
-#else
+#endif
+#ifndef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   multiplayer_director_->SetDebugInputSystem(&input_);
 #endif
 
@@ -522,7 +538,7 @@ bool PieNoonGame::InitializeGameState() {
     MultiplayerController* controller = new MultiplayerController();
     controller->Initialize(&game_state_, &config);
     AddController(controller);
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
     multiplayer_director_->RegisterController(controller);
 #endif
   }
@@ -580,19 +596,237 @@ bool PieNoonGame::InitializeGpgIds() {
   return true;
 }
 
-bool PieNoonGame::LoadFile(const char* filename, std::string* dest) {
-  const char* read_filename = filename;
-  std::string overlay;
+void PieNoonGame::InitializeShaderCache() {
+  // Saved programs go in the per-user data directory.
+  std::string directory;
+  if (GetConfig().use_shader_cache()) {
+    char* path = SDL_GetPrefPath("Google", "PieNoon");
+    if (path != nullptr) {
+      directory = path;
+      SDL_free(path);
+    }
+  }
+  shader_cache_.Initialize(&renderer_, directory);
+}
+
+void PieNoonGame::InitializeCompressedTextures() {
+  compressed_texture_format_ = kCompressedTextureNone;
+  if (!GetConfig().use_compressed_textures()) return;
+
+  const char* version =
+      reinterpret_cast<const char*>(glGetString(GL_VERSION));
+  const char* extensions =
+      reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+  auto supports = [extensions](const char* extension) {
+    return extensions != nullptr && strstr(extensions, extension) != nullptr;
+  };
+  std::vector<CompressedTextureFormat> formats;
+  // ASTC is smaller for the same quality, so prefer it.
+  if (supports("GL_KHR_texture_compression_astc_ldr")) {
+    formats.push_back(kCompressedTextureAstc);
+  }
+  // ETC2 is part of OpenGL ES 3, and of desktop OpenGL with ES 3
+  // compatibility.
+  if ((version != nullptr && strncmp(version, "OpenGL ES 3", 11) == 0) ||
+      supports("GL_ARB_ES3_compatibility")) {
+    formats.push_back(kCompressedTextureEtc2);
+  }
+  if (formats.empty()) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "The GPU can't use compressed textures, so using webp\n");
+    return;
+  }
+
+  // Compressed textures are only loaded from the packs, and build_assets.py
+  // compresses every texture or none, so use the best format that was built.
+  // As in FindPackedAsset(), an overlay without a pack hides both packs.
+  if (overlay_name_.empty() || overlay_pack_.is_open()) {
+    for (auto format = formats.begin(); format != formats.end(); ++format) {
+      const char* directory = CompressedTextureDirectory(*format);
+      if (overlay_pack_.HasDirectory(directory) ||
+          asset_pack_.HasDirectory(directory)) {
+        fplbase::LogInfo(fplbase::kApplication, "Using %s textures\n",
+                         directory);
+        compressed_texture_format_ = *format;
+        return;
+      }
+    }
+  }
+  fplbase::LogInfo(fplbase::kApplication,
+                   "No compressed textures, so using webp\n");
+}
+
+std::string PieNoonGame::OverlayFilename(const char* filename) {
   if (!overlay_name_.empty()) {
-    overlay = "overlays/" + overlay_name_ + "/" + std::string(filename);
-    const char* overlay_filename = overlay.c_str();
-    auto handle = SDL_RWFromFile(overlay_filename, "rb");
+    const std::string overlay =
+        "overlays/" + overlay_name_ + "/" + std::string(filename);
+    auto handle = SDL_RWFromFile(overlay.c_str(), "rb");
     if (handle) {
       SDL_RWclose(handle);
-      read_filename = overlay_filename;
+      return overlay;
     }
   }
-  return fplbase::LoadFileRaw(read_filename, dest);
+  return filename;
+}
+
+// Packs are optional: without one, assets are loaded as separate files.
+static void OpenAssetPack(const std::string& filename, AssetPack* pack) {
+  pack->Close();
+  auto handle = SDL_RWFromFile(filename.c_str(), "rb");
+  if (!handle) return;
+  SDL_RWclose(handle);
+  if (pack->Open(filename.c_str())) {
+    fplbase::LogInfo(fplbase::kApplication, "Loaded %d assets from %s\n",
+                     static_cast<int>(pack->num_entries()), filename.c_str());
+  }
+}
+
+void PieNoonGame::OpenAssetPacks() {
+  OpenAssetPack(kAssetPackFileName, &asset_pack_);
+  if (!overlay_name_.empty()) {
+    OpenAssetPack("overlays/" + overlay_name_ + "/" + kAssetPackFileName,
+                  &overlay_pack_);
+  }
+}
+
+bool PieNoonGame::FindPackedAsset(const char* filename, const uint8_t** data,
+                                  size_t* size) {
+  // An overlay without a pack must still override the main pack, so use
+  // separate files throughout.
+  if (!overlay_name_.empty() && !overlay_pack_.is_open()) return false;
+  return overlay_pack_.Find(filename, data, size) ||
+         asset_pack_.Find(filename, data, size);
+}
+
+bool PieNoonGame::ReadAssetFile(const char* filename, std::string* dest) {
+  const uint8_t* data;
+  size_t size;
+  if (FindPackedAsset(filename, &data, &size)) {
+    dest->assign(reinterpret_cast<const char*>(data), size);
+    return true;
+  }
+  return fplbase::LoadFileRaw(OverlayFilename(filename).c_str(), dest);
+}
+
+static bool HasExtension(const char* filename, const char* extension) {
+  const size_t length = strlen(filename);
+  const size_t extension_length = strlen(extension);
+  return length >= extension_length &&
+         strcmp(filename + length - extension_length, extension) == 0;
+}
+
+std::string PieNoonGame::AssetFilename(const char* filename) {
+  // Materials only name .ktx textures once InitializeCompressedTextures() has
+  // chosen a format, and it doesn't change after that.
+  if (HasExtension(filename, ".ktx")) {
+    const char* directory =
+        CompressedTextureDirectory(compressed_texture_format_);
+    if (directory != nullptr) return std::string(directory) + "/" + filename;
+  }
+  return filename;
+}
+
+bool PieNoonGame::LoadFile(const char* filename, std::string* dest) {
+  // These are decoded on the job system, and uploaded by the plan.
+  if (texture_load_plan_.Decodes(filename)) return false;
+  // Textures are loaded on the loader thread, so this traces it too.
+  StartupSpan span(&startup_tracer_, "LoadFile", filename);
+  if (!ReadAssetFile(AssetFilename(filename).c_str(), dest)) return false;
+  if (HasExtension(filename, ".fplmat") &&
+      compressed_texture_format_ != kCompressedTextureNone) {
+    UseCompressedTextures(filename, dest);
+  }
+  return true;
+}
+
+// True if 'filename' is in the overlay, rather than the main assets.
+static bool IsInOverlay(const std::string& filename,
+                        const std::string& overlay_filename,
+                        const AssetPack& overlay_pack) {
+  const uint8_t* data;
+  size_t size;
+  return overlay_pack.Find(filename.c_str(), &data, &size) ||
+         overlay_filename != filename;
+}
+
+bool PieNoonGame::FindCompressedTexture(const std::string& texture,
+                                        KtxImage* image, size_t* ktx_size) {
+  const char* directory =
+      CompressedTextureDirectory(compressed_texture_format_);
+  const std::string path = std::string(directory) + "/" +
+                           texture.substr(0, texture.rfind('.')) + ".ktx";
+  // An overlay's texture must not be replaced by the main one's copy.
+  if (!overlay_name_.empty() &&
+      IsInOverlay(texture, OverlayFilename(texture.c_str()), overlay_pack_) &&
+      !IsInOverlay(path, OverlayFilename(path.c_str()), overlay_pack_)) {
+    return false;
+  }
+  // The pack is mapped, so this only touches the header's page, not the
+  // texture: that's left for the loader thread.
+  const uint8_t* data;
+  if (!FindPackedAsset(path.c_str(), &data, ktx_size)) return false;
+  if (!ParseKtxHeader(data, *ktx_size, image) ||
+      KtxFormat(*image) != compressed_texture_format_) {
+    fplbase::LogError(fplbase::kApplication, "%s isn't a valid %s texture\n",
+                      path.c_str(), directory);
+    return false;
+  }
+  return true;
+}
+
+void PieNoonGame::UseCompressedTextures(const char* filename,
+                                        std::string* material) {
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(material->data()), material->size());
+  if (!matdef::VerifyMaterialBuffer(verifier)) return;
+  const matdef::Material* def = matdef::GetMaterial(material->data());
+  auto textures = def->texture_filenames();
+  if (textures == nullptr) return;
+
+  size_t compressed_bytes = 0;
+  size_t uncompressed_bytes = 0;
+  for (auto it = textures->begin(); it != textures->end(); ++it) {
+    const flatbuffers::String* name = *it;
+    const std::string texture = name->str();
+    const size_t dot = texture.rfind('.');
+    // Names are rewritten in place, so the new one can't be longer.
+    if (dot == std::string::npos || dot + 4 > texture.size()) continue;
+
+    KtxImage image;
+    size_t ktx_size;
+    if (!FindCompressedTexture(texture, &image, &ktx_size)) continue;
+    compressed_bytes += ktx_size;
+    uncompressed_bytes += UncompressedBytes(image);
+
+    // The material is our own copy, so shorten the name where it is: the
+    // length prefix, then the characters and their terminator.
+    char* chars = const_cast<char*>(name->c_str());
+    const std::string ktx_name = texture.substr(0, dot) + ".ktx";
+    memcpy(chars, ktx_name.c_str(), ktx_name.size() + 1);
+    flatbuffers::WriteScalar(chars - sizeof(flatbuffers::uoffset_t),
+                             static_cast<flatbuffers::uoffset_t>(
+                                 ktx_name.size()));
+  }
+
+  if (uncompressed_bytes > 0) {
+    fplbase::LogInfo(
+        fplbase::kApplication,
+        "%s: %s textures take %d KB rather than %d KB, saving %d KB\n",
+        filename, CompressedTextureDirectory(compressed_texture_format_),
+        static_cast<int>(compressed_bytes / 1024),
+        static_cast<int>(uncompressed_bytes / 1024),
+        static_cast<int>((uncompressed_bytes - compressed_bytes) / 1024));
+  }
+}
+
+bool PieNoonGame::MapFile(const char* filename, MappedFile* dest) {
+  const uint8_t* data;
+  size_t size;
+  if (FindPackedAsset(filename, &data, &size)) {
+    dest->OpenView(data, size);
+    return true;
+  }
+  return dest->Open(OverlayFilename(filename).c_str());
 }
 
 // Initialize each member in turn. This is logically just one function, since
@@ -600,9 +834,15 @@ bool PieNoonGame::LoadFile(const char* filename, std::string* dest) {
 // debugging and readability to have each section lexographically separate.
 bool PieNoonGame::Initialize(const char* const binary_directory) {
   fplbase::LogInfo(fplbase::kApplication, "PieNoon initializing...\n");
+  startup_tracer_.NameThread("main");
+  StartupSpan initialize_span(&startup_tracer_, "Initialize");
 
   if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir)) return false;
 
+  // The default overlay's name may itself be in the main pack.
+  const StartupTracer::Clock::time_point packs_start =
+      StartupTracer::Clock::now();
+  OpenAssetPacks();
   if (overlay_name_ == "") {
     std::string default_overlay;
     if (LoadFile(kDefaultOverlayFile, &default_overlay)) {
@@ -613,49 +853,86 @@ bool PieNoonGame::Initialize(const char* const binary_directory) {
                          "Forcing default overlay of %s\n",
                 default_overlay.c_str());
         PieNoonGame::SetOverlayName(default_overlay.c_str());
+        OpenAssetPacks();
       }
     }
   }
+  startup_tracer_.AddSpan("OpenAssetPacks", packs_start);
+
+  {
+    StartupSpan span(&startup_tracer_, "InitializeConfig");
+    if (!InitializeConfig()) return false;
+  }
+
+  // Start the worker threads early, so that everything after this can hand
+  // work to them.
+  job_system_.Initialize(JobSystem::DefaultNumWorkers());
 
-  if (!InitializeConfig()) return false;
 #ifdef ANDROID_HMD
   if (!InitializeCardboardConfig()) return false;
 #endif
   if (!InitializeGpgIds()) return false;
 
-  if (!InitializeRenderer()) return false;
+  {
+    StartupSpan span(&startup_tracer_, "InitializeRenderer");
+    if (!InitializeRenderer()) return false;
+    InitializeCompressedTextures();
+    InitializeShaderCache();
+  }
 
-  if (!InitializeRenderingAssets()) return false;
+  {
+    StartupSpan span(&startup_tracer_, "InitializeRenderingAssets");
+    if (!InitializeRenderingAssets()) return false;
+  }
 
   input_.Initialize();
 
-  // Some people are having trouble loading the audio engine, and it's not
-  // strictly necessary for gameplay, so don't die if the audio engine fails to
-  // initialize.
-  if (!audio_engine_.Initialize(GetConfig().audio())) {
-    fplbase::LogError(fplbase::kApplication,
-                      "Failed to initialize audio engine.\n");
-  }
+  {
+    StartupSpan span(&startup_tracer_, "InitializeAudio");
+    // Some people are having trouble loading the audio engine, and it's not
+    // strictly necessary for gameplay, so don't die if the audio engine fails
+    // to initialize.
+    if (!audio_engine_.Initialize(GetConfig().audio())) {
+      fplbase::LogError(fplbase::kApplication,
+                        "Failed to initialize audio engine.\n");
+    }
 
-  if (!audio_engine_.LoadSoundBank("sound_banks/sound_assets.pinbank")) {
-    fplbase::LogError(fplbase::kApplication, "Failed to load sound bank.\n");
-  }
+    if (!audio_engine_.LoadSoundBank("sound_banks/sound_assets.pinbank")) {
+      fplbase::LogError(fplbase::kApplication, "Failed to load sound bank.\n");
+    }
 
-  // Start loading sounds
-  audio_engine_.StartLoadingSoundFiles();
+    // Start loading sounds
+    audio_engine_.StartLoadingSoundFiles();
+  }
 
   input_.AddAppEventCallback(AudioEngineVolumeControl(&audio_engine_));
 
-  if (!InitializeGameState()) return false;
+  {
+    StartupSpan span(&startup_tracer_, "InitializeGameState");
+    if (!InitializeGameState()) return false;
+  }
 
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-  if (!gpg_manager.Initialize(fplbase::LoadPreference("logged_in", 1) != 0))
-    return false;
+  {
+    StartupSpan span(&startup_tracer_, "InitializeGpg");
+    if (!gpg_manager.Initialize(fplbase::LoadPreference("logged_in", 1) != 0))
+      return false;
+  }
+#endif
 
-  if (!gpg_multiplayer_.Initialize(GetConfig()
-                                       .multiscreen_options()
-                                       ->nearby_connections_service_id()
-                                       ->c_str())) {
+#ifdef PIE_NOON_USES_MULTISCREEN
+  const MultiscreenOptions* multiscreen_options =
+      GetConfig().multiscreen_options();
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  MultiplayerTransport* transport = new NearbyTransport();
+#else
+  MultiplayerTransport* transport =
+      new UdpTransport(multiscreen_options->udp_port(),
+                       multiscreen_options->udp_discovery_address()->str());
+#endif
+  if (!gpg_multiplayer_.Initialize(
+          multiscreen_options->nearby_connections_service_id()->c_str(),
+          transport)) {
     fplbase::LogError(fplbase::kApplication,
                       "GPGMultiplayer::Initialize failed\n");
     return false;
@@ -680,10 +957,11 @@ bool PieNoonGame::Initialize(const char* const binary_directory) {
   return true;
 }
 
-// Returns the mesh for renderable_id, if we have one, or the pajama mesh
-// (a mesh with a texture that's obviously wrong), if we don't.
-fplbase::Mesh* PieNoonGame::GetCardboardFront(int renderable_id, int variant) {
-  // Return the invalid mesh if the indices are out of bounds.
+// Returns the quad for renderable_id, if we have one, or the pajama quad
+// (a quad with a texture that's obviously wrong), if we don't.
+CardboardQuads::QuadId PieNoonGame::GetCardboardFront(int renderable_id,
+                                                      int variant) {
+  // Return the invalid quad if the indices are out of bounds.
   auto invalid_front = cardboard_fronts_[RenderableId_Invalid][0];
   if (renderable_id < 0 || RenderableId_Count <= renderable_id) {
     return invalid_front;
@@ -695,13 +973,14 @@ fplbase::Mesh* PieNoonGame::GetCardboardFront(int renderable_id, int variant) {
   const int variant_clamped =
       mathfu::Clamp(variant, 0, static_cast<int>(fronts.size()) - 1);
   auto front = fronts[variant_clamped];
-  return front == nullptr ? invalid_front : front;
+  return front == CardboardQuads::kInvalidQuad ? invalid_front : front;
 }
 
 void PieNoonGame::RenderCardboard(const SceneDescription& scene,
                                   const mat4& camera_transform) {
-  const Config& config = GetConfig();
+  const ConfigCache& hot_config = game_state_.config_cache();
 
+  cardboard_quads_.Bind();
   for (size_t i = 0; i < scene.renderables().size(); ++i) {
     const auto& renderable = scene.renderables()[i];
     const int id = renderable->id();
@@ -712,8 +991,7 @@ void PieNoonGame::RenderCardboard(const SceneDescription& scene,
 
     // Set the camera and light positions in object space.
     const mat4 world_matrix_inverse = renderable->world_matrix().Inverse();
-    renderer_.set_camera_pos(world_matrix_inverse *
-                             game_state_.camera().Position());
+    renderer_.set_camera_pos(world_matrix_inverse * scene.camera_position());
 
     // TODO: check amount of lights.
     renderer_.set_light_pos(world_matrix_inverse * (*scene.lights()[0]));
@@ -726,38 +1004,40 @@ void PieNoonGame::RenderCardboard(const SceneDescription& scene,
     //
     // If we have a back, draw the back too, slightly offset.
     // The back is the *inside* of the cardboard, representing corrugation.
-    if (cardboard_backs_[id]) {
+    if (cardboard_backs_[id] != CardboardQuads::kInvalidQuad) {
       shader_cardboard->Set(renderer_);
-      cardboard_backs_[id]->Render(renderer_);
+      cardboard_quads_.Render(renderer_, cardboard_backs_[id]);
     }
 
     // Draw the popsicle stick that props up the cardboard.
-    if (config.renderables()->Get(id)->stick() && stick_front_ != nullptr &&
-        stick_back_ != nullptr) {
+    if (hot_config.stick(id) && stick_front_ != CardboardQuads::kInvalidQuad &&
+        stick_back_ != CardboardQuads::kInvalidQuad) {
       shader_textured_->Set(renderer_);
-      stick_front_->Render(renderer_);
-      stick_back_->Render(renderer_);
+      cardboard_quads_.Render(renderer_, stick_front_);
+      cardboard_quads_.Render(renderer_, stick_back_);
     }
 
     renderer_.set_color(renderable->color());
 
-    if (config.renderables()->Get(id)->cardboard()) {
+    if (hot_config.cardboard(id)) {
       shader_cardboard->Set(renderer_);
-      shader_cardboard->SetUniform(
-          "ambient_material", LoadVec3(config.cardboard_ambient_material()));
-      shader_cardboard->SetUniform(
-          "diffuse_material", LoadVec3(config.cardboard_diffuse_material()));
-      shader_cardboard->SetUniform(
-          "specular_material", LoadVec3(config.cardboard_specular_material()));
-      shader_cardboard->SetUniform("shininess", config.cardboard_shininess());
+      shader_cardboard->SetUniform("ambient_material",
+                                   hot_config.cardboard_ambient_material());
+      shader_cardboard->SetUniform("diffuse_material",
+                                   hot_config.cardboard_diffuse_material());
+      shader_cardboard->SetUniform("specular_material",
+                                   hot_config.cardboard_specular_material());
+      shader_cardboard->SetUniform("shininess",
+                                   hot_config.cardboard_shininess());
       shader_cardboard->SetUniform("normalmap_scale",
-                                   config.cardboard_normalmap_scale());
+                                   hot_config.cardboard_normalmap_scale());
     } else {
       shader_textured_->Set(renderer_);
     }
-    auto front = GetCardboardFront(id, renderable->variant());
-    front->Render(renderer_);
+    cardboard_quads_.Render(renderer_,
+                            GetCardboardFront(id, renderable->variant()));
   }
+  cardboard_quads_.Unbind();
 }
 
 void PieNoonGame::Render(const SceneDescription& scene) {
@@ -801,6 +1081,7 @@ void PieNoonGame::RenderScene(const SceneDescription& scene,
                               const mat4& additional_camera_changes,
                               const vec2i& resolution) {
   const Config& config = GetConfig();
+  const ConfigCache& hot_config = game_state_.config_cache();
   const Config& cardboard_config = GetCardboardConfig();
 
   float viewport_angle = game_state_.is_in_cardboard()
@@ -848,20 +1129,24 @@ void PieNoonGame::RenderScene(const SceneDescription& scene,
   renderer_.set_model_view_projection(camera_transform);
   renderer_.set_light_pos(*scene.lights()[0]);  // TODO: check amount of lights.
   shader_simple_shadow_->SetUniform("world_scale_bias", world_scale_bias);
+  cardboard_quads_.Bind();
   for (size_t i = 0; i < scene.renderables().size(); ++i) {
     const auto& renderable = scene.renderables()[i];
     const int id = renderable->id();
-    auto front = GetCardboardFront(id, renderable->variant());
-    if (config.renderables()->Get(id)->shadow()) {
+    const CardboardQuads::QuadId front =
+        GetCardboardFront(id, renderable->variant());
+    if (hot_config.shadow(id)) {
       renderer_.set_model(renderable->world_matrix());
       shader_simple_shadow_->Set(renderer_);
       // The first texture of the shadow shader has to be that of the
       // billboard.
-      shadow_mat_->textures()[0] = front->GetMaterial(0)->textures()[0];
+      shadow_mat_->textures()[0] =
+          cardboard_quads_.material(front)->textures()[0];
       shadow_mat_->Set(renderer_);
-      front->Render(renderer_, true);
+      cardboard_quads_.Render(renderer_, front, true);
     }
   }
+  cardboard_quads_.Unbind();
   renderer_.DepthTest(true);
 
   // Now render the Renderables normally, on top of the shadows.
@@ -961,6 +1246,36 @@ void PieNoonGame::CorrectCardboardCamera(mat4& cardboard_camera) {
   cardboard_camera = rotation * cardboard_camera * rotation;
 }
 
+// Update game logic by a variable number of milliseconds, then populate
+// 'scene' from the game state--all the positions, orientations, and
+// renderable-ids (which specify materials) of the characters and props.
+// May run on a job system thread, while the main thread renders.
+void PieNoonGame::AdvanceGameState(WorldTime delta_time,
+                                   SceneDescription* scene) {
+  if (lockstep_.active()) {
+    // The game has already been run, in fixed steps, by RunLockstepFrames().
+    if (state_ != kMultiscreenClient) game_state_.PopulateScene(scene);
+    return;
+  }
+
+  if (state_ == kMultiscreenClient) {
+    // We are the client, we only update a few small things.
+    game_state_.particle_manager().AdvanceFrame(
+        static_cast<TimeStep>(delta_time));
+    game_state_.engine().AdvanceFrame(delta_time);
+    return;
+  }
+
+  if (state_ != kPaused) {
+    game_state_.AdvanceFrame(delta_time);
+  } else {
+    game_state_.particle_manager().AdvanceFrame(
+        static_cast<TimeStep>(delta_time));
+    game_state_.engine().AdvanceFrame(delta_time);
+  }
+  game_state_.PopulateScene(scene);
+}
+
 // Debug function to print out state machine transitions.
 void PieNoonGame::DebugPrintCharacterStates() {
   // Display the state changes, at least until we get real rendering up.
@@ -988,13 +1303,45 @@ void PieNoonGame::DebugPrintPieStates() {
   }
 }
 
+void PieNoonGame::DebugPrintJobStats(WorldTime world_time) {
+  if (world_time - job_stats_time_ < kMillisecondsPerSecond) return;
+  job_stats_time_ = world_time;
+
+  std::vector<WorkerStats> stats;
+  job_system_.GetStats(&stats);
+  for (size_t i = 0; i < stats.size(); ++i) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Job thread [%i]: %.0f%% busy, %i jobs, %i stolen\n",
+                     static_cast<int>(i), stats[i].utilization * 100.0,
+                     static_cast<int>(stats[i].jobs_executed),
+                     static_cast<int>(stats[i].jobs_stolen));
+  }
+  job_system_.ResetStats();
+}
+
+void PieNoonGame::DebugPrintUploadStats(WorldTime world_time) {
+  if (world_time - upload_stats_time_ < kMillisecondsPerSecond) return;
+  upload_stats_time_ = world_time;
+
+  const UploadStats& stats = upload_scheduler_.stats();
+  if (stats.finalizes > 0) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Texture uploads: %i of %i frames, avg %.2f ms, "
+                     "max %.2f ms\n",
+                     stats.finalizes, stats.frames,
+                     stats.total_milliseconds / stats.finalizes,
+                     stats.max_milliseconds);
+  }
+  upload_scheduler_.ResetStats();
+}
+
 const Config& PieNoonGame::GetConfig() const {
-  return *fpl::pie_noon::GetConfig(config_source_.c_str());
+  return *fpl::pie_noon::GetConfig(config_file_.data());
 }
 
 const Config& PieNoonGame::GetCardboardConfig() const {
 #ifdef ANDROID_HMD
-  return *fpl::pie_noon::GetConfig(cardboard_config_source_.c_str());
+  return *fpl::pie_noon::GetConfig(cardboard_config_file_.data());
 #else
   return GetConfig();
 #endif
@@ -1002,7 +1349,7 @@ const Config& PieNoonGame::GetCardboardConfig() const {
 
 const CharacterStateMachineDef* PieNoonGame::GetStateMachine() const {
   return fpl::pie_noon::GetCharacterStateMachineDef(
-      state_machine_source_.c_str());
+      state_machine_file_.data());
 }
 
 struct ButtonToTranslation {
@@ -1111,13 +1458,7 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
   }
   switch (state_) {
     case kLoadingInitialMaterials: {
-      if (matman_.FindMaterial(config.loading_material()->c_str())
-              ->textures()[0]
-              ->id() &&
-          matman_.FindMaterial(config.loading_logo()->c_str())
-              ->textures()[0]
-              ->id() &&
-          full_screen_fader_.material()->textures()[0]->id()) {
+      if (texture_load_plan_.Resident(kLoadPriorityLoadingScreen)) {
         // Fade in the loading screen.
         FadeToPieNoonState(kLoading, config.full_screen_fade_time(),
                            mathfu::kZeros4f, false);
@@ -1126,9 +1467,11 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
     }
     case kLoading: {
       // When we initialized assets, we kicked off a thread to load all
-      // textures. Here we check if those have finished loading.
+      // textures. Here we check if the ones needed next have finished
+      // loading; the rest carry on loading behind the title menu.
       // We also leave the loading screen up for a minimum amount of time.
-      if (!Fading() && matman_.TryFinalize() && audio_engine_.TryFinalize() &&
+      if (!Fading() && texture_load_plan_.Resident(kLoadPriorityCardboards) &&
+          audio_engine_.TryFinalize() &&
           (time - state_entry_time_) > config.min_loading_time()) {
         // If we've already displayed the tutorial before, jump straight to
         // the game. If we don't have the capability to record our previous
@@ -1137,6 +1480,9 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
                                                          0);
         const PieNoonState first_state =
             displayed_tutorial ? kFinished : kTutorial;
+        // The tutorial's slides are requested after everything else, so
+        // wait for everything before showing it.
+        if (first_state == kTutorial && !textures_loaded_) break;
         tutorial_slide_time_ = time;
 
         // Fade out the loading screen and fade in the scene or tutorial.
@@ -1178,7 +1524,7 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
           !stinger_channel_.Playing()) {
         game_state_.PostGameLogging();
         if (game_state_.is_multiscreen() && multiplayer_director_ != nullptr) {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
           multiplayer_director_->SendEndGameMsg();
           SendTrackerEvent(kCategoryMultiscreen, kActionFinish, kLabelGameHost);
           gpg_multiplayer_.StartAdvertising();
@@ -1194,7 +1540,7 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
       if (input_.GetButton(fplbase::FPLK_AC_BACK).went_down()) {
         SendTrackerEvent(kCategoryUi, kActionClickedButton, kLabelUnpauseButton,
                          time - pause_time_);
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         gpg_multiplayer_.ResetToIdle();
 #endif
         gui_menu_.Setup(TitleScreenButtons(config), &matman_);
@@ -1204,7 +1550,7 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
     }
     case kMultiplayerWaiting: {
       if (input_.GetButton(fplbase::FPLK_AC_BACK).went_down()) {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         gpg_multiplayer_.ResetToIdle();
 #endif
         gui_menu_.Setup(config.msx_screen_buttons(), &matman_);
@@ -1255,9 +1601,9 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
     }
     case kMultiscreenClient: {
       if (input_.GetButton(fplbase::FPLK_AC_BACK).went_down()) {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         gpg_multiplayer_.DisconnectAll();
-#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#endif  // PIE_NOON_USES_MULTISCREEN
         gui_menu_.Setup(config.msx_screen_buttons(), &matman_);
       } else {
         UpdateMultiscreenMenuIcons();
@@ -1338,6 +1684,15 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
     audio_engine_.Pause(false);
   }
 
+  // Lockstep lasts as long as the multiscreen game.
+  if (next_state != kPlaying && next_state != kPaused &&
+      next_state != kMultiscreenClient) {
+    lockstep_.Stop();
+  }
+  // Clients show only their controls, so a lockstep client's game runs just
+  // for its results.
+  game_state_.set_is_displayed(next_state != kMultiscreenClient);
+
   switch (next_state) {
     case kLoadingInitialMaterials: {
       break;
@@ -1377,6 +1732,18 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
         music_channel_ = audio_engine_.PlaySound("MusicAction");
         ambience_channel_ = audio_engine_.PlaySound("Ambience");
         game_state_.Reset(GameState::kTrackAnalytics);
+
+        const MultiscreenOptions* options = config.multiscreen_options();
+        if (game_state_.is_multiscreen() && multiplayer_director_ != nullptr &&
+            multiplayer_director_->lockstep()) {
+          // Frame 0 for us and the clients.
+          game_state_.random().Seed(multiplayer_director_->lockstep_seed());
+          lockstep_.Start(options->lockstep_step_milliseconds(),
+                          options->lockstep_checksum_interval(),
+                          options->lockstep_max_catch_up_frames(), true, 0);
+        } else {
+          lockstep_.Stop();
+        }
       }
       break;
     }
@@ -1388,6 +1755,9 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
       if (game_state_.is_multiscreen() && multiplayer_director_ != nullptr) {
         multiplayer_director_->EndGame();
       }
+#ifdef PIE_NOON_USES_MULTISCREEN
+      DumpMultiplayerTelemetry();
+#endif
       if (ambience_channel_.Valid()) {
         ambience_channel_.Stop();
       }
@@ -1472,6 +1842,9 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
 
   state_ = next_state;
   state_entry_time_ = prev_world_time_;
+
+  // The game state may have been reset, so don't draw the old scene.
+  scene_ready_ = false;
 }
 
 // Update the current game state and perform a state transition if requested.
@@ -1622,20 +1995,18 @@ void PieNoonGame::AttachMultiplayerControllers() {
   }
 }
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
 
 void PieNoonGame::ProcessMultiplayerMessages() {
-  while (gpg_multiplayer_.HasMessage()) {
-    std::pair<std::string, std::vector<uint8_t>> msg_info =
-        gpg_multiplayer_.GetNextMessage();
-    std::string sender = msg_info.first;
-    if (!msg_info.second.empty()) {
+  while (gpg_multiplayer_.GetNextMessage(&incoming_message_)) {
+    const std::vector<uint8_t>& payload = incoming_message_.payload;
+    const int sender = incoming_message_.sender;
+    if (!payload.empty()) {
       // Verify the message contents are trustworthy.
-      flatbuffers::Verifier verifier(msg_info.second.data(),
-                                     msg_info.second.size());
+      flatbuffers::Verifier verifier(payload.data(), payload.size());
 
       const multiplayer::MessageRoot* message =
-          multiplayer::GetMessageRoot(msg_info.second.data());
+          multiplayer::GetMessageRoot(payload.data());
 
       // Make sure the message has valid data.
       if (multiplayer::VerifyMessageRootBuffer(verifier)) {
@@ -1646,17 +2017,17 @@ void PieNoonGame::ProcessMultiplayerMessages() {
                            "Process a player assignment: %d\n",
                   player_assignment->player_id());
           StartMultiscreenGameAsClient(
-              (CharacterId)player_assignment->player_id());
+              (CharacterId)player_assignment->player_id(),
+              player_assignment->lockstep_seed(),
+              player_assignment->run_until_frame());
         } else if (message->data_type() == multiplayer::Data_PlayerCommand) {
           const multiplayer::PlayerCommand* player_command =
               (const multiplayer::PlayerCommand*)message->data();
           // process a player command
           if (game_state_.is_multiscreen() &&
               multiplayer_director_ != nullptr) {
-            int player_id =
-                gpg_multiplayer_.GetPlayerNumberByInstanceId(sender);
-            if (player_id >= 0) {
-              multiplayer_director_->InputPlayerCommand(player_id,
+            if (sender >= 0) {
+              multiplayer_director_->InputPlayerCommand(sender,
                                                         *player_command);
             }
           }
@@ -1671,9 +2042,19 @@ void PieNoonGame::ProcessMultiplayerMessages() {
               CurrentWorldTime(input_) +
               start_turn->seconds() * kMillisecondsPerSecond;
 
-          ProcessPlayerStatusMessage(*start_turn->player_status());
+          if (lockstep_.active()) {
+            lockstep_.ExtendRunUntil(start_turn->run_until_frame());
+          }
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+          PlayerStatusSnapshot status;
+          status_replication_.RecordReceived(payload.size());
+          if (status_replication_.ReceiveFull(*start_turn->player_status(),
+                                              &status)) {
+            ProcessPlayerStatus(status, true);
+          }
+          SendPlayerStatusAck();
+
+#ifdef PIE_NOON_USES_MULTISCREEN
           SendMultiscreenPlayerCommand();
 #endif
           // Reload the current menu to reset all the buttons.
@@ -1686,13 +2067,101 @@ void PieNoonGame::ProcessMultiplayerMessages() {
               (const multiplayer::EndGame*)message->data();
           fplbase::LogInfo(fplbase::kApplication,
                            "Multiplayer message: EndGame.");
-          ProcessPlayerStatusMessage(*end_game->player_status());
+          PlayerStatusSnapshot status;
+          status_replication_.RecordReceived(payload.size());
+          if (status_replication_.ReceiveFull(*end_game->player_status(),
+                                              &status)) {
+            ProcessPlayerStatus(status, true);
+          }
+          const ReplicationStats& stats = status_replication_.stats();
+          fplbase::LogInfo(fplbase::kApplication,
+                           "Status replication received %d full, %d delta, "
+                           "%d bytes; dropped %d stale, %d unusable\n",
+                           stats.full_statuses, stats.delta_statuses,
+                           static_cast<int>(stats.bytes_received),
+                           stats.stale_statuses, stats.unusable_deltas);
           // The game is over, go to the wait screen.
           TransitionToPieNoonState(kMultiplayerWaiting);
         } else if (message->data_type() == multiplayer::Data_PlayerStatus) {
           const multiplayer::PlayerStatus* player_status =
               (const multiplayer::PlayerStatus*)message->data();
-          ProcessPlayerStatusMessage(*player_status);
+          PlayerStatusSnapshot status;
+          status_replication_.RecordReceived(payload.size());
+          if (status_replication_.ReceiveFull(*player_status, &status)) {
+            ProcessPlayerStatus(status, false);
+          }
+        } else if (message->data_type() ==
+                   multiplayer::Data_PlayerStatusDelta) {
+          const multiplayer::PlayerStatusDelta* delta =
+              (const multiplayer::PlayerStatusDelta*)message->data();
+          PlayerStatusSnapshot status;
+          status_replication_.RecordReceived(payload.size());
+          if (status_replication_.ReceiveDelta(*delta, &status)) {
+            ProcessPlayerStatus(status, false);
+          }
+          SendPlayerStatusAck();
+        } else if (message->data_type() == multiplayer::Data_PlayerStatusAck) {
+          const multiplayer::PlayerStatusAck* ack =
+              (const multiplayer::PlayerStatusAck*)message->data();
+          if (game_state_.is_multiscreen() &&
+              multiplayer_director_ != nullptr) {
+            if (sender >= 0) {
+              multiplayer_director_->ReceivePlayerStatusAck(sender, *ack,
+                                                            payload.size());
+            }
+          }
+        } else if (message->data_type() == multiplayer::Data_TurnCommands) {
+          const multiplayer::TurnCommands* turn_commands =
+              (const multiplayer::TurnCommands*)message->data();
+          if (lockstep_.active() && !lockstep_.is_host()) {
+            multiplayer_director_->QueueTurnCommands(*turn_commands);
+            lockstep_.ExtendRunUntil(turn_commands->run_until_frame());
+          }
+        } else if (message->data_type() == multiplayer::Data_StateChecksum) {
+          const multiplayer::StateChecksum* state_checksum =
+              (const multiplayer::StateChecksum*)message->data();
+          uint32_t checksum = 0;
+          if (!lockstep_.active()) {
+            // Already out of step.
+          } else if (lockstep_.is_host()) {
+            if (sender >= 0 &&
+                lockstep_.FindChecksum(state_checksum->frame(), &checksum) &&
+                checksum != state_checksum->checksum()) {
+              fplbase::LogInfo(fplbase::kApplication,
+                               "Lockstep: player %d out of step at frame %d",
+                               sender,
+                               static_cast<int>(state_checksum->frame()));
+              multiplayer_director_->MarkDesynced(sender);
+              // Tell the client, so it stops running its own game.
+              SendStateChecksum(sender, state_checksum->frame(), checksum);
+            }
+          } else {
+            // The host only replies when our checksums don't match.
+            fplbase::LogInfo(fplbase::kApplication,
+                             "Lockstep: out of step with the host at frame "
+                             "%d, using player statuses",
+                             static_cast<int>(state_checksum->frame()));
+            lockstep_.Stop();
+          }
+        } else if (message->data_type() == multiplayer::Data_FullSync) {
+          const multiplayer::FullSync* full_sync =
+              (const multiplayer::FullSync*)message->data();
+          fplbase::LogInfo(fplbase::kApplication,
+                           "Multiplayer message: FullSync.");
+          ProcessFullSync(*full_sync, payload.size());
+        } else if (message->data_type() == multiplayer::Data_Ping) {
+          const multiplayer::Ping* ping =
+              (const multiplayer::Ping*)message->data();
+          if (sender >= 0) SendPong(sender, ping->time());
+        } else if (message->data_type() == multiplayer::Data_Pong) {
+          const multiplayer::Pong* pong =
+              (const multiplayer::Pong*)message->data();
+          if (sender >= 0) {
+            const uint32_t now =
+                static_cast<uint32_t>(CurrentWorldTime(input_));
+            gpg_multiplayer_.telemetry().RecordRoundTrip(
+                sender, static_cast<int>(now - pong->time()));
+          }
         } else {
           fplbase::LogError(fplbase::kApplication,
                    "Multiplayer message has a data type of NONE.");
@@ -1717,32 +2186,95 @@ void PieNoonGame::ProcessMultiplayerMessages() {
           fplbase::kApplication,
           "Got reconnected player %d (instance %s), send his assignment again.",
           player, instance_id.c_str());
-      multiplayer_director_->SendPlayerAssignmentMsg(instance_id, player);
+      multiplayer_director_->SendPlayerAssignmentMsg(instance_id, player, true);
+      multiplayer_director_->SendFullSyncMsg(instance_id, player);
       SendTrackerEvent(kCategoryMultiscreen, kActionStart, kLabelReconnection);
     }
   }
 }
 
-void PieNoonGame::ProcessPlayerStatusMessage(
-    const multiplayer::PlayerStatus& status) {
+void PieNoonGame::ProcessFullSync(const multiplayer::FullSync& full_sync,
+                                  size_t message_size) {
+  // Pick up the turn where the host is, rather than waiting for the next
+  // one to start.
+  const WorldTime now = CurrentWorldTime(input_);
+  multiscreen_turn_number_ = full_sync.turn();
+  multiscreen_turn_end_time_ = now + full_sync.turn_milliseconds();
+
+  // Our command, as the host has it.
+  const multiplayer::PlayerCommand* command = full_sync.command();
+  if (command != nullptr) {
+    multiscreen_action_aim_at_ = command->aim_at();
+    multiscreen_action_to_perform_ =
+        command->is_firing() ? ButtonId_Attack : command->is_blocking()
+                                                     ? ButtonId_Defend
+                                                     : ButtonId_Cancel;
+  }
+
+  PlayerStatusSnapshot status;
+  status_replication_.RecordReceived(message_size);
+  if (full_sync.player_status() != nullptr &&
+      status_replication_.ReceiveFull(*full_sync.player_status(), &status)) {
+    ProcessPlayerStatus(status, true);
+  }
+  SendPlayerStatusAck();
+
+  const auto pie_damage = full_sync.pie_damage();
+  int my_pie_damage = 0;
+  if (pie_damage != nullptr) {
+    for (CharacterId i = 0;
+         i < static_cast<CharacterId>(game_state_.characters().size()) &&
+             i < static_cast<CharacterId>(pie_damage->size());
+         ++i) {
+      game_state_.characters()[i]->set_pie_damage(pie_damage->Get(i));
+    }
+    if (multiscreen_my_player_id_ >= 0 &&
+        multiscreen_my_player_id_ <
+            static_cast<CharacterId>(pie_damage->size())) {
+      my_pie_damage = pie_damage->Get(multiscreen_my_player_id_);
+    }
+  }
+  status_predictor_.Resync(multiscreen_turn_number_,
+                           full_sync.turn_milliseconds() == 0, my_pie_damage);
+
+  ReloadMultiscreenMenu();
+  UpdateMultiscreenMenuIcons();
+  if (full_sync.turn_milliseconds() > 0) {
+    InitCountdownImage((full_sync.turn_milliseconds() +
+                        kMillisecondsPerSecond - 1) /
+                       kMillisecondsPerSecond);
+  }
+}
+
+void PieNoonGame::ProcessPlayerStatus(const PlayerStatusSnapshot& status,
+                                      bool full) {
+  // In lockstep, our own game is more up to date than the host's statuses.
+  if (lockstep_.active()) return;
+
+  status_predictor_.Reconcile(status, full);
+
   // Iterate through characters and player healths.
   auto c = game_state_.characters().begin();
-  auto h = status.player_health()->begin();
-  for (; c != game_state_.characters().end() &&
-         h != status.player_health()->end();
+  auto h = status.health.begin();
+  for (; c != game_state_.characters().end() && h != status.health.end();
        ++c, ++h) {
     (*c)->set_health(*h);
   }
+  ShowMultiscreenSplats(status);
+}
+
+void PieNoonGame::ShowMultiscreenSplats(const PlayerStatusSnapshot& status) {
   unsigned char splats;
-  if (multiscreen_my_player_id_ >=
-          static_cast<int>(status.player_splats()->Length()) ||
+  if (multiscreen_my_player_id_ >= static_cast<int>(status.splats.size()) ||
       game_state_.characters()[multiscreen_my_player_id_]->health() <= 0) {
     // we're an invalid player (or a dead one), don't show our splats.
     splats = 0;
   } else {
-    splats = status.player_splats()->Get(multiscreen_my_player_id_);
+    splats = status.splats[multiscreen_my_player_id_];
   }
 
+  // Splats that are no longer active fade out each frame, in Run().
+  status_predictor_.SetSplats(splats);
   int new_splats = 0;
   for (int i = 0; i < GetConfig().multiscreen_options()->max_players(); i++) {
     if (splats & (1 << i)) {
@@ -1750,13 +2282,6 @@ void PieNoonGame::ProcessPlayerStatusMessage(
       if (ShowMultiscreenSplat(i)) {
         new_splats++;
       }
-    } else {
-      // splat i is inactive
-      auto splat =
-          gui_menu_.FindImageById((ButtonId)(ButtonId_Multiplayer_Splat1 + i));
-      if (splat != nullptr) {
-        splat->set_is_visible(false);
-      }
     }
   }
   if (new_splats > 0) {
@@ -1764,7 +2289,7 @@ void PieNoonGame::ProcessPlayerStatusMessage(
     audio_engine_.PlaySound("HitWithLargePie");
   }
 }
-#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#endif  // PIE_NOON_USES_MULTISCREEN
 
 bool PieNoonGame::ShowMultiscreenSplat(int splat_num) {
   auto splat = gui_menu_.FindImageById(
@@ -1902,7 +2427,7 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
         break;
       case ButtonId_MenuStart:
         fplbase::LogInfo(fplbase::kApplication, "Menu: START pressed");
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         if (state_ == kMultiplayerWaiting) {
           if (gpg_multiplayer_.is_hosting() &&
               gpg_multiplayer_.GetNumConnectedPlayers() >= 1) {
@@ -1979,13 +2504,15 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
         break;
       }
       case ButtonId_MenuMultiScreenJoin: {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         const Config& config = GetConfig();
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
         if (config.multiscreen_options()->use_full_name_as_instance_name() &&
             gpg_manager.player_data() != nullptr) {
           gpg_multiplayer_.set_my_instance_name(
               gpg_manager.player_data()->Name());
         }
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
         gpg_multiplayer_.set_auto_connect(
             GetConfig().multiscreen_options()->auto_connect_on_client());
         SendTrackerEvent(kCategoryMultiscreen, kActionStart, kLabelDiscovery);
@@ -1996,8 +2523,9 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
         break;
       }
       case ButtonId_MenuMultiScreenHost: {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         const Config& config = GetConfig();
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
         if (gpg_manager.player_data() != nullptr) {
           if (config.multiscreen_options()->use_full_name_as_instance_name() &&
               gpg_manager.player_data() != nullptr) {
@@ -2005,6 +2533,7 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
                 gpg_manager.player_data()->Name());
           }
         }
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
         gpg_multiplayer_.set_auto_connect(
             GetConfig().multiscreen_options()->auto_connect_on_host());
         SendTrackerEvent(kCategoryMultiscreen, kActionStart, kLabelAdvertising);
@@ -2046,9 +2575,9 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
 
       case ButtonId_MenuBack: {
         const Config& config = GetConfig();
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         gpg_multiplayer_.ResetToIdle();
-#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#endif  // PIE_NOON_USES_MULTISCREEN
         SendTrackerEvent(kCategoryUi, kActionClickedButton,
                          kLabelExtrasBackButton, game_state_.is_multiscreen());
         UpdateControllers(0);  // clear went_down()
@@ -2090,7 +2619,7 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
           multiscreen_action_aim_at_ = button_num;
         }
         if (multiscreen_turn_end_time_ > CurrentWorldTime(input_)) {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
           SendMultiscreenPlayerCommand();
 #endif
         }
@@ -2105,20 +2634,31 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
   return state_;
 }
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
 
 void PieNoonGame::StartMultiscreenGameAsHost() {
   fplbase::LogInfo(fplbase::kApplication,
                    "Multiplayer StartMultiscreenGameAsHost");
   gpg_multiplayer_.StopAdvertising();
+  gpg_multiplayer_.telemetry().Reset();
+  next_ping_time_ = 0;
   int connected_players = gpg_multiplayer_.GetNumConnectedPlayers();
+  const MultiscreenOptions* options = GetConfig().multiscreen_options();
+  if (options->lockstep()) {
+    multiplayer_director_->EnableLockstep(
+        static_cast<uint32_t>(mathfu::RandomInRange<int>(
+            1, std::numeric_limits<int>::max())),
+        options->lockstep_step_milliseconds());
+  } else {
+    multiplayer_director_->DisableLockstep();
+  }
   // send each player their player ID and start the game
   for (int i = 0; i < connected_players; i++) {
     const auto& instance_id = gpg_multiplayer_.GetInstanceIdByPlayerNumber(i);
     fplbase::LogInfo(fplbase::kApplication,
                      "Multiplayer Send assignment %d to instance %s", i,
             instance_id.c_str());
-    multiplayer_director_->SendPlayerAssignmentMsg(instance_id, i);
+    multiplayer_director_->SendPlayerAssignmentMsg(instance_id, i, false);
   }
   // If we have less than the max number of players, set the rest to AI.
   multiplayer_director_->set_num_ai_players(
@@ -2130,7 +2670,9 @@ void PieNoonGame::StartMultiscreenGameAsHost() {
                    connected_players);
 }
 
-void PieNoonGame::StartMultiscreenGameAsClient(CharacterId id) {
+void PieNoonGame::StartMultiscreenGameAsClient(CharacterId id,
+                                               uint32_t lockstep_seed,
+                                               uint32_t run_until_frame) {
   fplbase::LogInfo(fplbase::kApplication,
                    "Multiplayer StartMultiscreenGameAsClient");
   // Set up the menu screen.
@@ -2144,6 +2686,41 @@ void PieNoonGame::StartMultiscreenGameAsClient(CharacterId id) {
   multiscreen_action_aim_at_ = (id + 1) % num_players;
   multiscreen_turn_number_ = 0;
   multiscreen_turn_end_time_ = 0;
+  status_replication_.Reset();
+  gpg_multiplayer_.telemetry().Reset();
+  next_ping_time_ = 0;
+
+  // The host acts on commands once its own, slightly longer, turn ends.
+  const Config& config = GetConfig();
+  const MultiscreenOptions* options = config.multiscreen_options();
+  PredictionTiming timing;
+  timing.throw_delay = options->network_grace_milliseconds() +
+                       options->pie_delay_milliseconds();
+  timing.character_delay = options->char_delay_milliseconds();
+  timing.flight_time = config.pie_flight_time();
+  timing.timeout = options->prediction_timeout_milliseconds();
+  timing.smoothing = options->health_smoothing_milliseconds();
+  status_predictor_.Reset(
+      num_players, id, config.character_health(),
+      static_cast<int>(config.renderable_id_for_pie_damage()->Length()) - 1,
+      timing);
+
+  if (lockstep_seed != 0) {
+    // Set up the game just as the host does, so we start off the same.
+    game_state_.EnterJoiningMode();
+    AttachMultiplayerControllers();
+    game_state_.Reset(GameState::kNoAnalytics);
+    game_state_.random().Seed(lockstep_seed);
+    multiplayer_director_->StartFollowing(
+        options->lockstep_step_milliseconds());
+    lockstep_.Start(options->lockstep_step_milliseconds(),
+                    options->lockstep_checksum_interval(),
+                    options->lockstep_max_catch_up_frames(), false,
+                    run_until_frame);
+  } else {
+    lockstep_.Stop();
+  }
+
   SendMultiscreenPlayerCommand();
   UpdateMultiscreenMenuIcons();
   TransitionToPieNoonState(kMultiscreenClient);
@@ -2151,28 +2728,121 @@ void PieNoonGame::StartMultiscreenGameAsClient(CharacterId id) {
 }
 
 void PieNoonGame::SendMultiscreenPlayerCommand() {
-  flatbuffers::FlatBufferBuilder builder;
+  PooledBuilder builder(&message_builders_);
   auto message_root = multiplayer::CreateMessageRoot(
-      builder, multiplayer::Data_PlayerCommand,
+      *builder, multiplayer::Data_PlayerCommand,
       multiplayer::CreatePlayerCommand(
-          builder, multiscreen_action_aim_at_,
+          *builder, multiscreen_action_aim_at_,
           (multiscreen_action_to_perform_ == ButtonId_Attack),
           (multiscreen_action_to_perform_ == ButtonId_Defend))
           .Union());
 
-  builder.Finish(message_root);
+  builder->Finish(message_root);
 
   const multiplayer::MessageRoot* msgtest =
-      multiplayer::GetMessageRoot(builder.GetBufferPointer());
+      multiplayer::GetMessageRoot(builder->GetBufferPointer());
   fplbase::LogInfo(fplbase::kApplication, "SendMessage data type of %d",
                    msgtest->data_type());
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_.BroadcastMessage(message, true);
+  gpg_multiplayer_.BroadcastMessage(builder->GetBufferPointer(),
+                                    builder->GetSize(), true);
 }
 
-#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+void PieNoonGame::SendStateChecksum(CharacterId player, uint32_t frame,
+                                    uint32_t checksum) {
+  PooledBuilder builder(&message_builders_);
+  auto message_root = multiplayer::CreateMessageRoot(
+      *builder, multiplayer::Data_StateChecksum,
+      multiplayer::CreateStateChecksum(*builder, frame, checksum).Union());
+  builder->Finish(message_root);
+
+  // Send unreliably; there'll be another one along soon.
+  if (player == kNoCharacter) {
+    gpg_multiplayer_.BroadcastMessage(builder->GetBufferPointer(),
+                                      builder->GetSize(), false);
+  } else {
+    gpg_multiplayer_.SendMessageToPlayer(player, builder->GetBufferPointer(),
+                                         builder->GetSize(), false);
+  }
+}
+
+void PieNoonGame::SendPingIfDue() {
+  const int interval = GetConfig()
+                           .multiscreen_options()
+                           ->telemetry_ping_interval_milliseconds();
+  const WorldTime now = CurrentWorldTime(input_);
+  if (interval <= 0 || now < next_ping_time_) return;
+  next_ping_time_ = now + interval;
+
+  PooledBuilder builder(&message_builders_);
+  auto message_root = multiplayer::CreateMessageRoot(
+      *builder, multiplayer::Data_Ping,
+      multiplayer::CreatePing(*builder, static_cast<uint32_t>(now)).Union());
+  builder->Finish(message_root);
+
+  // Send unreliably, so resends don't count towards the round trip.
+  gpg_multiplayer_.BroadcastMessage(builder->GetBufferPointer(),
+                                    builder->GetSize(), false);
+}
+
+void PieNoonGame::SendPong(CharacterId player, uint32_t time) {
+  PooledBuilder builder(&message_builders_);
+  auto message_root = multiplayer::CreateMessageRoot(
+      *builder, multiplayer::Data_Pong,
+      multiplayer::CreatePong(*builder, time).Union());
+  builder->Finish(message_root);
+
+  gpg_multiplayer_.SendMessageToPlayer(player, builder->GetBufferPointer(),
+                                       builder->GetSize(), false);
+}
+
+void PieNoonGame::DumpMultiplayerTelemetry() {
+  MultiplayerTelemetry& telemetry = gpg_multiplayer_.telemetry();
+  for (int i = 0; i < telemetry.num_peers(); ++i) {
+    const PeerTelemetry peer = telemetry.peer(i);
+    fplbase::LogInfo(fplbase::kApplication,
+                     "MP telemetry: player %d round trip %d ms (smoothed "
+                     "%.0f, max %d), sent %d messages (%d bytes), received "
+                     "%d (%d bytes), %d resends\n",
+                     i, peer.round_trip_milliseconds,
+                     peer.smoothed_round_trip_milliseconds,
+                     peer.max_round_trip_milliseconds,
+                     static_cast<int>(peer.messages_sent),
+                     static_cast<int>(peer.bytes_sent),
+                     static_cast<int>(peer.messages_received),
+                     static_cast<int>(peer.bytes_received),
+                     peer.reliable_resends);
+  }
+  const QueueTelemetry queue = telemetry.queue();
+  fplbase::LogInfo(fplbase::kApplication,
+                   "MP telemetry: queue depth up to %d, %d overflowed; "
+                   "messages waited %.1f ms for the game (max %.1f)\n",
+                   queue.max_depth, queue.overflowed,
+                   queue.smoothed_delay_milliseconds,
+                   queue.max_delay_milliseconds);
+
+  const flatbuffers::String* filename =
+      GetConfig().multiscreen_options()->telemetry_file();
+  if (filename != nullptr && filename->size() > 0 &&
+      !telemetry.DumpToFile(filename->c_str())) {
+    fplbase::LogError(fplbase::kApplication,
+                      "Unable to write multiplayer telemetry to %s",
+                      filename->c_str());
+  }
+}
+
+// Tell the host which status we have, so it knows what to send next.
+void PieNoonGame::SendPlayerStatusAck() {
+  PooledBuilder builder(&message_builders_);
+  builder->Finish(status_replication_.CreateAckMessage(*builder));
+
+  status_replication_.RecordSent(builder->GetSize());
+  // Send unreliably.
+  gpg_multiplayer_.BroadcastMessage(builder->GetBufferPointer(),
+                                    builder->GetSize(), false);
+}
+
+#endif  // PIE_NOON_USES_MULTISCREEN
 
 void PieNoonGame::ReloadMultiscreenMenu() {
   if (gui_menu_.menu_def() == GetConfig().multiplayer_client()) {
@@ -2274,7 +2944,12 @@ void PieNoonGame::UpdateMultiscreenMenuIcons() {
           button->set_current_up_material(material_alive);
         else
           button->set_current_up_material(material_koed);
-        button->set_color(game_state_.characters()[i]->ButtonColor());
+        // Darken the face as health drops.
+        const float brightness =
+            mathfu::Lerp(kNoHealthButtonBrightness, 1.0f,
+                         status_predictor_.displayed_health_fraction(i));
+        const vec4 color = game_state_.characters()[i]->ButtonColor();
+        button->set_color(vec4(color.xyz() * brightness, color.w()));
 
         if (image != nullptr) image->set_is_visible(false);
       }
@@ -2289,7 +2964,8 @@ void PieNoonGame::UpdateMultiscreenMenuIcons() {
       // Finally, if there is a splat on screen in slot N, disable button N.
       auto splat =
           gui_menu_.FindImageById((ButtonId)(ButtonId_Multiplayer_Splat1 + i));
-      if (splat != nullptr && splat->is_visible()) {
+      if (splat != nullptr && splat->is_visible() &&
+          status_predictor_.splat_active(i)) {
         if (button != nullptr) button->set_is_active(false);
         if (image != nullptr) image->set_is_visible(false);
       }
@@ -2326,7 +3002,7 @@ void PieNoonGame::UpdateMultiscreenMenuIcons() {
 }
 
 void PieNoonGame::SetupWaitingForPlayersMenu() {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
   auto players = gui_menu_.FindImageById(ButtonId_Multiplayer_NumPlayers);
   int num_players = gpg_multiplayer_.GetNumConnectedPlayers();
   if (players != nullptr && num_players >= 0 && num_players <= 4) {
@@ -2347,8 +3023,32 @@ void PieNoonGame::SetupWaitingForPlayersMenu() {
 // to keep them up to date so we can check their inputs as needed.)
 void PieNoonGame::UpdateControllers(WorldTime delta_time) {
   for (size_t i = 0; i < active_controllers_.size(); i++) {
-    if (active_controllers_[i].get() != nullptr) {
-      active_controllers_[i]->AdvanceFrame(delta_time);
+    Controller* controller = active_controllers_[i].get();
+    if (controller == nullptr) continue;
+    // In lockstep, these are run in fixed steps along with the game.
+    if (lockstep_.active() &&
+        controller->controller_type() == Controller::kTypeMultiplayer) {
+      continue;
+    }
+    controller->AdvanceFrame(delta_time);
+  }
+}
+
+void PieNoonGame::RunLockstepFrames(WorldTime delta_time) {
+  const int frames = lockstep_.FramesToRun(delta_time);
+  const WorldTime step = lockstep_.step();
+  for (int i = 0; i < frames; ++i) {
+    const uint32_t frame = lockstep_.frame();
+    multiplayer_director_->AdvanceLockstepFrame(frame, step);
+    multiplayer_director_->AdvanceControllers(step);
+    game_state_.AdvanceFrame(step);
+    game_state_.FlushSideEffects(&audio_engine_);
+
+    const uint32_t checksum = game_state_.Checksum();
+    if (lockstep_.EndFrame(checksum) && !lockstep_.is_host()) {
+#ifdef PIE_NOON_USES_MULTISCREEN
+      SendStateChecksum(kNoCharacter, frame, checksum);
+#endif
     }
   }
 }
@@ -2416,8 +3116,12 @@ void PieNoonGame::LoadTutorialSlide(int slide_index) {
   const int num_slides = static_cast<int>(tutorial_slides_->size());
   if (slide_index < 0 || slide_index >= num_slides) return;
 
+  // Requested through the scheduler, so that the slides aren't all uploaded
+  // in the same frame. The menu asset cache unloads them once they're no
+  // longer shown and the budget is exceeded.
   const char* slide_name = TutorialSlideName(slide_index);
-  matman_.LoadMaterial(slide_name);
+  upload_scheduler_.Request(slide_name);
+  menu_assets_.UseMaterial(slide_name);
 }
 
 // Preload the initial few tutorial slides to prime the slide load-unload
@@ -2507,6 +3211,7 @@ void PieNoonGame::Run() {
       input_.Delay((min_update_time - delta_time) / 1000.0);
       continue;
     }
+    StartupSpan frame_span(&startup_tracer_, "Frame");
 
     // TODO: Can we move these to 'Render'?
     renderer_.AdvanceFrame(input_.minimized(), input_.Time());
@@ -2524,10 +3229,22 @@ void PieNoonGame::Run() {
     full_screen_fader_.set_ortho_mat(ortho_mat);
     full_screen_fader_.set_extents(res);
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
     gpg_multiplayer_.Update();
 #endif
 
+    // Textures that weren't needed to leave the loading screen carry on
+    // arriving afterwards.
+    texture_load_plan_.Upload();
+    if (!textures_loaded_ || menu_assets_.loading()) {
+      textures_loaded_ = upload_scheduler_.Finalize(&matman_) &&
+                         texture_load_plan_.uploaded();
+    }
+    menu_assets_.AdvanceFrame();
+    if (config.print_upload_stats()) {
+      DebugPrintUploadStats(world_time);
+    }
+
     // If we're all done loading, run & render the game as usual.
     switch (state_) {
       case kJoining:
@@ -2536,7 +3253,7 @@ void PieNoonGame::Run() {
       case kMultiplayerWaiting:
       case kMultiscreenClient:
       case kFinished: {
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
         if (state_ == kMultiplayerWaiting) {
           if (!gpg_multiplayer_.is_hosting()) {
             // Show the correct "Joining" screen.
@@ -2574,9 +3291,18 @@ void PieNoonGame::Run() {
         }
 
         ProcessMultiplayerMessages();
+        if (gpg_multiplayer_.IsConnected() &&
+            (state_ == kMultiscreenClient ||
+             (state_ == kPlaying && game_state_.is_multiscreen()))) {
+          SendPingIfDue();
+        }
         if (game_state_.is_multiscreen() && multiplayer_director_ != nullptr &&
             state_ == kPlaying) {
-          multiplayer_director_->AdvanceFrame(delta_time);
+          if (lockstep_.active()) {
+            RunLockstepFrames(delta_time);
+          } else {
+            multiplayer_director_->AdvanceFrame(delta_time);
+          }
           bool show_look = (multiplayer_director_->start_turn_timer() < 1000 &&
                             (multiplayer_director_->turn_timer() == 0 ||
                              multiplayer_director_->turn_timer() > 2000));
@@ -2624,6 +3350,32 @@ void PieNoonGame::Run() {
 
         if (state_ == kMultiscreenClient) {
           // do multiscreen client logic
+          // Once our turn is over, guess what our command did, rather than
+          // waiting to hear from the host.
+          const WorldTime now = CurrentWorldTime(input_);
+          if (lockstep_.active()) {
+            // In lockstep we run the game ourselves, so we know exactly
+            // what our command did. Just smooth the health for display.
+            RunLockstepFrames(delta_time);
+            multiplayer_director_->CaptureStatus(&lockstep_status_);
+            status_predictor_.Reconcile(lockstep_status_, true);
+            ShowMultiscreenSplats(lockstep_status_);
+          } else if (multiscreen_turn_number_ > 0 &&
+                     now > multiscreen_turn_end_time_) {
+            status_predictor_.PredictTurn(
+                multiscreen_turn_number_, multiscreen_action_aim_at_,
+                multiscreen_action_to_perform_ == ButtonId_Attack,
+                multiscreen_turn_end_time_);
+          }
+          status_predictor_.AdvanceFrame(now, delta_time);
+          if (!lockstep_.active()) {
+            for (CharacterId i = 0;
+                 i < static_cast<CharacterId>(game_state_.characters().size());
+                 ++i) {
+              game_state_.characters()[i]->set_health(
+                  status_predictor_.predicted_health(i));
+            }
+          }
           if (CurrentWorldTime(input_) <= multiscreen_turn_end_time_) {
             // We are during a turn, update timer and splats.
             UpdateCountdownImage(CurrentWorldTime(input_));
@@ -2681,6 +3433,18 @@ void PieNoonGame::Run() {
                   splat->texture_position()[0],
                   splat->texture_position()[1] +
                       config.multiscreen_options()->splat_drip_speed()));
+              // fade out splats the host has cleared
+              if (!status_predictor_.splat_active(i)) {
+                const float fraction =
+                    status_predictor_.displayed_splat_fraction(i);
+                if (fraction <= 0.0f) {
+                  splat->set_is_visible(false);
+                } else {
+                  splat->set_color(mathfu::vec4(
+                      splat->color()[0], splat->color()[1], splat->color()[2],
+                      std::min(splat->color()[3], fraction)));
+                }
+              }
             }
           }
           if (!gpg_multiplayer_.IsConnected()) {
@@ -2713,15 +3477,29 @@ void PieNoonGame::Run() {
         }
 #endif
 
-        if (state_ != kPaused && state_ != kMultiscreenClient) {
-          // Update game logic by a variable number of milliseconds.
-          game_state_.AdvanceFrame(delta_time, &audio_engine_);
+        SceneDescription& next_scene = scenes_[1 - current_scene_];
+        if (state_ == kMultiscreenClient) {
+          AdvanceGameState(delta_time, &next_scene);
+          Render2DElements(scenes_[current_scene_], mat4::Identity());
+        } else if (config.pipeline_simulation() && scene_ready_) {
+          // Draw the scene built last frame while the job system builds the
+          // next one. Nothing else touches the game state until it's done.
+          JobCounter simulated;
+          job_system_.Submit([this, delta_time, &next_scene](int) {
+            AdvanceGameState(delta_time, &next_scene);
+          }, &simulated);
+          Render(scenes_[current_scene_]);
+          job_system_.Wait(simulated);
+          current_scene_ = 1 - current_scene_;
         } else {
-          // We are the client, we only update a few small things.
-          game_state_.particle_manager().AdvanceFrame(
-              static_cast<TimeStep>(delta_time));
-          game_state_.engine().AdvanceFrame(delta_time);
+          AdvanceGameState(delta_time, &next_scene);
+          current_scene_ = 1 - current_scene_;
+          Render(scenes_[current_scene_]);
+          scene_ready_ = true;
         }
+        // Now that the game state is back on this thread, play and send what
+        // its frame asked for.
+        game_state_.FlushSideEffects(&audio_engine_);
 
         if (state_ == kPlaying && !stinger_channel_.Valid() &&
             game_state_.IsGameOver()) {
@@ -2732,19 +3510,6 @@ void PieNoonGame::Run() {
         // Update audio engine state.
         audio_engine_.AdvanceFrame(world_time);
 
-        // Issue draw calls for the 'scene'.
-        if (state_ != kMultiscreenClient) {
-          // Populate 'scene' from the game state--all the positions,
-          // orientations, and renderable-ids (which specify materials) of the
-          // characters and props. Also specify the camera matrix.
-          game_state_.PopulateScene(&scene_);
-
-          // Issue draw calls for the 'scene'.
-          Render(scene_);
-        } else {
-          Render2DElements(scene_, mat4::Identity());
-        }
-
         // Output debug information.
         if (config.print_character_states()) {
           DebugPrintCharacterStates();
@@ -2752,6 +3517,9 @@ void PieNoonGame::Run() {
         if (config.print_pie_states()) {
           DebugPrintPieStates();
         }
+        if (config.print_job_stats()) {
+          DebugPrintJobStats(world_time);
+        }
         if (config.allow_camera_movement()) {
           DebugCamera();
         }
@@ -2823,17 +3591,34 @@ void PieNoonGame::Run() {
                                  vec2(1, 0));
       }  // Fallthrough
 
-      case kLoadingInitialMaterials:
+      case kLoadingInitialMaterials: {
         // Finalize the materials that have been loaded thus far.
-        matman_.TryFinalize();
+        const StartupTracer::Clock::time_point finalize_start =
+            StartupTracer::Clock::now();
+        upload_scheduler_.Finalize(&matman_);
+        startup_tracer_.AddSpan("FinalizeTextures", finalize_start);
 
         if (UpdatePieNoonStateAndTransition() == kFinished) {
           game_state_.Reset(GameState::kNoAnalytics);
         }
         break;
+      }
 
       case kTutorial: {
-        matman_.TryFinalize();
+        // Keep uploads out of the slides' fades, unless the slide on screen
+        // is still waiting for its texture.
+        const char* slide_name = TutorialSlideName(tutorial_slide_index_);
+        auto slide =
+            slide_name != nullptr ? matman_.FindMaterial(slide_name) : nullptr;
+        if (slide_name != nullptr) {
+          // Ask again if the cache unloaded the slide before it was shown.
+          if (slide == nullptr) LoadTutorialSlide(tutorial_slide_index_);
+          menu_assets_.UseMaterial(slide_name);
+        }
+        const bool slide_ready =
+            slide == nullptr || slide->textures()[0]->id() != 0;
+        upload_scheduler_.AdvanceFrame(
+            &matman_, slide_ready && !full_screen_fader_.Finished(world_time));
         audio_engine_.TryFinalize();
         const bool should_transition = ShouldTransitionFromSlide(world_time);
         if (should_transition) {
@@ -2854,12 +3639,8 @@ void PieNoonGame::Run() {
         }
 
         // Draw the slide covering the entire screen.
-        const char* slide_name = TutorialSlideName(tutorial_slide_index_);
-        if (slide_name != nullptr) {
-          auto slide = matman_.FindMaterial(slide_name);
-          if (slide->textures()[0]->id()) {
-            RenderInMiddleOfScreen(ortho_mat, tutorial_aspect_ratio_, slide);
-          }
+        if (slide != nullptr && slide->textures()[0]->id()) {
+          RenderInMiddleOfScreen(ortho_mat, tutorial_aspect_ratio_, slide);
         }
 
         const int num_slides = static_cast<int>(tutorial_slides_->size());
@@ -2870,10 +3651,10 @@ void PieNoonGame::Run() {
             advance_slide = full_screen_fader_.Render(world_time);
           }
           if (advance_slide) {
-            // Unload current slide to save memory.
-            if (slide_name != nullptr) {
-              matman_.UnloadMaterial(slide_name);
-            }
+            // Don't upload the current slide if it was skipped before it
+            // loaded. Once it's no longer used, the menu asset cache unloads
+            // it when it needs the memory.
+            if (slide_name != nullptr) upload_scheduler_.Cancel(slide_name);
 
             const unsigned int SLIDE_NUMBER_BUFFER_SIZE = 32;
             char slide_number[SLIDE_NUMBER_BUFFER_SIZE];
@@ -2899,6 +3680,37 @@ void PieNoonGame::Run() {
       default:
         assert(false);
     }
+
+    // Startup ends with the first frame the player can interact with.
+    if (!startup_tracer_.finished() && state_ != kLoadingInitialMaterials &&
+        state_ != kLoading) {
+      // This frame is part of startup, so its span goes in the trace.
+      frame_span.End();
+      FinishStartupTrace();
+      if (!startup_benchmark_file_.empty()) break;
+    }
+  }
+}
+
+void PieNoonGame::FinishStartupTrace() {
+  startup_tracer_.AddInstant("First interactive frame");
+  const double milliseconds = startup_tracer_.Finish();
+  fplbase::LogInfo(fplbase::kApplication,
+                   "First interactive frame after %.1f ms\n", milliseconds);
+
+  std::string filename = startup_benchmark_file_;
+  const flatbuffers::String* config_filename =
+      GetConfig().startup_trace_file();
+  if (filename.empty() && config_filename != nullptr) {
+    filename = config_filename->str();
+  }
+  if (filename.empty()) return;
+  if (startup_tracer_.WriteToFile(filename)) {
+    fplbase::LogInfo(fplbase::kApplication, "Wrote startup trace to %s\n",
+                     filename.c_str());
+  } else {
+    fplbase::LogError(fplbase::kApplication,
+                      "Can't write startup trace to %s\n", filename.c_str());
   }
 }
 
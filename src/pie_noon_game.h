@@ -20,26 +20,43 @@
 #endif  // __ANDROID__
 
 #include "ai_controller.h"
+#include "asset_pack.h"
+#include "builder_pool.h"
 #include "cardboard_controller.h"
+#include "cardboard_quads.h"
 #include "fplbase/asset_manager.h"
 #include "fplbase/input.h"
 #include "fplbase/renderer.h"
 #include "full_screen_fader.h"
 #include "game_state.h"
 #include "gui_menu.h"
+#include "job_system.h"
+#include "ktx_texture.h"
+#include "lockstep.h"
+#include "mapped_file.h"
+#include "menu_asset_cache.h"
 #include "multiplayer_controller.h"
 #include "multiplayer_director.h"
 #include "pindrop/pindrop.h"
 #include "player_controller.h"
 #include "scene_description.h"
+#include "shader_cache.h"
+#include "startup_tracer.h"
+#include "status_predictor.h"
+#include "status_replicator.h"
+#include "texture_load_plan.h"
 #include "touchscreen_button.h"
 #include "touchscreen_controller.h"
+#include "upload_scheduler.h"
 
 #ifdef ANDROID_GAMEPAD
 #include "gamepad_controller.h"
 #endif  // ANDROID_GAMEPAD
+#include "multiplayer_transport.h"
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
 #include "gpg_manager.h"
+#endif
+#ifdef PIE_NOON_USES_MULTISCREEN
 #include "gpg_multiplayer.h"
 #endif
 
@@ -75,6 +92,12 @@ class PieNoonGame {
     overlay_name_ = overlay_name;
   }
 
+  // Write the startup trace to 'trace_file', relative to the assets
+  // directory, and exit after the first interactive frame.
+  void SetStartupBenchmark(const char* trace_file) {
+    startup_benchmark_file_ = trace_file;
+  }
+
 #if defined(__ANDROID__)
   // Parse launch mode and overlay directory name from Intent data.
   static void ParseViewIntentData(const std::string& intent_data,
@@ -89,9 +112,12 @@ class PieNoonGame {
 #endif
   bool InitializeGpgIds();
   bool InitializeRenderer();
-  fplbase::Mesh* CreateVerticalQuadMesh(
+  CardboardQuads::QuadId AddVerticalQuad(
       const flatbuffers::String* material_name, const vec3& offset,
       const vec2& pixel_bounds, float pixel_to_world_scale);
+  void LoadMenuAssets(const UiGroup* menu_def, LoadPriority priority);
+  fplbase::Material* LoadStartupMaterial(const char* material_name,
+                                         LoadPriority priority);
   bool InitializeRenderingAssets();
   bool InitializeGameState();
   void RenderCardboard(const SceneDescription& scene,
@@ -105,13 +131,18 @@ class PieNoonGame {
   void Render2DElements(const SceneDescription& scene,
                         const mat4& additional_camera_changes);
   void CorrectCardboardCamera(mat4& cardboard_camera);
+  void AdvanceGameState(WorldTime delta_time, SceneDescription* scene);
   void DebugPrintCharacterStates();
   void DebugPrintPieStates();
+  void DebugPrintJobStats(WorldTime world_time);
+  void DebugPrintUploadStats(WorldTime world_time);
+  // Log how long startup took, and write the trace if one was asked for.
+  void FinishStartupTrace();
   void DebugCamera();
   const Config& GetConfig() const;
   const Config& GetCardboardConfig() const;
   const CharacterStateMachineDef* GetStateMachine() const;
-  fplbase::Mesh* GetCardboardFront(int renderable_id, int variant);
+  CardboardQuads::QuadId GetCardboardFront(int renderable_id, int variant);
   PieNoonState UpdatePieNoonState();
   void TransitionToPieNoonState(PieNoonState next_state);
   PieNoonState UpdatePieNoonStateAndTransition();
@@ -146,29 +177,83 @@ class PieNoonGame {
                               fplbase::Material* material);
 
   void ProcessMultiplayerMessages();
-  void ProcessPlayerStatusMessage(const multiplayer::PlayerStatus&);
+  // 'full' is true for statuses that start or end a turn.
+  void ProcessPlayerStatus(const PlayerStatusSnapshot& status, bool full);
+  // We've reconnected, and the host has sent us the game as it stands.
+  void ProcessFullSync(const multiplayer::FullSync& full_sync,
+                       size_t message_size);
+  // Show the splats covering our buttons in 'status'.
+  void ShowMultiscreenSplats(const PlayerStatusSnapshot& status);
 
   // returns true if a new splat was displayed
   bool ShowMultiscreenSplat(int splat_num);
 
+  // In lockstep, run the game for as many fixed steps as 'delta_time' of
+  // real time allows.
+  void RunLockstepFrames(WorldTime delta_time);
+
   static void StringArrayResource(const char* resource_name,
                                   std::vector<std::string>* strings);
 
   void CheckForNewAchievements();
 
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+#ifdef PIE_NOON_USES_MULTISCREEN
   void StartMultiscreenGameAsHost();
-  void StartMultiscreenGameAsClient(CharacterId id);
+  // A non-zero 'lockstep_seed' means run the game in lockstep with the host,
+  // up to 'run_until_frame' for now.
+  void StartMultiscreenGameAsClient(CharacterId id, uint32_t lockstep_seed,
+                                    uint32_t run_until_frame);
   void SendMultiscreenPlayerCommand();
+  void SendPlayerStatusAck();
+  // In lockstep, send our game state's checksum for 'frame' to 'player', or
+  // to the host if 'player' is kNoCharacter.
+  void SendStateChecksum(CharacterId player, uint32_t frame,
+                         uint32_t checksum);
+  // Ping the other players now and then, to measure round trip times.
+  void SendPingIfDue();
+  void SendPong(CharacterId player, uint32_t time);
+  // Log the game's multiplayer telemetry, and write it to the configured
+  // file, if any.
+  void DumpMultiplayerTelemetry();
 #endif
   void ReloadMultiscreenMenu();
   void UpdateMultiscreenMenuIcons();
   void SetupWaitingForPlayersMenu();
   bool ShouldTransitionFromSlide(WorldTime world_time);
 
+  // The file to read for 'filename': the one in the overlay directory, if
+  // there's an overlay and it has one, otherwise 'filename'.
+  static std::string OverlayFilename(const char* filename);
+  // Open the main asset pack, and the overlay's, if they were built.
+  static void OpenAssetPacks();
+  // Look for 'filename' in the overlay's pack, then in the main pack.
+  static bool FindPackedAsset(const char* filename, const uint8_t** data,
+                              size_t* size);
+  // The file to read for 'filename': compressed textures are in their
+  // format's directory.
+  static std::string AssetFilename(const char* filename);
+  // Read 'filename' from the packs, or from its separate file.
+  static bool ReadAssetFile(const char* filename, std::string* dest);
+  // Choose the compressed texture format to load, from those the GPU supports
+  // and the packs hold. Call once the packs are open.
+  void InitializeCompressedTextures();
+  // Choose where the shader cache saves programs.
+  void InitializeShaderCache();
+  // Point the textures of a material just loaded from 'filename' at their
+  // compressed copies, where there are any, and log the memory saved.
+  static void UseCompressedTextures(const char* filename,
+                                    std::string* material);
+  // Find the packed compressed copy of 'texture', in the chosen format, and
+  // read its header and size. Returns false if there isn't a valid one.
+  static bool FindCompressedTexture(const std::string& texture,
+                                    KtxImage* image, size_t* ktx_size);
   // Overrides fplbase::LoadFile() in order to optionally load files from
   // overlay directories.
   static bool LoadFile(const char* filename, std::string* dest);
+  // As LoadFile(), but maps the file rather than copying it.
+  static bool MapFile(const char* filename, MappedFile* dest);
+  // Map a config file and check it, so it can be used in place from then on.
+  static bool MapConfig(const char* filename, MappedFile* dest);
 
   // The overall operating mode of our game. See CalculatePieNoonState for the
   // state machine definition.
@@ -179,9 +264,9 @@ class PieNoonGame {
   WorldTime state_entry_time_;
 
   // Hold configuration binary data.
-  std::string config_source_;
+  MappedFile config_file_;
 #ifdef ANDROID_HMD
-  std::string cardboard_config_source_;
+  MappedFile cardboard_config_file_;
 #endif
 
   // Report touches, button presses, keyboard presses.
@@ -196,13 +281,16 @@ class PieNoonGame {
   // Manage ownership and playing of audio assets.
   pindrop::AudioEngine audio_engine_;
 
-  // Map RenderableId to rendering mesh.
-  std::vector<fplbase::Mesh*> cardboard_fronts_[RenderableId_Count];
-  fplbase::Mesh* cardboard_backs_[RenderableId_Count];
+  // Every cardboard front, back and stick, in one vertex buffer.
+  CardboardQuads cardboard_quads_;
 
-  // Rendering mesh for front and back of the stick that props cardboard.
-  fplbase::Mesh* stick_front_;
-  fplbase::Mesh* stick_back_;
+  // Map RenderableId to quads in cardboard_quads_.
+  std::vector<CardboardQuads::QuadId> cardboard_fronts_[RenderableId_Count];
+  CardboardQuads::QuadId cardboard_backs_[RenderableId_Count];
+
+  // Quads for front and back of the stick that props cardboard.
+  CardboardQuads::QuadId stick_front_;
+  CardboardQuads::QuadId stick_back_;
 
   // Shaders we use.
   fplbase::Shader* shader_cardboard;
@@ -215,7 +303,11 @@ class PieNoonGame {
   fplbase::Material* shadow_mat_;
 
   // Hold state machine binary data.
-  std::string state_machine_source_;
+  MappedFile state_machine_file_;
+
+  // Threads that run the game's parallel work. Declared before game_state_
+  // so that it outlives it.
+  JobSystem job_system_;
 
   // Hold characters, pies, camera state.
   GameState game_state_;
@@ -235,13 +327,31 @@ class PieNoonGame {
   // player starts aimed at the next player (or p3 is aimed back at p0).
   CharacterId multiscreen_action_aim_at_;
   int multiscreen_turn_number_;
+  // On the client, rebuilds player statuses from the host's deltas.
+  StatusReplicationClient status_replication_;
+  // On the client, guesses at statuses between the host's, and smooths them.
+  StatusPredictor status_predictor_;
+  // Frame timing for multiscreen games run in lockstep. Inactive otherwise.
+  LockstepSession lockstep_;
+  // On a client in lockstep, statuses read from our own game.
+  PlayerStatusSnapshot lockstep_status_;
+  // When to next ping the other players.
+  WorldTime next_ping_time_;
   // Animation for the multiscreen splats that appear.
   float multiscreen_splat_param;
   float multiscreen_splat_param_speed;
 
   // Description of the scene to be rendered. Isolates gameplay and rendering
   // code with a type-light structure. Recreated every frame.
-  SceneDescription scene_;
+  // There are two, so that one can be drawn while the other is built.
+  SceneDescription scenes_[2];
+
+  // Index into scenes_ of the one to draw next.
+  int current_scene_;
+
+  // True if scenes_[current_scene_] was built from the current game state,
+  // and can be drawn while the next one is built.
+  bool scene_ready_;
 
   // World time of previous update. We use this to calculate the delta_time
   // of the current update. This value is tied to the real-world clock.
@@ -250,6 +360,12 @@ class PieNoonGame {
   // prev_world_time_ will keep chugging.
   WorldTime prev_world_time_;
 
+  // When the job system stats were last printed and reset.
+  WorldTime job_stats_time_;
+
+  // When the texture upload stats were last printed and reset.
+  WorldTime upload_stats_time_;
+
   // Debug data. For displaying when a character's state has changed.
   std::vector<int> debug_previous_states_;
   std::vector<motive::Angle> debug_previous_angles_;
@@ -257,6 +373,23 @@ class PieNoonGame {
   TouchscreenController* touch_controller_;
   GuiMenu gui_menu_;
 
+  // The textures requested at startup, by how soon they're needed. Static,
+  // so the file loader can skip those it decodes.
+  static TextureLoadPlan texture_load_plan_;
+
+  // True once every texture requested at startup has been finalized.
+  bool textures_loaded_;
+
+  // Spreads the tutorial slides' uploads over frames.
+  UploadScheduler upload_scheduler_;
+
+  // Loads menus' textures as they're needed, and unloads the least recently
+  // used ones, and old tutorial slides, when over budget.
+  MenuAssetCache menu_assets_;
+
+  // Owns the shaders, and saves their compiled programs between launches.
+  ShaderCache shader_cache_;
+
   std::map<int, ControllerId> gamepad_to_controller_map_;
 
   CardboardController* cardboard_controller_;
@@ -310,12 +443,31 @@ class PieNoonGame {
 
   // Name of the optional overlay to load assets from.
   static std::string overlay_name_;
+  // Assets packed by build_assets.py. Files in the overlay's pack take
+  // precedence over those in the main pack, which take precedence over
+  // separate files.
+  static AssetPack asset_pack_;
+  static AssetPack overlay_pack_;
+
+  // Spans from before main() until the first interactive frame. Static, so
+  // file loads on the loader thread can be traced.
+  static StartupTracer startup_tracer_;
+  // Set by --startup-benchmark. Run() returns after the first interactive
+  // frame, once the trace is written here.
+  std::string startup_benchmark_file_;
+  // Format to load .ktx textures in, or kCompressedTextureNone for webp.
+  static CompressedTextureFormat compressed_texture_format_;
 
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   GPGManager gpg_manager;
-
+#endif
+#ifdef PIE_NOON_USES_MULTISCREEN
   // Network multiplayer library for multi-screen version
   GPGMultiplayer gpg_multiplayer_;
+  // Reused for every incoming message, so receiving doesn't allocate.
+  IncomingMessage incoming_message_;
+  // Builders for outgoing messages, reused so that sending doesn't allocate.
+  FlatBufferBuilderPool message_builders_;
 #endif
 };
 
@@ -62,6 +62,11 @@ class SceneDescription {
   const mathfu::mat4& camera() const { return camera_; }
   void set_camera(const mathfu::mat4& camera) { camera_ = camera; }
 
+  const mathfu::vec3& camera_position() const { return camera_position_; }
+  void set_camera_position(const mathfu::vec3& position) {
+    camera_position_ = position;
+  }
+
   std::vector<std::unique_ptr<Renderable>>& renderables() {
     return renderables_;
   }
@@ -84,6 +89,9 @@ class SceneDescription {
   // The camera position, orientation, fov.
   mathfu::mat4 camera_;
 
+  // Where the camera is in world space, for lighting.
+  mathfu::vec3 camera_position_;
+
   // Array of items to be rendered and their positions.
   std::vector<std::unique_ptr<Renderable>> renderables_;
 
@@ -0,0 +1,224 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <cstdio>
+#include <cstring>
+#include "SDL.h"
+#include "asset_pack.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "shader_cache.h"
+
+#ifdef _WIN32
+#define PIE_NOON_GL_APIENTRY __stdcall
+#else
+#define PIE_NOON_GL_APIENTRY
+#endif
+
+namespace fpl {
+namespace pie_noon {
+
+// From OpenGL ES 3, OpenGL 4.1 and GL_OES_get_program_binary, which not all
+// of the GL headers we build with declare, so the functions are looked up at
+// run time.
+static const GLenum kGlProgramBinaryLength = 0x8741;
+static const GLenum kGlNumProgramBinaryFormats = 0x87FE;
+typedef void(PIE_NOON_GL_APIENTRY* GetProgramBinaryFunction)(
+    GLuint program, GLsizei buffer_size, GLsizei* length,
+    GLenum* binary_format, void* binary);
+typedef void(PIE_NOON_GL_APIENTRY* ProgramBinaryFunction)(
+    GLuint program, GLenum binary_format, const void* binary, GLsizei length);
+static GetProgramBinaryFunction get_program_binary = nullptr;
+static ProgramBinaryFunction program_binary = nullptr;
+
+// Saved program files start with this, then the binary.
+struct ShaderCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t binary_format;
+  uint32_t size;
+};
+static const char kShaderCacheMagic[4] = {'P', 'I', 'E', 'S'};
+static const uint32_t kShaderCacheVersion = 1;
+
+ShaderCache::ShaderCache() : renderer_(nullptr), hits_(0), misses_(0) {}
+
+ShaderCache::~ShaderCache() {
+  for (auto it = shaders_.begin(); it != shaders_.end(); ++it) {
+    delete it->second;
+  }
+}
+
+void ShaderCache::Initialize(fplbase::Renderer* renderer,
+                             const std::string& directory) {
+  renderer_ = renderer;
+  directory_.clear();
+
+  const char* strings[] = {
+      reinterpret_cast<const char*>(glGetString(GL_VENDOR)),
+      reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+      reinterpret_cast<const char*>(glGetString(GL_VERSION))};
+  driver_.clear();
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+    if (strings[i] != nullptr) driver_ += strings[i];
+    driver_ += '\n';
+  }
+
+  get_program_binary = reinterpret_cast<GetProgramBinaryFunction>(
+      SDL_GL_GetProcAddress("glGetProgramBinary"));
+  program_binary = reinterpret_cast<ProgramBinaryFunction>(
+      SDL_GL_GetProcAddress("glProgramBinary"));
+  if (get_program_binary == nullptr || program_binary == nullptr) {
+    get_program_binary = reinterpret_cast<GetProgramBinaryFunction>(
+        SDL_GL_GetProcAddress("glGetProgramBinaryOES"));
+    program_binary = reinterpret_cast<ProgramBinaryFunction>(
+        SDL_GL_GetProcAddress("glProgramBinaryOES"));
+  }
+  GLint num_formats = 0;
+  if (get_program_binary != nullptr && program_binary != nullptr) {
+    glGetIntegerv(kGlNumProgramBinaryFormats, &num_formats);
+  }
+  if (num_formats <= 0 || directory.empty()) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Shader programs can't be saved, so compiling them\n");
+    return;
+  }
+  directory_ = directory;
+}
+
+fplbase::Shader* ShaderCache::FindShader(const char* basename) const {
+  auto it = shaders_.find(basename);
+  return it == shaders_.end() ? nullptr : it->second;
+}
+
+fplbase::Shader* ShaderCache::LoadShader(const char* basename) {
+  fplbase::Shader* shader = FindShader(basename);
+  if (shader != nullptr) return shader;
+
+  const std::string name = basename;
+  std::string vertex_source;
+  std::string fragment_source;
+  if (!fplbase::LoadFile((name + ".glslv").c_str(), &vertex_source) ||
+      !fplbase::LoadFile((name + ".glslf").c_str(), &fragment_source)) {
+    fplbase::LogError(fplbase::kError, "Can't load shader: %s\n", basename);
+    return nullptr;
+  }
+
+  const std::string key_source =
+      driver_ + vertex_source + '\0' + fragment_source;
+  const uint64_t key = AssetPack::HashName(key_source.data(),
+                                           key_source.size());
+  const uint32_t program = LoadProgram(name, key);
+  if (program != 0) {
+    shader = new fplbase::Shader(program, 0, 0);
+    shader->InitializeUniforms();
+    ++hits_;
+  } else {
+    shader = renderer_->CompileAndLinkShader(vertex_source.c_str(),
+                                             fragment_source.c_str());
+    if (shader == nullptr) {
+      fplbase::LogError(fplbase::kError, "Shader error in %s:\n%s\n",
+                        basename, renderer_->last_error().c_str());
+      return nullptr;
+    }
+    SaveProgram(name, key, shader->program());
+    ++misses_;
+  }
+  shaders_[name] = shader;
+  return shader;
+}
+
+// Shader names are paths, so the file is named by their hash instead.
+std::string ShaderCache::ProgramFilename(const std::string& name) const {
+  char filename[32];
+  snprintf(filename, sizeof(filename), "%016llx.pieshader",
+           static_cast<unsigned long long>(
+               AssetPack::HashName(name.data(), name.size())));
+  return directory_ + filename;
+}
+
+uint32_t ShaderCache::LoadProgram(const std::string& name,
+                                  uint64_t key) const {
+  if (directory_.empty()) return 0;
+  const std::string filename = ProgramFilename(name);
+  auto handle = SDL_RWFromFile(filename.c_str(), "rb");
+  if (!handle) return 0;
+  SDL_RWclose(handle);
+  std::string contents;
+  if (!fplbase::LoadFileRaw(filename.c_str(), &contents)) return 0;
+
+  ShaderCacheHeader header;
+  if (contents.size() < sizeof(header)) return 0;
+  memcpy(&header, contents.data(), sizeof(header));
+  if (memcmp(header.magic, kShaderCacheMagic, sizeof(header.magic)) != 0 ||
+      header.version != kShaderCacheVersion || header.key != key ||
+      header.size != contents.size() - sizeof(header)) {
+    return 0;
+  }
+
+  const GLuint program = glCreateProgram();
+  program_binary(program, header.binary_format,
+                 contents.data() + sizeof(header),
+                 static_cast<GLsizei>(header.size));
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (linked != GL_TRUE) {
+    // Drivers may reject programs saved by other versions of themselves.
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Saved shader program %s is out of date\n",
+                     filename.c_str());
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+void ShaderCache::SaveProgram(const std::string& name, uint64_t key,
+                              uint32_t program) const {
+  if (directory_.empty()) return;
+  // Any program saved for this shader is stale, so it goes even if this one
+  // can't be saved.
+  const std::string filename = ProgramFilename(name);
+  remove(filename.c_str());
+
+  GLint size = 0;
+  glGetProgramiv(program, kGlProgramBinaryLength, &size);
+  if (size <= 0) return;
+  std::string binary(static_cast<size_t>(size), '\0');
+  GLsizei length = 0;
+  GLenum binary_format = 0;
+  get_program_binary(program, size, &length, &binary_format, &binary[0]);
+  if (length <= 0) return;
+
+  ShaderCacheHeader header;
+  memcpy(header.magic, kShaderCacheMagic, sizeof(header.magic));
+  header.version = kShaderCacheVersion;
+  header.key = key;
+  header.binary_format = binary_format;
+  header.size = static_cast<uint32_t>(length);
+
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) return;
+  const bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(binary.data(), 1, static_cast<size_t>(length), file) ==
+          static_cast<size_t>(length);
+  // Don't leave a partial file to be read next time.
+  if (fclose(file) != 0 || !written) remove(filename.c_str());
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,81 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SHADER_CACHE_H_
+#define PIE_NOON_SHADER_CACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Owns the game's shaders, as fplbase::AssetManager would, but saves each
+// linked program with glGetProgramBinary() so that later launches can load it
+// rather than compile its GLSL again.
+//
+// Each shader has one saved program, keyed by a hash of the shader's source
+// and of the driver's vendor, renderer and version strings, so an edited
+// shader or an updated driver is compiled afresh and its program replaces the
+// stale one. A saved program that the driver rejects is compiled too, and
+// saved again. Drivers that can't save programs compile every shader, as
+// before.
+class ShaderCache {
+ public:
+  ShaderCache();
+  ~ShaderCache();
+
+  // Save programs in 'directory', which must end with a path separator. With
+  // an empty directory, shaders are compiled and nothing is saved. Call once
+  // there's a GL context.
+  void Initialize(fplbase::Renderer* renderer, const std::string& directory);
+
+  // Load 'basename'.glslv and 'basename'.glslf, or the program saved from
+  // them. Returns the shader already loaded under that name, if any, or
+  // nullptr if it can't be built.
+  fplbase::Shader* LoadShader(const char* basename);
+  // The shader loaded as 'basename', or nullptr.
+  fplbase::Shader* FindShader(const char* basename) const;
+
+  // Shaders loaded from saved programs, and shaders compiled.
+  int hits() const { return hits_; }
+  int misses() const { return misses_; }
+
+ private:
+  // Build a program from the file saved for 'name'. Returns 0 if there isn't
+  // one, it was saved under another key, or the driver rejects it.
+  uint32_t LoadProgram(const std::string& name, uint64_t key) const;
+  // Save 'program' for 'name', replacing any program saved under another key.
+  void SaveProgram(const std::string& name, uint64_t key,
+                   uint32_t program) const;
+  std::string ProgramFilename(const std::string& name) const;
+
+  fplbase::Renderer* renderer_;
+  // Empty if programs can't be saved.
+  std::string directory_;
+  // Identifies the driver, as part of every key.
+  std::string driver_;
+  std::map<std::string, fplbase::Shader*> shaders_;
+  int hits_;
+  int misses_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShaderCache);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SHADER_CACHE_H_
@@ -0,0 +1,104 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <algorithm>
+#include <cmath>
+#include "spatial_grid.h"
+
+using mathfu::vec3;
+
+namespace fpl {
+namespace pie_noon {
+
+// Used when the caller asks for a degenerate cell size.
+static const float kDefaultCellSize = 1.0f;
+
+SpatialGrid::SpatialGrid()
+    : cell_size_(kDefaultCellSize),
+      inverse_cell_size_(1.0f / kDefaultCellSize),
+      num_entities_(0) {}
+
+void SpatialGrid::Clear(float cell_size) {
+  cells_.clear();
+  cell_size_ = cell_size > 0.0f ? cell_size : kDefaultCellSize;
+  inverse_cell_size_ = 1.0f / cell_size_;
+  num_entities_ = 0;
+}
+
+int SpatialGrid::CellCoordinate(float world_coordinate) const {
+  return static_cast<int>(std::floor(world_coordinate * inverse_cell_size_));
+}
+
+SpatialGrid::CellKey SpatialGrid::KeyForCell(int x, int z) {
+  return (static_cast<CellKey>(static_cast<uint32_t>(x)) << 32) |
+         static_cast<CellKey>(static_cast<uint32_t>(z));
+}
+
+SpatialGrid::CellKey SpatialGrid::KeyForPosition(const vec3& position) const {
+  return KeyForCell(CellCoordinate(position.x()),
+                    CellCoordinate(position.z()));
+}
+
+void SpatialGrid::Insert(const corgi::EntityRef& entity,
+                         const vec3& position) {
+  cells_[KeyForPosition(position)].push_back(entity);
+  num_entities_++;
+}
+
+void SpatialGrid::Remove(const corgi::EntityRef& entity,
+                         const vec3& position) {
+  auto cell_iter = cells_.find(KeyForPosition(position));
+  if (cell_iter == cells_.end()) return;
+
+  Cell& cell = cell_iter->second;
+  auto entity_iter = std::find(cell.begin(), cell.end(), entity);
+  if (entity_iter == cell.end()) return;
+
+  // Order within a cell doesn't matter, so swap with the back to avoid
+  // shifting the remaining entries.
+  *entity_iter = cell.back();
+  cell.pop_back();
+  if (cell.empty()) {
+    cells_.erase(cell_iter);
+  }
+  num_entities_--;
+}
+
+void SpatialGrid::Move(const corgi::EntityRef& entity,
+                       const vec3& old_position, const vec3& new_position) {
+  if (KeyForPosition(old_position) == KeyForPosition(new_position)) return;
+  Remove(entity, old_position);
+  Insert(entity, new_position);
+}
+
+void SpatialGrid::Query(const vec3& center, float radius,
+                        std::vector<corgi::EntityRef>* results) const {
+  const int min_x = CellCoordinate(center.x() - radius);
+  const int max_x = CellCoordinate(center.x() + radius);
+  const int min_z = CellCoordinate(center.z() - radius);
+  const int max_z = CellCoordinate(center.z() + radius);
+
+  for (int x = min_x; x <= max_x; ++x) {
+    for (int z = min_z; z <= max_z; ++z) {
+      auto cell_iter = cells_.find(KeyForCell(x, z));
+      if (cell_iter == cells_.end()) continue;
+      const Cell& cell = cell_iter->second;
+      results->insert(results->end(), cell.begin(), cell.end());
+    }
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,80 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SPATIAL_GRID_H_
+#define PIE_NOON_SPATIAL_GRID_H_
+
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "corgi/entity_manager.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Uniform grid over the ground (XZ) plane. Entities are bucketed by the cell
+// that contains their position, so a radius query only has to look at the
+// handful of cells that overlap the query circle instead of at every entity.
+//
+// The grid only knows the positions it was told about. Callers that move
+// entities must call Move() so that the entity ends up in the correct cell.
+// Queries return candidates only; callers do the exact distance test against
+// the entity's current position.
+class SpatialGrid {
+ public:
+  SpatialGrid();
+
+  // Remove all entities and change the size of each (square) cell.
+  // The cell size should be on the order of the typical query radius.
+  void Clear(float cell_size);
+
+  // Add 'entity' to the cell that contains 'position'.
+  void Insert(const corgi::EntityRef& entity, const mathfu::vec3& position);
+
+  // Remove 'entity' from the cell that contains 'position'. 'position' must
+  // be the position the entity was inserted (or last moved) with.
+  void Remove(const corgi::EntityRef& entity, const mathfu::vec3& position);
+
+  // Move 'entity' from the cell containing 'old_position' to the cell
+  // containing 'new_position'. Does nothing if the cell does not change.
+  void Move(const corgi::EntityRef& entity, const mathfu::vec3& old_position,
+            const mathfu::vec3& new_position);
+
+  // Append to 'results' every entity in a cell that overlaps the circle
+  // of 'radius' around 'center'. 'results' is not cleared first.
+  void Query(const mathfu::vec3& center, float radius,
+             std::vector<corgi::EntityRef>* results) const;
+
+  float cell_size() const { return cell_size_; }
+  size_t num_entities() const { return num_entities_; }
+
+ private:
+  typedef uint64_t CellKey;
+  typedef std::vector<corgi::EntityRef> Cell;
+
+  int CellCoordinate(float world_coordinate) const;
+  static CellKey KeyForCell(int x, int z);
+  CellKey KeyForPosition(const mathfu::vec3& position) const;
+
+  std::unordered_map<CellKey, Cell> cells_;
+  float cell_size_;
+  float inverse_cell_size_;
+  size_t num_entities_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SPATIAL_GRID_H_
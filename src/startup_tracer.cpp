@@ -0,0 +1,173 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <cstdio>
+#include "startup_tracer.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Chrome traces need a process id. There's only the one.
+static const int kTraceProcessId = 1;
+
+StartupTracer::StartupTracer()
+    : start_(Clock::now()), finished_(false), finish_milliseconds_(0.0) {}
+
+int64_t StartupTracer::Microseconds(Clock::time_point time) const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time - start_)
+      .count();
+}
+
+int StartupTracer::ThreadIndex() {
+  const std::thread::id id = std::this_thread::get_id();
+  auto it = threads_.find(id);
+  if (it != threads_.end()) return it->second;
+  const int index = static_cast<int>(thread_names_.size());
+  threads_[id] = index;
+  thread_names_.push_back("thread " + flatbuffers::NumToString(index));
+  return index;
+}
+
+void StartupTracer::NameThread(const char* name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  thread_names_[ThreadIndex()] = name;
+}
+
+void StartupTracer::Add(const Event& event) {
+  if (finished_) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (finished_) return;
+  events_.push_back(event);
+  events_.back().thread = ThreadIndex();
+}
+
+void StartupTracer::AddSpan(const char* name, Clock::time_point start,
+                            const std::string& detail) {
+  Event event;
+  event.name = name;
+  event.detail = detail;
+  event.phase = 'X';
+  event.start_microseconds = Microseconds(start);
+  event.duration_microseconds = Microseconds(Clock::now()) -
+                                event.start_microseconds;
+  event.value = 0;
+  Add(event);
+}
+
+void StartupTracer::AddInstant(const char* name) {
+  Event event;
+  event.name = name;
+  event.phase = 'i';
+  event.start_microseconds = Microseconds(Clock::now());
+  event.duration_microseconds = 0;
+  event.value = 0;
+  Add(event);
+}
+
+void StartupTracer::AddCounter(const char* name, const char* series,
+                               int value) {
+  Event event;
+  event.name = name;
+  event.detail = series;
+  event.phase = 'C';
+  event.start_microseconds = Microseconds(Clock::now());
+  event.duration_microseconds = 0;
+  event.value = value;
+  Add(event);
+}
+
+double StartupTracer::Finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!finished_) {
+    finished_ = true;
+    finish_milliseconds_ = Microseconds(Clock::now()) / 1000.0;
+  }
+  return finish_milliseconds_;
+}
+
+bool StartupTracer::finished() const { return finished_; }
+
+// 'text' as a JSON string, quotes included.
+static std::string JsonString(const std::string& text) {
+  std::string json = "\"";
+  for (auto it = text.begin(); it != text.end(); ++it) {
+    const unsigned char c = static_cast<unsigned char>(*it);
+    if (c == '"' || c == '\\') {
+      json += '\\';
+      json += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      json += escaped;
+    } else {
+      json += static_cast<char>(c);
+    }
+  }
+  return json + "\"";
+}
+
+std::string StartupTracer::ToJson() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::string pid = flatbuffers::NumToString(kTraceProcessId);
+  std::vector<std::string> entries;
+  for (size_t i = 0; i < thread_names_.size(); ++i) {
+    entries.push_back("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" +
+                      pid + ",\"tid\":" + flatbuffers::NumToString(i) +
+                      ",\"args\":{\"name\":" + JsonString(thread_names_[i]) +
+                      "}}");
+  }
+  for (auto it = events_.begin(); it != events_.end(); ++it) {
+    std::string entry =
+        "{\"name\":" + JsonString(it->name) + ",\"ph\":\"" + it->phase +
+        "\",\"pid\":" + pid + ",\"tid\":" +
+        flatbuffers::NumToString(it->thread) + ",\"ts\":" +
+        flatbuffers::NumToString(it->start_microseconds);
+    switch (it->phase) {
+      case 'X':
+        entry += ",\"dur\":" +
+                 flatbuffers::NumToString(it->duration_microseconds);
+        if (!it->detail.empty()) {
+          entry += ",\"args\":{\"detail\":" + JsonString(it->detail) + "}";
+        }
+        break;
+      case 'i':
+        entry += ",\"s\":\"g\"";
+        break;
+      case 'C':
+        entry += ",\"args\":{" + JsonString(it->detail) + ":" +
+                 flatbuffers::NumToString(it->value) + "}";
+        break;
+    }
+    entries.push_back(entry + "}");
+  }
+
+  std::string json = "{\"traceEvents\":[\n";
+  for (size_t i = 0; i < entries.size(); ++i) {
+    json += entries[i];
+    json += i + 1 < entries.size() ? ",\n" : "\n";
+  }
+  return json + "]}\n";
+}
+
+bool StartupTracer::WriteToFile(const std::string& filename) const {
+  const std::string json = ToJson();
+  FILE* file = fopen(filename.c_str(), "w");
+  if (file == nullptr) return false;
+  const bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+  return fclose(file) == 0 && written;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,123 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_STARTUP_TRACER_H_
+#define PIE_NOON_STARTUP_TRACER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Records what the game does between the process starting and the first
+// frame the player can interact with, from any thread, and writes it as a
+// Chrome trace (load it in chrome://tracing). Times are relative to the
+// tracer's construction, so a tracer with static storage starts timing
+// before main().
+class StartupTracer {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  StartupTracer();
+
+  // Name the calling thread in the trace. Other threads are numbered.
+  void NameThread(const char* name);
+
+  // Record a span on the calling thread, from 'start' until now. 'detail',
+  // if not empty, is shown with it.
+  void AddSpan(const char* name, Clock::time_point start,
+               const std::string& detail = std::string());
+  // Record a moment, such as the first interactive frame.
+  void AddInstant(const char* name);
+  // Record the value of a counter, such as the shader cache's hits.
+  void AddCounter(const char* name, const char* series, int value);
+
+  // Stop recording. Returns the milliseconds since the tracer was created.
+  // Later calls do nothing, and return the same time.
+  double Finish();
+  bool finished() const;
+
+  // The events so far as a Chrome trace.
+  std::string ToJson() const;
+  // Write ToJson() to 'filename'. Returns false if it can't be written.
+  bool WriteToFile(const std::string& filename) const;
+
+ private:
+  struct Event {
+    std::string name;
+    std::string detail;
+    // 'X' for spans, 'i' for instants and 'C' for counters.
+    char phase;
+    int64_t start_microseconds;
+    int64_t duration_microseconds;
+    int thread;
+    int value;
+  };
+
+  int64_t Microseconds(Clock::time_point time) const;
+  // Call with mutex_ held.
+  int ThreadIndex();
+  void Add(const Event& event);
+
+  const Clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::vector<Event> events_;
+  std::map<std::thread::id, int> threads_;
+  std::vector<std::string> thread_names_;
+  // Read without the lock, so spans after Finish() cost next to nothing.
+  std::atomic<bool> finished_;
+  double finish_milliseconds_;
+
+  DISALLOW_COPY_AND_ASSIGN(StartupTracer);
+};
+
+// Records a span from its construction until End(), or until it goes out of
+// scope. 'detail' is only copied while the tracer is recording.
+class StartupSpan {
+ public:
+  StartupSpan(StartupTracer* tracer, const char* name,
+              const char* detail = nullptr)
+      : tracer_(tracer), name_(name), start_(StartupTracer::Clock::now()) {
+    if (detail != nullptr && !tracer_->finished()) detail_ = detail;
+  }
+  ~StartupSpan() { End(); }
+
+  // Record the span now, rather than when it goes out of scope.
+  void End() {
+    if (tracer_ == nullptr) return;
+    tracer_->AddSpan(name_, start_, detail_);
+    tracer_ = nullptr;
+  }
+
+ private:
+  StartupTracer* tracer_;
+  const char* name_;
+  std::string detail_;
+  StartupTracer::Clock::time_point start_;
+
+  DISALLOW_COPY_AND_ASSIGN(StartupSpan);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_STARTUP_TRACER_H_
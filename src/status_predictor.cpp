@@ -0,0 +1,158 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "status_predictor.h"
+
+namespace fpl {
+namespace pie_noon {
+
+StatusPredictor::StatusPredictor()
+    : me_(-1),
+      max_health_(1),
+      max_pie_damage_(0),
+      last_predicted_turn_(-1),
+      my_pie_damage_(0),
+      splats_(0) {}
+
+void StatusPredictor::Reset(int num_players, CharacterId me, int max_health,
+                            int max_pie_damage,
+                            const PredictionTiming& timing) {
+  me_ = me;
+  max_health_ = max_health > 0 ? max_health : 1;
+  max_pie_damage_ = max_pie_damage;
+  timing_ = timing;
+  if (timing_.smoothing <= 0) timing_.smoothing = 1;
+  last_predicted_turn_ = -1;
+  my_pie_damage_ = 0;
+  splats_ = 0;
+  authoritative_health_.assign(num_players, max_health_);
+  predicted_health_.assign(num_players, max_health_);
+  displayed_health_.assign(num_players, static_cast<float>(max_health_));
+  displayed_splats_.assign(num_players, 0.0f);
+  hits_.clear();
+}
+
+void StatusPredictor::Reconcile(const PlayerStatusSnapshot& status,
+                                bool full) {
+  const int num_players =
+      std::min(static_cast<int>(status.health.size()),
+               static_cast<int>(authoritative_health_.size()));
+  for (int i = 0; i < num_players; ++i) {
+    const int health = status.health[i];
+    // The host empties a character's pie when it's hit.
+    if (i == me_ && health < authoritative_health_[i]) my_pie_damage_ = 0;
+    authoritative_health_[i] = health;
+  }
+
+  if (full) {
+    // Full statuses come at the start of a turn, by which time every pie
+    // from the last one has landed.
+    hits_.clear();
+  } else {
+    hits_.erase(std::remove_if(hits_.begin(), hits_.end(),
+                               [this](const PredictedHit& hit) {
+                                 return authoritative_health_[hit.target] <
+                                        hit.health_when_thrown;
+                               }),
+                hits_.end());
+  }
+}
+
+void StatusPredictor::Resync(int turn, bool turn_over, int my_pie_damage) {
+  last_predicted_turn_ = turn_over ? turn : -1;
+  my_pie_damage_ = std::max(0, std::min(my_pie_damage, max_pie_damage_));
+}
+
+void StatusPredictor::PredictTurn(int turn, CharacterId aim_at,
+                                  bool is_firing, WorldTime now) {
+  if (turn == last_predicted_turn_ || !IsValid(me_)) return;
+  last_predicted_turn_ = turn;
+  if (authoritative_health_[me_] <= 0) return;
+
+  if (!is_firing) {
+    // Waiting (or blocking) leaves the pie to grow.
+    my_pie_damage_ = std::min(my_pie_damage_ + 1, max_pie_damage_);
+    return;
+  }
+
+  if (IsValid(aim_at) && aim_at != me_ && my_pie_damage_ > 0 &&
+      authoritative_health_[aim_at] > 0) {
+    PredictedHit hit;
+    hit.target = aim_at;
+    hit.damage = my_pie_damage_;
+    hit.health_when_thrown = authoritative_health_[aim_at];
+    hit.land_time = now + timing_.throw_delay +
+                    me_ * timing_.character_delay + timing_.flight_time;
+    hit.expire_time = hit.land_time + timing_.timeout;
+    hits_.push_back(hit);
+  }
+  my_pie_damage_ = 0;
+}
+
+void StatusPredictor::SetSplats(unsigned int splats) {
+  splats_ = splats;
+  for (size_t i = 0; i < displayed_splats_.size(); ++i) {
+    // New splats ease in by themselves, so show them fully straight away.
+    if (splat_active(static_cast<int>(i))) displayed_splats_[i] = 1.0f;
+  }
+}
+
+void StatusPredictor::AdvanceFrame(WorldTime now, WorldTime delta_time) {
+  // A hit the host hasn't confirmed by now was probably blocked.
+  hits_.erase(std::remove_if(hits_.begin(), hits_.end(),
+                             [now](const PredictedHit& hit) {
+                               return now >= hit.expire_time;
+                             }),
+              hits_.end());
+
+  predicted_health_ = authoritative_health_;
+  for (auto it = hits_.begin(); it != hits_.end(); ++it) {
+    if (now >= it->land_time) predicted_health_[it->target] -= it->damage;
+  }
+
+  const float step = std::min(
+      1.0f, static_cast<float>(delta_time) / timing_.smoothing);
+  for (size_t i = 0; i < predicted_health_.size(); ++i) {
+    if (predicted_health_[i] < 0) predicted_health_[i] = 0;
+    displayed_health_[i] +=
+        (predicted_health_[i] - displayed_health_[i]) * step;
+  }
+
+  const float fade = static_cast<float>(delta_time) / timing_.smoothing;
+  for (size_t i = 0; i < displayed_splats_.size(); ++i) {
+    if (!splat_active(static_cast<int>(i))) {
+      displayed_splats_[i] = std::max(0.0f, displayed_splats_[i] - fade);
+    }
+  }
+}
+
+int StatusPredictor::predicted_health(CharacterId id) const {
+  return IsValid(id) ? predicted_health_[id] : 0;
+}
+
+float StatusPredictor::displayed_health_fraction(CharacterId id) const {
+  if (!IsValid(id)) return 0.0f;
+  return mathfu::Clamp(displayed_health_[id] / max_health_, 0.0f, 1.0f);
+}
+
+float StatusPredictor::displayed_splat_fraction(int splat) const {
+  if (splat < 0 || splat >= static_cast<int>(displayed_splats_.size())) {
+    return 0.0f;
+  }
+  return displayed_splats_[splat];
+}
+
+}  // pie_noon
+}  // fpl
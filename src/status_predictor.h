@@ -0,0 +1,136 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_STATUS_PREDICTOR_H_
+#define PIE_NOON_STATUS_PREDICTOR_H_
+
+#include <vector>
+#include "common.h"
+#include "status_replicator.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// When the host acts on a turn's commands, relative to the end of the turn
+// on the client.
+struct PredictionTiming {
+  PredictionTiming()
+      : throw_delay(0),
+        character_delay(0),
+        flight_time(0),
+        timeout(0),
+        smoothing(1) {}
+
+  // From the client's turn ending to the host throwing the first pie.
+  WorldTime throw_delay;
+  // Extra delay for each character after the first.
+  WorldTime character_delay;
+  // How long a pie is in the air.
+  WorldTime flight_time;
+  // How long after it should have landed to give up on a predicted hit the
+  // host never confirmed.
+  WorldTime timeout;
+  // Roughly how long displayed health takes to catch up with a change.
+  WorldTime smoothing;
+};
+
+// Client-side guess at the player statuses between host updates.
+//
+// The client only knows its own command, so predictions are limited to what
+// that command does: a pie it throws should land on its target, and a pie
+// it doesn't throw grows. Everything else comes from the host. Predicted
+// hits are dropped once the host confirms them, or when a full status
+// arrives, or once they time out.
+//
+// Health is also smoothed, so it eases to each new value rather than
+// jumping whenever a packet arrives, and splats the host has cleared fade
+// out over the same time rather than vanishing.
+//
+// This is not a local run of the game: the client never sees the other
+// players' commands, so it can't simulate their throws or blocks.
+class StatusPredictor {
+ public:
+  StatusPredictor();
+
+  // Start over, with every player on full health.
+  void Reset(int num_players, CharacterId me, int max_health,
+             int max_pie_damage, const PredictionTiming& timing);
+
+  // Apply a status from the host. A full status replaces any predictions;
+  // a delta only confirms the ones on players whose health has dropped.
+  void Reconcile(const PlayerStatusSnapshot& status, bool full);
+
+  // We've reconnected, and the host has told us the turn it's on and how
+  // big our pie is. If 'turn_over', the host has already acted on our
+  // command for 'turn', so it mustn't be predicted again.
+  void Resync(int turn, bool turn_over, int my_pie_damage);
+
+  // Our turn ended at 'now' with this command. Repeat calls for the same
+  // 'turn' are ignored.
+  void PredictTurn(int turn, CharacterId aim_at, bool is_firing,
+                   WorldTime now);
+
+  // The splats the host says are on our screen, one bit per splat.
+  void SetSplats(unsigned int splats);
+
+  // Land or expire predicted hits, and move displayed health and splats
+  // along.
+  void AdvanceFrame(WorldTime now, WorldTime delta_time);
+
+  // Best guess at a player's current health.
+  int predicted_health(CharacterId id) const;
+  // Predicted health, smoothed for display, from 0 (out) to 1 (full).
+  float displayed_health_fraction(CharacterId id) const;
+  // Best guess at how big our pie is.
+  int my_pie_damage() const { return my_pie_damage_; }
+  // Whether the host still has this splat on our screen.
+  bool splat_active(int splat) const {
+    return splat >= 0 && splat < 32 && ((splats_ >> splat) & 1) != 0;
+  }
+  // How much of a splat to show, from 0 (gone) to 1 (fully there).
+  float displayed_splat_fraction(int splat) const;
+
+ private:
+  struct PredictedHit {
+    CharacterId target;
+    int damage;
+    // Target's authoritative health when we threw.
+    int health_when_thrown;
+    WorldTime land_time;
+    WorldTime expire_time;
+  };
+
+  bool IsValid(CharacterId id) const {
+    return id >= 0 && id < static_cast<int>(authoritative_health_.size());
+  }
+
+  CharacterId me_;
+  int max_health_;
+  int max_pie_damage_;
+  PredictionTiming timing_;
+  int last_predicted_turn_;
+  int my_pie_damage_;
+  unsigned int splats_;
+
+  std::vector<int> authoritative_health_;
+  std::vector<int> predicted_health_;
+  std::vector<float> displayed_health_;
+  std::vector<float> displayed_splats_;
+  std::vector<PredictedHit> hits_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_STATUS_PREDICTOR_H_
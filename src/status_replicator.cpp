@@ -0,0 +1,234 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "status_replicator.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// PlayerStatusDelta marks changed players in a single byte.
+static const size_t kMaxReplicatedPlayers = 8;
+
+void StatusHistory::Clear() {
+  for (int i = 0; i < kSize; ++i) {
+    snapshots_[i] = PlayerStatusSnapshot();
+  }
+}
+
+PlayerStatusSnapshot* StatusHistory::Add(unsigned int sequence) {
+  PlayerStatusSnapshot* snapshot = &snapshots_[sequence % kSize];
+  snapshot->sequence = sequence;
+  return snapshot;
+}
+
+const PlayerStatusSnapshot* StatusHistory::Find(unsigned int sequence) const {
+  if (sequence == 0) return nullptr;
+  const PlayerStatusSnapshot* snapshot = &snapshots_[sequence % kSize];
+  return snapshot->sequence == sequence ? snapshot : nullptr;
+}
+
+StatusReplicationHost::StatusReplicationHost() {}
+
+void StatusReplicationHost::Reset(int num_clients) {
+  // Keep counting up from the last game's sequence numbers, so that clients
+  // that haven't reset yet don't mistake new statuses for stale ones.
+  history_.Clear();
+  acknowledged_.assign(num_clients, 0);
+}
+
+void StatusReplicationHost::ResetClient(int client) {
+  if (client >= 0 && client < static_cast<int>(acknowledged_.size())) {
+    acknowledged_[client] = 0;
+  }
+}
+
+void StatusReplicationHost::Capture(const std::vector<uint8_t>& health,
+                                    const std::vector<uint8_t>& splats) {
+  const size_t num_players =
+      std::min(std::min(health.size(), splats.size()), kMaxReplicatedPlayers);
+  latest_.sequence++;
+  latest_.health.assign(health.begin(), health.begin() + num_players);
+  latest_.splats.assign(splats.begin(), splats.begin() + num_players);
+  *history_.Add(latest_.sequence) = latest_;
+}
+
+flatbuffers::Offset<multiplayer::PlayerStatus>
+StatusReplicationHost::CreateFullStatus(
+    flatbuffers::FlatBufferBuilder& builder) {
+  stats_.full_statuses++;
+  auto health = builder.CreateVector(latest_.health);
+  auto splats = builder.CreateVector(latest_.splats);
+  return multiplayer::CreatePlayerStatus(builder, health, splats,
+                                         latest_.sequence);
+}
+
+flatbuffers::Offset<multiplayer::MessageRoot>
+StatusReplicationHost::CreateDeltaMessage(
+    int client, flatbuffers::FlatBufferBuilder& builder) {
+  const unsigned int acknowledged =
+      client >= 0 && client < static_cast<int>(acknowledged_.size())
+          ? acknowledged_[client]
+          : 0;
+  const size_t num_players = latest_.health.size();
+
+  // Without a usable baseline, every player counts as changed.
+  const PlayerStatusSnapshot* baseline = history_.Find(acknowledged);
+  if (baseline != nullptr && baseline->health.size() != num_players) {
+    baseline = nullptr;
+  }
+
+  uint8_t changed_players = 0;
+  changed_health_.clear();
+  changed_splats_.clear();
+  for (size_t i = 0; i < num_players; ++i) {
+    if (baseline == nullptr || baseline->health[i] != latest_.health[i] ||
+        baseline->splats[i] != latest_.splats[i]) {
+      changed_players |= static_cast<uint8_t>(1 << i);
+      changed_health_.push_back(latest_.health[i]);
+      changed_splats_.push_back(latest_.splats[i]);
+    }
+  }
+  if (baseline == nullptr) {
+    stats_.full_statuses++;
+  } else {
+    stats_.delta_statuses++;
+  }
+
+  auto health = builder.CreateVector(changed_health_);
+  auto splats = builder.CreateVector(changed_splats_);
+  return multiplayer::CreateMessageRoot(
+      builder, multiplayer::Data_PlayerStatusDelta,
+      multiplayer::CreatePlayerStatusDelta(
+          builder, latest_.sequence, baseline == nullptr ? 0 : acknowledged,
+          static_cast<uint8_t>(num_players), changed_players, health, splats)
+          .Union());
+}
+
+void StatusReplicationHost::ReceiveAck(
+    int client, const multiplayer::PlayerStatusAck& ack) {
+  if (client < 0 || client >= static_cast<int>(acknowledged_.size())) return;
+  stats_.acks++;
+
+  // Acks are unreliable too, so never move back to an older baseline. A 0
+  // means the client lost track, and needs every player again.
+  const unsigned int sequence = ack.sequence();
+  if (sequence == 0 || history_.Find(sequence) == nullptr) {
+    acknowledged_[client] = 0;
+  } else if (sequence > acknowledged_[client]) {
+    acknowledged_[client] = sequence;
+  }
+}
+
+StatusReplicationClient::StatusReplicationClient()
+    : latest_sequence_(0), ack_sequence_(0) {}
+
+void StatusReplicationClient::Reset() {
+  history_.Clear();
+  latest_sequence_ = 0;
+  ack_sequence_ = 0;
+}
+
+bool StatusReplicationClient::Accept(unsigned int sequence) {
+  if (sequence != 0 && sequence <= latest_sequence_) {
+    stats_.stale_statuses++;
+    return false;
+  }
+  return true;
+}
+
+bool StatusReplicationClient::ReceiveFull(
+    const multiplayer::PlayerStatus& message, PlayerStatusSnapshot* status) {
+  stats_.full_statuses++;
+  if (!Accept(message.sequence())) return false;
+
+  status->sequence = message.sequence();
+  status->health.clear();
+  status->splats.clear();
+  if (message.player_health() != nullptr) {
+    status->health.assign(message.player_health()->begin(),
+                          message.player_health()->end());
+  }
+  if (message.player_splats() != nullptr) {
+    status->splats.assign(message.player_splats()->begin(),
+                          message.player_splats()->end());
+  }
+
+  // Statuses from hosts that don't number them can't be used as baselines.
+  if (status->sequence != 0) {
+    *history_.Add(status->sequence) = *status;
+    latest_sequence_ = status->sequence;
+    ack_sequence_ = status->sequence;
+  }
+  return true;
+}
+
+bool StatusReplicationClient::ReceiveDelta(
+    const multiplayer::PlayerStatusDelta& message,
+    PlayerStatusSnapshot* status) {
+  stats_.delta_statuses++;
+  if (!Accept(message.sequence())) return false;
+
+  const size_t num_players = message.num_players();
+  const auto* health = message.player_health();
+  const auto* splats = message.player_splats();
+  const PlayerStatusSnapshot* baseline = history_.Find(message.baseline());
+  if ((message.baseline() != 0 && baseline == nullptr) ||
+      (baseline != nullptr && baseline->health.size() != num_players) ||
+      num_players > kMaxReplicatedPlayers || health == nullptr ||
+      splats == nullptr) {
+    // Ask the host to start over with every player.
+    stats_.unusable_deltas++;
+    ack_sequence_ = 0;
+    return false;
+  }
+
+  if (baseline != nullptr) {
+    status->health = baseline->health;
+    status->splats = baseline->splats;
+  } else {
+    status->health.assign(num_players, 0);
+    status->splats.assign(num_players, 0);
+  }
+  flatbuffers::uoffset_t changed = 0;
+  for (size_t i = 0; i < num_players; ++i) {
+    if ((message.changed_players() & (1 << i)) == 0) continue;
+    if (changed >= health->size() || changed >= splats->size()) {
+      stats_.unusable_deltas++;
+      ack_sequence_ = 0;
+      return false;
+    }
+    status->health[i] = health->Get(changed);
+    status->splats[i] = splats->Get(changed);
+    changed++;
+  }
+
+  status->sequence = message.sequence();
+  *history_.Add(status->sequence) = *status;
+  latest_sequence_ = status->sequence;
+  ack_sequence_ = status->sequence;
+  return true;
+}
+
+flatbuffers::Offset<multiplayer::MessageRoot>
+StatusReplicationClient::CreateAckMessage(
+    flatbuffers::FlatBufferBuilder& builder) {
+  stats_.acks++;
+  return multiplayer::CreateMessageRoot(
+      builder, multiplayer::Data_PlayerStatusAck,
+      multiplayer::CreatePlayerStatusAck(builder, ack_sequence_).Union());
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,161 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_STATUS_REPLICATOR_H_
+#define PIE_NOON_STATUS_REPLICATOR_H_
+
+#include <cstdint>
+#include <vector>
+#include "common.h"
+#include "flatbuffers/flatbuffers.h"
+#include "multiplayer_generated.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Health and splats of every player, as the host saw them at one moment.
+struct PlayerStatusSnapshot {
+  PlayerStatusSnapshot() : sequence(0) {}
+
+  // 0 if the snapshot is empty, or came from a host that doesn't number
+  // its statuses.
+  unsigned int sequence;
+  std::vector<uint8_t> health;
+  std::vector<uint8_t> splats;
+};
+
+// Traffic caused by status replication, for keeping an eye on bandwidth.
+struct ReplicationStats {
+  ReplicationStats()
+      : full_statuses(0),
+        delta_statuses(0),
+        acks(0),
+        stale_statuses(0),
+        unusable_deltas(0),
+        bytes_sent(0),
+        bytes_received(0) {}
+
+  int full_statuses;
+  int delta_statuses;
+  int acks;
+  // Statuses that arrived after a newer one, and were dropped.
+  int stale_statuses;
+  // Deltas whose baseline we no longer had, and were dropped.
+  int unusable_deltas;
+  size_t bytes_sent;
+  size_t bytes_received;
+};
+
+// The last few statuses, looked up by sequence number.
+class StatusHistory {
+ public:
+  void Clear();
+
+  // Returns the slot for 'sequence', overwriting the oldest status.
+  PlayerStatusSnapshot* Add(unsigned int sequence);
+
+  // Returns nullptr if 'sequence' is 0 or too old.
+  const PlayerStatusSnapshot* Find(unsigned int sequence) const;
+
+ private:
+  static const int kSize = 32;
+  PlayerStatusSnapshot snapshots_[kSize];
+};
+
+// Host half of status replication. Every status gets a sequence number, and
+// each client is sent only what changed since the newest status it has
+// acknowledged. Statuses are sent unreliably, so a lost one just means the
+// next delta is measured from an older baseline.
+class StatusReplicationHost {
+ public:
+  StatusReplicationHost();
+
+  // Forget all statuses and acknowledgements.
+  void Reset(int num_clients);
+
+  // Forget what 'client' has acknowledged, so that its next delta includes
+  // every player. Use when a client reconnects.
+  void ResetClient(int client);
+
+  // Record the current status of every player, and give it the next
+  // sequence number.
+  void Capture(const std::vector<uint8_t>& health,
+               const std::vector<uint8_t>& splats);
+
+  // The latest captured status, in full, for embedding in reliable messages.
+  flatbuffers::Offset<multiplayer::PlayerStatus> CreateFullStatus(
+      flatbuffers::FlatBufferBuilder& builder);
+
+  // A message holding the difference between the latest captured status and
+  // the newest one that 'client' has acknowledged.
+  flatbuffers::Offset<multiplayer::MessageRoot> CreateDeltaMessage(
+      int client, flatbuffers::FlatBufferBuilder& builder);
+
+  // Handle a PlayerStatusAck from 'client'.
+  void ReceiveAck(int client, const multiplayer::PlayerStatusAck& ack);
+
+  void RecordSent(size_t bytes) { stats_.bytes_sent += bytes; }
+  void RecordReceived(size_t bytes) { stats_.bytes_received += bytes; }
+  const ReplicationStats& stats() const { return stats_; }
+
+ private:
+  StatusHistory history_;
+  PlayerStatusSnapshot latest_;
+  // For each client, the newest status it has, or 0 if none.
+  std::vector<unsigned int> acknowledged_;
+  // Scratch space for CreateDeltaMessage(), kept to avoid allocating.
+  std::vector<uint8_t> changed_health_;
+  std::vector<uint8_t> changed_splats_;
+  ReplicationStats stats_;
+};
+
+// Client half of status replication. Rebuilds full statuses from deltas,
+// and drops any that are older than the newest one applied.
+class StatusReplicationClient {
+ public:
+  StatusReplicationClient();
+
+  void Reset();
+
+  // Returns true and fills in 'status' if 'message' should be applied.
+  bool ReceiveFull(const multiplayer::PlayerStatus& message,
+                   PlayerStatusSnapshot* status);
+  bool ReceiveDelta(const multiplayer::PlayerStatusDelta& message,
+                    PlayerStatusSnapshot* status);
+
+  // Tells the host what to use as the baseline for the next delta.
+  flatbuffers::Offset<multiplayer::MessageRoot> CreateAckMessage(
+      flatbuffers::FlatBufferBuilder& builder);
+
+  void RecordSent(size_t bytes) { stats_.bytes_sent += bytes; }
+  void RecordReceived(size_t bytes) { stats_.bytes_received += bytes; }
+  const ReplicationStats& stats() const { return stats_; }
+
+ private:
+  // Returns false if 'sequence' is older than the newest status applied.
+  bool Accept(unsigned int sequence);
+
+  StatusHistory history_;
+  // Newest status applied, or 0 if none.
+  unsigned int latest_sequence_;
+  // What to acknowledge next. 0 after a delta we couldn't use, so that the
+  // host starts over.
+  unsigned int ack_sequence_;
+  ReplicationStats stats_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_STATUS_REPLICATOR_H_
@@ -0,0 +1,136 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "texture_load_plan.h"
+
+namespace fpl {
+namespace pie_noon {
+
+TextureLoadPlan::TextureLoadPlan()
+    : resident_(0),
+      next_upload_(0),
+      job_system_(nullptr),
+      read_file_(nullptr) {}
+
+TextureLoadPlan::~TextureLoadPlan() {
+  WaitForDecoding();
+  for (auto it = decodes_.begin(); it != decodes_.end(); ++it) {
+    free((*it)->pixels);
+  }
+}
+
+void TextureLoadPlan::Add(LoadPriority priority, fplbase::Material* material) {
+  assert(0 <= priority && priority < kLoadPriorityCount);
+  if (material == nullptr) return;
+  materials_[priority].push_back(material);
+}
+
+static bool IsWebP(const std::string& filename) {
+  static const char kExtension[] = ".webp";
+  const size_t extension_length = sizeof(kExtension) - 1;
+  return filename.size() >= extension_length &&
+         strcmp(filename.c_str() + filename.size() - extension_length,
+                kExtension) == 0;
+}
+
+void TextureLoadPlan::StartDecoding(JobSystem* job_system,
+                                    ReadFileFunction read_file) {
+  assert(decodes_.empty());
+  // The render thread doesn't run jobs until it waits on them, so without
+  // workers the loader thread is no slower.
+  if (job_system->num_threads() < 2) return;
+  job_system_ = job_system;
+  read_file_ = read_file;
+
+  for (int priority = 0; priority < kLoadPriorityCount; ++priority) {
+    const std::vector<fplbase::Material*>& materials = materials_[priority];
+    for (auto it = materials.begin(); it != materials.end(); ++it) {
+      const std::vector<fplbase::Texture*>& textures = (*it)->textures();
+      for (auto tex = textures.begin(); tex != textures.end(); ++tex) {
+        // Materials can share textures, and GPU-compressed ones don't need
+        // decoding.
+        const std::string& filename = (*tex)->filename();
+        if (!IsWebP(filename) || Decodes(filename.c_str())) continue;
+        decoded_filenames_.insert(filename);
+        std::unique_ptr<Decode> decode(new Decode());
+        decode->texture = *tex;
+        decode->filename = filename;
+        decode->pixels = nullptr;
+        decode->size = mathfu::kZeros2i;
+        decode->has_alpha = false;
+        decode->decoded = false;
+        decodes_.push_back(std::move(decode));
+      }
+    }
+  }
+
+  // Submitted in priority order, which is roughly the order workers take
+  // them in.
+  for (auto it = decodes_.begin(); it != decodes_.end(); ++it) {
+    Decode* decode = it->get();
+    job_system_->Submit([this, decode](int) { DecodeTexture(decode); },
+                        &decoding_);
+  }
+}
+
+void TextureLoadPlan::DecodeTexture(Decode* decode) {
+  std::string file;
+  if (read_file_(decode->filename.c_str(), &file)) {
+    decode->pixels = fplbase::Texture::UnpackWebP(
+        file.data(), file.size(), mathfu::kOnes2f, &decode->size,
+        &decode->has_alpha);
+  }
+  if (decode->pixels == nullptr) {
+    fplbase::LogError(fplbase::kApplication, "Can't decode %s\n",
+                      decode->filename.c_str());
+  }
+  decode->decoded.store(true, std::memory_order_release);
+}
+
+void TextureLoadPlan::Upload() {
+  while (next_upload_ < decodes_.size()) {
+    Decode& decode = *decodes_[next_upload_];
+    if (!decode.decoded.load(std::memory_order_acquire)) return;
+    if (decode.pixels != nullptr) {
+      decode.texture->LoadFromMemory(decode.pixels, decode.size,
+                                     fplbase::kFormatAuto, decode.has_alpha);
+      free(decode.pixels);
+      decode.pixels = nullptr;
+    }
+    next_upload_++;
+  }
+}
+
+void TextureLoadPlan::WaitForDecoding() {
+  if (job_system_ == nullptr) return;
+  job_system_->Wait(decoding_);
+  job_system_ = nullptr;
+}
+
+bool TextureLoadPlan::Resident(LoadPriority priority) const {
+  for (; resident_ <= priority; ++resident_) {
+    const std::vector<fplbase::Material*>& materials = materials_[resident_];
+    for (auto it = materials.begin(); it != materials.end(); ++it) {
+      const std::vector<fplbase::Texture*>& textures = (*it)->textures();
+      for (auto tex = textures.begin(); tex != textures.end(); ++tex) {
+        if (!(*tex)->id()) return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
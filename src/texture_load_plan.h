@@ -0,0 +1,121 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_TEXTURE_LOAD_PLAN_H_
+#define PIE_NOON_TEXTURE_LOAD_PLAN_H_
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "job_system.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// How soon a texture is needed. Each is needed before the next.
+enum LoadPriority {
+  // The spinner and logo shown while everything else loads.
+  kLoadPriorityLoadingScreen,
+  // The title menu, which is the first thing shown once loading is done.
+  kLoadPriorityTitleMenu,
+  // The cardboard cutouts, and everything else seen in a game.
+  kLoadPriorityCardboards,
+  // Anything else requested at startup.
+  kLoadPriorityExtras,
+  kLoadPriorityCount
+};
+
+// Tracks the materials requested at startup by priority, so the game can
+// carry on once the ones it needs first are resident, rather than waiting
+// for all of them.
+//
+// fplbase decodes textures on its single loader thread, one at a time. The
+// plan's webp textures are instead decoded on the job system's workers, all
+// at once, and uploaded on the render thread in priority order. Everything
+// else, such as GPU-compressed textures, is left to the loader thread, which
+// goes in the order textures are requested, so materials must be requested,
+// and added here, in priority order.
+class TextureLoadPlan {
+ public:
+  // Reads a file's contents into 'dest'. Returns false if it can't.
+  typedef bool (*ReadFileFunction)(const char* filename, std::string* dest);
+
+  TextureLoadPlan();
+  ~TextureLoadPlan();
+
+  // 'material' has just been requested from the AssetManager.
+  void Add(LoadPriority priority, fplbase::Material* material);
+
+  // Start decoding the webp textures added so far on 'job_system''s workers.
+  // Call before fplbase::AssetManager::StartLoadingTextures(), and have the
+  // file loader refuse whatever Decodes() claims, so the loader thread
+  // doesn't decode them too. Does nothing if there are no workers.
+  void StartDecoding(JobSystem* job_system, ReadFileFunction read_file);
+
+  // True if 'filename' is a texture StartDecoding() took on. Can be called
+  // from any thread once StartDecoding() has returned.
+  bool Decodes(const char* filename) const {
+    return decoded_filenames_.find(filename) != decoded_filenames_.end();
+  }
+
+  // Upload the decoded textures in priority order, up to the first that is
+  // still being decoded. Call once a frame from the render thread.
+  void Upload();
+
+  // True once everything StartDecoding() took on has been uploaded.
+  bool uploaded() const { return next_upload_ == decodes_.size(); }
+
+  // Wait for the decoding jobs. Call before the job system shuts down.
+  void WaitForDecoding();
+
+  // True once every texture at 'priority' or more urgent is on the GPU.
+  // fplbase::AssetManager::TryFinalize() and Upload() are what put them
+  // there, so call those first.
+  bool Resident(LoadPriority priority) const;
+
+ private:
+  struct Decode {
+    fplbase::Texture* texture;
+    std::string filename;
+    // Set by the decoding job, before 'decoded'. Freed with free().
+    uint8_t* pixels;
+    vec2i size;
+    bool has_alpha;
+    std::atomic<bool> decoded;
+  };
+
+  void DecodeTexture(Decode* decode);
+
+  std::vector<fplbase::Material*> materials_[kLoadPriorityCount];
+  // Priorities before this one are known to be resident.
+  mutable int resident_;
+
+  // In priority order. Only changed by StartDecoding().
+  std::vector<std::unique_ptr<Decode>> decodes_;
+  std::set<std::string> decoded_filenames_;
+  size_t next_upload_;
+  JobSystem* job_system_;
+  JobCounter decoding_;
+  ReadFileFunction read_file_;
+
+  DISALLOW_COPY_AND_ASSIGN(TextureLoadPlan);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_TEXTURE_LOAD_PLAN_H_
@@ -0,0 +1,565 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "fplbase/utilities.h"
+#include "udp_transport.h"
+
+namespace fpl {
+
+// Every packet starts with one of these.
+enum PacketKind {
+  // Client looking for hosts. Body is the service id.
+  kPacketDiscover = 1,
+  // Host answering kPacketDiscover. Body is the host's name.
+  kPacketAdvertise,
+  // Client asking to join. Body is the service id, a 0, then the name.
+  kPacketConnect,
+  kPacketAccept,
+  kPacketReject,
+  kPacketDisconnect,
+  // Body is a 4-byte sequence number, then the payload.
+  kPacketReliable,
+  // Body is the 4-byte sequence number being acknowledged.
+  kPacketAcknowledge,
+  // Body is the payload.
+  kPacketUnreliable,
+  kPacketKeepAlive,
+};
+
+static const size_t kMaxPacketSize = 64 * 1024;
+static const size_t kSequenceSize = 4;
+static const int kPollMilliseconds = 20;
+// Limit on reliable payloads held back waiting for a missing one.
+static const size_t kMaxEarlyPackets = 256;
+
+static const std::chrono::milliseconds kDiscoveryInterval(500);
+static const std::chrono::milliseconds kHostTimeout(3000);
+static const std::chrono::milliseconds kConnectInterval(500);
+static const std::chrono::milliseconds kConnectTimeout(5000);
+static const std::chrono::milliseconds kResendInterval(100);
+static const std::chrono::milliseconds kKeepAliveInterval(1000);
+static const std::chrono::milliseconds kPeerTimeout(5000);
+
+static void WriteSequence(uint32_t sequence, std::vector<uint8_t>* body) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    body->push_back(static_cast<uint8_t>(sequence >> shift));
+  }
+}
+
+static uint32_t ReadSequence(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+UdpTransport::UdpTransport(uint16_t port, const std::string& discovery_address)
+    : port_(port),
+      discovery_address_(discovery_address),
+      listener_(nullptr),
+      socket_(-1),
+      bound_port_(0),
+      running_(false),
+      advertising_(false),
+      discovering_(false) {
+  memset(&discovery_sockaddr_, 0, sizeof(discovery_sockaddr_));
+}
+
+UdpTransport::~UdpTransport() { Close(); }
+
+bool UdpTransport::Initialize(const std::string& service_id,
+                              MultiplayerTransportListener* listener) {
+  service_id_ = service_id;
+  listener_ = listener;
+
+  discovery_sockaddr_.sin_family = AF_INET;
+  discovery_sockaddr_.sin_port = htons(port_);
+  if (inet_pton(AF_INET, discovery_address_.c_str(),
+                &discovery_sockaddr_.sin_addr) != 1) {
+    fplbase::LogError(fplbase::kApplication,
+                      "UdpTransport: Bad discovery address '%s'",
+                      discovery_address_.c_str());
+    return false;
+  }
+  return Open(0);
+}
+
+bool UdpTransport::Open(uint16_t port) {
+  // Also clears bound_port_, so it stays 0 if anything below fails.
+  Close();
+
+  socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket_ < 0) {
+    fplbase::LogError(fplbase::kApplication,
+                      "UdpTransport: Unable to create a socket.");
+    return false;
+  }
+  // Needed for discovery probes sent to a broadcast address.
+  int enable = 1;
+  setsockopt(socket_, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+  fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL, 0) | O_NONBLOCK);
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+      0) {
+    fplbase::LogError(fplbase::kApplication,
+                      "UdpTransport: Unable to bind to port %d.", port);
+    close(socket_);
+    socket_ = -1;
+    return false;
+  }
+  bound_port_ = port;
+
+  running_ = true;
+  receive_thread_ = std::thread(&UdpTransport::ReceiveThread, this);
+  return true;
+}
+
+void UdpTransport::Close() {
+  running_ = false;
+  if (receive_thread_.joinable()) {
+    receive_thread_.join();
+  }
+  if (socket_ >= 0) {
+    close(socket_);
+    socket_ = -1;
+  }
+  bound_port_ = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  peers_.clear();
+  discovered_hosts_.clear();
+}
+
+void UdpTransport::StartAdvertising(const std::string& name) {
+  // Only hosts listen on the well-known port, so that clients on the same
+  // machine don't fight over it.
+  bool success = bound_port_ == port_ || Open(port_);
+  if (success) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    advertising_ = true;
+    discovering_ = false;
+    advertised_name_ = name;
+  }
+  listener_->OnAdvertisingResult(success);
+}
+
+void UdpTransport::StopAdvertising() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  advertising_ = false;
+}
+
+void UdpTransport::AcceptConnectionRequest(
+    const std::string& client_instance_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Peer* peer = FindPeer(client_instance_id, kPeerRequested);
+  if (peer == nullptr) return;
+  peer->state = kPeerConnected;
+  SendToPeer(peer, kPacketAccept, std::vector<uint8_t>());
+}
+
+void UdpTransport::RejectConnectionRequest(
+    const std::string& client_instance_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Peer* peer = FindPeer(client_instance_id, kPeerRequested);
+  if (peer == nullptr) return;
+  SendToPeer(peer, kPacketReject, std::vector<uint8_t>());
+  peers_.erase(client_instance_id);
+}
+
+void UdpTransport::StartDiscovery() {
+  if (bound_port_ == port_) {
+    Open(0);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  advertising_ = false;
+  discovering_ = true;
+  discovered_hosts_.clear();
+  // Send the first probe straight away.
+  last_discovery_probe_ = Clock::time_point();
+}
+
+void UdpTransport::StopDiscovery() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  discovering_ = false;
+}
+
+void UdpTransport::SendConnectionRequest(const std::string& name,
+                                         const std::string& host_instance_id) {
+  EventList events;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto host = discovered_hosts_.find(host_instance_id);
+    if (host == discovered_hosts_.end()) {
+      events.push_back([this, host_instance_id]() {
+        listener_->OnConnectionResponse(host_instance_id, false);
+      });
+    } else {
+      connect_name_ = name;
+      const Clock::time_point now = Clock::now();
+      Peer& peer = peers_[host_instance_id];
+      peer = Peer();
+      peer.address = host->second.address;
+      peer.state = kPeerConnecting;
+      peer.created = now;
+      peer.last_received = now;
+      peer.next_send_sequence = 0;
+      peer.next_receive_sequence = 0;
+
+      std::vector<uint8_t> body(service_id_.begin(), service_id_.end());
+      body.push_back(0);
+      body.insert(body.end(), name.begin(), name.end());
+      SendToPeer(&peer, kPacketConnect, body);
+    }
+  }
+  Dispatch(events);
+}
+
+void UdpTransport::Disconnect(const std::string& instance_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto peer = peers_.find(instance_id);
+  if (peer == peers_.end()) return;
+  SendToPeer(&peer->second, kPacketDisconnect, std::vector<uint8_t>());
+  peers_.erase(peer);
+}
+
+void UdpTransport::SendReliableMessage(const std::string& instance_id,
+                                       const uint8_t* data, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Peer* peer = FindPeer(instance_id, kPeerConnected);
+  if (peer == nullptr) return;
+
+  // Keep a copy to resend until it's acknowledged.
+  const uint32_t sequence = peer->next_send_sequence++;
+  std::vector<uint8_t>& body = peer->unacknowledged[sequence];
+  body.reserve(kSequenceSize + size);
+  WriteSequence(sequence, &body);
+  body.insert(body.end(), data, data + size);
+  SendToPeer(peer, kPacketReliable, body);
+}
+
+void UdpTransport::SendUnreliableMessage(const std::string& instance_id,
+                                         const uint8_t* data, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Peer* peer = FindPeer(instance_id, kPeerConnected);
+  if (peer == nullptr) return;
+  SendToPeer(peer, kPacketUnreliable, data, size);
+}
+
+int UdpTransport::GetResendCount(const std::string& instance_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto peer = peers_.find(instance_id);
+  return peer == peers_.end() ? 0 : peer->second.resends;
+}
+
+void UdpTransport::ReceiveThread() {
+  std::vector<uint8_t> buffer(kMaxPacketSize);
+  EventList events;
+  while (running_) {
+    pollfd poll_fd;
+    poll_fd.fd = socket_;
+    poll_fd.events = POLLIN;
+    poll_fd.revents = 0;
+    const bool readable = poll(&poll_fd, 1, kPollMilliseconds) > 0;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (readable) {
+        sockaddr_in from;
+        socklen_t from_size = sizeof(from);
+        const ssize_t size =
+            recvfrom(socket_, buffer.data(), buffer.size(), 0,
+                     reinterpret_cast<sockaddr*>(&from), &from_size);
+        if (size <= 0) break;
+        HandlePacket(from, buffer.data(), static_cast<size_t>(size), &events);
+      }
+      Tick(Clock::now(), &events);
+    }
+    Dispatch(events);
+    events.clear();
+  }
+}
+
+void UdpTransport::HandlePacket(const sockaddr_in& from, const uint8_t* data,
+                                size_t size, EventList* events) {
+  const uint8_t kind = data[0];
+  const uint8_t* body = data + 1;
+  const size_t body_size = size - 1;
+  const std::string instance_id = AddressToInstanceId(from);
+
+  auto peer_it = peers_.find(instance_id);
+  Peer* peer = peer_it == peers_.end() ? nullptr : &peer_it->second;
+  if (peer != nullptr) {
+    peer->last_received = Clock::now();
+  }
+
+  switch (kind) {
+    case kPacketDiscover: {
+      if (advertising_ &&
+          std::string(body, body + body_size) == service_id_) {
+        SendPacket(from, kPacketAdvertise,
+                   std::vector<uint8_t>(advertised_name_.begin(),
+                                        advertised_name_.end()));
+      }
+      break;
+    }
+    case kPacketAdvertise: {
+      if (!discovering_) break;
+      DiscoveredHost& host = discovered_hosts_[instance_id];
+      const bool is_new = host.last_seen == Clock::time_point();
+      host.address = from;
+      host.last_seen = Clock::now();
+      if (is_new) {
+        const std::string name(body, body + body_size);
+        events->push_back([this, instance_id, name]() {
+          listener_->OnEndpointFound(instance_id, name);
+        });
+      }
+      break;
+    }
+    case kPacketConnect: {
+      const uint8_t* separator =
+          std::find(body, body + body_size, static_cast<uint8_t>(0));
+      if (separator == body + body_size ||
+          std::string(body, separator) != service_id_) {
+        break;
+      }
+      if (peer != nullptr) {
+        // Our accept must have been lost.
+        if (peer->state == kPeerConnected) {
+          SendToPeer(peer, kPacketAccept, std::vector<uint8_t>());
+        }
+        break;
+      }
+      if (!advertising_) {
+        SendPacket(from, kPacketReject, std::vector<uint8_t>());
+        break;
+      }
+      const Clock::time_point now = Clock::now();
+      Peer& new_peer = peers_[instance_id];
+      new_peer.address = from;
+      new_peer.state = kPeerRequested;
+      new_peer.created = now;
+      new_peer.last_received = now;
+      new_peer.last_sent = now;
+      new_peer.next_send_sequence = 0;
+      new_peer.next_receive_sequence = 0;
+      const std::string name(separator + 1, body + body_size);
+      events->push_back([this, instance_id, name]() {
+        listener_->OnConnectionRequest(instance_id, name);
+      });
+      break;
+    }
+    case kPacketAccept:
+    case kPacketReject: {
+      if (peer == nullptr || peer->state != kPeerConnecting) break;
+      const bool accepted = kind == kPacketAccept;
+      if (accepted) {
+        peer->state = kPeerConnected;
+      } else {
+        peers_.erase(peer_it);
+      }
+      events->push_back([this, instance_id, accepted]() {
+        listener_->OnConnectionResponse(instance_id, accepted);
+      });
+      break;
+    }
+    case kPacketDisconnect: {
+      if (peer == nullptr) break;
+      if (peer->state == kPeerConnected) {
+        events->push_back(
+            [this, instance_id]() { listener_->OnDisconnected(instance_id); });
+      }
+      peers_.erase(peer_it);
+      break;
+    }
+    case kPacketReliable: {
+      if (peer == nullptr || peer->state != kPeerConnected ||
+          body_size < kSequenceSize) {
+        break;
+      }
+      HandleReliable(peer, instance_id, body, body_size, events);
+      break;
+    }
+    case kPacketAcknowledge: {
+      if (peer == nullptr || body_size < kSequenceSize) break;
+      peer->unacknowledged.erase(ReadSequence(body));
+      break;
+    }
+    case kPacketUnreliable: {
+      if (peer == nullptr || peer->state != kPeerConnected) break;
+      std::vector<uint8_t> payload(body, body + body_size);
+      events->push_back([this, instance_id, payload]() {
+        listener_->OnMessageReceived(instance_id, payload, false);
+      });
+      break;
+    }
+    default: {
+      // Keep-alives only need to update last_received.
+      break;
+    }
+  }
+}
+
+void UdpTransport::HandleReliable(Peer* peer, const std::string& instance_id,
+                                  const uint8_t* data, size_t size,
+                                  EventList* events) {
+  const uint32_t sequence = ReadSequence(data);
+  std::vector<uint8_t> ack;
+  WriteSequence(sequence, &ack);
+  SendToPeer(peer, kPacketAcknowledge, ack);
+
+  if (sequence < peer->next_receive_sequence) {
+    // Already delivered; our acknowledgement was lost.
+    return;
+  }
+  if (sequence > peer->next_receive_sequence) {
+    if (peer->early.size() < kMaxEarlyPackets) {
+      peer->early[sequence].assign(data + kSequenceSize, data + size);
+    }
+    return;
+  }
+
+  std::vector<uint8_t> payload(data + kSequenceSize, data + size);
+  for (;;) {
+    events->push_back([this, instance_id, payload]() {
+      listener_->OnMessageReceived(instance_id, payload, true);
+    });
+    peer->next_receive_sequence++;
+    auto next = peer->early.find(peer->next_receive_sequence);
+    if (next == peer->early.end()) break;
+    payload.swap(next->second);
+    peer->early.erase(next);
+  }
+}
+
+void UdpTransport::Tick(Clock::time_point now, EventList* events) {
+  if (discovering_) {
+    if (now - last_discovery_probe_ >= kDiscoveryInterval) {
+      SendPacket(discovery_sockaddr_, kPacketDiscover,
+                 std::vector<uint8_t>(service_id_.begin(), service_id_.end()));
+      last_discovery_probe_ = now;
+    }
+    for (auto it = discovered_hosts_.begin(); it != discovered_hosts_.end();) {
+      if (now - it->second.last_seen > kHostTimeout) {
+        const std::string instance_id = it->first;
+        events->push_back(
+            [this, instance_id]() { listener_->OnEndpointLost(instance_id); });
+        it = discovered_hosts_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  for (auto it = peers_.begin(); it != peers_.end();) {
+    const std::string& instance_id = it->first;
+    Peer& peer = it->second;
+    bool drop = false;
+    switch (peer.state) {
+      case kPeerConnecting: {
+        if (now - peer.created > kConnectTimeout) {
+          events->push_back([this, instance_id]() {
+            listener_->OnConnectionResponse(instance_id, false);
+          });
+          drop = true;
+        } else if (now - peer.last_sent >= kConnectInterval) {
+          std::vector<uint8_t> body(service_id_.begin(), service_id_.end());
+          body.push_back(0);
+          body.insert(body.end(), connect_name_.begin(), connect_name_.end());
+          SendToPeer(&peer, kPacketConnect, body);
+        }
+        break;
+      }
+      case kPeerRequested: {
+        drop = now - peer.last_received > kPeerTimeout;
+        break;
+      }
+      case kPeerConnected: {
+        if (now - peer.last_received > kPeerTimeout) {
+          fplbase::LogInfo(fplbase::kApplication,
+                           "UdpTransport: %s timed out", instance_id.c_str());
+          events->push_back([this, instance_id]() {
+            listener_->OnDisconnected(instance_id);
+          });
+          drop = true;
+          break;
+        }
+        if (!peer.unacknowledged.empty() &&
+            now - peer.last_resent >= kResendInterval) {
+          for (auto packet = peer.unacknowledged.begin();
+               packet != peer.unacknowledged.end(); ++packet) {
+            SendToPeer(&peer, kPacketReliable, packet->second);
+            peer.resends++;
+          }
+          peer.last_resent = now;
+        }
+        if (now - peer.last_sent >= kKeepAliveInterval) {
+          SendToPeer(&peer, kPacketKeepAlive, std::vector<uint8_t>());
+        }
+        break;
+      }
+    }
+    if (drop) {
+      it = peers_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void UdpTransport::Dispatch(const EventList& events) {
+  for (auto it = events.begin(); it != events.end(); ++it) {
+    (*it)();
+  }
+}
+
+void UdpTransport::SendPacket(const sockaddr_in& to, uint8_t kind,
+                              const uint8_t* body, size_t size) {
+  packet_.clear();
+  packet_.push_back(kind);
+  packet_.insert(packet_.end(), body, body + size);
+  sendto(socket_, packet_.data(), packet_.size(), 0,
+         reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+}
+
+void UdpTransport::SendToPeer(Peer* peer, uint8_t kind, const uint8_t* body,
+                              size_t size) {
+  SendPacket(peer->address, kind, body, size);
+  peer->last_sent = Clock::now();
+}
+
+UdpTransport::Peer* UdpTransport::FindPeer(const std::string& instance_id,
+                                           PeerState state) {
+  auto it = peers_.find(instance_id);
+  return it != peers_.end() && it->second.state == state ? &it->second
+                                                         : nullptr;
+}
+
+std::string UdpTransport::AddressToInstanceId(const sockaddr_in& address) {
+  char host[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+  return std::string(host) + ":" +
+         flatbuffers::NumToString(ntohs(address.sin_port));
+}
+
+}  // namespace fpl
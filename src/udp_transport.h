@@ -0,0 +1,165 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// udp_transport.h
+//
+// MultiplayerTransport over plain UDP sockets, for running hosts and clients
+// as separate processes on desktop.
+//
+// A host listens on a well-known port. Clients find hosts by sending probes
+// to a discovery address on that port: 127.0.0.1 finds hosts on the same
+// machine, and a broadcast address finds hosts on the local network.
+// Instances are identified by their "address:port".
+//
+// Reliable messages are numbered per connection, acknowledged, resent until
+// acknowledged, and delivered in order. Connections that go quiet for too
+// long are dropped, so keep-alives are sent when there's nothing else to say.
+
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include <netinet/in.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "multiplayer_transport.h"
+
+namespace fpl {
+
+class UdpTransport : public MultiplayerTransport {
+ public:
+  // Hosts listen on 'port'. Clients send discovery probes to
+  // 'discovery_address' on that port.
+  UdpTransport(uint16_t port, const std::string& discovery_address);
+  virtual ~UdpTransport();
+
+  virtual bool Initialize(const std::string& service_id,
+                          MultiplayerTransportListener* listener);
+
+  virtual void StartAdvertising(const std::string& name);
+  virtual void StopAdvertising();
+  virtual void AcceptConnectionRequest(const std::string& client_instance_id);
+  virtual void RejectConnectionRequest(const std::string& client_instance_id);
+
+  virtual void StartDiscovery();
+  virtual void StopDiscovery();
+  virtual void SendConnectionRequest(const std::string& name,
+                                     const std::string& host_instance_id);
+
+  virtual void Disconnect(const std::string& instance_id);
+  virtual void SendReliableMessage(const std::string& instance_id,
+                                   const uint8_t* data, size_t size);
+  virtual void SendUnreliableMessage(const std::string& instance_id,
+                                     const uint8_t* data, size_t size);
+  virtual int GetResendCount(const std::string& instance_id);
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+  // Listener calls, made once mutex_ has been released.
+  typedef std::vector<std::function<void()>> EventList;
+
+  enum PeerState {
+    // A client has asked us to accept it.
+    kPeerRequested,
+    // We've asked a host to accept us.
+    kPeerConnecting,
+    kPeerConnected,
+  };
+
+  struct Peer {
+    sockaddr_in address;
+    PeerState state;
+    Clock::time_point created;
+    Clock::time_point last_received;
+    Clock::time_point last_sent;
+    Clock::time_point last_resent;
+    uint32_t next_send_sequence;
+    uint32_t next_receive_sequence;
+    // Reliable packets sent again because they weren't acknowledged in time.
+    int resends;
+    // Reliable packets we've sent that haven't been acknowledged yet.
+    std::map<uint32_t, std::vector<uint8_t>> unacknowledged;
+    // Reliable payloads that arrived ahead of one we're still waiting for.
+    std::map<uint32_t, std::vector<uint8_t>> early;
+  };
+
+  // A host that answered our discovery probes.
+  struct DiscoveredHost {
+    sockaddr_in address;
+    Clock::time_point last_seen;
+  };
+
+  // Bind a new socket to 'port' (0 for any), and restart the receive thread.
+  // Forgets every peer.
+  bool Open(uint16_t port);
+  void Close();
+
+  void ReceiveThread();
+  void HandlePacket(const sockaddr_in& from, const uint8_t* data, size_t size,
+                    EventList* events);
+  void HandleReliable(Peer* peer, const std::string& instance_id,
+                      const uint8_t* data, size_t size, EventList* events);
+  void Tick(Clock::time_point now, EventList* events);
+  void Dispatch(const EventList& events);
+
+  // Make sure mutex_ is locked when calling these.
+  void SendPacket(const sockaddr_in& to, uint8_t kind, const uint8_t* body,
+                  size_t size);
+  void SendPacket(const sockaddr_in& to, uint8_t kind,
+                  const std::vector<uint8_t>& body) {
+    SendPacket(to, kind, body.data(), body.size());
+  }
+  void SendToPeer(Peer* peer, uint8_t kind, const uint8_t* body, size_t size);
+  void SendToPeer(Peer* peer, uint8_t kind, const std::vector<uint8_t>& body) {
+    SendToPeer(peer, kind, body.data(), body.size());
+  }
+  Peer* FindPeer(const std::string& instance_id, PeerState state);
+
+  static std::string AddressToInstanceId(const sockaddr_in& address);
+
+  uint16_t port_;
+  std::string discovery_address_;
+  sockaddr_in discovery_sockaddr_;
+
+  std::string service_id_;
+  MultiplayerTransportListener* listener_;
+
+  // Only changed by Open() and Close(), while the receive thread is stopped.
+  int socket_;
+  uint16_t bound_port_;
+  std::thread receive_thread_;
+  std::atomic<bool> running_;
+
+  // Guards everything below.
+  std::mutex mutex_;
+  bool advertising_;
+  bool discovering_;
+  std::string advertised_name_;
+  // Name sent along with connection requests.
+  std::string connect_name_;
+  Clock::time_point last_discovery_probe_;
+  std::map<std::string, Peer> peers_;
+  std::map<std::string, DiscoveredHost> discovered_hosts_;
+  // Reused for every outgoing packet.
+  std::vector<uint8_t> packet_;
+};
+
+}  // namespace fpl
+
+#endif  // UDP_TRANSPORT_H
@@ -0,0 +1,108 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <algorithm>
+#include <cmath>
+#include "upload_scheduler.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const double kDefaultBudgetMilliseconds = 2.0;
+
+static bool Resident(const fplbase::Material& material) {
+  const std::vector<fplbase::Texture*>& textures = material.textures();
+  for (auto it = textures.begin(); it != textures.end(); ++it) {
+    if (!(*it)->id()) return false;
+  }
+  return true;
+}
+
+UploadScheduler::UploadScheduler()
+    : budget_milliseconds_(kDefaultBudgetMilliseconds),
+      cooldown_frames_(0),
+      in_flight_milliseconds_(0.0),
+      finalized_this_frame_(false) {
+  ResetStats();
+}
+
+void UploadScheduler::Request(const char* material_name) {
+  if (in_flight_ == material_name ||
+      std::find(queue_.begin(), queue_.end(), material_name) != queue_.end()) {
+    return;
+  }
+  queue_.push_back(material_name);
+}
+
+void UploadScheduler::Cancel(const char* material_name) {
+  queue_.erase(std::remove(queue_.begin(), queue_.end(), material_name),
+               queue_.end());
+  if (in_flight_ == material_name) in_flight_.clear();
+}
+
+bool UploadScheduler::Finalize(fplbase::AssetManager* matman) {
+  const Clock::time_point start = Clock::now();
+  const bool finished = matman->TryFinalize();
+  const double milliseconds =
+      std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+  // Several calls in one frame count as one finalize.
+  if (!finalized_this_frame_) stats_.finalizes++;
+  finalized_this_frame_ = true;
+  stats_.total_milliseconds += milliseconds;
+  stats_.max_milliseconds = std::max(stats_.max_milliseconds, milliseconds);
+  in_flight_milliseconds_ += milliseconds;
+  return finished;
+}
+
+void UploadScheduler::AdvanceFrame(fplbase::AssetManager* matman, bool hold) {
+  stats_.frames++;
+  finalized_this_frame_ = false;
+  if (hold || idle()) return;
+  if (cooldown_frames_ > 0) {
+    cooldown_frames_--;
+    return;
+  }
+
+  if (!in_flight_.empty()) {
+    Finalize(matman);
+    const fplbase::Material* material =
+        matman->FindMaterial(in_flight_.c_str());
+    if (material != nullptr && !Resident(*material)) return;
+    // Pay back any time over budget before starting the next upload.
+    cooldown_frames_ = std::max(
+        0, static_cast<int>(std::ceil(in_flight_milliseconds_ /
+                                      budget_milliseconds_)) - 1);
+    in_flight_.clear();
+    if (cooldown_frames_ > 0) return;
+  }
+
+  while (in_flight_.empty() && !queue_.empty()) {
+    const std::string name = queue_.front();
+    queue_.pop_front();
+    if (matman->LoadMaterial(name.c_str()) != nullptr) in_flight_ = name;
+    in_flight_milliseconds_ = 0.0;
+  }
+}
+
+void UploadScheduler::ResetStats() {
+  stats_.frames = 0;
+  stats_.finalizes = 0;
+  stats_.total_milliseconds = 0.0;
+  stats_.max_milliseconds = 0.0;
+}
+
+}  // pie_noon
+}  // fpl
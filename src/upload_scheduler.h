@@ -0,0 +1,95 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_UPLOAD_SCHEDULER_H_
+#define PIE_NOON_UPLOAD_SCHEDULER_H_
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// What finalizing textures has cost since the stats were last reset.
+struct UploadStats {
+  int frames;
+  // Frames in which fplbase::AssetManager::TryFinalize() was called.
+  int finalizes;
+  double total_milliseconds;
+  double max_milliseconds;
+};
+
+// Spreads texture uploads over frames. fplbase uploads every texture that
+// has finished decoding in one TryFinalize() call, so materials requested
+// together land on the GPU in the same frame. Materials requested through
+// the scheduler are instead handed to the AssetManager one at a time, each
+// once the one before it is on the GPU, and no sooner than the time budget
+// allows: an upload that took three budgets' worth of time is followed by
+// two frames without one.
+//
+// Every TryFinalize() call should go through Finalize(), so its cost is
+// counted.
+class UploadScheduler {
+ public:
+  UploadScheduler();
+
+  // Time each frame may spend uploading, on average.
+  void set_budget_milliseconds(double budget) { budget_milliseconds_ = budget; }
+
+  // Load 'material_name' when the uploads before it are done.
+  void Request(const char* material_name);
+
+  // Forget about 'material_name', if it hasn't been loaded yet. Call before
+  // unloading it.
+  void Cancel(const char* material_name);
+
+  // Call once a frame. While 'hold' is true (during a fade, say) nothing is
+  // uploaded and nothing new is requested.
+  void AdvanceFrame(fplbase::AssetManager* matman, bool hold);
+
+  // Upload whatever has been decoded, timing how long it takes. Returns
+  // AssetManager::TryFinalize()'s result.
+  bool Finalize(fplbase::AssetManager* matman);
+
+  // True when nothing is queued or waiting to be uploaded.
+  bool idle() const { return in_flight_.empty() && queue_.empty(); }
+
+  const UploadStats& stats() const { return stats_; }
+  void ResetStats();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  double budget_milliseconds_;
+  std::deque<std::string> queue_;
+  // The material handed to the AssetManager and not yet on the GPU. Looked up
+  // by name each frame, as it may be unloaded in the meantime.
+  std::string in_flight_;
+  // Frames to wait before requesting the next material.
+  int cooldown_frames_;
+  // Cost of the finalizes since 'in_flight_' was requested.
+  double in_flight_milliseconds_;
+  UploadStats stats_;
+  // True if Finalize() has been called since the last AdvanceFrame().
+  bool finalized_this_frame_;
+
+  DISALLOW_COPY_AND_ASSIGN(UploadScheduler);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_UPLOAD_SCHEDULER_H_
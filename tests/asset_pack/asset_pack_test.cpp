@@ -0,0 +1,188 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "asset_pack.h"
+#include "gtest/gtest.h"
+
+using fpl::pie_noon::AssetPack;
+using fpl::pie_noon::AssetPackEntry;
+using fpl::pie_noon::AssetPackHeader;
+
+static const char kFilename[] = "asset_pack_test.piepack";
+
+typedef std::pair<std::string, std::string> Asset;
+
+class AssetPackTests : public ::testing::Test {
+ protected:
+  virtual void TearDown() { remove(kFilename); }
+
+  // Lay the assets out as scripts/build_assets.py does.
+  static std::string BuildPack(std::vector<Asset> assets) {
+    std::sort(assets.begin(), assets.end(),
+              [](const Asset& a, const Asset& b) {
+      const uint64_t hash_a = AssetPack::HashName(a.first.c_str(),
+                                                  a.first.size());
+      const uint64_t hash_b = AssetPack::HashName(b.first.c_str(),
+                                                  b.first.size());
+      return hash_a != hash_b ? hash_a < hash_b : a.first < b.first;
+    });
+
+    AssetPackHeader header;
+    memcpy(header.magic, fpl::pie_noon::kAssetPackMagic, sizeof(header.magic));
+    header.version = fpl::pie_noon::kAssetPackVersion;
+    header.num_entries = static_cast<uint32_t>(assets.size());
+    header.reserved = 0;
+    std::string pack(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::string names;
+    size_t name_offset =
+        sizeof(header) + assets.size() * sizeof(AssetPackEntry);
+    for (auto it = assets.begin(); it != assets.end(); ++it) {
+      names += it->first;
+    }
+    std::string data;
+    const size_t data_start = Align(name_offset + names.size());
+    for (auto it = assets.begin(); it != assets.end(); ++it) {
+      data.resize(Align(data.size()));
+      AssetPackEntry entry;
+      entry.hash = AssetPack::HashName(it->first.c_str(), it->first.size());
+      entry.offset = data_start + data.size();
+      entry.size = it->second.size();
+      entry.name_offset = static_cast<uint32_t>(name_offset);
+      entry.name_length = static_cast<uint32_t>(it->first.size());
+      pack.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+      name_offset += it->first.size();
+      data += it->second;
+    }
+    pack += names;
+    pack.resize(data_start);
+    return pack + data;
+  }
+
+  static size_t Align(size_t offset) {
+    const size_t alignment = fpl::pie_noon::kAssetPackAlignment;
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+
+  static void WriteFile(const std::string& contents) {
+    FILE* file = fopen(kFilename, "wb");
+    ASSERT_TRUE(file != nullptr);
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+  }
+
+  static std::string Find(const AssetPack& pack, const char* name) {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    if (!pack.Find(name, &data, &size)) return "<missing>";
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(data) %
+                      fpl::pie_noon::kAssetPackAlignment);
+    return std::string(reinterpret_cast<const char*>(data), size);
+  }
+};
+
+TEST_F(AssetPackTests, FindsAssets) {
+  std::vector<Asset> assets;
+  assets.push_back(Asset("config.pieconfig", "config"));
+  assets.push_back(Asset("textures/pie.webp", std::string(1000, 'p')));
+  assets.push_back(Asset("empty", ""));
+  for (int i = 0; i < 100; ++i) {
+    assets.push_back(Asset("sounds/" + std::to_string(i), std::to_string(i)));
+  }
+  WriteFile(BuildPack(assets));
+
+  AssetPack pack;
+  ASSERT_TRUE(pack.Open(kFilename));
+  EXPECT_EQ(assets.size(), pack.num_entries());
+  for (auto it = assets.begin(); it != assets.end(); ++it) {
+    EXPECT_EQ(it->second, Find(pack, it->first.c_str()));
+  }
+  EXPECT_EQ("config", Find(pack, "./config.pieconfig"));
+  EXPECT_EQ("<missing>", Find(pack, "textures"));
+  EXPECT_EQ("<missing>", Find(pack, "sounds/100"));
+
+  pack.Close();
+  EXPECT_FALSE(pack.is_open());
+  EXPECT_EQ("<missing>", Find(pack, "config.pieconfig"));
+}
+
+TEST_F(AssetPackTests, HasDirectory) {
+  std::vector<Asset> assets;
+  assets.push_back(Asset("etc2/textures/pie.ktx", "ktx"));
+  assets.push_back(Asset("astc", "not a directory"));
+  WriteFile(BuildPack(assets));
+
+  AssetPack pack;
+  EXPECT_FALSE(pack.HasDirectory("etc2"));
+  ASSERT_TRUE(pack.Open(kFilename));
+  EXPECT_TRUE(pack.HasDirectory("etc2"));
+  EXPECT_TRUE(pack.HasDirectory("etc2/textures"));
+  EXPECT_FALSE(pack.HasDirectory("etc"));
+  EXPECT_FALSE(pack.HasDirectory("astc"));
+}
+
+TEST_F(AssetPackTests, RejectsOtherFiles) {
+  AssetPack pack;
+  EXPECT_FALSE(pack.Open("asset_pack_test_missing.piepack"));
+
+  WriteFile("PIE");
+  EXPECT_FALSE(pack.Open(kFilename));
+
+  std::string contents = BuildPack(std::vector<Asset>(1, Asset("a", "b")));
+  contents[0] = 'X';
+  WriteFile(contents);
+  EXPECT_FALSE(pack.Open(kFilename));
+  EXPECT_FALSE(pack.is_open());
+}
+
+TEST_F(AssetPackTests, RejectsCorruptIndex) {
+  std::vector<Asset> assets;
+  assets.push_back(Asset("a", "aaaa"));
+  assets.push_back(Asset("b", "bbbb"));
+  const std::string contents = BuildPack(assets);
+
+  // Truncated, so the last asset runs past the end of the file.
+  WriteFile(contents.substr(0, contents.size() - 1));
+  AssetPack pack;
+  EXPECT_FALSE(pack.Open(kFilename));
+
+  // Entries out of order, so they can't be searched.
+  std::string unsorted = contents;
+  std::swap_ranges(unsorted.begin() + sizeof(AssetPackHeader),
+                   unsorted.begin() + sizeof(AssetPackHeader) +
+                       sizeof(AssetPackEntry),
+                   unsorted.begin() + sizeof(AssetPackHeader) +
+                       sizeof(AssetPackEntry));
+  WriteFile(unsorted);
+  EXPECT_FALSE(pack.Open(kFilename));
+
+  WriteFile(contents);
+  EXPECT_TRUE(pack.Open(kFilename));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
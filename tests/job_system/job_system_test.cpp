@@ -0,0 +1,214 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "job_system.h"
+
+namespace pn = ::fpl::pie_noon;
+
+// Enough workers to get real contention, even on small test machines.
+static const int kNumWorkers = 7;
+
+class JobSystemTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() { jobs_.Initialize(kNumWorkers); }
+  virtual void TearDown() { jobs_.Shutdown(); }
+
+  pn::JobSystem jobs_;
+};
+
+TEST_F(JobSystemTests, EveryJobRunsOnce) {
+  static const int kNumJobs = 20000;
+  std::atomic<int> total(0);
+  pn::JobCounter counter;
+  for (int i = 0; i < kNumJobs; ++i) {
+    jobs_.Submit([&total, i](int) { total += i; }, &counter);
+  }
+  jobs_.Wait(counter);
+  EXPECT_TRUE(counter.Done());
+  EXPECT_EQ(kNumJobs * (kNumJobs - 1) / 2, total.load());
+}
+
+TEST_F(JobSystemTests, ParallelForCoversRangeExactlyOnce) {
+  static const int kCount = 10007;
+  std::vector<std::atomic<int>> hits(kCount);
+  for (int repeat = 0; repeat < 200; ++repeat) {
+    for (int i = 0; i < kCount; ++i) hits[i] = 0;
+    jobs_.ParallelFor(kCount, 16, [&hits](int begin, int end, int) {
+      for (int i = begin; i < end; ++i) hits[i]++;
+    });
+    for (int i = 0; i < kCount; ++i) {
+      ASSERT_EQ(1, hits[i].load()) << "index " << i << " repeat " << repeat;
+    }
+  }
+}
+
+TEST_F(JobSystemTests, NestedParallelFor) {
+  static const int kOuter = 64;
+  static const int kInner = 257;
+  std::atomic<int> total(0);
+  jobs_.ParallelFor(kOuter, 1, [this, &total](int begin, int end, int) {
+    for (int i = begin; i < end; ++i) {
+      jobs_.ParallelFor(kInner, 8, [&total](int b, int e, int) {
+        total += e - b;
+      });
+    }
+  });
+  EXPECT_EQ(kOuter * kInner, total.load());
+}
+
+TEST_F(JobSystemTests, DependentJobsSeeResults) {
+  static const int kCount = 1000;
+  for (int repeat = 0; repeat < 100; ++repeat) {
+    std::vector<int> first(kCount, 0);
+    std::vector<int> second(kCount, 0);
+    pn::JobCounter first_done;
+    pn::JobCounter second_done;
+    for (int i = 0; i < kCount; ++i) {
+      jobs_.Submit([&first, i](int) { first[i] = i + 1; }, &first_done);
+    }
+    for (int i = 0; i < kCount; ++i) {
+      jobs_.Submit([&first, &second, i](int) { second[i] = first[i] * 2; },
+                   &second_done, &first_done);
+    }
+    jobs_.Wait(second_done);
+    for (int i = 0; i < kCount; ++i) {
+      ASSERT_EQ(2 * (i + 1), second[i]);
+    }
+  }
+}
+
+TEST_F(JobSystemTests, DependencyAlreadyDone) {
+  pn::JobCounter done;
+  pn::JobCounter counter;
+  bool ran = false;
+  jobs_.Submit([&ran](int) { ran = true; }, &counter, &done);
+  jobs_.Wait(counter);
+  EXPECT_TRUE(ran);
+}
+
+TEST_F(JobSystemTests, LongDependencyChain) {
+  static const int kLength = 500;
+  std::vector<std::unique_ptr<pn::JobCounter>> counters;
+  for (int i = 0; i < kLength; ++i) {
+    counters.push_back(std::unique_ptr<pn::JobCounter>(new pn::JobCounter));
+  }
+  std::vector<int> order;
+  for (int i = 0; i < kLength; ++i) {
+    pn::JobCounter* dependency = i == 0 ? nullptr : counters[i - 1].get();
+    jobs_.Submit([&order, i](int) { order.push_back(i); }, counters[i].get(),
+                 dependency);
+  }
+  jobs_.Wait(*counters.back());
+  ASSERT_EQ(static_cast<size_t>(kLength), order.size());
+  for (int i = 0; i < kLength; ++i) {
+    EXPECT_EQ(i, order[i]);
+  }
+}
+
+TEST_F(JobSystemTests, SubmitFromOtherThreads) {
+  static const int kThreads = 4;
+  static const int kJobsPerThread = 5000;
+  std::atomic<int> total(0);
+  pn::JobCounter counter;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.push_back(std::thread([this, &total, &counter]() {
+      for (int i = 0; i < kJobsPerThread; ++i) {
+        jobs_.Submit([&total](int) { total++; }, &counter);
+      }
+    }));
+  }
+  for (auto it = threads.begin(); it != threads.end(); ++it) it->join();
+  jobs_.Wait(counter);
+  EXPECT_EQ(kThreads * kJobsPerThread, total.load());
+}
+
+TEST_F(JobSystemTests, ScratchIsPerWorkerAndReleased) {
+  static const int kCount = 4096;
+  std::atomic<int> failures(0);
+  jobs_.ParallelFor(kCount, 1, [this, &failures](int begin, int end,
+                                                 int worker_index) {
+    pn::ScratchAllocator& scratch = jobs_.scratch(worker_index);
+    int* values = scratch.AllocateArray<int>(end - begin);
+    if (values == nullptr) {
+      failures++;
+      return;
+    }
+    for (int i = begin; i < end; ++i) values[i - begin] = i;
+    for (int i = begin; i < end; ++i) {
+      if (values[i - begin] != i) failures++;
+    }
+  });
+  EXPECT_EQ(0, failures.load());
+  for (int i = 0; i < jobs_.num_threads(); ++i) {
+    EXPECT_EQ(0u, jobs_.scratch(i).used());
+  }
+}
+
+TEST_F(JobSystemTests, StatsCountEveryJob) {
+  static const int kNumJobs = 5000;
+  jobs_.ResetStats();
+  pn::JobCounter counter;
+  for (int i = 0; i < kNumJobs; ++i) {
+    jobs_.Submit([](int) {}, &counter);
+  }
+  jobs_.Wait(counter);
+
+  std::vector<pn::WorkerStats> stats;
+  jobs_.GetStats(&stats);
+  ASSERT_EQ(static_cast<size_t>(kNumWorkers + 1), stats.size());
+  uint64_t executed = 0;
+  for (auto it = stats.begin(); it != stats.end(); ++it) {
+    executed += it->jobs_executed;
+    EXPECT_LE(it->jobs_stolen, it->jobs_executed);
+    EXPECT_GE(it->utilization, 0.0);
+  }
+  EXPECT_EQ(static_cast<uint64_t>(kNumJobs), executed);
+}
+
+TEST(JobSystemLifetimeTests, RestartRepeatedly) {
+  pn::JobSystem jobs;
+  for (int repeat = 0; repeat < 50; ++repeat) {
+    jobs.Initialize(repeat % 5);
+    std::atomic<int> total(0);
+    jobs.ParallelFor(1000, 1, [&total](int begin, int end, int) {
+      total += end - begin;
+    });
+    EXPECT_EQ(1000, total.load());
+    jobs.Shutdown();
+  }
+}
+
+TEST(JobSystemLifetimeTests, NoWorkersRunsInline) {
+  pn::JobSystem jobs;
+  int total = 0;
+  jobs.ParallelFor(100, 1, [&total](int begin, int end, int worker_index) {
+    EXPECT_EQ(0, worker_index);
+    total += end - begin;
+  });
+  EXPECT_EQ(100, total);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
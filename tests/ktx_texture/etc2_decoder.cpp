@@ -0,0 +1,266 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstring>
+#include "etc2_decoder.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Bytes of compressed data per 4x4 block.
+static const size_t kEtc2RgbBlockSize = 8;
+static const size_t kEtc2RgbaBlockSize = 16;
+
+// ETC1's intensity modifiers, used by ETC2's individual and differential
+// modes.
+static const int kEtcModifiers[8][4] = {
+    {2, 8, -2, -8},       {5, 17, -5, -17},     {9, 29, -9, -29},
+    {13, 42, -13, -42},   {18, 60, -18, -60},   {24, 80, -24, -80},
+    {33, 106, -33, -106}, {47, 183, -47, -183}};
+
+// Distances between the paint colors of ETC2's T and H modes.
+static const int kEtc2Distances[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+static const int kEacModifiers[16][8] = {
+    {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9},  {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9},  {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9},  {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8},   {-3, -5, -7, -9, 2, 4, 6, 8}};
+
+static uint8_t Clamp255(int value) {
+  return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static int Extend4(int value) { return (value << 4) | value; }
+static int Extend5(int value) { return (value << 3) | (value >> 2); }
+static int Extend6(int value) { return (value << 2) | (value >> 4); }
+static int Extend7(int value) { return (value << 1) | (value >> 6); }
+
+static uint64_t ReadBigEndian64(const uint8_t* data) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) value = (value << 8) | data[i];
+  return value;
+}
+
+static int Bits(uint64_t block, int high, int low) {
+  return static_cast<int>((block >> low) & ((1ull << (high - low + 1)) - 1));
+}
+
+// A 3-bit two's complement value.
+static int SignExtend3(int value) { return value >= 4 ? value - 8 : value; }
+
+// Index into the block's paint colors or modifiers for pixel (x, y).
+static int PixelIndex(uint64_t block, int x, int y) {
+  const int bit = x * 4 + y;
+  return static_cast<int>(((block >> (bit + 16)) & 1) << 1 |
+                          ((block >> bit) & 1));
+}
+
+// Decode an ETC2 RGB block into the RGB bytes of a 4x4 block of pixels,
+// 'stride' bytes apart per row. Alpha is left alone.
+static void DecodeEtc2RgbBlock(const uint8_t* data, uint8_t* out,
+                               size_t stride) {
+  const uint64_t block = ReadBigEndian64(data);
+  int paint[4][3];
+  bool use_paint = false;
+
+  if (Bits(block, 33, 33) == 0) {
+    // Individual mode: two 4-bit colors.
+    const int base[2][3] = {
+        {Extend4(Bits(block, 63, 60)), Extend4(Bits(block, 55, 52)),
+         Extend4(Bits(block, 47, 44))},
+        {Extend4(Bits(block, 59, 56)), Extend4(Bits(block, 51, 48)),
+         Extend4(Bits(block, 43, 40))}};
+    const int tables[2] = {Bits(block, 39, 37), Bits(block, 36, 34)};
+    const bool flip = Bits(block, 32, 32) != 0;
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        const int sub = flip ? (y >= 2) : (x >= 2);
+        const int modifier =
+            kEtcModifiers[tables[sub]][PixelIndex(block, x, y)];
+        uint8_t* pixel = out + y * stride + x * 4;
+        for (int c = 0; c < 3; ++c) {
+          pixel[c] = Clamp255(base[sub][c] + modifier);
+        }
+      }
+    }
+    return;
+  }
+
+  const int r = Bits(block, 63, 59);
+  const int g = Bits(block, 55, 51);
+  const int b = Bits(block, 47, 43);
+  const int r2 = r + SignExtend3(Bits(block, 58, 56));
+  const int g2 = g + SignExtend3(Bits(block, 50, 48));
+  const int b2 = b + SignExtend3(Bits(block, 42, 40));
+
+  if (r2 < 0 || r2 > 31) {
+    // T mode: one color, and a second with two more either side of it.
+    const int c1[3] = {
+        Extend4(Bits(block, 60, 59) << 2 | Bits(block, 57, 56)),
+        Extend4(Bits(block, 55, 52)), Extend4(Bits(block, 51, 48))};
+    const int c2[3] = {Extend4(Bits(block, 47, 44)),
+                       Extend4(Bits(block, 43, 40)),
+                       Extend4(Bits(block, 39, 36))};
+    const int distance =
+        kEtc2Distances[Bits(block, 35, 34) << 1 | Bits(block, 32, 32)];
+    for (int c = 0; c < 3; ++c) {
+      paint[0][c] = c1[c];
+      paint[1][c] = c2[c] + distance;
+      paint[2][c] = c2[c];
+      paint[3][c] = c2[c] - distance;
+    }
+    use_paint = true;
+  } else if (g2 < 0 || g2 > 31) {
+    // H mode: two colors, with two paint colors either side of each.
+    const int c1[3] = {
+        Extend4(Bits(block, 62, 59)),
+        Extend4(Bits(block, 58, 56) << 1 | Bits(block, 52, 52)),
+        Extend4(Bits(block, 51, 51) << 3 | Bits(block, 49, 47))};
+    const int c2[3] = {Extend4(Bits(block, 46, 43)),
+                       Extend4(Bits(block, 42, 39)),
+                       Extend4(Bits(block, 38, 35))};
+    const int order = (c1[0] << 16 | c1[1] << 8 | c1[2]) >=
+                      (c2[0] << 16 | c2[1] << 8 | c2[2]);
+    const int distance =
+        kEtc2Distances[Bits(block, 34, 34) << 2 | Bits(block, 32, 32) << 1 |
+                       order];
+    for (int c = 0; c < 3; ++c) {
+      paint[0][c] = c1[c] + distance;
+      paint[1][c] = c1[c] - distance;
+      paint[2][c] = c2[c] + distance;
+      paint[3][c] = c2[c] - distance;
+    }
+    use_paint = true;
+  } else if (b2 < 0 || b2 > 31) {
+    // Planar mode: a gradient from three colors.
+    const int o[3] = {
+        Extend6(Bits(block, 62, 57)),
+        Extend7(Bits(block, 56, 56) << 6 | Bits(block, 54, 49)),
+        Extend6(Bits(block, 48, 48) << 5 | Bits(block, 44, 43) << 3 |
+                Bits(block, 41, 39))};
+    const int h[3] = {
+        Extend6(Bits(block, 38, 34) << 1 | Bits(block, 32, 32)),
+        Extend7(Bits(block, 31, 25)), Extend6(Bits(block, 24, 19))};
+    const int v[3] = {Extend6(Bits(block, 18, 13)),
+                      Extend7(Bits(block, 12, 6)),
+                      Extend6(Bits(block, 5, 0))};
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        uint8_t* pixel = out + y * stride + x * 4;
+        for (int c = 0; c < 3; ++c) {
+          pixel[c] = Clamp255(
+              (x * (h[c] - o[c]) + y * (v[c] - o[c]) + 4 * o[c] + 2) >> 2);
+        }
+      }
+    }
+    return;
+  } else {
+    // Differential mode: as individual mode, with 5-bit colors.
+    const int base[2][3] = {{Extend5(r), Extend5(g), Extend5(b)},
+                            {Extend5(r2), Extend5(g2), Extend5(b2)}};
+    const int tables[2] = {Bits(block, 39, 37), Bits(block, 36, 34)};
+    const bool flip = Bits(block, 32, 32) != 0;
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        const int sub = flip ? (y >= 2) : (x >= 2);
+        const int modifier =
+            kEtcModifiers[tables[sub]][PixelIndex(block, x, y)];
+        uint8_t* pixel = out + y * stride + x * 4;
+        for (int c = 0; c < 3; ++c) {
+          pixel[c] = Clamp255(base[sub][c] + modifier);
+        }
+      }
+    }
+    return;
+  }
+
+  if (use_paint) {
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        const int* color = paint[PixelIndex(block, x, y)];
+        uint8_t* pixel = out + y * stride + x * 4;
+        for (int c = 0; c < 3; ++c) pixel[c] = Clamp255(color[c]);
+      }
+    }
+  }
+}
+
+// Decode an EAC alpha block into the alpha bytes of a 4x4 block of pixels.
+static void DecodeEacAlphaBlock(const uint8_t* data, uint8_t* out,
+                                size_t stride) {
+  const uint64_t block = ReadBigEndian64(data);
+  const int base = Bits(block, 63, 56);
+  const int multiplier = Bits(block, 55, 52);
+  const int* modifiers = kEacModifiers[Bits(block, 51, 48)];
+  for (int x = 0; x < 4; ++x) {
+    for (int y = 0; y < 4; ++y) {
+      const int bit = 45 - 3 * (x * 4 + y);
+      const int index = Bits(block, bit + 2, bit);
+      out[y * stride + x * 4 + 3] =
+          Clamp255(base + modifiers[index] * multiplier);
+    }
+  }
+}
+
+bool DecodeEtc2(const KtxImage& image, std::vector<uint8_t>* rgba) {
+  const bool has_alpha =
+      image.gl_internal_format == kGlCompressedRgba8Etc2Eac;
+  if (!has_alpha && image.gl_internal_format != kGlCompressedRgb8Etc2) {
+    return false;
+  }
+  const int blocks_wide = (image.width + 3) / 4;
+  const int blocks_high = (image.height + 3) / 4;
+  const size_t block_size = has_alpha ? kEtc2RgbaBlockSize : kEtc2RgbBlockSize;
+  if (image.size <
+      static_cast<size_t>(blocks_wide) * blocks_high * block_size) {
+    return false;
+  }
+
+  // Decode whole blocks into a buffer padded to a multiple of 4 pixels, then
+  // crop.
+  const size_t padded_stride = static_cast<size_t>(blocks_wide) * 4 * 4;
+  std::vector<uint8_t> padded(padded_stride * blocks_high * 4, 255);
+  const uint8_t* block = image.data;
+  for (int by = 0; by < blocks_high; ++by) {
+    for (int bx = 0; bx < blocks_wide; ++bx) {
+      uint8_t* out = &padded[by * 4 * padded_stride + bx * 4 * 4];
+      if (has_alpha) {
+        DecodeEacAlphaBlock(block, out, padded_stride);
+        DecodeEtc2RgbBlock(block + 8, out, padded_stride);
+      } else {
+        DecodeEtc2RgbBlock(block, out, padded_stride);
+      }
+      block += block_size;
+    }
+  }
+
+  const size_t stride = static_cast<size_t>(image.width) * 4;
+  rgba->resize(stride * image.height);
+  for (int y = 0; y < image.height; ++y) {
+    memcpy(&(*rgba)[y * stride], &padded[y * padded_stride], stride);
+  }
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,38 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef PIE_NOON_ETC2_DECODER_H_
+#define PIE_NOON_ETC2_DECODER_H_
+
+#include <cstdint>
+#include <vector>
+#include "ktx_texture.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Decode an ETC2 RGB8 or RGBA8 (EAC alpha) image to RGBA, four bytes a
+// pixel, row by row from the top. For checking the textures build_assets.py
+// writes without a GPU. Returns false for other formats, or if the image
+// holds too few blocks.
+bool DecodeEtc2(const KtxImage& image, std::vector<uint8_t>* rgba);
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_ETC2_DECODER_H_
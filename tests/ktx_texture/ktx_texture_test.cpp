@@ -0,0 +1,201 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "etc2_decoder.h"
+#include "ktx_texture.h"
+#include "gtest/gtest.h"
+
+using fpl::pie_noon::DecodeEtc2;
+using fpl::pie_noon::KtxImage;
+using fpl::pie_noon::ParseKtx;
+using fpl::pie_noon::ParseKtxHeader;
+using fpl::pie_noon::kGlCompressedRgb8Etc2;
+using fpl::pie_noon::kGlCompressedRgba8Etc2Eac;
+
+class KtxTextureTests : public ::testing::Test {
+ protected:
+  // A KTX file holding 'blocks', 8 bytes each, big-endian.
+  static std::vector<uint8_t> Ktx(uint32_t gl_internal_format, int width,
+                                  int height,
+                                  const std::vector<uint64_t>& blocks) {
+    static const uint8_t kIdentifier[12] = {0xAB, 'K',  'T',  'X',
+                                            ' ',  '1',  '1',  0xBB,
+                                            '\r', '\n', 0x1A, '\n'};
+    const uint32_t fields[13] = {
+        0x04030201, 0, 1, 0, gl_internal_format, 0,
+        static_cast<uint32_t>(width), static_cast<uint32_t>(height), 0, 0, 1,
+        1, 0};
+    std::vector<uint8_t> file(kIdentifier, kIdentifier + sizeof(kIdentifier));
+    AppendRaw(&file, fields, sizeof(fields));
+    const uint32_t image_size = static_cast<uint32_t>(blocks.size() * 8);
+    AppendRaw(&file, &image_size, sizeof(image_size));
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+      for (int shift = 56; shift >= 0; shift -= 8) {
+        file.push_back(static_cast<uint8_t>(*it >> shift));
+      }
+    }
+    return file;
+  }
+
+  // Decode a 4x4 ETC2 RGB block.
+  static std::vector<uint8_t> DecodeBlock(uint64_t block) {
+    const std::vector<uint8_t> file =
+        Ktx(kGlCompressedRgb8Etc2, 4, 4, std::vector<uint64_t>(1, block));
+    KtxImage image;
+    EXPECT_TRUE(ParseKtx(file.data(), file.size(), &image));
+    std::vector<uint8_t> rgba;
+    EXPECT_TRUE(DecodeEtc2(image, &rgba));
+    EXPECT_EQ(64u, rgba.size());
+    rgba.resize(64);
+    return rgba;
+  }
+
+  static void ExpectPixel(const std::vector<uint8_t>& rgba, int x, int y,
+                          int r, int g, int b, int a) {
+    const uint8_t* pixel = &rgba[(y * 4 + x) * 4];
+    EXPECT_EQ(r, pixel[0]) << x << "," << y;
+    EXPECT_EQ(g, pixel[1]) << x << "," << y;
+    EXPECT_EQ(b, pixel[2]) << x << "," << y;
+    EXPECT_EQ(a, pixel[3]) << x << "," << y;
+  }
+
+ private:
+  static void AppendRaw(std::vector<uint8_t>* file, const void* data,
+                        size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    file->insert(file->end(), bytes, bytes + size);
+  }
+};
+
+static uint64_t Bit(int bit) { return 1ull << bit; }
+
+TEST_F(KtxTextureTests, ParseRejectsBadFiles) {
+  std::vector<uint8_t> file =
+      Ktx(kGlCompressedRgb8Etc2, 4, 4, std::vector<uint64_t>(1, 0));
+  KtxImage image;
+  ASSERT_TRUE(ParseKtx(file.data(), file.size(), &image));
+  EXPECT_EQ(4, image.width);
+  EXPECT_EQ(4, image.height);
+  EXPECT_EQ(8u, image.size);
+  EXPECT_EQ(file.data() + file.size() - 8, image.data);
+
+  EXPECT_FALSE(ParseKtx(file.data(), file.size() - 1, &image));
+  EXPECT_FALSE(ParseKtx(file.data(), 63, &image));
+  file[1] = 'J';
+  EXPECT_FALSE(ParseKtx(file.data(), file.size(), &image));
+}
+
+TEST_F(KtxTextureTests, ParseHeaderOnly) {
+  std::vector<uint8_t> file =
+      Ktx(kGlCompressedRgba8Etc2Eac, 8, 4, std::vector<uint64_t>(4, 0));
+  KtxImage image;
+  // The header is enough, even without the image after it.
+  ASSERT_TRUE(ParseKtxHeader(file.data(), 64, &image));
+  EXPECT_EQ(kGlCompressedRgba8Etc2Eac, image.gl_internal_format);
+  EXPECT_EQ(8, image.width);
+  EXPECT_EQ(4, image.height);
+  EXPECT_TRUE(image.data == nullptr);
+  EXPECT_EQ(0u, image.size);
+
+  EXPECT_FALSE(ParseKtxHeader(file.data(), 63, &image));
+  file[12] = 0;
+  EXPECT_FALSE(ParseKtxHeader(file.data(), file.size(), &image));
+}
+
+TEST_F(KtxTextureTests, DecodeRejectsShortImages) {
+  // A 5x4 image needs two blocks.
+  const std::vector<uint8_t> file =
+      Ktx(kGlCompressedRgb8Etc2, 5, 4, std::vector<uint64_t>(1, 0));
+  KtxImage image;
+  ASSERT_TRUE(ParseKtx(file.data(), file.size(), &image));
+  std::vector<uint8_t> rgba;
+  EXPECT_FALSE(DecodeEtc2(image, &rgba));
+}
+
+TEST_F(KtxTextureTests, IndividualMode) {
+  // Red 0xA on the left, 0x5 on the right, modifier table 0. Pixel (1, 2)
+  // uses the -8 modifier, the others +2.
+  const std::vector<uint8_t> rgba =
+      DecodeBlock(0xA5ull << 56 | Bit(16 + 6) | Bit(6));
+  ExpectPixel(rgba, 0, 0, 172, 2, 2, 255);
+  ExpectPixel(rgba, 3, 3, 87, 2, 2, 255);
+  ExpectPixel(rgba, 1, 2, 162, 0, 0, 255);
+}
+
+TEST_F(KtxTextureTests, DifferentialMode) {
+  // Red 16 on top, with table 1, and 17 below, with table 0.
+  const std::vector<uint8_t> rgba =
+      DecodeBlock(0x81ull << 56 | 0x23ull << 32);
+  ExpectPixel(rgba, 3, 1, 137, 5, 5, 255);
+  ExpectPixel(rgba, 0, 2, 142, 2, 2, 255);
+}
+
+TEST_F(KtxTextureTests, TMode) {
+  // Green, then paint colors around gray 0x88, distance 3.
+  const std::vector<uint8_t> rgba = DecodeBlock(
+      Bit(58) | 0xFull << 52 | 0x888ull << 36 | Bit(33) | Bit(4) |
+      Bit(16 + 8) | Bit(16 + 12) | Bit(12));
+  ExpectPixel(rgba, 0, 0, 0, 255, 0, 255);
+  ExpectPixel(rgba, 1, 0, 139, 139, 139, 255);
+  ExpectPixel(rgba, 2, 0, 136, 136, 136, 255);
+  ExpectPixel(rgba, 3, 0, 133, 133, 133, 255);
+}
+
+TEST_F(KtxTextureTests, HMode) {
+  // Paint colors around red and blue, distance 6.
+  const std::vector<uint8_t> rgba =
+      DecodeBlock(0xFull << 59 | Bit(50) | 0xFull << 35 | Bit(33) | Bit(1) |
+                  Bit(16 + 1));
+  ExpectPixel(rgba, 0, 0, 255, 6, 6, 255);
+  ExpectPixel(rgba, 0, 1, 0, 0, 249, 255);
+}
+
+TEST_F(KtxTextureTests, PlanarMode) {
+  // Black at the origin, red to the right, blue down.
+  const std::vector<uint8_t> rgba =
+      DecodeBlock(Bit(42) | 0x1Full << 34 | Bit(33) | Bit(32) | 0x3F);
+  ExpectPixel(rgba, 0, 0, 0, 0, 0, 255);
+  ExpectPixel(rgba, 1, 0, 64, 0, 0, 255);
+  ExpectPixel(rgba, 2, 1, 128, 0, 64, 255);
+  ExpectPixel(rgba, 3, 3, 191, 0, 191, 255);
+}
+
+TEST_F(KtxTextureTests, EacAlpha) {
+  // Alpha 128 with modifier table 13. Pixel (0, 0) adds 9, the others 0.
+  std::vector<uint64_t> blocks;
+  blocks.push_back(128ull << 56 | 1ull << 52 | 13ull << 48 |
+                   0x924924924924ull | 7ull << 45);
+  blocks.push_back(0);
+  const std::vector<uint8_t> file =
+      Ktx(kGlCompressedRgba8Etc2Eac, 4, 4, blocks);
+  KtxImage image;
+  ASSERT_TRUE(ParseKtx(file.data(), file.size(), &image));
+  std::vector<uint8_t> rgba;
+  ASSERT_TRUE(DecodeEtc2(image, &rgba));
+  ExpectPixel(rgba, 0, 0, 2, 2, 2, 137);
+  ExpectPixel(rgba, 2, 3, 2, 2, 2, 128);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,98 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "gtest/gtest.h"
+#include "lockstep.h"
+
+using fpl::pie_noon::LockstepRandom;
+using fpl::pie_noon::LockstepSession;
+using fpl::pie_noon::StateHash;
+
+class LockstepTests : public ::testing::Test {};
+
+TEST_F(LockstepTests, SameSeedSameNumbers) {
+  LockstepRandom a(1234);
+  LockstepRandom b(1234);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(a.Next(), b.Next());
+  }
+  b.Seed(1234);
+  a.Seed(1234);
+  for (int i = 0; i < 1000; ++i) {
+    const int value = a.InRange(-3, 3);
+    ASSERT_EQ(value, b.InRange(-3, 3));
+    ASSERT_LE(-3, value);
+    ASSERT_GT(3, value);
+    const float f = a.NextFloat();
+    ASSERT_EQ(f, b.NextFloat());
+    ASSERT_LE(0.0f, f);
+    ASSERT_GT(1.0f, f);
+  }
+  EXPECT_EQ(5, a.InRange(5, 5));
+}
+
+TEST_F(LockstepTests, HashNoticesChanges) {
+  StateHash a;
+  StateHash b;
+  a.Add(1);
+  a.Add(2);
+  b.Add(2);
+  b.Add(1);
+  EXPECT_NE(a.value(), b.value());
+}
+
+// The host is never held back, except to catch up gradually.
+TEST_F(LockstepTests, HostRunsInFixedSteps) {
+  LockstepSession session;
+  EXPECT_FALSE(session.active());
+  session.Start(16, 10, 4, true, 0);
+  EXPECT_TRUE(session.active());
+  EXPECT_EQ(0, session.FramesToRun(10));
+  EXPECT_EQ(1, session.FramesToRun(10));
+  EXPECT_EQ(4, session.FramesToRun(100));
+  // 100 - 64 + 4 left over from before.
+  EXPECT_EQ(2, session.FramesToRun(0));
+}
+
+// Clients can't run past the frame the host has allowed.
+TEST_F(LockstepTests, ClientWaitsForHost) {
+  LockstepSession session;
+  session.Start(10, 2, 100, false, 3);
+  int frames = session.FramesToRun(100);
+  EXPECT_EQ(3, frames);
+  for (int i = 0; i < frames; ++i) {
+    EXPECT_EQ(i % 2 == 0, session.EndFrame(100 + i));
+  }
+  EXPECT_EQ(0, session.FramesToRun(0));
+
+  session.ExtendRunUntil(2);
+  EXPECT_EQ(0, session.FramesToRun(0));
+  session.ExtendRunUntil(5);
+  EXPECT_EQ(2, session.FramesToRun(0));
+
+  uint32_t checksum = 0;
+  EXPECT_TRUE(session.FindChecksum(2, &checksum));
+  EXPECT_EQ(102u, checksum);
+  EXPECT_FALSE(session.FindChecksum(1, &checksum));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,276 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "flatbuffers/util.h"
+#include "gpg_multiplayer.h"
+#include "gtest/gtest.h"
+#include "loopback_transport.h"
+
+using fpl::GPGMultiplayer;
+using fpl::IncomingMessage;
+using fpl::LinkConditions;
+using fpl::LoopbackNetwork;
+
+// As in rawassets/config.json, for the later turns.
+static const int kTurnMilliseconds = 2000;
+static const int kNetworkGraceMilliseconds = 500;
+
+static const int kStepMilliseconds = 5;
+static const int kNumClients = 2;
+static const char kServiceId[] = "pie_noon_test";
+static const char kHostId[] = "host";
+
+// A host and clients connected over an emulated network. Turns are modelled
+// the way MultiplayerDirector plays them: the host starts a turn, and each
+// client sends its command back when its own copy of the turn ends. The host
+// waits the turn length plus the network grace period for them.
+class LoopbackTransportTests : public ::testing::Test {
+ protected:
+  LoopbackTransportTests() : network_(1234) {}
+
+  virtual void SetUp() {
+    for (int i = 0; i <= kNumClients; ++i) {
+      const std::string id = i == 0 ? kHostId : ClientId(i - 1);
+      GPGMultiplayer& instance = instances_[i];
+      ASSERT_TRUE(
+          instance.Initialize(kServiceId, network_.CreateTransport(id)));
+      instance.set_my_instance_name(id);
+      instance.set_auto_connect(true);
+      instance.set_max_connected_players_allowed(kNumClients);
+    }
+  }
+
+  static std::string ClientId(int client) {
+    return "client" + flatbuffers::NumToString(client);
+  }
+  GPGMultiplayer& host() { return instances_[0]; }
+  GPGMultiplayer& client(int client) { return instances_[client + 1]; }
+
+  void SetAllConditions(const LinkConditions& conditions) {
+    network_.set_default_conditions(conditions);
+  }
+
+  // Move time on by one step, updating every instance like a game frame.
+  void Step() {
+    network_.Advance(kStepMilliseconds);
+    for (int i = 0; i <= kNumClients; ++i) instances_[i].Update();
+  }
+
+  // Step until 'done' is true, for at most 'limit' milliseconds. Returns
+  // whether 'done' came true.
+  template <typename Condition>
+  bool StepUntil(Condition done, int limit) {
+    for (int waited = 0; waited < limit; waited += kStepMilliseconds) {
+      if (done()) return true;
+      Step();
+    }
+    return done();
+  }
+
+  void ConnectAll() {
+    host().StartAdvertising();
+    for (int i = 0; i < kNumClients; ++i) client(i).StartDiscovery();
+    ASSERT_TRUE(StepUntil([this]() {
+      for (int i = 0; i < kNumClients; ++i) {
+        if (!client(i).IsConnected()) return false;
+      }
+      return host().GetNumConnectedPlayers() == kNumClients;
+    }, 10000));
+    host().StopAdvertising();
+    Step();
+    ASSERT_TRUE(host().IsConnected());
+  }
+
+  // Plays one turn. Returns how long before the host's deadline the last
+  // command arrived, which is negative if any were late.
+  int PlayTurn(uint8_t turn) {
+    const int start = network_.now();
+    const int deadline = start + kTurnMilliseconds + kNetworkGraceMilliseconds;
+    host().BroadcastMessage(&turn, 1, true);
+
+    std::vector<int> turn_ends(kNumClients, -1);
+    std::vector<int> arrivals(kNumClients, -1);
+    IncomingMessage message;
+    StepUntil([&]() {
+      for (int i = 0; i < kNumClients; ++i) {
+        while (client(i).GetNextMessage(&message)) {
+          if (message.payload.size() == 1 && message.payload[0] == turn) {
+            turn_ends[i] = network_.now() + kTurnMilliseconds;
+          }
+        }
+        if (turn_ends[i] >= 0 && network_.now() >= turn_ends[i]) {
+          client(i).BroadcastMessage(&turn, 1, true);
+          turn_ends[i] = -2;
+        }
+      }
+      while (host().GetNextMessage(&message)) {
+        if (message.sender >= 0 && message.sender < kNumClients &&
+            message.payload.size() == 1 && message.payload[0] == turn) {
+          arrivals[message.sender] = network_.now();
+        }
+      }
+      for (int i = 0; i < kNumClients; ++i) {
+        if (arrivals[i] < 0) return false;
+      }
+      return true;
+    }, 4 * kTurnMilliseconds);
+
+    int margin = kTurnMilliseconds;
+    for (int i = 0; i < kNumClients; ++i) {
+      if (arrivals[i] < 0) return -1;
+      margin = std::min(margin, deadline - arrivals[i]);
+    }
+    return margin;
+  }
+
+  // Must outlive the instances, which own its transports.
+  LoopbackNetwork network_;
+  // The host, then the clients.
+  GPGMultiplayer instances_[kNumClients + 1];
+};
+
+TEST_F(LoopbackTransportTests, TurnsFitInGraceOnBusyWifi) {
+  LinkConditions wifi;
+  wifi.latency_milliseconds = 60;
+  wifi.jitter_milliseconds = 40;
+  wifi.jitter_distribution = LinkConditions::kJitterExponential;
+  wifi.drop_rate = 0.05f;
+  SetAllConditions(wifi);
+  ConnectAll();
+
+  int worst_margin = kTurnMilliseconds;
+  for (uint8_t turn = 0; turn < 20; ++turn) {
+    const int margin = PlayTurn(turn);
+    ASSERT_LE(0, margin) << "Turn " << static_cast<int>(turn) << " was late";
+    worst_margin = std::min(worst_margin, margin);
+  }
+  RecordProperty("worst_margin_milliseconds", worst_margin);
+  EXPECT_LT(0, network_.stats().packets_dropped);
+}
+
+TEST_F(LoopbackTransportTests, TurnsLateWhenRoundTripExceedsGrace) {
+  LinkConditions slow;
+  slow.latency_milliseconds = kNetworkGraceMilliseconds / 2 + 50;
+  SetAllConditions(slow);
+  ConnectAll();
+
+  EXPECT_GT(0, PlayTurn(0));
+}
+
+TEST_F(LoopbackTransportTests, ShortOutageKeepsReliableOrder) {
+  LinkConditions wifi;
+  wifi.latency_milliseconds = 30;
+  wifi.jitter_milliseconds = 30;
+  SetAllConditions(wifi);
+  ConnectAll();
+
+  const std::string client_id = ClientId(0);
+  network_.SetLinkCut(kHostId, client_id, true);
+  for (uint8_t i = 0; i < 10; ++i) {
+    ASSERT_TRUE(host().SendMessage(client_id, &i, 1, true));
+    const uint8_t lost = 100;
+    ASSERT_TRUE(host().SendMessage(client_id, &lost, 1, false));
+    Step();
+  }
+  StepUntil([]() { return false; }, 1000);
+  network_.SetLinkCut(kHostId, client_id, false);
+
+  std::vector<uint8_t> received;
+  IncomingMessage message;
+  StepUntil([&]() {
+    while (client(0).GetNextMessage(&message)) {
+      received.insert(received.end(), message.payload.begin(),
+                      message.payload.end());
+    }
+    return received.size() >= 10;
+  }, 2000);
+  ASSERT_EQ(10u, received.size());
+  for (uint8_t i = 0; i < 10; ++i) EXPECT_EQ(i, received[i]);
+  EXPECT_TRUE(client(0).IsConnected());
+  EXPECT_EQ(kNumClients, host().GetNumConnectedPlayers());
+}
+
+TEST_F(LoopbackTransportTests, ReconnectsAfterLongOutage) {
+  LinkConditions wifi;
+  wifi.latency_milliseconds = 60;
+  wifi.jitter_milliseconds = 20;
+  wifi.drop_rate = 0.02f;
+  SetAllConditions(wifi);
+  network_.set_peer_timeout_milliseconds(3000);
+  ConnectAll();
+
+  const std::string client_id = ClientId(0);
+  network_.SetLinkCut(kHostId, client_id, true);
+  const int cut_at = network_.now();
+  ASSERT_TRUE(StepUntil([this]() {
+    return !client(0).IsConnected() &&
+           host().GetNumConnectedPlayers() == kNumClients - 1;
+  }, 10000));
+  const int noticed_at = network_.now();
+  EXPECT_LE(3000, noticed_at - cut_at);
+  // The other client keeps playing while the host waits for this one.
+  EXPECT_TRUE(client(1).IsConnected());
+
+  network_.SetLinkCut(kHostId, client_id, false);
+  const int restored_at = network_.now();
+  client(0).StartDiscovery();
+  ASSERT_TRUE(
+      StepUntil([this]() { return host().HasReconnectedPlayer(); }, 10000));
+  EXPECT_EQ(0, host().GetReconnectedPlayer());
+  ASSERT_TRUE(StepUntil([this]() { return client(0).IsConnected(); }, 1000));
+  const int recovery = network_.now() - restored_at;
+  RecordProperty("recovery_milliseconds", recovery);
+  EXPECT_GT(1000, recovery);
+
+  // Messages flow again, and the slot is the same one.
+  const uint8_t hello = 42;
+  ASSERT_TRUE(host().SendMessageToPlayer(0, &hello, 1, true));
+  IncomingMessage message;
+  ASSERT_TRUE(StepUntil(
+      [&]() { return client(0).GetNextMessage(&message); }, 1000));
+  EXPECT_EQ(hello, message.payload[0]);
+}
+
+TEST_F(LoopbackTransportTests, BandwidthCapQueuesMessages) {
+  LinkConditions narrow;
+  narrow.latency_milliseconds = 10;
+  narrow.bytes_per_second = 1000;
+  SetAllConditions(narrow);
+  ConnectAll();
+
+  const std::vector<uint8_t> payload(100, 7);
+  const int sent_at = network_.now();
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(host().SendMessage(ClientId(0), payload, true));
+  }
+  int received = 0;
+  IncomingMessage message;
+  ASSERT_TRUE(StepUntil([&]() {
+    while (client(0).GetNextMessage(&message)) received++;
+    return received == 5;
+  }, 2000));
+  EXPECT_LE(500, network_.now() - sent_at);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,80 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdio>
+#include <string>
+#include "gtest/gtest.h"
+#include "mapped_file.h"
+
+using fpl::pie_noon::MappedFile;
+
+static const char kFilename[] = "mapped_file_test.bin";
+
+class MappedFileTests : public ::testing::Test {
+ protected:
+  virtual void TearDown() { remove(kFilename); }
+
+  static void WriteFile(const std::string& contents) {
+    FILE* file = fopen(kFilename, "wb");
+    ASSERT_TRUE(file != nullptr);
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+  }
+};
+
+TEST_F(MappedFileTests, MapsWholeFile) {
+  std::string contents("PIEC");
+  for (int i = 0; i < 10000; ++i) contents.push_back(static_cast<char>(i));
+  WriteFile(contents);
+
+  MappedFile file;
+  ASSERT_TRUE(file.Open(kFilename));
+  ASSERT_EQ(contents.size(), file.size());
+  EXPECT_EQ(contents, std::string(reinterpret_cast<const char*>(file.data()),
+                                  file.size()));
+#if !defined(_WIN32) && !defined(__ANDROID__)
+  EXPECT_TRUE(file.mapped());
+#endif
+
+  file.Close();
+  EXPECT_TRUE(file.data() == nullptr);
+  EXPECT_EQ(0u, file.size());
+  EXPECT_FALSE(file.mapped());
+}
+
+TEST_F(MappedFileTests, OpensEmptyFile) {
+  WriteFile("");
+  MappedFile file;
+  ASSERT_TRUE(file.Open(kFilename));
+  EXPECT_EQ(0u, file.size());
+  EXPECT_FALSE(file.mapped());
+}
+
+TEST_F(MappedFileTests, MissingFileLeavesItEmpty) {
+  WriteFile("old");
+  MappedFile file;
+  ASSERT_TRUE(file.Open(kFilename));
+  EXPECT_FALSE(file.Open("no_such_file.bin"));
+  EXPECT_TRUE(file.data() == nullptr);
+  EXPECT_EQ(0u, file.size());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "message_ring.h"
+
+class MessageRingTests : public ::testing::Test {};
+
+TEST_F(MessageRingTests, PopsInOrder) {
+  fpl::MessageRing ring(4, 16);
+  const uint8_t first[] = {1, 2, 3};
+  const uint8_t second[] = {4};
+  ring.Push(0, first, sizeof(first));
+  ring.Push(2, second, sizeof(second));
+
+  fpl::IncomingMessage message;
+  ASSERT_TRUE(ring.Pop(&message));
+  EXPECT_EQ(0, message.sender);
+  EXPECT_EQ(std::vector<uint8_t>(first, first + sizeof(first)),
+            message.payload);
+  ASSERT_TRUE(ring.Pop(&message));
+  EXPECT_EQ(2, message.sender);
+  EXPECT_EQ(std::vector<uint8_t>(second, second + sizeof(second)),
+            message.payload);
+  EXPECT_FALSE(ring.Pop(&message));
+  EXPECT_TRUE(ring.Empty());
+}
+
+TEST_F(MessageRingTests, KeepsEverythingWhenFull) {
+  // Capacity is rounded up to 4.
+  fpl::MessageRing ring(3, 16);
+  for (int i = 0; i < 10; ++i) {
+    const uint8_t data[] = {static_cast<uint8_t>(i)};
+    ring.Push(i, data, sizeof(data));
+  }
+  EXPECT_EQ(6, ring.overflowed());
+  EXPECT_EQ(10u, ring.Size());
+
+  // Popping some frees up ring slots, but what's pushed next still has to
+  // wait behind the overflow.
+  fpl::IncomingMessage message;
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(ring.Pop(&message));
+    EXPECT_EQ(i, message.sender);
+  }
+  const uint8_t data[] = {10};
+  ring.Push(10, data, sizeof(data));
+  EXPECT_EQ(7, ring.overflowed());
+
+  for (int i = 2; i <= 10; ++i) {
+    ASSERT_TRUE(ring.Pop(&message));
+    EXPECT_EQ(i, message.sender);
+    ASSERT_EQ(1u, message.payload.size());
+    EXPECT_EQ(i, message.payload[0]);
+  }
+  EXPECT_FALSE(ring.Pop(&message));
+  EXPECT_TRUE(ring.Empty());
+
+  // Once drained, the ring is used again.
+  ring.Push(11, data, sizeof(data));
+  EXPECT_EQ(7, ring.overflowed());
+  ASSERT_TRUE(ring.Pop(&message));
+  EXPECT_EQ(11, message.sender);
+
+  for (int i = 0; i < 6; ++i) ring.Push(i, data, sizeof(data));
+  ring.Clear();
+  EXPECT_TRUE(ring.Empty());
+  EXPECT_EQ(0u, ring.Size());
+}
+
+// One thread pushes while another pops, more slowly at first so that the
+// ring overflows. Every message must arrive exactly once, in order, and
+// intact.
+TEST_F(MessageRingTests, ProducerAndConsumerThreads) {
+  static const int kNumMessages = 100000;
+  fpl::MessageRing ring(64, 8);
+
+  std::thread producer([&ring]() {
+    for (int i = 0; i < kNumMessages; ++i) {
+      const uint8_t data[] = {static_cast<uint8_t>(i),
+                              static_cast<uint8_t>(i >> 8),
+                              static_cast<uint8_t>(i >> 16)};
+      ring.Push(i, data, 1 + i % sizeof(data));
+    }
+  });
+
+  fpl::IncomingMessage message;
+  for (int i = 0; i < kNumMessages;) {
+    if (!ring.Pop(&message)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(i, message.sender);
+    ASSERT_EQ(static_cast<size_t>(1 + i % 3), message.payload.size());
+    ASSERT_EQ(static_cast<uint8_t>(i), message.payload[0]);
+    if (i < 1000) std::this_thread::sleep_for(std::chrono::microseconds(10));
+    ++i;
+  }
+  producer.join();
+  EXPECT_TRUE(ring.Empty());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "multiplayer_telemetry.h"
+
+using fpl::MultiplayerTelemetry;
+using fpl::PeerTelemetry;
+using fpl::QueueTelemetry;
+
+class MultiplayerTelemetryTests : public ::testing::Test {};
+
+TEST_F(MultiplayerTelemetryTests, CountsTrafficPerPlayer) {
+  MultiplayerTelemetry telemetry;
+  telemetry.RecordSent(1, 10);
+  telemetry.RecordSent(1, 20);
+  telemetry.RecordReceived(0, 5);
+  // Not connected, so not counted.
+  telemetry.RecordReceived(-1, 100);
+
+  ASSERT_EQ(2, telemetry.num_peers());
+  const PeerTelemetry host = telemetry.peer(0);
+  EXPECT_EQ(0u, host.messages_sent);
+  EXPECT_EQ(1u, host.messages_received);
+  EXPECT_EQ(5u, host.bytes_received);
+  const PeerTelemetry client = telemetry.peer(1);
+  EXPECT_EQ(2u, client.messages_sent);
+  EXPECT_EQ(30u, client.bytes_sent);
+
+  telemetry.Reset();
+  EXPECT_EQ(0, telemetry.num_peers());
+  EXPECT_EQ(0u, telemetry.peer(1).messages_sent);
+}
+
+TEST_F(MultiplayerTelemetryTests, CountsTrafficFromManyThreads) {
+  MultiplayerTelemetry telemetry;
+  const int kThreads = 4;
+  const int kMessages = 10000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.push_back(std::thread([&telemetry, i]() {
+      for (int j = 0; j < kMessages; ++j) {
+        telemetry.RecordSent(i % 2, 3);
+        telemetry.RecordReceived(i, 1);
+      }
+    }));
+  }
+  // Reading while the counts go up doesn't get in their way.
+  for (int i = 0; i < 100; ++i) telemetry.peer(0);
+  for (auto it = threads.begin(); it != threads.end(); ++it) it->join();
+
+  ASSERT_EQ(kThreads, telemetry.num_peers());
+  EXPECT_EQ(2u * kMessages, telemetry.peer(0).messages_sent);
+  EXPECT_EQ(6u * kMessages, telemetry.peer(1).bytes_sent);
+  EXPECT_EQ(static_cast<uint64_t>(kMessages),
+            telemetry.peer(3).messages_received);
+}
+
+TEST_F(MultiplayerTelemetryTests, TracksRoundTrips) {
+  MultiplayerTelemetry telemetry;
+  EXPECT_EQ(-1, telemetry.peer(0).round_trip_milliseconds);
+
+  telemetry.RecordRoundTrip(0, 100);
+  PeerTelemetry peer = telemetry.peer(0);
+  EXPECT_EQ(100, peer.round_trip_milliseconds);
+  EXPECT_FLOAT_EQ(100.0f, peer.smoothed_round_trip_milliseconds);
+
+  telemetry.RecordRoundTrip(0, 20);
+  telemetry.RecordRoundTrip(0, 300);
+  peer = telemetry.peer(0);
+  EXPECT_EQ(300, peer.round_trip_milliseconds);
+  EXPECT_EQ(20, peer.min_round_trip_milliseconds);
+  EXPECT_EQ(300, peer.max_round_trip_milliseconds);
+  EXPECT_EQ(3, peer.pings_answered);
+  // Smoothing keeps one slow ping from dominating.
+  EXPECT_LT(peer.smoothed_round_trip_milliseconds, 150.0f);
+  EXPECT_GT(peer.smoothed_round_trip_milliseconds, 20.0f);
+}
+
+TEST_F(MultiplayerTelemetryTests, TracksQueue) {
+  MultiplayerTelemetry telemetry;
+  telemetry.RecordQueue(7, 0);
+  telemetry.RecordQueue(2, 1);
+  telemetry.RecordDeliveryDelay(std::chrono::milliseconds(4));
+  telemetry.RecordDeliveryDelay(std::chrono::milliseconds(12));
+
+  const QueueTelemetry queue = telemetry.queue();
+  EXPECT_EQ(2, queue.depth);
+  EXPECT_EQ(7, queue.max_depth);
+  EXPECT_EQ(1, queue.overflowed);
+  EXPECT_FLOAT_EQ(12.0f, queue.last_delay_milliseconds);
+  EXPECT_FLOAT_EQ(12.0f, queue.max_delay_milliseconds);
+  EXPECT_EQ(2, queue.delays_recorded);
+}
+
+TEST_F(MultiplayerTelemetryTests, DumpsToFile) {
+  MultiplayerTelemetry telemetry;
+  telemetry.RecordSent(0, 42);
+  telemetry.RecordResends(0, 3);
+
+  const char kFilename[] = "multiplayer_telemetry_test.csv";
+  ASSERT_TRUE(telemetry.DumpToFile(kFilename));
+  FILE* file = fopen(kFilename, "r");
+  ASSERT_TRUE(file != nullptr);
+  std::string contents;
+  char buffer[256];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.append(buffer, size);
+  }
+  fclose(file);
+  remove(kFilename);
+
+  EXPECT_EQ(0u, contents.find("player,"));
+  EXPECT_NE(std::string::npos, contents.find("\n0,-1,"));
+  EXPECT_NE(std::string::npos, contents.find(",1,42,0,0,"));
+  EXPECT_NE(std::string::npos, contents.find("queue_depth,"));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,102 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <string>
+#include <thread>
+#include "startup_tracer.h"
+#include "gtest/gtest.h"
+
+using fpl::pie_noon::StartupSpan;
+using fpl::pie_noon::StartupTracer;
+
+class StartupTracerTests : public ::testing::Test {
+ protected:
+  static bool Contains(const std::string& text, const std::string& part) {
+    return text.find(part) != std::string::npos;
+  }
+};
+
+TEST_F(StartupTracerTests, RecordsSpansPerThread) {
+  StartupTracer tracer;
+  tracer.NameThread("main");
+  { StartupSpan span(&tracer, "Initialize"); }
+  std::thread loader([&tracer]() {
+    StartupSpan span(&tracer, "LoadFile", "textures/a.webp");
+  });
+  loader.join();
+
+  const std::string json = tracer.ToJson();
+  EXPECT_TRUE(Contains(json, "\"args\":{\"name\":\"main\"}"));
+  EXPECT_TRUE(Contains(json, "\"args\":{\"name\":\"thread 1\"}"));
+  EXPECT_TRUE(Contains(json, "{\"name\":\"Initialize\",\"ph\":\"X\","
+                             "\"pid\":1,\"tid\":0,"));
+  EXPECT_TRUE(Contains(json, "{\"name\":\"LoadFile\",\"ph\":\"X\","
+                             "\"pid\":1,\"tid\":1,"));
+  EXPECT_TRUE(Contains(json, "\"args\":{\"detail\":\"textures/a.webp\"}"));
+  EXPECT_EQ(std::string("{\"traceEvents\":[\n"), json.substr(0, 17));
+  EXPECT_EQ(std::string("}\n]}\n"), json.substr(json.size() - 5));
+}
+
+TEST_F(StartupTracerTests, CountersAndInstants) {
+  StartupTracer tracer;
+  tracer.AddCounter("Shader cache", "hits", 4);
+  tracer.AddInstant("First interactive frame");
+  const std::string json = tracer.ToJson();
+  EXPECT_TRUE(Contains(json, "\"ph\":\"C\""));
+  EXPECT_TRUE(Contains(json, "\"args\":{\"hits\":4}"));
+  EXPECT_TRUE(Contains(json, "{\"name\":\"First interactive frame\","
+                             "\"ph\":\"i\""));
+}
+
+TEST_F(StartupTracerTests, EscapesStrings) {
+  StartupTracer tracer;
+  { StartupSpan span(&tracer, "Load", "a\"b\\c\n"); }
+  EXPECT_TRUE(Contains(tracer.ToJson(), "\"a\\\"b\\\\c\\u000a\""));
+}
+
+TEST_F(StartupTracerTests, FinishStopsRecording) {
+  StartupTracer tracer;
+  { StartupSpan span(&tracer, "Before"); }
+  EXPECT_FALSE(tracer.finished());
+  const double milliseconds = tracer.Finish();
+  EXPECT_TRUE(tracer.finished());
+  EXPECT_GE(milliseconds, 0.0);
+  EXPECT_EQ(milliseconds, tracer.Finish());
+  { StartupSpan span(&tracer, "After"); }
+  const std::string json = tracer.ToJson();
+  EXPECT_TRUE(Contains(json, "\"Before\""));
+  EXPECT_FALSE(Contains(json, "\"After\""));
+}
+
+TEST_F(StartupTracerTests, EndRecordsSpanOnce) {
+  StartupTracer tracer;
+  {
+    StartupSpan span(&tracer, "Frame", "first");
+    span.End();
+    tracer.Finish();
+  }
+  const std::string json = tracer.ToJson();
+  EXPECT_TRUE(Contains(json, "\"Frame\""));
+  EXPECT_EQ(json.find("\"Frame\""), json.rfind("\"Frame\""));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
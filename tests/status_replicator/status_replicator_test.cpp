@@ -0,0 +1,201 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vector>
+#include "gtest/gtest.h"
+#include "status_replicator.h"
+
+using fpl::pie_noon::PlayerStatusSnapshot;
+using fpl::pie_noon::StatusReplicationClient;
+using fpl::pie_noon::StatusReplicationHost;
+namespace multiplayer = fpl::pie_noon::multiplayer;
+
+class StatusReplicatorTests : public ::testing::Test {
+ protected:
+  static std::vector<uint8_t> Bytes(uint8_t a, uint8_t b) {
+    std::vector<uint8_t> bytes;
+    bytes.push_back(a);
+    bytes.push_back(b);
+    return bytes;
+  }
+
+  // The delta for 'client', built in 'builder', which is cleared first.
+  static const multiplayer::PlayerStatusDelta* Delta(
+      StatusReplicationHost* host, int client,
+      flatbuffers::FlatBufferBuilder* builder) {
+    builder->Clear();
+    builder->Finish(host->CreateDeltaMessage(client, *builder));
+    const multiplayer::MessageRoot* root =
+        multiplayer::GetMessageRoot(builder->GetBufferPointer());
+    EXPECT_EQ(multiplayer::Data_PlayerStatusDelta, root->data_type());
+    return static_cast<const multiplayer::PlayerStatusDelta*>(root->data());
+  }
+
+  // Hand the client's ack to the host.
+  static void Ack(StatusReplicationClient* client,
+                  StatusReplicationHost* host, int id) {
+    flatbuffers::FlatBufferBuilder builder;
+    builder.Finish(client->CreateAckMessage(builder));
+    const multiplayer::MessageRoot* root =
+        multiplayer::GetMessageRoot(builder.GetBufferPointer());
+    ASSERT_EQ(multiplayer::Data_PlayerStatusAck, root->data_type());
+    host->ReceiveAck(
+        id, *static_cast<const multiplayer::PlayerStatusAck*>(root->data()));
+  }
+
+  // The sequence number the client will acknowledge next.
+  static unsigned int AckSequence(StatusReplicationClient* client) {
+    flatbuffers::FlatBufferBuilder builder;
+    builder.Finish(client->CreateAckMessage(builder));
+    const multiplayer::MessageRoot* root =
+        multiplayer::GetMessageRoot(builder.GetBufferPointer());
+    return static_cast<const multiplayer::PlayerStatusAck*>(root->data())
+        ->sequence();
+  }
+};
+
+TEST_F(StatusReplicatorTests, SendsOnlyChangesSinceAckedBaseline) {
+  StatusReplicationHost host;
+  StatusReplicationClient client;
+  flatbuffers::FlatBufferBuilder builder;
+  PlayerStatusSnapshot status;
+  host.Reset(1);
+
+  // Nothing acknowledged yet, so every player is sent.
+  host.Capture(Bytes(10, 10), Bytes(0, 0));
+  const multiplayer::PlayerStatusDelta* first = Delta(&host, 0, &builder);
+  EXPECT_EQ(0u, first->baseline());
+  EXPECT_EQ(3, first->changed_players());
+  ASSERT_TRUE(client.ReceiveDelta(*first, &status));
+  EXPECT_EQ(Bytes(10, 10), status.health);
+  Ack(&client, &host, 0);
+
+  host.Capture(Bytes(10, 7), Bytes(0, 1));
+  const multiplayer::PlayerStatusDelta* second = Delta(&host, 0, &builder);
+  EXPECT_EQ(status.sequence + 1, second->sequence());
+  EXPECT_EQ(status.sequence, second->baseline());
+  EXPECT_EQ(2, second->changed_players());
+  EXPECT_EQ(1u, second->player_health()->size());
+  ASSERT_TRUE(client.ReceiveDelta(*second, &status));
+  EXPECT_EQ(Bytes(10, 7), status.health);
+  EXPECT_EQ(Bytes(0, 1), status.splats);
+  EXPECT_EQ(second->sequence(), status.sequence);
+  EXPECT_EQ(1, host.stats().full_statuses);
+  EXPECT_EQ(1, host.stats().delta_statuses);
+}
+
+TEST_F(StatusReplicatorTests, AgedOutBaselineFallsBackToFullStatus) {
+  StatusReplicationHost host;
+  StatusReplicationClient client;
+  flatbuffers::FlatBufferBuilder builder;
+  PlayerStatusSnapshot status;
+  host.Reset(1);
+
+  host.Capture(Bytes(10, 10), Bytes(0, 0));
+  ASSERT_TRUE(client.ReceiveDelta(*Delta(&host, 0, &builder), &status));
+  Ack(&client, &host, 0);
+
+  // The client's acks stop arriving while the host moves on past its
+  // history of 32 statuses.
+  for (int i = 0; i < 32; ++i) {
+    host.Capture(Bytes(10, 9), Bytes(0, 0));
+  }
+  const multiplayer::PlayerStatusDelta* delta = Delta(&host, 0, &builder);
+  EXPECT_EQ(0u, delta->baseline());
+  EXPECT_EQ(3, delta->changed_players());
+  ASSERT_TRUE(client.ReceiveDelta(*delta, &status));
+  EXPECT_EQ(Bytes(10, 9), status.health);
+
+  // An ack for a status the host has forgotten gets every player too.
+  client.Reset();
+  host.Capture(Bytes(8, 9), Bytes(0, 0));
+  ASSERT_TRUE(client.ReceiveDelta(*Delta(&host, 0, &builder), &status));
+  for (int i = 0; i < 32; ++i) {
+    host.Capture(Bytes(8, 8), Bytes(0, 0));
+  }
+  Ack(&client, &host, 0);
+  EXPECT_EQ(0u, Delta(&host, 0, &builder)->baseline());
+}
+
+TEST_F(StatusReplicatorTests, ClientDropsStaleAndUnusableDeltas) {
+  StatusReplicationHost host;
+  StatusReplicationClient client;
+  flatbuffers::FlatBufferBuilder older_builder;
+  flatbuffers::FlatBufferBuilder newer_builder;
+  PlayerStatusSnapshot status;
+  host.Reset(1);
+
+  host.Capture(Bytes(10, 10), Bytes(0, 0));
+  const multiplayer::PlayerStatusDelta* older =
+      Delta(&host, 0, &older_builder);
+  host.Capture(Bytes(9, 10), Bytes(0, 0));
+  const multiplayer::PlayerStatusDelta* newer =
+      Delta(&host, 0, &newer_builder);
+
+  // Arriving out of order, the older status is dropped, and so is a repeat.
+  ASSERT_TRUE(client.ReceiveDelta(*newer, &status));
+  EXPECT_FALSE(client.ReceiveDelta(*older, &status));
+  EXPECT_FALSE(client.ReceiveDelta(*newer, &status));
+  EXPECT_EQ(Bytes(9, 10), status.health);
+  EXPECT_EQ(2, client.stats().stale_statuses);
+  EXPECT_EQ(newer->sequence(), AckSequence(&client));
+
+  // A delta against a baseline the client doesn't have can't be applied, so
+  // the client asks for every player.
+  Ack(&client, &host, 0);
+  host.Capture(Bytes(9, 8), Bytes(0, 0));
+  const multiplayer::PlayerStatusDelta* delta =
+      Delta(&host, 0, &older_builder);
+  ASSERT_NE(0u, delta->baseline());
+  client.Reset();
+  EXPECT_FALSE(client.ReceiveDelta(*delta, &status));
+  EXPECT_EQ(1, client.stats().unusable_deltas);
+  EXPECT_EQ(0u, AckSequence(&client));
+}
+
+TEST_F(StatusReplicatorTests, ResetClientSendsEveryPlayer) {
+  StatusReplicationHost host;
+  StatusReplicationClient client;
+  flatbuffers::FlatBufferBuilder builder;
+  PlayerStatusSnapshot status;
+  host.Reset(2);
+
+  host.Capture(Bytes(10, 10), Bytes(0, 0));
+  ASSERT_TRUE(client.ReceiveDelta(*Delta(&host, 1, &builder), &status));
+  Ack(&client, &host, 1);
+  host.Capture(Bytes(10, 10), Bytes(0, 0));
+  EXPECT_NE(0u, Delta(&host, 1, &builder)->baseline());
+
+  // The client reconnects with nothing, so starts over from a full status.
+  host.ResetClient(1);
+  client.Reset();
+  const multiplayer::PlayerStatusDelta* delta = Delta(&host, 1, &builder);
+  EXPECT_EQ(0u, delta->baseline());
+  EXPECT_EQ(3, delta->changed_players());
+  ASSERT_TRUE(client.ReceiveDelta(*delta, &status));
+  EXPECT_EQ(Bytes(10, 10), status.health);
+  EXPECT_EQ(delta->sequence(), AckSequence(&client));
+
+  // The other client was never acknowledged, and is unaffected.
+  EXPECT_EQ(0u, Delta(&host, 0, &builder)->baseline());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}